@@ -3509,6 +3509,45 @@ return fmt.Errorf("converting field CpumapSoft: %v", err)
  return nil
  }
 
+// NewSuperpageInfo returns an instance of SuperpageInfo initialized with defaults.
+func NewSuperpageInfo() (*SuperpageInfo, error) {
+var (
+x SuperpageInfo
+xc C.libxl_superpage_info)
+
+C.libxl_superpage_info_init(&xc)
+defer C.libxl_superpage_info_dispose(&xc)
+
+if err := x.fromC(&xc); err != nil {
+return nil, err }
+
+return &x, nil}
+
+func (x *SuperpageInfo) fromC(xc *C.libxl_superpage_info) error {
+ x.ScanRate = uint32(xc.scan_rate)
+x.Pages4K = uint64(xc.pages_4k)
+x.Pages2M = uint64(xc.pages_2m)
+x.Pages1G = uint64(xc.pages_1g)
+x.Coalesced = uint64(xc.coalesced)
+x.Passes = uint64(xc.passes)
+
+ return nil}
+
+func (x *SuperpageInfo) toC(xc *C.libxl_superpage_info) (err error){defer func(){
+if err != nil{
+C.libxl_superpage_info_dispose(xc)}
+}()
+
+xc.scan_rate = C.uint32_t(x.ScanRate)
+xc.pages_4k = C.uint64_t(x.Pages4K)
+xc.pages_2m = C.uint64_t(x.Pages2M)
+xc.pages_1g = C.uint64_t(x.Pages1G)
+xc.coalesced = C.uint64_t(x.Coalesced)
+xc.passes = C.uint64_t(x.Passes)
+
+ return nil
+ }
+
 // NewPhysinfo returns an instance of Physinfo initialized with defaults.
 func NewPhysinfo() (*Physinfo, error) {
 var (
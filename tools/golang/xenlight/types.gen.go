@@ -1097,6 +1097,15 @@ Cpumap Bitmap
 CpumapSoft Bitmap
 }
 
+type SuperpageInfo struct {
+ScanRate uint32
+Pages4K uint64
+Pages2M uint64
+Pages1G uint64
+Coalesced uint64
+Passes uint64
+}
+
 type Physinfo struct {
 ThreadsPerCore uint32
 CoresPerSocket uint32
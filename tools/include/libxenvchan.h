@@ -45,6 +45,7 @@
 #include <xen/io/libxenvchan.h>
 #include <xen/xen.h>
 #include <xen/sys/evtchn.h>
+#include <sys/uio.h>
 #include <xenevtchn.h>
 #include <xengnttab.h>
 
@@ -91,6 +92,9 @@ struct libxenvchan {
 	 * during cleanup.
 	 * */
 	char *xs_path;
+	/* Notification batching, see libxenvchan_set_notify_batch() */
+	uint32_t notify_batch;
+	uint32_t unnotified_write, unnotified_read;
 };
 
 /**
@@ -179,3 +183,84 @@ int libxenvchan_is_open(struct libxenvchan* ctrl);
 int libxenvchan_data_ready(struct libxenvchan *ctrl);
 /** Amount of data it is possible to send without blocking */
 int libxenvchan_buffer_space(struct libxenvchan *ctrl);
+
+/**
+ * Scatter-gather packet-based send: sends the concatenation of the buffers
+ * in $iov if possible, notifying the peer once.
+ * @param ctrl The vchan control structure
+ * @param iov Buffers to send
+ * @param iovcnt Number of buffers in $iov
+ * @return -1 on error, 0 if nonblocking and insufficient space is available,
+ *         or the total size of the buffers
+ */
+int libxenvchan_sendv(struct libxenvchan *ctrl, const struct iovec *iov,
+                      int iovcnt);
+/**
+ * Scatter-gather packet-based receive: fills all the buffers in $iov, in
+ * order, if enough data is available.
+ * @param ctrl The vchan control structure
+ * @param iov Buffers to fill
+ * @param iovcnt Number of buffers in $iov
+ * @return -1 on error, 0 if nonblocking and insufficient data is available,
+ *         or the total size of the buffers
+ */
+int libxenvchan_recvv(struct libxenvchan *ctrl, const struct iovec *iov,
+                      int iovcnt);
+
+/**
+ * Zero-copy send: returns the free space of the send ring in $iov, as up
+ * to two segments (the second one has zero length unless the space wraps
+ * around the end of the ring).  Data written there is sent by
+ * libxenvchan_send_commit().  Never blocks.
+ * @param ctrl The vchan control structure
+ * @param min Space wanted; the peer is asked to notify us when it frees
+ *            space if less than $min is available
+ * @param iov Returns the free space
+ * @return -1 on error, otherwise the amount of free space
+ */
+int libxenvchan_send_peek(struct libxenvchan *ctrl, size_t min,
+                          struct iovec iov[2]);
+/**
+ * Zero-copy send: makes $size bytes written to the space returned by
+ * libxenvchan_send_peek() visible to the peer.
+ * @return -1 on error, or $size
+ */
+int libxenvchan_send_commit(struct libxenvchan *ctrl, size_t size);
+/**
+ * Zero-copy receive: returns the data ready in the receive ring in $iov,
+ * as up to two segments.  Never blocks.
+ *
+ * The data remains shared with the peer until committed: a misbehaving
+ * peer can change it at any time, so it must be copied before being
+ * validated.
+ * @param ctrl The vchan control structure
+ * @param min Data wanted; the peer is asked to notify us when it sends
+ *            more if less than $min is ready
+ * @param iov Returns the data ready
+ * @return -1 on error, otherwise the amount of data ready
+ */
+int libxenvchan_recv_peek(struct libxenvchan *ctrl, size_t min,
+                          struct iovec iov[2]);
+/**
+ * Zero-copy receive: releases the first $size bytes returned by
+ * libxenvchan_recv_peek() back to the peer.
+ * @return -1 on error, or $size
+ */
+int libxenvchan_recv_commit(struct libxenvchan *ctrl, size_t size);
+
+/**
+ * Batches notifications: the peer is only notified once at least $bytes
+ * have been sent or consumed since the last notification, instead of after
+ * every operation.  0 (the default) notifies after every operation.
+ *
+ * Pending notifications are sent by libxenvchan_wait(), libxenvchan_flush()
+ * and libxenvchan_close().  Callers waiting on libxenvchan_fd_for_select()
+ * must call libxenvchan_flush() before sleeping, or both ends may wait for
+ * each other.
+ */
+void libxenvchan_set_notify_batch(struct libxenvchan *ctrl, size_t bytes);
+/**
+ * Sends any notification held back by libxenvchan_set_notify_batch().
+ * @return -1 on error, 0 otherwise
+ */
+int libxenvchan_flush(struct libxenvchan *ctrl);
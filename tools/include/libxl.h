@@ -1498,6 +1498,16 @@ void libxl_mac_copy(libxl_ctx *ctx, libxl_mac *dst, const libxl_mac *src);
  */
 #define LIBXL_HAVE_CREATEINFO_XEND_SUSPEND_EVTCHN_COMPAT
 
+/*
+ * LIBXL_HAVE_SUPERPAGE_INFO
+ *
+ * If this is defined, libxl_domain_get_superpage_info() and
+ * libxl_domain_set_superpage_scan_rate() are available to report how a
+ * domain's memory is mapped and to control the recoalescing of its
+ * superpage mappings.
+ */
+#define LIBXL_HAVE_SUPERPAGE_INFO 1
+
 typedef char **libxl_string_list;
 void libxl_string_list_dispose(libxl_string_list *sl);
 int libxl_string_list_length(const libxl_string_list *sl);
@@ -2007,6 +2017,16 @@ int libxl_wait_for_free_memory(libxl_ctx *ctx, uint32_t domid, uint64_t memory_k
  */
 int libxl_wait_for_memory_target(libxl_ctx *ctx, uint32_t domid, int wait_secs);
 
+/*
+ * Superpage mappings of an HVM domain's memory.  The page counts reflect
+ * the last complete pass of the hypervisor's recoalescing scanner, which
+ * runs at scan_rate 2M regions per second (0 disables it).
+ */
+int libxl_domain_get_superpage_info(libxl_ctx *ctx, uint32_t domid,
+                                    libxl_superpage_info *info);
+int libxl_domain_set_superpage_scan_rate(libxl_ctx *ctx, uint32_t domid,
+                                         uint32_t rate);
+
 #if defined(LIBXL_API_VERSION) && LIBXL_API_VERSION < 0x040800
 #define libxl_get_memory_target libxl_get_memory_target_0x040700
 #define libxl_domain_need_memory libxl_domain_need_memory_0x040700
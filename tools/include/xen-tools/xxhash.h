@@ -0,0 +1,22 @@
+#ifndef __XEN_TOOLS_XXHASH__
+#define __XEN_TOOLS_XXHASH__
+
+/*
+ * xxHash, built for the tools from the hypervisor's xen/lib/xxhash*.c, see
+ * e.g. tools/misc/Makefile.  The sources use what this provides.
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <xen-tools/common-macros.h>
+
+#define get_unaligned_le32(p) le32toh(get_unaligned_t(uint32_t, p))
+#define get_unaligned_le64(p) le64toh(get_unaligned_t(uint64_t, p))
+
+#include "../../../xen/include/xen/xxhash.h"
+
+#endif /* __XEN_TOOLS_XXHASH__ */
@@ -879,9 +879,68 @@ long long xc_logdirty_control(xc_interface *xch,
                               unsigned int mode,
                               xc_shadow_op_stats_t *stats);
 
+/*
+ * Dirty ring: a log of the pages dirtied while in log-dirty mode, letting
+ * the cost of tracking scale with the number of writes rather than with the
+ * size of the guest.  See struct xen_dirty_ring for the protocol.
+ */
+typedef struct xc_dirty_ring xc_dirty_ring_t;
+
+/* nr_frames must be a power of two. */
+int xc_dirty_ring_enable(xc_interface *xch, uint32_t domid,
+                         unsigned int nr_frames);
+int xc_dirty_ring_disable(xc_interface *xch, uint32_t domid);
+
+/*
+ * Make the entries logged since the previous harvest available for
+ * consumption, re-arming dirty logging for them.  Returns the number of
+ * newly harvested entries, or -1 with errno set.  errno EOVERFLOW means the
+ * ring overflowed, and the full bitmap needs retrieving with
+ * XEN_DOMCTL_SHADOW_OP_CLEAN, which also resets the ring.
+ */
+long xc_dirty_ring_harvest(xc_interface *xch, uint32_t domid,
+                           unsigned int mode, xc_shadow_op_stats_t *stats);
+
+xc_dirty_ring_t *xc_dirty_ring_map(xc_interface *xch, uint32_t domid);
+void xc_dirty_ring_unmap(xc_dirty_ring_t *ring);
+bool xc_dirty_ring_overflowed(const xc_dirty_ring_t *ring);
+
+/*
+ * Copy up to nr harvested pfns out of the ring, freeing their slots.
+ * Returns the number of pfns copied.
+ */
+unsigned int xc_dirty_ring_consume(xc_dirty_ring_t *ring, xen_pfn_t *pfns,
+                                   unsigned int nr);
+
 int xc_get_paging_mempool_size(xc_interface *xch, uint32_t domid, uint64_t *size);
 int xc_set_paging_mempool_size(xc_interface *xch, uint32_t domid, uint64_t size);
 
+typedef struct xen_domctl_p2m_superpage xc_p2m_superpage_t;
+int xc_domain_get_superpage_info(xc_interface *xch, uint32_t domid,
+                                 xc_p2m_superpage_t *info);
+int xc_domain_set_superpage_scan_rate(xc_interface *xch, uint32_t domid,
+                                      uint32_t rate);
+
+/*
+ * VM exit profiling of HVM domains, see XEN_DOMCTL_exit_stats.  op is one of
+ * XEN_DOMCTL_EXIT_STATS_{DISABLE,ENABLE,RESET}.
+ */
+typedef struct xen_domctl_exit_stats_reason xc_exit_stats_reason_t;
+typedef struct xen_domctl_exit_stats_detail xc_exit_stats_detail_t;
+int xc_domain_exit_stats_op(xc_interface *xch, uint32_t domid, uint32_t op);
+
+/*
+ * Retrieve up to *nr_reasons / *nr_details entries, which get updated to
+ * the number of entries available.  Either array may be NULL with a zero
+ * count, to size the buffers.
+ */
+int xc_domain_exit_stats_get(xc_interface *xch, uint32_t domid,
+                             xc_exit_stats_reason_t *reasons,
+                             uint32_t *nr_reasons,
+                             xc_exit_stats_detail_t *details,
+                             uint32_t *nr_details,
+                             uint64_t *details_lost, uint64_t *tsc_khz);
+
 int xc_sched_credit_domain_set(xc_interface *xch,
                                uint32_t domid,
                                struct xen_domctl_sched_credit *sdom);
@@ -1139,6 +1198,18 @@ int xc_evtchn_reset(xc_interface *xch,
 typedef struct evtchn_status xc_evtchn_status_t;
 int xc_evtchn_status(xc_interface *xch, xc_evtchn_status_t *status);
 
+/*
+ * Coalesce notifications of one of the calling domain's ports: deliver
+ * after @count notifications, or @timeout_us after the first one held
+ * back.  A zero @timeout_us turns coalescing off again.
+ */
+int xc_evtchn_set_coalesce(xc_interface *xch, evtchn_port_t port,
+                           uint32_t count, uint32_t timeout_us);
+
+typedef struct evtchn_coalesce_stats xc_evtchn_coalesce_stats_t;
+int xc_evtchn_coalesce_stats(xc_interface *xch,
+                             xc_evtchn_coalesce_stats_t *stats);
+
 
 
 int xc_physdev_pci_access_modify(xc_interface *xch,
@@ -1520,6 +1591,18 @@ int xc_tbuf_set_cpu_mask(xc_interface *xch, xc_cpumap_t mask);
 
 int xc_tbuf_set_evt_mask(xc_interface *xch, uint32_t mask);
 
+/*
+ * Only trace while a vCPU of domid, or only vcpu of it unless that is
+ * XEN_SYSCTL_TBUF_ALL_VCPUS, is running.  DOMID_INVALID removes the filter.
+ */
+int xc_tbuf_set_filter(xc_interface *xch, uint32_t domid, uint32_t vcpu);
+
+/*
+ * Only trace 1 in rate events of the classes set in class_mask (an event
+ * mask), or all of them if rate is 0 or 1.
+ */
+int xc_tbuf_set_sample(xc_interface *xch, uint32_t class_mask, uint32_t rate);
+
 /**
  * Enable vmtrace for given vCPU.
  *
@@ -2329,6 +2412,25 @@ int xc_memshr_fork(xc_interface *xch,
 int xc_memshr_fork_reset(xc_interface *xch, uint32_t forked_domain,
                          bool reset_state, bool reset_memory);
 
+/*
+ * Create a pool of nr paused forks of source_domain, using config to create
+ * the new domains, and return their domain ids in domids.  Forks get handed
+ * out by unpausing them.  On failure, any fork created is destroyed again.
+ */
+int xc_memshr_fork_pool(xc_interface *xch, uint32_t source_domain,
+                        struct xen_domctl_createdomain *config,
+                        bool allow_with_iommu, bool block_interrupts,
+                        uint32_t *domids, unsigned int nr);
+
+/*
+ * Reset nr forks of source_domain with a single hypercall.  Resetting memory
+ * only drops the pages each fork made private since its last reset.  The
+ * same restrictions as for xc_memshr_fork_reset apply.
+ */
+int xc_memshr_fork_reset_multi(xc_interface *xch, uint32_t source_domain,
+                               const uint32_t *domids, unsigned int nr,
+                               bool reset_state, bool reset_memory);
+
 /* Debug calls: return the number of pages referencing the shared frame backing
  * the input argument. Should be one or greater.
  *
@@ -236,6 +236,22 @@ int xendevicemodel_inject_msi(
     xendevicemodel_handle *dmod, domid_t domid, uint64_t msi_addr,
     uint32_t msi_data);
 
+/**
+ * This function injects a batch of MSIs into a guest, in order, with a
+ * single hypercall.
+ *
+ * @parm dmod a handle to an open devicemodel interface.
+ * @parm domid the domain id to be serviced
+ * @parm msis an array of MSI address/data pairs, with pad set to 0
+ * @parm nr the number of MSIs in the array
+ * @parm done if not NULL, set to the number of MSIs injected, all of them
+ *            on success, and the ones preceding the failed one on failure
+ * @return 0 on success, -1 on failure.
+ */
+int xendevicemodel_inject_msi_batch(
+    xendevicemodel_handle *dmod, domid_t domid,
+    struct xen_dm_op_inject_msi msis[], uint32_t nr, uint32_t *done);
+
 /**
  * This function enables tracking of changes in the VRAM area.
  *
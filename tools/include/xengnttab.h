@@ -356,6 +356,82 @@ int xengnttab_dmabuf_imp_to_refs(xengnttab_handle *xgt, uint32_t domid,
  */
 int xengnttab_dmabuf_imp_release(xengnttab_handle *xgt, uint32_t fd);
 
+/*
+ * Persistent grant cache.
+ *
+ * Backends whose frontends reuse a bounded set of grant references can
+ * keep them mapped across requests instead of mapping and unmapping
+ * them each time.  The cache maps grants on behalf of a xengnttab_handle,
+ * keyed by (domid, ref), and evicts the least recently used unpinned
+ * mappings once more than @max_pages pages are mapped.
+ *
+ * The cache is not thread safe; callers have to serialise accesses to a
+ * given cache.
+ */
+typedef struct xengnttab_cache xengnttab_cache;
+
+typedef struct xengnttab_cache_stats {
+    uint64_t hits;          /* Lookups satisfied by an existing mapping. */
+    uint64_t misses;        /* Lookups which needed a new mapping. */
+    uint64_t evictions;     /* Mappings dropped to stay within max_pages. */
+    uint64_t invalidations; /* Mappings dropped by invalidation. */
+    uint32_t mapped_pages;  /* Pages currently mapped by the cache. */
+    uint32_t max_pages;
+} xengnttab_cache_stats;
+
+/**
+ * Creates a grant cache mapping at most @max_pages pages with @prot (as in
+ * mmap()) through @xgt, which must stay open for the lifetime of the cache.
+ *
+ * On failure sets errno and returns NULL.
+ */
+xengnttab_cache *xengnttab_cache_create(xengnttab_handle *xgt,
+                                        uint32_t max_pages, int prot);
+
+/**
+ * Unmaps all pages mapped by @cache and frees it.  Pages still pinned by
+ * xengnttab_cache_get() are unmapped as well.
+ */
+void xengnttab_cache_destroy(xengnttab_cache *cache);
+
+/**
+ * Looks up the @count grant references @refs of domain @domid, and
+ * returns the address each of them is mapped at in @addrs.  References
+ * not in the cache are mapped with a single map operation, after evicting
+ * unpinned mappings if needed to stay within the cache's limit.
+ *
+ * Returned mappings are pinned, and stay valid until released with
+ * xengnttab_cache_put().  The addresses of different references are not
+ * contiguous.
+ *
+ * On failure sets errno and returns -1, with no mapping pinned.  errno is
+ * ENOSPC if the pinned mappings leave no room for the missing ones.
+ */
+int xengnttab_cache_get(xengnttab_cache *cache, uint32_t domid,
+                        uint32_t count, const uint32_t *refs, void **addrs);
+
+/**
+ * Unpins the @count mappings at @addrs returned by xengnttab_cache_get().
+ * The mappings stay in the cache for reuse.
+ *
+ * Returns -1 with errno set to EINVAL if an address is not a pinned
+ * mapping of @cache; the other mappings are still unpinned.
+ */
+int xengnttab_cache_put(xengnttab_cache *cache, uint32_t count, void **addrs);
+
+/**
+ * Drops all mappings of domain @domid from @cache, e.g. when its frontend
+ * disconnects.  Pinned mappings are no longer returned by lookups, and are
+ * unmapped when they are unpinned.
+ */
+void xengnttab_cache_invalidate(xengnttab_cache *cache, uint32_t domid);
+
+/**
+ * Returns the hit/miss statistics and current size of @cache in @stats.
+ */
+void xengnttab_cache_get_stats(xengnttab_cache *cache,
+                               xengnttab_cache_stats *stats);
+
 /*
  * Grant Sharing Interface (allocating and granting pages to others)
  */
@@ -0,0 +1,97 @@
+/*
+ * libxentrace: live consumption of Xen's trace buffers.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef XENTRACE_H
+#define XENTRACE_H
+
+#include <stdint.h>
+
+/* Callers who don't care don't need to #include <xentoollog.h> */
+struct xentoollog_logger;
+
+typedef struct xentrace_handle xentrace_handle;
+
+/* A trace record, as inserted by Xen. */
+typedef struct xentrace_record {
+    uint32_t event;         /* TRC_* event, without size and cycles bits. */
+    unsigned int nr_data;   /* Number of valid items in data[]. */
+    int has_tsc;
+    uint64_t tsc;
+    uint32_t data[7];
+} xentrace_record;
+
+/* Skip the records already in the buffers when opening. */
+#define XENTRACE_OPENFLAG_DISCARD  (1U << 0)
+
+/*
+ * Allocate trace buffers of pages pages per CPU, unless they already are,
+ * enable tracing, map the buffers and bind to VIRQ_TBUF.
+ *
+ * Records are consumed from the shared buffers as they get read, so there
+ * must only be one consumer, e.g. no xentrace running at the same time.
+ * Which events get traced is controlled with xc_tbuf_set_evt_mask() and
+ * friends, independently.
+ */
+xentrace_handle *xentrace_open(struct xentoollog_logger *logger,
+                               unsigned long pages, unsigned int open_flags);
+
+/* Unmaps the buffers.  Tracing is left enabled. */
+int xentrace_close(xentrace_handle *xth);
+
+/* One more than the highest physical CPU which may have a buffer. */
+unsigned int xentrace_nr_cpus(xentrace_handle *xth);
+
+/*
+ * Fetch the next record of cpu's buffer into rec.  Returns 1 if there was
+ * one, 0 if there are none at the moment (or cpu has no buffer), or -1 and
+ * sets errno if the buffer's state is corrupt.
+ *
+ * Records of each CPU are returned in the order of their timestamps.  Lost
+ * records (TRC_LOST_RECORDS) are returned like any other record, padding
+ * isn't.  The space of records read is given back to Xen when the records
+ * read so far from the buffer are exhausted, before looking for new ones.
+ */
+int xentrace_next(xentrace_handle *xth, unsigned int cpu,
+                  xentrace_record *rec);
+
+/*
+ * File descriptor which becomes readable when Xen notifies of a buffer
+ * having filled up to its high water mark (half of it), for use with
+ * poll() and the like.  Follow up with xentrace_wait(xth, 0).
+ */
+int xentrace_fd(xentrace_handle *xth);
+
+/*
+ * Wait up to timeout_ms milliseconds (or indefinitely if negative) for a
+ * notification from Xen.  Returns 1 if there was one, 0 on timeout, or -1
+ * and sets errno on error, including EINTR.
+ *
+ * Xen only notifies at the high water mark, so consumers wanting timely
+ * records should use a timeout, and look for records after each wait.
+ */
+int xentrace_wait(xentrace_handle *xth, int timeout_ms);
+
+#endif /* XENTRACE_H */
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,165 @@
+/******************************************************************************
+ * xc_dirty_ring.c
+ *
+ * API for consuming the log-dirty ring of a domain, an alternative to
+ * retrieving the full dirty bitmap for sparsely written guests.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "xc_private.h"
+
+struct xc_dirty_ring {
+    xc_interface *xch;
+    xenforeignmemory_resource_handle *fres;
+    struct xen_dirty_ring *ring;
+    unsigned int size;
+};
+
+int xc_dirty_ring_enable(xc_interface *xch, uint32_t domid,
+                         unsigned int nr_frames)
+{
+    struct xen_domctl domctl = {
+        .cmd = XEN_DOMCTL_shadow_op,
+        .domain = domid,
+        .u.shadow_op = {
+            .op = XEN_DOMCTL_SHADOW_OP_DIRTY_RING_ENABLE,
+            .pages = nr_frames,
+        },
+    };
+
+    return do_domctl(xch, &domctl);
+}
+
+int xc_dirty_ring_disable(xc_interface *xch, uint32_t domid)
+{
+    struct xen_domctl domctl = {
+        .cmd = XEN_DOMCTL_shadow_op,
+        .domain = domid,
+        .u.shadow_op = {
+            .op = XEN_DOMCTL_SHADOW_OP_DIRTY_RING_DISABLE,
+        },
+    };
+
+    return do_domctl(xch, &domctl);
+}
+
+long xc_dirty_ring_harvest(xc_interface *xch, uint32_t domid,
+                           unsigned int mode, xc_shadow_op_stats_t *stats)
+{
+    struct xen_domctl domctl = {
+        .cmd = XEN_DOMCTL_shadow_op,
+        .domain = domid,
+        .u.shadow_op = {
+            .op = XEN_DOMCTL_SHADOW_OP_DIRTY_RING_HARVEST,
+            .mode = mode,
+        },
+    };
+    int rc = do_domctl(xch, &domctl);
+
+    if ( rc )
+        return rc;
+
+    if ( stats )
+        *stats = domctl.u.shadow_op.stats;
+
+    return domctl.u.shadow_op.pages;
+}
+
+xc_dirty_ring_t *xc_dirty_ring_map(xc_interface *xch, uint32_t domid)
+{
+    xc_dirty_ring_t *ring;
+    size_t size;
+    void *addr = NULL;
+
+    if ( xenforeignmemory_resource_size(xch->fmem, domid,
+                                        XENMEM_resource_dirty_ring, 0,
+                                        &size) )
+    {
+        PERROR("Failed to query dirty ring size of d%u", domid);
+        return NULL;
+    }
+
+    ring = calloc(1, sizeof(*ring));
+    if ( !ring )
+    {
+        PERROR("Failed to allocate dirty ring handle");
+        return NULL;
+    }
+
+    ring->fres = xenforeignmemory_map_resource(
+        xch->fmem, domid, XENMEM_resource_dirty_ring, 0, 0,
+        size >> XC_PAGE_SHIFT, &addr, PROT_READ | PROT_WRITE, 0);
+    if ( !ring->fres )
+    {
+        PERROR("Failed to map dirty ring of d%u", domid);
+        free(ring);
+        return NULL;
+    }
+
+    ring->xch = xch;
+    ring->ring = addr;
+    ring->size = ring->ring->size;
+
+    /* Don't let a bogus size make us run off the end of the mapping. */
+    if ( !ring->size ||
+         (ring->size * sizeof(ring->ring->pfn[0]) +
+          offsetof(struct xen_dirty_ring, pfn)) > size )
+    {
+        ERROR("Invalid dirty ring size %u", ring->size);
+        xc_dirty_ring_unmap(ring);
+        return NULL;
+    }
+
+    return ring;
+}
+
+void xc_dirty_ring_unmap(xc_dirty_ring_t *ring)
+{
+    if ( !ring )
+        return;
+
+    xenforeignmemory_unmap_resource(ring->xch->fmem, ring->fres);
+    free(ring);
+}
+
+bool xc_dirty_ring_overflowed(const xc_dirty_ring_t *ring)
+{
+    return ring->ring->flags & XEN_DIRTY_RING_OVERFLOW;
+}
+
+unsigned int xc_dirty_ring_consume(xc_dirty_ring_t *ring, xen_pfn_t *pfns,
+                                   unsigned int nr)
+{
+    unsigned int cons = ring->ring->cons;
+    unsigned int harvest = ring->ring->harvest;
+    unsigned int n = 0;
+
+    if ( cons >= ring->size || harvest >= ring->size )
+        return 0;
+
+    xen_rmb(); /* Read harvest before the entries it covers. */
+
+    for ( ; n < nr && cons != harvest; ++n )
+    {
+        pfns[n] = ring->ring->pfn[cons];
+        if ( ++cons == ring->size )
+            cons = 0;
+    }
+
+    xen_mb(); /* Finish reading entries before handing the slots back. */
+    ring->ring->cons = cons;
+
+    return n;
+}
@@ -686,6 +686,102 @@ int xc_set_paging_mempool_size(xc_interface *xch, uint32_t domid, uint64_t size)
     return do_domctl(xch, &domctl);
 }
 
+int xc_domain_get_superpage_info(xc_interface *xch, uint32_t domid,
+                                 xc_p2m_superpage_t *info)
+{
+    int rc;
+    struct xen_domctl domctl = {
+        .cmd         = XEN_DOMCTL_p2m_superpage,
+        .domain      = domid,
+        .u.p2m_superpage = {
+            .op = XEN_DOMCTL_P2M_SUPERPAGE_GET,
+        },
+    };
+
+    rc = do_domctl(xch, &domctl);
+    if ( rc )
+        return rc;
+
+    *info = domctl.u.p2m_superpage;
+    return 0;
+}
+
+int xc_domain_set_superpage_scan_rate(xc_interface *xch, uint32_t domid,
+                                      uint32_t rate)
+{
+    struct xen_domctl domctl = {
+        .cmd         = XEN_DOMCTL_p2m_superpage,
+        .domain      = domid,
+        .u.p2m_superpage = {
+            .op = XEN_DOMCTL_P2M_SUPERPAGE_SET,
+            .rate = rate,
+        },
+    };
+
+    return do_domctl(xch, &domctl);
+}
+
+int xc_domain_exit_stats_op(xc_interface *xch, uint32_t domid, uint32_t op)
+{
+    struct xen_domctl domctl = {
+        .cmd         = XEN_DOMCTL_exit_stats,
+        .domain      = domid,
+        .u.exit_stats = {
+            .op = op,
+        },
+    };
+
+    return do_domctl(xch, &domctl);
+}
+
+int xc_domain_exit_stats_get(xc_interface *xch, uint32_t domid,
+                             xc_exit_stats_reason_t *reasons,
+                             uint32_t *nr_reasons,
+                             xc_exit_stats_detail_t *details,
+                             uint32_t *nr_details,
+                             uint64_t *details_lost, uint64_t *tsc_khz)
+{
+    int rc = -1;
+    struct xen_domctl domctl = {
+        .cmd         = XEN_DOMCTL_exit_stats,
+        .domain      = domid,
+        .u.exit_stats = {
+            .op = XEN_DOMCTL_EXIT_STATS_GET,
+            .nr_reasons = *nr_reasons,
+            .nr_details = *nr_details,
+        },
+    };
+    DECLARE_HYPERCALL_BOUNCE(reasons, *nr_reasons * sizeof(*reasons),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+    DECLARE_HYPERCALL_BOUNCE(details, *nr_details * sizeof(*details),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+
+    if ( xc_hypercall_bounce_pre(xch, reasons) )
+        return -1;
+    if ( xc_hypercall_bounce_pre(xch, details) )
+        goto out;
+
+    set_xen_guest_handle(domctl.u.exit_stats.reasons, reasons);
+    set_xen_guest_handle(domctl.u.exit_stats.details, details);
+
+    rc = do_domctl(xch, &domctl);
+    if ( !rc )
+    {
+        *nr_reasons = domctl.u.exit_stats.nr_reasons;
+        *nr_details = domctl.u.exit_stats.nr_details;
+        if ( details_lost )
+            *details_lost = domctl.u.exit_stats.details_lost;
+        if ( tsc_khz )
+            *tsc_khz = domctl.u.exit_stats.tsc_khz;
+    }
+
+    xc_hypercall_bounce_post(xch, details);
+ out:
+    xc_hypercall_bounce_post(xch, reasons);
+
+    return rc;
+}
+
 int xc_domain_setmaxmem(xc_interface *xch,
                         uint32_t domid,
                         uint64_t max_memkb)
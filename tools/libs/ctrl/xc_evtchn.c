@@ -74,6 +74,25 @@ int xc_evtchn_status(xc_interface *xch, xc_evtchn_status_t *status)
                         sizeof(*status), 1);
 }
 
+int xc_evtchn_set_coalesce(xc_interface *xch, evtchn_port_t port,
+                           uint32_t count, uint32_t timeout_us)
+{
+    struct evtchn_set_coalesce arg = {
+        .port       = port,
+        .count      = count,
+        .timeout_us = timeout_us,
+    };
+
+    return do_evtchn_op(xch, EVTCHNOP_set_coalesce, &arg, sizeof(arg), 0);
+}
+
+int xc_evtchn_coalesce_stats(xc_interface *xch,
+                             xc_evtchn_coalesce_stats_t *stats)
+{
+    return do_evtchn_op(xch, EVTCHNOP_coalesce_stats, stats,
+                        sizeof(*stats), 1);
+}
+
 /*
  * Local variables:
  * mode: C
@@ -272,6 +272,73 @@ int xc_memshr_fork_reset(xc_interface *xch, uint32_t domid, bool reset_state,
     return xc_memshr_memop(xch, domid, &mso);
 }
 
+int xc_memshr_fork_pool(xc_interface *xch, uint32_t pdomid,
+                        struct xen_domctl_createdomain *config,
+                        bool allow_with_iommu, bool block_interrupts,
+                        uint32_t *domids, unsigned int nr)
+{
+    unsigned int i;
+    int rc = 0;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        domids[i] = DOMID_INVALID;
+
+        /* Forking requires the new domain to be paused by the toolstack. */
+        if ( (rc = xc_domain_create(xch, &domids[i], config)) ||
+             (rc = xc_domain_pause(xch, domids[i])) ||
+             (rc = xc_memshr_fork(xch, pdomid, domids[i], allow_with_iommu,
+                                  block_interrupts)) )
+            break;
+    }
+
+    if ( rc )
+    {
+        int saved_errno = errno;
+
+        do {
+            if ( domids[i] != DOMID_INVALID )
+                xc_domain_destroy(xch, domids[i]);
+        } while ( i-- );
+
+        errno = saved_errno;
+    }
+
+    return rc;
+}
+
+int xc_memshr_fork_reset_multi(xc_interface *xch, uint32_t pdomid,
+                               const uint32_t *domids, unsigned int nr,
+                               bool reset_state, bool reset_memory)
+{
+    xen_mem_sharing_op_t mso;
+    DECLARE_HYPERCALL_BUFFER(uint16_t, forks);
+    unsigned int i;
+    int rc;
+
+    forks = xc_hypercall_buffer_alloc(xch, forks, nr * sizeof(*forks));
+    if ( !forks )
+        return -1;
+
+    for ( i = 0; i < nr; i++ )
+        forks[i] = domids[i];
+
+    memset(&mso, 0, sizeof(mso));
+    mso.op = XENMEM_sharing_op_fork_reset_multi;
+    set_xen_guest_handle(mso.u.fork_reset_multi.forks, forks);
+    mso.u.fork_reset_multi.nr_forks = nr;
+    if ( reset_state )
+        mso.u.fork_reset_multi.flags |= XENMEM_FORK_RESET_STATE;
+    if ( reset_memory )
+        mso.u.fork_reset_multi.flags |= XENMEM_FORK_RESET_MEMORY;
+
+    rc = xc_memshr_memop(xch, pdomid, &mso);
+
+    xc_hypercall_buffer_free(xch, forks);
+
+    return rc;
+}
+
 int xc_memshr_audit(xc_interface *xch)
 {
     xen_mem_sharing_op_t mso;
@@ -170,3 +170,29 @@ int xc_tbuf_set_evt_mask(xc_interface *xch, uint32_t mask)
     return do_sysctl(xch, &sysctl);
 }
 
+int xc_tbuf_set_filter(xc_interface *xch, uint32_t domid, uint32_t vcpu)
+{
+    struct xen_sysctl sysctl = {};
+
+    sysctl.cmd = XEN_SYSCTL_tbuf_op;
+    sysctl.interface_version = XEN_SYSCTL_INTERFACE_VERSION;
+    sysctl.u.tbuf_op.cmd  = XEN_SYSCTL_TBUFOP_set_filter;
+    sysctl.u.tbuf_op.domid = domid;
+    sysctl.u.tbuf_op.vcpu = vcpu;
+
+    return do_sysctl(xch, &sysctl);
+}
+
+int xc_tbuf_set_sample(xc_interface *xch, uint32_t class_mask, uint32_t rate)
+{
+    struct xen_sysctl sysctl = {};
+
+    sysctl.cmd = XEN_SYSCTL_tbuf_op;
+    sysctl.interface_version = XEN_SYSCTL_INTERFACE_VERSION;
+    sysctl.u.tbuf_op.cmd  = XEN_SYSCTL_TBUFOP_set_sample;
+    sysctl.u.tbuf_op.evt_mask = class_mask;
+    sysctl.u.tbuf_op.sample_rate = rate;
+
+    return do_sysctl(xch, &sysctl);
+}
+
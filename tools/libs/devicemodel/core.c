@@ -122,8 +122,15 @@ int xendevicemodel_xcall(xendevicemodel_handle *dmod,
 
     ret = xencall3(dmod->xcall, __HYPERVISOR_dm_op,
                    domid, nr_bufs, (unsigned long)op_bufs);
-    if (ret < 0)
+    if (ret < 0) {
+        const struct xen_dm_op *op = nr_bufs ? xcall_bufs[0] : NULL;
+
+        /* XEN_DMOP_inject_msi_batch reports its progress also on failure. */
+        if (op && bufs[0].size >= sizeof(*op) &&
+            op->op == XEN_DMOP_inject_msi_batch)
+            memcpy(bufs[0].ptr, op, bufs[0].size);
         goto out;
+    }
 
     for (i = 0; i < nr_bufs; i++)
         memcpy(bufs[i].ptr, xcall_bufs[i], bufs[i].size);
@@ -483,6 +490,31 @@ int xendevicemodel_inject_msi(
     return xendevicemodel_op(dmod, domid, 1, &op, sizeof(op));
 }
 
+int xendevicemodel_inject_msi_batch(
+    xendevicemodel_handle *dmod, domid_t domid,
+    struct xen_dm_op_inject_msi *msis, uint32_t nr, uint32_t *done)
+{
+    struct xen_dm_op op;
+    struct xen_dm_op_inject_msi_batch *header;
+    int rc;
+
+    memset(&op, 0, sizeof(op));
+
+    op.op = XEN_DMOP_inject_msi_batch;
+    header = &op.u.inject_msi_batch;
+
+    header->nr = nr;
+    header->done = 0;
+
+    rc = xendevicemodel_op(dmod, domid, 2, &op, sizeof(op),
+                           msis, (size_t)nr * sizeof(*msis));
+
+    if ( done )
+        *done = rc ? header->done : nr;
+
+    return rc;
+}
+
 int xendevicemodel_track_dirty_vram(
     xendevicemodel_handle *dmod, domid_t domid, uint64_t first_pfn,
     uint32_t nr, unsigned long *dirty_bitmap)
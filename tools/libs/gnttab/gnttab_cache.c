@@ -0,0 +1,472 @@
+/******************************************************************************
+ *
+ * Persistent grant cache.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Entries are hashed twice: by (domid, ref) for lookups, and by address
+ * for xengnttab_cache_put().  Unpinned entries are on an LRU list, and are
+ * evicted from its head.
+ *
+ * The misses of one xengnttab_cache_get() call are mapped as a single
+ * region.  As the grant devices can only unmap whole regions, a region is
+ * unmapped once all its entries are gone, and pages are accounted per
+ * region: only the pages of regions without pinned entries can be
+ * reclaimed, by evicting all of their entries.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <xenctrl.h>
+#include <xen_list.h>
+
+#include "private.h"
+
+struct cache_region {
+    void *addr;
+    uint32_t count;             /* Pages mapped. */
+    uint32_t live;              /* Entries still in the region. */
+    uint32_t unpinned;          /* Of which on the LRU list. */
+};
+
+struct cache_entry {
+    struct cache_entry *next_key;
+    struct cache_entry *next_addr;
+    XEN_TAILQ_ENTRY(struct cache_entry) lru;
+    uint32_t domid;
+    uint32_t ref;
+    void *addr;
+    struct cache_region *region;
+    unsigned int pin;
+    bool stale;                 /* Invalidated while pinned. */
+};
+
+struct xengnttab_cache {
+    xengnttab_handle *xgt;
+    int prot;
+    unsigned int hash_mask;
+    struct cache_entry **by_key;
+    struct cache_entry **by_addr;
+    XEN_TAILQ_HEAD(, struct cache_entry) lru;
+    uint32_t reclaimable_pages; /* In regions with no pinned entry. */
+    xengnttab_cache_stats stats;
+};
+
+static unsigned int key_hash(const xengnttab_cache *cache,
+                             uint32_t domid, uint32_t ref)
+{
+    return ((ref ^ (domid << 20)) * 2654435761U) & cache->hash_mask;
+}
+
+static unsigned int addr_hash(const xengnttab_cache *cache, const void *addr)
+{
+    return (((uintptr_t)addr >> XC_PAGE_SHIFT) * 2654435761U) &
+           cache->hash_mask;
+}
+
+static struct cache_entry *lookup_key(const xengnttab_cache *cache,
+                                      uint32_t domid, uint32_t ref)
+{
+    struct cache_entry *e = cache->by_key[key_hash(cache, domid, ref)];
+
+    while ( e && (e->domid != domid || e->ref != ref) )
+        e = e->next_key;
+
+    return e;
+}
+
+static struct cache_entry *lookup_addr(const xengnttab_cache *cache,
+                                       const void *addr)
+{
+    struct cache_entry *e = cache->by_addr[addr_hash(cache, addr)];
+
+    while ( e && e->addr != addr )
+        e = e->next_addr;
+
+    return e;
+}
+
+static void unhash_key(xengnttab_cache *cache, struct cache_entry *e)
+{
+    struct cache_entry **pe = &cache->by_key[key_hash(cache, e->domid,
+                                                      e->ref)];
+
+    while ( *pe != e )
+        pe = &(*pe)->next_key;
+    *pe = e->next_key;
+}
+
+static void unhash_addr(xengnttab_cache *cache, struct cache_entry *e)
+{
+    struct cache_entry **pe = &cache->by_addr[addr_hash(cache, e->addr)];
+
+    while ( *pe != e )
+        pe = &(*pe)->next_addr;
+    *pe = e->next_addr;
+}
+
+static void lru_add(xengnttab_cache *cache, struct cache_entry *e)
+{
+    struct cache_region *r = e->region;
+
+    XEN_TAILQ_INSERT_TAIL(&cache->lru, e, lru);
+    if ( ++r->unpinned == r->live )
+        cache->reclaimable_pages += r->count;
+}
+
+static void lru_del(xengnttab_cache *cache, struct cache_entry *e)
+{
+    struct cache_region *r = e->region;
+
+    XEN_TAILQ_REMOVE(&cache->lru, e, lru);
+    if ( r->unpinned-- == r->live )
+        cache->reclaimable_pages -= r->count;
+}
+
+/* Free an entry which is in neither hash nor on the LRU list. */
+static void free_entry(xengnttab_cache *cache, struct cache_entry *e)
+{
+    struct cache_region *r = e->region;
+
+    if ( r && !--r->live )
+    {
+        xengnttab_unmap(cache->xgt, r->addr, r->count);
+        cache->stats.mapped_pages -= r->count;
+        free(r);
+    }
+    else if ( r && r->unpinned == r->live )
+        cache->reclaimable_pages += r->count;
+
+    free(e);
+}
+
+/* Evict all entries of a region without pinned entries, unmapping it. */
+static void evict_region(xengnttab_cache *cache, struct cache_region *r)
+{
+    uint8_t *addr = r->addr;
+    uint32_t i, count = r->count;
+
+    /* r is freed with its last entry. */
+    for ( i = 0; i < count; i++ )
+    {
+        struct cache_entry *e = lookup_addr(cache, addr + i * XC_PAGE_SIZE);
+
+        if ( !e )
+            continue;
+
+        lru_del(cache, e);
+        unhash_key(cache, e);
+        unhash_addr(cache, e);
+        free_entry(cache, e);
+        cache->stats.evictions++;
+    }
+}
+
+/*
+ * Make room for @nr more pages, evicting the regions without pinned entries
+ * with the least recently used entries first.  Evicts nothing, and returns
+ * false, if that can't free enough pages.
+ */
+static bool make_room(xengnttab_cache *cache, uint32_t nr)
+{
+    struct cache_entry *e;
+
+    if ( (uint64_t)cache->stats.mapped_pages - cache->reclaimable_pages +
+         nr > cache->stats.max_pages )
+        return false;
+
+    while ( cache->stats.mapped_pages + nr > cache->stats.max_pages )
+    {
+        XEN_TAILQ_FOREACH(e, &cache->lru, lru)
+            if ( e->region->unpinned == e->region->live )
+                break;
+
+        evict_region(cache, e->region);
+    }
+
+    return true;
+}
+
+/* Drop one pin of an entry, as taken by xengnttab_cache_get(). */
+static void unpin(xengnttab_cache *cache, struct cache_entry *e)
+{
+    if ( --e->pin )
+        return;
+
+    if ( e->stale )
+    {
+        unhash_addr(cache, e);
+        free_entry(cache, e);
+    }
+    else
+        lru_add(cache, e);
+}
+
+xengnttab_cache *xengnttab_cache_create(xengnttab_handle *xgt,
+                                        uint32_t max_pages, int prot)
+{
+    xengnttab_cache *cache;
+    unsigned int nr_buckets = 64;
+
+    if ( !max_pages )
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    while ( nr_buckets < max_pages )
+        nr_buckets <<= 1;
+
+    cache = calloc(1, sizeof(*cache));
+    if ( !cache )
+        return NULL;
+
+    cache->by_key = calloc(nr_buckets, sizeof(*cache->by_key));
+    cache->by_addr = calloc(nr_buckets, sizeof(*cache->by_addr));
+    if ( !cache->by_key || !cache->by_addr )
+    {
+        free(cache->by_key);
+        free(cache->by_addr);
+        free(cache);
+        return NULL;
+    }
+
+    cache->xgt = xgt;
+    cache->prot = prot;
+    cache->hash_mask = nr_buckets - 1;
+    cache->stats.max_pages = max_pages;
+    XEN_TAILQ_INIT(&cache->lru);
+
+    return cache;
+}
+
+void xengnttab_cache_destroy(xengnttab_cache *cache)
+{
+    unsigned int i;
+
+    if ( !cache )
+        return;
+
+    /* Every entry, stale or not, is in the address hash. */
+    for ( i = 0; i <= cache->hash_mask; i++ )
+    {
+        struct cache_entry *e, *next;
+
+        for ( e = cache->by_addr[i]; e; e = next )
+        {
+            next = e->next_addr;
+            free_entry(cache, e);
+        }
+    }
+
+    free(cache->by_key);
+    free(cache->by_addr);
+    free(cache);
+}
+
+int xengnttab_cache_get(xengnttab_cache *cache, uint32_t domid,
+                        uint32_t count, const uint32_t *refs, void **addrs)
+{
+    struct cache_entry **ents = calloc(count, sizeof(*ents));
+    struct cache_entry **miss = calloc(count, sizeof(*miss));
+    uint32_t *miss_refs = calloc(count, sizeof(*miss_refs));
+    struct cache_region *r = NULL;
+    uint32_t i, nr_miss = 0;
+    uint8_t *addr;
+    int saved_errno;
+
+    if ( !count )
+        goto out;
+
+    if ( !ents || !miss || !miss_refs )
+        goto err;
+
+    /*
+     * Pin all hits first, so that making room for the misses can't evict
+     * them.  A reference repeated within the request hits the placeholder
+     * entry inserted for its first occurrence.
+     */
+    for ( i = 0; i < count; i++ )
+    {
+        struct cache_entry *e = lookup_key(cache, domid, refs[i]);
+
+        if ( e )
+        {
+            if ( !e->pin++ )
+                lru_del(cache, e);
+            cache->stats.hits++;
+        }
+        else
+        {
+            e = calloc(1, sizeof(*e));
+            if ( !e )
+                goto undo;
+
+            e->domid = domid;
+            e->ref = refs[i];
+            e->pin = 1;
+            e->next_key = cache->by_key[key_hash(cache, domid, refs[i])];
+            cache->by_key[key_hash(cache, domid, refs[i])] = e;
+
+            miss[nr_miss] = e;
+            miss_refs[nr_miss++] = refs[i];
+            cache->stats.misses++;
+        }
+
+        ents[i] = e;
+    }
+
+    if ( nr_miss )
+    {
+        if ( !make_room(cache, nr_miss) )
+        {
+            errno = ENOSPC;
+            goto undo;
+        }
+
+        r = malloc(sizeof(*r));
+        if ( !r )
+            goto undo;
+
+        addr = xengnttab_map_domain_grant_refs(cache->xgt, nr_miss, domid,
+                                               miss_refs, cache->prot);
+        if ( !addr )
+            goto undo;
+
+        r->addr = addr;
+        r->count = r->live = nr_miss;
+        cache->stats.mapped_pages += nr_miss;
+
+        for ( i = 0; i < nr_miss; i++ )
+        {
+            struct cache_entry *e = miss[i];
+
+            e->addr = addr + i * XC_PAGE_SIZE;
+            e->region = r;
+            e->next_addr = cache->by_addr[addr_hash(cache, e->addr)];
+            cache->by_addr[addr_hash(cache, e->addr)] = e;
+        }
+    }
+
+    for ( i = 0; i < count; i++ )
+        addrs[i] = ents[i]->addr;
+
+ out:
+    free(miss_refs);
+    free(miss);
+    free(ents);
+
+    return 0;
+
+ undo:
+    saved_errno = errno;
+
+    /* Unmapped placeholders are dropped with their last pin. */
+    while ( i-- )
+    {
+        struct cache_entry *e = ents[i];
+
+        if ( e->region )
+            unpin(cache, e);
+        else if ( !--e->pin )
+        {
+            unhash_key(cache, e);
+            free(e);
+        }
+    }
+
+    free(r);
+    errno = saved_errno;
+
+ err:
+    free(miss_refs);
+    free(miss);
+    free(ents);
+
+    return -1;
+}
+
+int xengnttab_cache_put(xengnttab_cache *cache, uint32_t count, void **addrs)
+{
+    uint32_t i;
+    int rc = 0;
+
+    for ( i = 0; i < count; i++ )
+    {
+        struct cache_entry *e = lookup_addr(cache, addrs[i]);
+
+        if ( !e || !e->pin )
+        {
+            errno = EINVAL;
+            rc = -1;
+            continue;
+        }
+
+        unpin(cache, e);
+    }
+
+    return rc;
+}
+
+void xengnttab_cache_invalidate(xengnttab_cache *cache, uint32_t domid)
+{
+    unsigned int i;
+
+    for ( i = 0; i <= cache->hash_mask; i++ )
+    {
+        struct cache_entry **pe = &cache->by_key[i];
+
+        while ( *pe )
+        {
+            struct cache_entry *e = *pe;
+
+            if ( e->domid != domid )
+            {
+                pe = &e->next_key;
+                continue;
+            }
+
+            *pe = e->next_key;
+            cache->stats.invalidations++;
+
+            if ( e->pin )
+                e->stale = true;
+            else
+            {
+                lru_del(cache, e);
+                unhash_addr(cache, e);
+                free_entry(cache, e);
+            }
+        }
+    }
+}
+
+void xengnttab_cache_get_stats(xengnttab_cache *cache,
+                               xengnttab_cache_stats *stats)
+{
+    *stats = cache->stats;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -246,6 +246,9 @@ struct xc_sr_context
             unsigned long *deferred_pages;
             unsigned long nr_deferred_pages;
             xc_hypercall_buffer_t dirty_bitmap_hbuf;
+
+            /* Dirty ring, if available, used during the live phase. */
+            xc_dirty_ring_t *dirty_ring;
         } save;
 
         struct /* Restore data. */
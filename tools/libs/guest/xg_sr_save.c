@@ -400,6 +400,54 @@ static int send_dirty_pages(struct xc_sr_context *ctx,
     return ctx->save.ops.check_vm_state(ctx);
 }
 
+/*
+ * Send the pages harvested from the dirty ring.  Used instead of
+ * send_dirty_pages() for iterations of the live migration loop which didn't
+ * need the full bitmap.
+ */
+static int send_dirty_ring_pages(struct xc_sr_context *ctx,
+                                 unsigned long entries)
+{
+    xc_interface *xch = ctx->xch;
+    xen_pfn_t pfns[256];
+    unsigned long written = 0;
+    unsigned int i, nr;
+    int rc;
+
+    while ( (nr = xc_dirty_ring_consume(ctx->save.dirty_ring, pfns,
+                                        ARRAY_SIZE(pfns))) != 0 )
+    {
+        for ( i = 0; i < nr; ++i )
+        {
+            if ( pfns[i] >= ctx->save.p2m_size )
+            {
+                ERROR("Dirty ring pfn %#"PRIpfn" beyond p2m size %#lx",
+                      pfns[i], ctx->save.p2m_size);
+                return -1;
+            }
+
+            rc = add_to_batch(ctx, pfns[i]);
+            if ( rc )
+                return rc;
+        }
+
+        written += nr;
+        xc_report_progress_step(xch, written, entries);
+    }
+
+    rc = flush_batch(ctx);
+    if ( rc )
+        return rc;
+
+    if ( written != entries )
+        DPRINTF("Dirty ring contained %lu entries, expected %lu",
+                written, entries);
+
+    xc_report_progress_step(xch, entries, entries);
+
+    return ctx->save.ops.check_vm_state(ctx);
+}
+
 /*
  * Send all pages in the guests p2m.  Used as the first iteration of the live
  * migration loop, and for a non-live save.
@@ -448,6 +496,39 @@ static int enable_logdirty(struct xc_sr_context *ctx)
     return 0;
 }
 
+/*
+ * Set up the dirty ring, which lets iterations of the live loop skip
+ * retrieving and scanning the whole dirty bitmap.  Failure isn't fatal: the
+ * bitmap is used instead.  Must be called before enabling logdirty, as the
+ * ring can only record pages which get dirtied after its creation.
+ */
+#define DIRTY_RING_FRAMES 64
+
+static void setup_dirty_ring(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+
+    if ( xc_dirty_ring_enable(xch, ctx->domid, DIRTY_RING_FRAMES) )
+    {
+        DPRINTF("Dirty ring unavailable, using the bitmap: %d", errno);
+        return;
+    }
+
+    ctx->save.dirty_ring = xc_dirty_ring_map(xch, ctx->domid);
+    if ( !ctx->save.dirty_ring )
+        xc_dirty_ring_disable(xch, ctx->domid);
+}
+
+static void teardown_dirty_ring(struct xc_sr_context *ctx)
+{
+    if ( !ctx->save.dirty_ring )
+        return;
+
+    xc_dirty_ring_unmap(ctx->save.dirty_ring);
+    ctx->save.dirty_ring = NULL;
+    xc_dirty_ring_disable(ctx->xch, ctx->domid);
+}
+
 static int update_progress_string(struct xc_sr_context *ctx, char **str)
 {
     xc_interface *xch = ctx->xch;
@@ -498,6 +579,7 @@ static int send_memory_live(struct xc_sr_context *ctx)
     xc_shadow_op_stats_t stats = { 0, ctx->save.p2m_size };
     char *progress_str = NULL;
     unsigned int x = 0;
+    bool from_ring = false;
     int rc;
     int policy_decision;
 
@@ -534,7 +616,8 @@ static int send_memory_live(struct xc_sr_context *ctx)
             if ( rc )
                 goto out;
 
-            rc = send_dirty_pages(ctx, stats.dirty_count);
+            rc = from_ring ? send_dirty_ring_pages(ctx, stats.dirty_count)
+                           : send_dirty_pages(ctx, stats.dirty_count);
             if ( rc )
                 goto out;
         }
@@ -551,7 +634,27 @@ static int send_memory_live(struct xc_sr_context *ctx)
         if ( policy_decision != XGS_POLICY_CONTINUE_PRECOPY )
             break;
 
-        if ( xc_logdirty_control(
+        from_ring = false;
+        if ( ctx->save.dirty_ring )
+        {
+            long nr = xc_dirty_ring_harvest(xch, ctx->domid, 0, &stats);
+
+            if ( nr >= 0 )
+            {
+                stats.dirty_count = nr;
+                from_ring = true;
+            }
+            else if ( errno != EOVERFLOW )
+            {
+                PERROR("Failed to harvest dirty ring");
+                rc = -1;
+                goto out;
+            }
+        }
+
+        /* Also resets an overflowed ring. */
+        if ( !from_ring &&
+             xc_logdirty_control(
                  xch, ctx->domid, XEN_DOMCTL_SHADOW_OP_CLEAN,
                  &ctx->save.dirty_bitmap_hbuf, ctx->save.p2m_size,
                  0, &stats) != ctx->save.p2m_size )
@@ -735,6 +838,8 @@ static int send_domain_memory_live(struct xc_sr_context *ctx)
 {
     int rc;
 
+    setup_dirty_ring(ctx);
+
     rc = enable_logdirty(ctx);
     if ( rc )
         goto out;
@@ -743,6 +848,9 @@ static int send_domain_memory_live(struct xc_sr_context *ctx)
     if ( rc )
         goto out;
 
+    /* The final pass, and any checkpoints, use the bitmap. */
+    teardown_dirty_ring(ctx);
+
     rc = suspend_and_send_dirty(ctx);
     if ( rc )
         goto out;
@@ -755,6 +863,7 @@ static int send_domain_memory_live(struct xc_sr_context *ctx)
     }
 
  out:
+    teardown_dirty_ring(ctx);
     return rc;
 }
 
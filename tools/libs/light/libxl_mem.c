@@ -577,6 +577,46 @@ int libxl_get_free_memory_0x040700(libxl_ctx *ctx, uint32_t *memkb)
     return libxl__memkb_64to32(ctx, rc, my_memkb, memkb);
 }
 
+int libxl_domain_get_superpage_info(libxl_ctx *ctx, uint32_t domid,
+                                    libxl_superpage_info *info)
+{
+    xc_p2m_superpage_t xcinfo;
+    int rc = 0;
+    GC_INIT(ctx);
+
+    if (xc_domain_get_superpage_info(ctx->xch, domid, &xcinfo)) {
+        LOGED(ERROR, domid, "Getting superpage info");
+        rc = ERROR_FAIL;
+        goto out;
+    }
+
+    info->scan_rate = xcinfo.rate;
+    info->pages_4k = xcinfo.pages_4k;
+    info->pages_2m = xcinfo.pages_2m;
+    info->pages_1g = xcinfo.pages_1g;
+    info->coalesced = xcinfo.coalesced;
+    info->passes = xcinfo.passes;
+
+out:
+    GC_FREE;
+    return rc;
+}
+
+int libxl_domain_set_superpage_scan_rate(libxl_ctx *ctx, uint32_t domid,
+                                         uint32_t rate)
+{
+    int rc = 0;
+    GC_INIT(ctx);
+
+    if (xc_domain_set_superpage_scan_rate(ctx->xch, domid, rate)) {
+        LOGED(ERROR, domid, "Setting superpage scan rate to %"PRIu32, rate);
+        rc = ERROR_FAIL;
+    }
+
+    GC_FREE;
+    return rc;
+}
+
 int libxl_wait_for_free_memory(libxl_ctx *ctx, uint32_t domid,
                                uint64_t memory_kb, int wait_secs)
 {
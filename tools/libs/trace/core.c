@@ -0,0 +1,367 @@
+/*
+ * libxentrace: live consumption of Xen's trace buffers.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <xentoollog.h>
+#include <xenctrl.h>
+#include <xenevtchn.h>
+#include <xenforeignmemory.h>
+#include <xentrace.h>
+
+#include <xen/trace.h>
+
+struct xentrace_cpu {
+    struct t_buf *meta;         /* Followed by the data. */
+    uint32_t pos;               /* Of the next record to read. */
+    uint32_t prod;              /* Snapshot of meta->prod. */
+};
+
+struct xentrace_handle {
+    xentoollog_logger *logger, *logger_tofree;
+    xc_interface *xch;
+    xenforeignmemory_handle *fmem;
+    xenevtchn_handle *xce;
+    int port;
+
+    const struct t_info *t_info;
+    size_t t_info_size;
+    uint32_t data_size;
+    unsigned int nr_cpus;
+    struct xentrace_cpu *cpus;
+};
+
+#define ERROR(xth, err, fmt, ...) \
+    xtl_log((xth)->logger, XTL_ERROR, err, "xentrace", fmt, ## __VA_ARGS__)
+
+static int map_buffers(xentrace_handle *xth, unsigned long t_info_mfn)
+{
+    unsigned int t_info_pages = xth->t_info_size >> XC_PAGE_SHIFT;
+    xen_pfn_t *pfns;
+    unsigned int pages, cpu, i;
+
+    /* t_info spans contiguous frames, more than one on larger hosts. */
+    pfns = calloc(t_info_pages, sizeof(*pfns));
+    if ( !pfns )
+        return -1;
+    for ( i = 0; i < t_info_pages; i++ )
+        pfns[i] = t_info_mfn + i;
+
+    xth->t_info = xenforeignmemory_map(xth->fmem, DOMID_XEN, PROT_READ,
+                                       t_info_pages, pfns, NULL);
+    free(pfns);
+    if ( !xth->t_info )
+    {
+        ERROR(xth, errno, "failed to map the trace buffers' metadata");
+        return -1;
+    }
+
+    pages = xth->t_info->tbuf_size;
+    if ( !pages )
+    {
+        ERROR(xth, 0, "trace buffers of size 0");
+        errno = EINVAL;
+        return -1;
+    }
+    xth->data_size = pages * XC_PAGE_SIZE - sizeof(struct t_buf);
+
+    pfns = calloc(pages, sizeof(*pfns));
+    if ( !pfns )
+        return -1;
+
+    /* CPUs which were offline when the buffers got allocated have none. */
+    for ( cpu = 0; cpu < xth->nr_cpus; cpu++ )
+    {
+        const uint32_t *mfn_list;
+
+        if ( !xth->t_info->mfn_offset[cpu] )
+            continue;
+
+        mfn_list = (const uint32_t *)xth->t_info +
+                   xth->t_info->mfn_offset[cpu];
+        for ( i = 0; i < pages; i++ )
+            pfns[i] = mfn_list[i];
+
+        xth->cpus[cpu].meta = xenforeignmemory_map(xth->fmem, DOMID_XEN,
+                                                   PROT_READ | PROT_WRITE,
+                                                   pages, pfns, NULL);
+        if ( !xth->cpus[cpu].meta )
+        {
+            ERROR(xth, errno, "failed to map the trace buffer of CPU%u", cpu);
+            free(pfns);
+            return -1;
+        }
+    }
+
+    free(pfns);
+
+    return 0;
+}
+
+xentrace_handle *xentrace_open(xentoollog_logger *logger,
+                               unsigned long pages, unsigned int open_flags)
+{
+    xentrace_handle *xth = calloc(1, sizeof(*xth));
+    xc_physinfo_t physinfo;
+    unsigned long t_info_mfn, t_info_size;
+    unsigned int cpu;
+
+    if ( !xth )
+        return NULL;
+
+    xth->logger = logger;
+    if ( !xth->logger )
+    {
+        xth->logger = xth->logger_tofree =
+            (xentoollog_logger *)
+            xtl_createlogger_stdiostream(stderr, XTL_PROGRESS, 0);
+        if ( !xth->logger )
+            goto err;
+    }
+
+    xth->xch = xc_interface_open(xth->logger, xth->logger, 0);
+    if ( !xth->xch )
+        goto err;
+
+    xth->fmem = xenforeignmemory_open(xth->logger, 0);
+    if ( !xth->fmem )
+        goto err;
+
+    xth->xce = xenevtchn_open(xth->logger, 0);
+    if ( !xth->xce )
+        goto err;
+
+    xth->port = xenevtchn_bind_virq(xth->xce, VIRQ_TBUF);
+    if ( xth->port < 0 )
+    {
+        ERROR(xth, errno, "failed to bind VIRQ_TBUF");
+        goto err;
+    }
+
+    if ( xc_physinfo(xth->xch, &physinfo) )
+    {
+        ERROR(xth, errno, "failed to get the number of CPUs");
+        goto err;
+    }
+    xth->nr_cpus = physinfo.max_cpu_id + 1;
+
+    xth->cpus = calloc(xth->nr_cpus, sizeof(*xth->cpus));
+    if ( !xth->cpus )
+        goto err;
+
+    if ( xc_tbuf_enable(xth->xch, pages, &t_info_mfn, &t_info_size) )
+    {
+        ERROR(xth, errno, "failed to enable the trace buffers");
+        goto err;
+    }
+    xth->t_info_size = t_info_size;
+
+    if ( map_buffers(xth, t_info_mfn) )
+        goto err;
+
+    for ( cpu = 0; cpu < xth->nr_cpus; cpu++ )
+    {
+        struct xentrace_cpu *c = &xth->cpus[cpu];
+
+        if ( !c->meta )
+            continue;
+
+        if ( open_flags & XENTRACE_OPENFLAG_DISCARD )
+            c->meta->cons = c->meta->prod;
+        c->pos = c->prod = c->meta->cons;
+    }
+
+    return xth;
+
+ err:
+    xentrace_close(xth);
+    return NULL;
+}
+
+int xentrace_close(xentrace_handle *xth)
+{
+    unsigned int cpu, pages;
+
+    if ( !xth )
+        return 0;
+
+    if ( xth->t_info )
+    {
+        pages = xth->t_info->tbuf_size;
+
+        for ( cpu = 0; cpu < xth->nr_cpus; cpu++ )
+        {
+            struct xentrace_cpu *c = &xth->cpus[cpu];
+
+            if ( !c->meta )
+                continue;
+
+            /* Give back the space of the records read. */
+            xen_mb();
+            c->meta->cons = c->pos;
+            xenforeignmemory_unmap(xth->fmem, c->meta, pages);
+        }
+
+        xenforeignmemory_unmap(xth->fmem, (void *)xth->t_info,
+                               xth->t_info_size >> XC_PAGE_SHIFT);
+    }
+
+    free(xth->cpus);
+    if ( xth->xce && xth->port >= 0 )
+        xenevtchn_unbind(xth->xce, xth->port);
+    xenevtchn_close(xth->xce);
+    xenforeignmemory_close(xth->fmem);
+    xc_interface_close(xth->xch);
+    xtl_logger_destroy(xth->logger_tofree);
+    free(xth);
+
+    return 0;
+}
+
+unsigned int xentrace_nr_cpus(xentrace_handle *xth)
+{
+    return xth->nr_cpus;
+}
+
+int xentrace_next(xentrace_handle *xth, unsigned int cpu,
+                  xentrace_record *rec)
+{
+    struct xentrace_cpu *c;
+    const unsigned char *data;
+    uint32_t data_size = xth->data_size;
+
+    if ( cpu >= xth->nr_cpus || !xth->cpus[cpu].meta )
+        return 0;
+
+    c = &xth->cpus[cpu];
+    data = (const unsigned char *)(c->meta + 1);
+
+    for ( ; ; )
+    {
+        uint32_t header, offset, size, avail;
+        const uint32_t *words;
+        unsigned int extra;
+
+        if ( c->pos == c->prod )
+        {
+            /* Records read so far are copied out, give back their space. */
+            xen_mb();
+            c->meta->cons = c->pos;
+
+            c->prod = c->meta->prod;
+            xen_rmb(); /* read prod, then read records. */
+
+            if ( c->prod >= 2 * data_size || (c->prod & 3) )
+            {
+                ERROR(xth, 0, "CPU%u: bogus prod %#x", cpu, c->prod);
+                c->prod = c->pos;
+                errno = EIO;
+                return -1;
+            }
+
+            if ( c->pos == c->prod )
+                return 0;
+        }
+
+        avail = c->prod - c->pos;
+        if ( c->prod < c->pos )
+            avail += 2 * data_size;
+
+        offset = c->pos % data_size;
+        words = (const uint32_t *)(data + offset);
+        header = words[0];
+        extra = TRC_HD_EXTRA(header);
+        size = sizeof(uint32_t) * (1 + extra) +
+               (TRC_HD_INCLUDES_CYCLE_COUNT(header) ? sizeof(uint64_t) : 0);
+
+        /* Records never straddle the end of the buffer. */
+        if ( size > avail || offset + size > data_size )
+        {
+            ERROR(xth, 0, "CPU%u: bogus record %#x at %#x", cpu, header,
+                  c->pos);
+            c->pos = c->prod;
+            errno = EIO;
+            return -1;
+        }
+
+        c->pos += size;
+        if ( c->pos >= 2 * data_size )
+            c->pos -= 2 * data_size;
+
+        rec->event = TRC_HD_TO_EVENT(header);
+        if ( rec->event == TRC_TRACE_WRAP_BUFFER )
+            continue;
+
+        rec->has_tsc = TRC_HD_INCLUDES_CYCLE_COUNT(header);
+        words++;
+        if ( rec->has_tsc )
+        {
+            rec->tsc = ((uint64_t)words[1] << 32) | words[0];
+            words += 2;
+        }
+        else
+            rec->tsc = 0;
+
+        rec->nr_data = extra;
+        memcpy(rec->data, words, extra * sizeof(uint32_t));
+
+        return 1;
+    }
+}
+
+int xentrace_fd(xentrace_handle *xth)
+{
+    return xenevtchn_fd(xth->xce);
+}
+
+int xentrace_wait(xentrace_handle *xth, int timeout_ms)
+{
+    struct pollfd pfd = {
+        .fd = xenevtchn_fd(xth->xce),
+        .events = POLLIN | POLLERR,
+    };
+    int rc, port;
+
+    rc = poll(&pfd, 1, timeout_ms);
+    if ( rc <= 0 )
+        return rc;
+
+    port = xenevtchn_pending(xth->xce);
+    if ( port < 0 )
+        return -1;
+    if ( port != xth->port )
+        return 0;
+
+    if ( xenevtchn_unmask(xth->xce, port) < 0 )
+        return -1;
+
+    return 1;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
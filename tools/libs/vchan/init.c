@@ -343,6 +343,8 @@ struct libxenvchan *libxenvchan_server_init(struct xentoollog_logger *logger,
 	ctrl->event = NULL;
 	ctrl->is_server = 1;
 	ctrl->server_persist = 0;
+	ctrl->notify_batch = 0;
+	ctrl->unnotified_write = ctrl->unnotified_read = 0;
 
 	ctrl->read.order = min_order(left_min);
 	ctrl->write.order = min_order(right_min);
@@ -427,6 +429,8 @@ struct libxenvchan *libxenvchan_client_init(struct xentoollog_logger *logger,
 	ctrl->gnttab = NULL;
 	ctrl->write.order = ctrl->read.order = 0;
 	ctrl->is_server = 0;
+	ctrl->notify_batch = 0;
+	ctrl->unnotified_write = ctrl->unnotified_read = 0;
 
 	xs = xs_open(0);
 	if (!xs)
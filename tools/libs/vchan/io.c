@@ -32,6 +32,7 @@
 #include <sys/mman.h>
 #include <sys/ioctl.h>
 #include <sys/uio.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
@@ -112,6 +113,44 @@ static inline int send_notify(struct libxenvchan *ctrl, uint8_t bit)
 		return 0;
 }
 
+/*
+ * Account for size bytes written (VCHAN_NOTIFY_WRITE) or consumed
+ * (VCHAN_NOTIFY_READ), and notify once notify_batch bytes are pending.
+ * Until then the peer's request for notification stays set.
+ */
+static inline int batch_notify(struct libxenvchan *ctrl, uint8_t bit,
+                               size_t size)
+{
+	uint32_t *pending = bit == VCHAN_NOTIFY_WRITE ?
+		&ctrl->unnotified_write : &ctrl->unnotified_read;
+	*pending += size;
+	if (*pending < ctrl->notify_batch)
+		return 0;
+	*pending = 0;
+	return send_notify(ctrl, bit);
+}
+
+void libxenvchan_set_notify_batch(struct libxenvchan *ctrl, size_t bytes)
+{
+	ctrl->notify_batch = bytes > UINT32_MAX ? UINT32_MAX : bytes;
+}
+
+int libxenvchan_flush(struct libxenvchan *ctrl)
+{
+	int ret = 0;
+	if (ctrl->unnotified_write) {
+		ctrl->unnotified_write = 0;
+		if (send_notify(ctrl, VCHAN_NOTIFY_WRITE))
+			ret = -1;
+	}
+	if (ctrl->unnotified_read) {
+		ctrl->unnotified_read = 0;
+		if (send_notify(ctrl, VCHAN_NOTIFY_READ))
+			ret = -1;
+	}
+	return ret;
+}
+
 /*
  * Get the amount of buffer space available, and do nothing about
  * notifications.
@@ -198,13 +237,75 @@ int libxenvchan_buffer_space(struct libxenvchan *ctrl)
 
 int libxenvchan_wait(struct libxenvchan *ctrl)
 {
-	int ret = xenevtchn_pending(ctrl->event);
+	int ret;
+	/* The peer may be waiting for what we have held back. */
+	if (libxenvchan_flush(ctrl))
+		return -1;
+	ret = xenevtchn_pending(ctrl->event);
 	if (ret < 0)
 		return -1;
 	xenevtchn_unmask(ctrl->event, ret);
 	return 0;
 }
 
+/**
+ * Split the size bytes of a ring starting at index idx into its
+ * contiguous segments.
+ */
+static inline void ring_segments(void *ring, uint32_t ring_size, uint32_t idx,
+                                 size_t size, struct iovec iov[2])
+{
+	uint32_t real_idx = idx & (ring_size - 1);
+	size_t avail_contig = ring_size - real_idx;
+	if (avail_contig > size)
+		avail_contig = size;
+	iov[0].iov_base = ring + real_idx;
+	iov[0].iov_len = avail_contig;
+	iov[1].iov_base = ring;
+	iov[1].iov_len = size - avail_contig;
+}
+
+/* Copy size bytes to the send ring, at pos bytes past the producer */
+static void copy_to_ring(struct libxenvchan *ctrl, uint32_t pos,
+                         const void *data, size_t size)
+{
+	struct iovec seg[2];
+	ring_segments(wr_ring(ctrl), wr_ring_size(ctrl), wr_prod(ctrl) + pos,
+	              size, seg);
+	memcpy(seg[0].iov_base, data, seg[0].iov_len);
+	if (seg[1].iov_len)
+		// we rolled across the end of the ring
+		memcpy(seg[1].iov_base, data + seg[0].iov_len, seg[1].iov_len);
+}
+
+/* Copy size bytes from the receive ring, at pos bytes past the consumer */
+static void copy_from_ring(struct libxenvchan *ctrl, uint32_t pos,
+                           void *data, size_t size)
+{
+	struct iovec seg[2];
+	ring_segments((void *)rd_ring(ctrl), rd_ring_size(ctrl),
+	              rd_cons(ctrl) + pos, size, seg);
+	memcpy(data, seg[0].iov_base, seg[0].iov_len);
+	if (seg[1].iov_len)
+		// we rolled across the end of the ring
+		memcpy(data + seg[0].iov_len, seg[1].iov_base, seg[1].iov_len);
+}
+
+/* Total size of an iovec array, or -1 if it doesn't fit in an int */
+static int iov_size(const struct iovec *iov, int iovcnt)
+{
+	size_t size = 0;
+	int i;
+	if (iovcnt < 0)
+		return -1;
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len > INT_MAX - size)
+			return -1;
+		size += iov[i].iov_len;
+	}
+	return size;
+}
+
 /**
  * returns -1 on error, or size on success
  *
@@ -212,20 +313,33 @@ int libxenvchan_wait(struct libxenvchan *ctrl)
  */
 static int do_send(struct libxenvchan *ctrl, const void *data, size_t size)
 {
-	int real_idx = wr_prod(ctrl) & (wr_ring_size(ctrl) - 1);
-	int avail_contig = wr_ring_size(ctrl) - real_idx;
-	if (avail_contig > size)
-		avail_contig = size;
 	xen_mb(); /* read indexes /then/ write data */
-	memcpy(wr_ring(ctrl) + real_idx, data, avail_contig);
-	if (avail_contig < size)
-	{
-		// we rolled across the end of the ring
-		memcpy(wr_ring(ctrl), data + avail_contig, size - avail_contig);
+	copy_to_ring(ctrl, 0, data, size);
+	xen_wmb(); /* write data /then/ notify */
+	wr_prod(ctrl) += size;
+	if (batch_notify(ctrl, VCHAN_NOTIFY_WRITE, size))
+		return -1;
+	return size;
+}
+
+/**
+ * returns -1 on error, or size on success
+ *
+ * caller must have checked that enough space is available for all of iov
+ */
+static int do_sendv(struct libxenvchan *ctrl, const struct iovec *iov,
+                    int iovcnt, size_t size)
+{
+	uint32_t pos = 0;
+	int i;
+	xen_mb(); /* read indexes /then/ write data */
+	for (i = 0; i < iovcnt; i++) {
+		copy_to_ring(ctrl, pos, iov[i].iov_base, iov[i].iov_len);
+		pos += iov[i].iov_len;
 	}
 	xen_wmb(); /* write data /then/ notify */
 	wr_prod(ctrl) += size;
-	if (send_notify(ctrl, VCHAN_NOTIFY_WRITE))
+	if (batch_notify(ctrl, VCHAN_NOTIFY_WRITE, size))
 		return -1;
 	return size;
 }
@@ -251,6 +365,49 @@ int libxenvchan_send(struct libxenvchan *ctrl, const void *data, size_t size)
 	}
 }
 
+int libxenvchan_sendv(struct libxenvchan *ctrl, const struct iovec *iov,
+                      int iovcnt)
+{
+	int avail, size = iov_size(iov, iovcnt);
+	if (size < 0)
+		return -1;
+	while (1) {
+		if (!libxenvchan_is_open(ctrl))
+			return -1;
+		avail = fast_get_buffer_space(ctrl, size);
+		if (size <= avail)
+			return do_sendv(ctrl, iov, iovcnt, size);
+		if (!ctrl->blocking)
+			return 0;
+		if (size > wr_ring_size(ctrl))
+			return -1;
+		if (libxenvchan_wait(ctrl))
+			return -1;
+	}
+}
+
+int libxenvchan_send_peek(struct libxenvchan *ctrl, size_t min,
+                          struct iovec iov[2])
+{
+	int avail;
+	if (!libxenvchan_is_open(ctrl))
+		return -1;
+	avail = fast_get_buffer_space(ctrl, min);
+	ring_segments(wr_ring(ctrl), wr_ring_size(ctrl), wr_prod(ctrl), avail, iov);
+	return avail;
+}
+
+int libxenvchan_send_commit(struct libxenvchan *ctrl, size_t size)
+{
+	if (size > raw_get_buffer_space(ctrl))
+		return -1;
+	xen_wmb(); /* write data /then/ notify */
+	wr_prod(ctrl) += size;
+	if (batch_notify(ctrl, VCHAN_NOTIFY_WRITE, size))
+		return -1;
+	return size;
+}
+
 int libxenvchan_write(struct libxenvchan *ctrl, const void *data, size_t size)
 {
 	int avail;
@@ -288,20 +445,33 @@ int libxenvchan_write(struct libxenvchan *ctrl, const void *data, size_t size)
  */
 static int do_recv(struct libxenvchan *ctrl, void *data, size_t size)
 {
-	int real_idx = rd_cons(ctrl) & (rd_ring_size(ctrl) - 1);
-	int avail_contig = rd_ring_size(ctrl) - real_idx;
-	if (avail_contig > size)
-		avail_contig = size;
 	xen_rmb(); /* data read must happen /after/ rd_cons read */
-	memcpy(data, rd_ring(ctrl) + real_idx, avail_contig);
-	if (avail_contig < size)
-	{
-		// we rolled across the end of the ring
-		memcpy(data + avail_contig, rd_ring(ctrl), size - avail_contig);
+	copy_from_ring(ctrl, 0, data, size);
+	xen_mb(); /* consume /then/ notify */
+	rd_cons(ctrl) += size;
+	if (batch_notify(ctrl, VCHAN_NOTIFY_READ, size))
+		return -1;
+	return size;
+}
+
+/**
+ * returns -1 on error, or size on success
+ *
+ * caller must have checked that enough data is available for all of iov
+ */
+static int do_recvv(struct libxenvchan *ctrl, const struct iovec *iov,
+                    int iovcnt, size_t size)
+{
+	uint32_t pos = 0;
+	int i;
+	xen_rmb(); /* data read must happen /after/ rd_cons read */
+	for (i = 0; i < iovcnt; i++) {
+		copy_from_ring(ctrl, pos, iov[i].iov_base, iov[i].iov_len);
+		pos += iov[i].iov_len;
 	}
 	xen_mb(); /* consume /then/ notify */
 	rd_cons(ctrl) += size;
-	if (send_notify(ctrl, VCHAN_NOTIFY_READ))
+	if (batch_notify(ctrl, VCHAN_NOTIFY_READ, size))
 		return -1;
 	return size;
 }
@@ -327,6 +497,50 @@ int libxenvchan_recv(struct libxenvchan *ctrl, void *data, size_t size)
 	}
 }
 
+int libxenvchan_recvv(struct libxenvchan *ctrl, const struct iovec *iov,
+                      int iovcnt)
+{
+	int size = iov_size(iov, iovcnt);
+	if (size < 0)
+		return -1;
+	while (1) {
+		int avail = fast_get_data_ready(ctrl, size);
+		if (size <= avail)
+			return do_recvv(ctrl, iov, iovcnt, size);
+		if (!libxenvchan_is_open(ctrl))
+			return -1;
+		if (!ctrl->blocking)
+			return 0;
+		if (size > rd_ring_size(ctrl))
+			return -1;
+		if (libxenvchan_wait(ctrl))
+			return -1;
+	}
+}
+
+int libxenvchan_recv_peek(struct libxenvchan *ctrl, size_t min,
+                          struct iovec iov[2])
+{
+	int avail = fast_get_data_ready(ctrl, min);
+	if (!avail && !libxenvchan_is_open(ctrl))
+		return -1;
+	xen_rmb(); /* data read must happen /after/ rd_prod read */
+	ring_segments((void *)rd_ring(ctrl), rd_ring_size(ctrl), rd_cons(ctrl),
+	              avail, iov);
+	return avail;
+}
+
+int libxenvchan_recv_commit(struct libxenvchan *ctrl, size_t size)
+{
+	if (size > raw_get_data_ready(ctrl))
+		return -1;
+	xen_mb(); /* consume /then/ notify */
+	rd_cons(ctrl) += size;
+	if (batch_notify(ctrl, VCHAN_NOTIFY_READ, size))
+		return -1;
+	return size;
+}
+
 int libxenvchan_read(struct libxenvchan *ctrl, void *data, size_t size)
 {
 	while (1) {
@@ -361,6 +575,8 @@ void libxenvchan_close(struct libxenvchan *ctrl)
 {
 	if (!ctrl)
 		return;
+	if (ctrl->ring)
+		libxenvchan_flush(ctrl);
 	if (ctrl->read.order >= PAGE_SHIFT)
 		munmap(ctrl->read.buffer, 1 << ctrl->read.order);
 	if (ctrl->write.order >= PAGE_SHIFT)
@@ -0,0 +1,398 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * xen-exitstat: profile the VM exits of an HVM domain.
+ *
+ * Enables XEN_DOMCTL_exit_stats for a domain and reports, by exit reason,
+ * how often the domain's vCPUs exit and how long Xen takes handling the
+ * exits, followed by the most expensive MSRs, I/O ports, CPUID leaves and
+ * faulting frames.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <xenctrl.h>
+#include <xen-tools/common-macros.h>
+
+static xc_interface *xch;
+static uint32_t domid;
+static unsigned int top = 20;
+static bool svm;
+
+static volatile sig_atomic_t interrupted;
+static void close_handler(int signum)
+{
+    interrupted = 1;
+}
+
+static const char *const vmx_reasons[] = {
+    [0]  = "EXCEPTION_NMI",        [1]  = "EXTERNAL_INTERRUPT",
+    [2]  = "TRIPLE_FAULT",         [3]  = "INIT",
+    [4]  = "SIPI",                 [5]  = "IO_SMI",
+    [6]  = "OTHER_SMI",            [7]  = "PENDING_VIRT_INTR",
+    [8]  = "PENDING_VIRT_NMI",     [9]  = "TASK_SWITCH",
+    [10] = "CPUID",                [11] = "GETSEC",
+    [12] = "HLT",                  [13] = "INVD",
+    [14] = "INVLPG",               [15] = "RDPMC",
+    [16] = "RDTSC",                [17] = "RSM",
+    [18] = "VMCALL",               [19] = "VMCLEAR",
+    [20] = "VMLAUNCH",             [21] = "VMPTRLD",
+    [22] = "VMPTRST",              [23] = "VMREAD",
+    [24] = "VMRESUME",             [25] = "VMWRITE",
+    [26] = "VMXOFF",               [27] = "VMXON",
+    [28] = "CR_ACCESS",            [29] = "DR_ACCESS",
+    [30] = "IO_INSTRUCTION",       [31] = "MSR_READ",
+    [32] = "MSR_WRITE",            [33] = "INVALID_GUEST_STATE",
+    [34] = "MSR_LOADING",          [36] = "MWAIT_INSTRUCTION",
+    [37] = "MONITOR_TRAP_FLAG",    [39] = "MONITOR_INSTRUCTION",
+    [40] = "PAUSE_INSTRUCTION",    [41] = "MCE_DURING_VMENTRY",
+    [43] = "TPR_BELOW_THRESHOLD",  [44] = "APIC_ACCESS",
+    [45] = "EOI_INDUCED",          [46] = "ACCESS_GDTR_OR_IDTR",
+    [47] = "ACCESS_LDTR_OR_TR",    [48] = "EPT_VIOLATION",
+    [49] = "EPT_MISCONFIG",        [50] = "INVEPT",
+    [51] = "RDTSCP",               [52] = "PREEMPTION_TIMER",
+    [53] = "INVVPID",              [54] = "WBINVD",
+    [55] = "XSETBV",               [56] = "APIC_WRITE",
+    [58] = "INVPCID",              [59] = "VMFUNC",
+    [62] = "PML_FULL",             [63] = "XSAVES",
+    [64] = "XRSTORS",              [74] = "BUS_LOCK",
+    [75] = "NOTIFY",
+};
+
+/* SVM exit codes from 0x60. */
+static const char *const svm_reasons[] = {
+    "INTR",         "NMI",          "SMI",          "INIT",
+    "VINTR",        "CR0_SEL_WRITE", "IDTR_READ",   "GDTR_READ",
+    "LDTR_READ",    "TR_READ",      "IDTR_WRITE",   "GDTR_WRITE",
+    "LDTR_WRITE",   "TR_WRITE",     "RDTSC",        "RDPMC",
+    "PUSHF",        "POPF",         "CPUID",        "RSM",
+    "IRET",         "SWINT",        "INVD",         "PAUSE",
+    "HLT",          "INVLPG",       "INVLPGA",      "IOIO",
+    "MSR",          "TASK_SWITCH",  "FERR_FREEZE",  "SHUTDOWN",
+    "VMRUN",        "VMMCALL",      "VMLOAD",       "VMSAVE",
+    "STGI",         "CLGI",         "SKINIT",       "RDTSCP",
+    "ICEBP",        "WBINVD",       "MONITOR",      "MWAIT",
+    "MWAIT_CONDITIONAL", "XSETBV",  "RDPRU",        "EFER_WRITE_TRAP",
+};
+
+static const char *reason_name(uint32_t reason)
+{
+    static char buf[32];
+    const char *name = NULL;
+
+    if ( reason == ~0U )
+        return "other";
+
+    if ( !svm )
+    {
+        if ( reason < ARRAY_SIZE(vmx_reasons) )
+            name = vmx_reasons[reason];
+    }
+    else if ( reason < 0x40 )
+    {
+        snprintf(buf, sizeof(buf), "%s%u_%s", reason & 0x20 ? "DR" : "CR",
+                 reason & 0xf, reason & 0x10 ? "WRITE" : "READ");
+        return buf;
+    }
+    else if ( reason < 0x60 )
+    {
+        snprintf(buf, sizeof(buf), "EXCEPTION_%u", reason - 0x40);
+        return buf;
+    }
+    else if ( reason - 0x60 < ARRAY_SIZE(svm_reasons) )
+        name = svm_reasons[reason - 0x60];
+    else if ( reason == 0x400 )
+        name = "NPF";
+    else if ( reason == 0x401 )
+        name = "AVIC_INCOMPLETE_IPI";
+    else if ( reason == 0x402 )
+        name = "AVIC_NOACCEL";
+
+    if ( name )
+        return name;
+
+    snprintf(buf, sizeof(buf), "%#x", reason);
+    return buf;
+}
+
+static void detail_name(const xc_exit_stats_detail_t *d, char *buf,
+                        size_t size)
+{
+    switch ( d->kind )
+    {
+    case XEN_DOMCTL_EXIT_STATS_MSR:
+        snprintf(buf, size, "MSR %#010"PRIx64" %s", d->key & 0xffffffffU,
+                 d->key >> 32 ? "write" : "read");
+        break;
+
+    case XEN_DOMCTL_EXIT_STATS_IO:
+        snprintf(buf, size, "port %#06"PRIx64" %s", d->key & 0xffff,
+                 d->key >> 32 ? "out" : "in");
+        break;
+
+    case XEN_DOMCTL_EXIT_STATS_CPUID:
+        snprintf(buf, size, "CPUID %#010"PRIx64":%"PRIx64,
+                 d->key & 0xffffffffU, d->key >> 32);
+        break;
+
+    case XEN_DOMCTL_EXIT_STATS_NPF:
+        snprintf(buf, size, "gfn %#"PRIx64, d->key);
+        break;
+
+    default:
+        snprintf(buf, size, "kind %u key %#"PRIx64, d->kind, d->key);
+        break;
+    }
+}
+
+static int cmp_reason(const void *a, const void *b)
+{
+    const xc_exit_stats_reason_t *x = a, *y = b;
+
+    return (x->cycles < y->cycles) - (x->cycles > y->cycles);
+}
+
+static int cmp_detail_key(const void *a, const void *b)
+{
+    const xc_exit_stats_detail_t *x = a, *y = b;
+
+    if ( x->kind != y->kind )
+        return x->kind - y->kind;
+    if ( x->reason != y->reason )
+        return (x->reason > y->reason) - (x->reason < y->reason);
+
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+static int cmp_detail(const void *a, const void *b)
+{
+    const xc_exit_stats_detail_t *x = a, *y = b;
+
+    return (x->cycles < y->cycles) - (x->cycles > y->cycles);
+}
+
+/* Sum up the per-vCPU entries for the same detail.  Returns the new count. */
+static unsigned int merge_details(xc_exit_stats_detail_t *d, unsigned int nr)
+{
+    unsigned int i, j = 0;
+
+    qsort(d, nr, sizeof(*d), cmp_detail_key);
+
+    for ( i = 0; i < nr; i++ )
+    {
+        if ( j && !cmp_detail_key(&d[j - 1], &d[i]) )
+        {
+            d[j - 1].count += d[i].count;
+            d[j - 1].cycles += d[i].cycles;
+        }
+        else
+            d[j++] = d[i];
+    }
+
+    return j;
+}
+
+static int show(void)
+{
+    xc_exit_stats_reason_t *reasons = NULL;
+    xc_exit_stats_detail_t *details = NULL;
+    uint32_t nr_reasons = 0, nr_details = 0, want_reasons, want_details;
+    uint64_t lost, tsc_khz, count = 0, cycles = 0;
+    unsigned int i;
+    char name[48];
+
+    /* Size the buffers first, leaving room for entries appearing meanwhile. */
+    if ( xc_domain_exit_stats_get(xch, domid, NULL, &nr_reasons, NULL,
+                                  &nr_details, NULL, NULL) )
+        return -1;
+
+    want_reasons = nr_reasons + 16;
+    want_details = nr_details + 64;
+    reasons = calloc(want_reasons, sizeof(*reasons));
+    details = calloc(want_details, sizeof(*details));
+    if ( !reasons || !details )
+        err(1, "calloc");
+
+    nr_reasons = want_reasons;
+    nr_details = want_details;
+    if ( xc_domain_exit_stats_get(xch, domid, reasons, &nr_reasons, details,
+                                  &nr_details, &lost, &tsc_khz) )
+    {
+        free(details);
+        free(reasons);
+        return -1;
+    }
+
+    nr_reasons = min(nr_reasons, want_reasons);
+    nr_details = merge_details(details, min(nr_details, want_details));
+
+    qsort(reasons, nr_reasons, sizeof(*reasons), cmp_reason);
+    qsort(details, nr_details, sizeof(*details), cmp_detail);
+
+    for ( i = 0; i < nr_reasons; i++ )
+    {
+        count += reasons[i].count;
+        cycles += reasons[i].cycles;
+    }
+
+    printf("%-24s %12s %12s %10s %6s\n",
+           "Exit reason", "Count", "Avg cycles", "Avg us", "%time");
+    for ( i = 0; i < nr_reasons; i++ )
+    {
+        const xc_exit_stats_reason_t *r = &reasons[i];
+
+        printf("%-24s %12"PRIu64" %12"PRIu64" %10.2f %6.2f\n",
+               reason_name(r->reason), r->count, r->cycles / r->count,
+               tsc_khz ? r->cycles * 1000.0 / tsc_khz / r->count : 0,
+               cycles ? r->cycles * 100.0 / cycles : 0);
+    }
+    printf("%-24s %12"PRIu64" %12"PRIu64" %10.2f\n", "Total", count,
+           count ? cycles / count : 0,
+           tsc_khz && count ? cycles * 1000.0 / tsc_khz / count : 0);
+
+    if ( nr_details )
+    {
+        printf("\n%-32s %-20s %12s %12s %10s\n",
+               "Detail", "Exit reason", "Count", "Avg cycles", "Avg us");
+        for ( i = 0; i < min(nr_details, top); i++ )
+        {
+            const xc_exit_stats_detail_t *d = &details[i];
+
+            detail_name(d, name, sizeof(name));
+            printf("%-32s %-20s %12"PRIu64" %12"PRIu64" %10.2f\n",
+                   name, reason_name(d->reason), d->count,
+                   d->cycles / d->count,
+                   tsc_khz ? d->cycles * 1000.0 / tsc_khz / d->count : 0);
+        }
+    }
+
+    if ( lost )
+        printf("\n%"PRIu64" exits not accounted by detail\n", lost);
+
+    free(details);
+    free(reasons);
+
+    return 0;
+}
+
+static bool is_svm(void)
+{
+    uint32_t eax = 0, ebx, ecx, edx;
+
+    asm volatile ( "cpuid"
+                   : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) );
+
+    /* "AuthenticAMD" or "HygonGenuine". */
+    return ebx == 0x68747541U || ebx == 0x6f677948U;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-n top] [-i interval] <command> <domid>\n"
+            "\n"
+            "Commands:\n"
+            "  enable   start profiling VM exits\n"
+            "  disable  stop profiling VM exits\n"
+            "  reset    clear the statistics\n"
+            "  show     print the statistics; with -i, clear them and\n"
+            "           print them every <interval> seconds until\n"
+            "           interrupted\n"
+            "\n"
+            "  -n top       number of details to print (default 20)\n"
+            "  -i interval  seconds between two prints of show\n",
+            prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int interval = 0;
+    const char *cmd;
+    int opt, rc = 0;
+
+    while ( (opt = getopt(argc, argv, "n:i:h")) != -1 )
+    {
+        switch ( opt )
+        {
+        case 'n':
+            top = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'i':
+            interval = strtoul(optarg, NULL, 0);
+            break;
+
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if ( argc - optind != 2 )
+        usage(argv[0]);
+
+    cmd = argv[optind];
+    domid = strtoul(argv[optind + 1], NULL, 0);
+    svm = is_svm();
+
+    xch = xc_interface_open(NULL, NULL, 0);
+    if ( !xch )
+        err(1, "xc_interface_open");
+
+    if ( !strcmp(cmd, "enable") )
+        rc = xc_domain_exit_stats_op(xch, domid, XEN_DOMCTL_EXIT_STATS_ENABLE);
+    else if ( !strcmp(cmd, "disable") )
+        rc = xc_domain_exit_stats_op(xch, domid,
+                                     XEN_DOMCTL_EXIT_STATS_DISABLE);
+    else if ( !strcmp(cmd, "reset") )
+        rc = xc_domain_exit_stats_op(xch, domid, XEN_DOMCTL_EXIT_STATS_RESET);
+    else if ( !strcmp(cmd, "show") && !interval )
+        rc = show();
+    else if ( !strcmp(cmd, "show") )
+    {
+        signal(SIGINT, close_handler);
+        signal(SIGTERM, close_handler);
+
+        while ( !interrupted && !rc )
+        {
+            rc = xc_domain_exit_stats_op(xch, domid,
+                                         XEN_DOMCTL_EXIT_STATS_RESET);
+            if ( rc )
+                break;
+
+            sleep(interval);
+            if ( interrupted )
+                break;
+
+            rc = show();
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+    else
+        usage(argv[0]);
+
+    if ( rc )
+        fprintf(stderr, "%s failed: %d - %s\n", cmd, errno, strerror(errno));
+
+    xc_interface_close(xch);
+
+    return !!rc;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
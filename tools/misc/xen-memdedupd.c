@@ -0,0 +1,577 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * xen-memdedupd: find and share identical pages between domains.
+ *
+ * Pages of the monitored domains are hashed with xxHash64 and recorded in
+ * an index.  When a page hashes to the same value as an indexed page, both
+ * are nominated for sharing, which makes them read-only, their contents are
+ * compared, and the pair is shared if they match.
+ *
+ * The first pass over a domain hashes all of its memory.  Log-dirty mode is
+ * enabled for it, and later passes only rehash the pages written since the
+ * previous one.  Hashing is rate limited, and a summary of the memory saved
+ * and of the CPU time spent is printed after each pass.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include <xenctrl.h>
+#include <xenforeignmemory.h>
+#include <xen-tools/xxhash.h>
+
+#define BATCH        256
+#define NO_ENTRY     UINT32_MAX
+#define BITS_PER_UL  (sizeof(unsigned long) * 8)
+
+struct entry {
+    uint64_t hash;
+    uint64_t handle;        /* Sharing handle, 0 if not nominated yet. */
+    xen_pfn_t gfn;
+    uint32_t next;          /* Next entry in the bucket, or free list. */
+    unsigned int dom;       /* Index into doms[]. */
+};
+
+struct dom {
+    uint32_t domid;
+    xen_pfn_t nr_pfns;
+    uint32_t *entry;        /* gfn -> index entry, or NO_ENTRY. */
+    xc_hypercall_buffer_t bitmap_hbuf;
+    bool logdirty;          /* Log-dirty mode was enabled by us. */
+    bool scanned;           /* A full pass has completed. */
+};
+
+static xc_interface *xch;
+static xenforeignmemory_handle *fh;
+
+static struct dom *doms;
+static unsigned int nr_doms;
+
+static struct entry *entries;
+static uint32_t nr_entries, free_entry = NO_ENTRY;
+static uint32_t *buckets;
+static uint32_t bucket_mask;
+
+static unsigned long rate = 25600;  /* Pages per second. */
+static unsigned int interval = 60;  /* Seconds between passes. */
+static bool oneshot, verbose;
+
+static struct {
+    uint64_t hashed, nominated, shared, mismatched;
+} stats, pass_stats;
+
+static volatile sig_atomic_t interrupted;
+static void close_handler(int signum)
+{
+    interrupted = 1;
+}
+
+static uint32_t *bucket(uint64_t hash)
+{
+    return &buckets[hash & bucket_mask];
+}
+
+static uint32_t entry_alloc(void)
+{
+    uint32_t idx = free_entry;
+
+    if ( idx != NO_ENTRY )
+    {
+        free_entry = entries[idx].next;
+        return idx;
+    }
+
+    if ( !(nr_entries & (nr_entries - 1)) )
+    {
+        struct entry *new = realloc(entries, sizeof(*entries) *
+                                    (nr_entries ? nr_entries * 2 : 1024));
+
+        if ( !new )
+            err(1, "realloc()");
+        entries = new;
+    }
+
+    return nr_entries++;
+}
+
+static void entry_insert(unsigned int d, xen_pfn_t gfn, uint64_t hash)
+{
+    uint32_t idx = entry_alloc();
+    struct entry *e = &entries[idx];
+
+    e->hash = hash;
+    e->handle = 0;
+    e->gfn = gfn;
+    e->dom = d;
+    e->next = *bucket(hash);
+    *bucket(hash) = idx;
+    doms[d].entry[gfn] = idx;
+}
+
+static void entry_remove(uint32_t idx)
+{
+    struct entry *e = &entries[idx];
+    uint32_t *p = bucket(e->hash);
+
+    while ( *p != idx )
+        p = &entries[*p].next;
+    *p = e->next;
+
+    doms[e->dom].entry[e->gfn] = NO_ENTRY;
+    e->next = free_entry;
+    free_entry = idx;
+}
+
+static int nominate(uint32_t domid, xen_pfn_t gfn, uint64_t *handle)
+{
+    if ( xc_memshr_nominate_gfn(xch, domid, gfn, handle) )
+        return -1;
+
+    pass_stats.nominated++;
+    return 0;
+}
+
+/*
+ * Compare two pages of (possibly) different domains, setting @equal.
+ * Returns 0 on success, -1 if the source page can't be mapped, and 1 if the
+ * client page can't.
+ */
+static int compare(uint32_t sdomid, xen_pfn_t sgfn,
+                   uint32_t cdomid, xen_pfn_t cgfn, bool *equal)
+{
+    void *spage, *cpage = NULL;
+    int serr, cerr = 0;
+
+    spage = xenforeignmemory_map(fh, sdomid, PROT_READ, 1, &sgfn, &serr);
+    if ( spage && !serr )
+        cpage = xenforeignmemory_map(fh, cdomid, PROT_READ, 1, &cgfn, &cerr);
+
+    if ( cpage && !cerr )
+        *equal = !memcmp(spage, cpage, XC_PAGE_SIZE);
+
+    if ( cpage )
+        xenforeignmemory_unmap(fh, cpage, 1);
+    if ( spage )
+        xenforeignmemory_unmap(fh, spage, 1);
+
+    if ( !spage || serr )
+        return -1;
+
+    return cpage && !cerr ? 0 : 1;
+}
+
+/*
+ * Try to share the client page with the page recorded in @e.  Returns 1 if
+ * the pages were shared, 0 if they differ or the client can't be shared, and
+ * -1 if @e is stale and has been removed.
+ *
+ * Nominating a page fails while it has any extra reference, so neither page
+ * may be mapped by us at that point.
+ */
+static int try_share(uint32_t idx, unsigned int d, xen_pfn_t gfn)
+{
+    struct entry *e = &entries[idx];
+    uint32_t sdomid = doms[e->dom].domid, cdomid = doms[d].domid;
+    uint64_t chandle;
+    bool equal = false;
+    int rc;
+
+    if ( !e->handle && nominate(sdomid, e->gfn, &e->handle) )
+    {
+        entry_remove(idx);
+        return -1;
+    }
+
+    if ( nominate(cdomid, gfn, &chandle) )
+        return 0;
+
+    /* Already sharing the same frame, e.g. rehashed after being shared. */
+    if ( chandle == e->handle )
+        return 1;
+
+    /*
+     * Both pages are read-only now.  The hash only says they are probably
+     * equal, so compare them before sharing.  The mappings for that are gone
+     * again before sharing, which requires no extra references either.
+     */
+    rc = compare(sdomid, e->gfn, cdomid, gfn, &equal);
+    if ( rc < 0 )
+    {
+        entry_remove(idx);
+        return -1;
+    }
+    if ( rc )
+        return 0;
+
+    if ( !equal )
+    {
+        pass_stats.mismatched++;
+        return 0;
+    }
+
+    if ( xc_memshr_share_gfns(xch, sdomid, e->gfn, e->handle,
+                              cdomid, gfn, chandle) )
+    {
+        if ( errno == -XENMEM_SHARING_OP_S_HANDLE_INVALID )
+        {
+            /* The source got written to since it was nominated. */
+            entry_remove(idx);
+            return -1;
+        }
+        return 0;
+    }
+
+    pass_stats.shared++;
+    return 1;
+}
+
+static void dedup_page(unsigned int d, xen_pfn_t gfn, uint64_t hash)
+{
+    uint32_t idx, next;
+
+    if ( doms[d].entry[gfn] != NO_ENTRY )
+        entry_remove(doms[d].entry[gfn]);
+
+    for ( idx = *bucket(hash); idx != NO_ENTRY; idx = next )
+    {
+        next = entries[idx].next;
+
+        if ( entries[idx].hash != hash ||
+             (entries[idx].dom == d && entries[idx].gfn == gfn) )
+            continue;
+
+        if ( try_share(idx, d, gfn) > 0 )
+            return;
+    }
+
+    entry_insert(d, gfn, hash);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Sleep as needed to keep hashing at no more than @rate pages per second. */
+static void throttle(uint64_t start, uint64_t pages)
+{
+    uint64_t due = start + pages * 1000000000ULL / rate, now = now_ns();
+
+    if ( due > now )
+    {
+        struct timespec ts = {
+            .tv_sec = (due - now) / 1000000000ULL,
+            .tv_nsec = (due - now) % 1000000000ULL,
+        };
+
+        nanosleep(&ts, NULL);
+    }
+}
+
+/*
+ * Hash a batch of pages, then look for matches once they are unmapped, as
+ * pages can't be nominated for sharing while we map them.
+ */
+static void dedup_batch(unsigned int d, xen_pfn_t *gfns, unsigned int nr)
+{
+    int errs[BATCH];
+    uint64_t hashes[BATCH];
+    unsigned int i;
+    uint8_t *map = xenforeignmemory_map(fh, doms[d].domid, PROT_READ, nr,
+                                        gfns, errs);
+
+    if ( !map )
+    {
+        if ( verbose )
+            warn("d%u: mapping %u pages from %#"PRI_xen_pfn,
+                 doms[d].domid, nr, gfns[0]);
+        return;
+    }
+
+    for ( i = 0; i < nr; i++ )
+        if ( !errs[i] )
+        {
+            hashes[i] = xxh64(map + i * XC_PAGE_SIZE, XC_PAGE_SIZE, 0);
+            pass_stats.hashed++;
+        }
+
+    xenforeignmemory_unmap(fh, map, nr);
+
+    for ( i = 0; i < nr; i++ )
+        if ( !errs[i] )
+            dedup_page(d, gfns[i], hashes[i]);
+}
+
+static unsigned int bitmap_pages(const struct dom *dom)
+{
+    return (dom->nr_pfns / 8 + XC_PAGE_SIZE) >> XC_PAGE_SHIFT;
+}
+
+static int dom_setup(struct dom *dom)
+{
+    DECLARE_HYPERCALL_BUFFER_SHADOW(unsigned long, bitmap, &dom->bitmap_hbuf);
+    xen_pfn_t max_gpfn;
+    xen_pfn_t i;
+
+    if ( xc_domain_maximum_gpfn(xch, dom->domid, &max_gpfn) < 0 )
+    {
+        warn("d%u: getting maximum gpfn", dom->domid);
+        return -1;
+    }
+    dom->nr_pfns = max_gpfn + 1;
+
+    dom->entry = malloc(dom->nr_pfns * sizeof(*dom->entry));
+    if ( !dom->entry )
+        err(1, "malloc()");
+    for ( i = 0; i < dom->nr_pfns; i++ )
+        dom->entry[i] = NO_ENTRY;
+
+    if ( xc_memshr_control(xch, dom->domid, 1) )
+    {
+        warn("d%u: enabling sharing", dom->domid);
+        return -1;
+    }
+
+    /*
+     * Without log-dirty mode (e.g. because something else, like a live
+     * migration, uses it), every pass rehashes the whole domain.
+     */
+    if ( xc_shadow_control(xch, dom->domid,
+                           XEN_DOMCTL_SHADOW_OP_ENABLE_LOGDIRTY, NULL, 0) )
+    {
+        warn("d%u: enabling log-dirty mode, falling back to full rescans",
+             dom->domid);
+        return 0;
+    }
+
+    bitmap = xc_hypercall_buffer_alloc_pages(xch, bitmap, bitmap_pages(dom));
+    if ( !bitmap )
+        err(1, "allocating dirty bitmap");
+
+    dom->logdirty = true;
+
+    return 0;
+}
+
+static void dom_teardown(struct dom *dom)
+{
+    DECLARE_HYPERCALL_BUFFER_SHADOW(unsigned long, bitmap, &dom->bitmap_hbuf);
+
+    if ( !dom->logdirty )
+        return;
+
+    xc_shadow_control(xch, dom->domid, XEN_DOMCTL_SHADOW_OP_OFF, NULL, 0);
+    xc_hypercall_buffer_free_pages(xch, bitmap, bitmap_pages(dom));
+}
+
+static void dom_pass(unsigned int d, uint64_t start, uint64_t *pages)
+{
+    struct dom *dom = &doms[d];
+    DECLARE_HYPERCALL_BUFFER_SHADOW(unsigned long, bitmap, &dom->bitmap_hbuf);
+    xen_pfn_t gfns[BATCH], gfn;
+    unsigned int nr = 0;
+    bool full = !dom->scanned || !dom->logdirty;
+
+    /*
+     * Retrieve and clear the pages dirtied so far.  Pages written during the
+     * pass will be picked up by the next one.
+     */
+    if ( dom->logdirty &&
+         xc_logdirty_control(xch, dom->domid, XEN_DOMCTL_SHADOW_OP_CLEAN,
+                             HYPERCALL_BUFFER(bitmap), dom->nr_pfns,
+                             0, NULL) != dom->nr_pfns )
+    {
+        warn("d%u: retrieving dirty bitmap", dom->domid);
+        full = true;
+    }
+
+    for ( gfn = 0; gfn < dom->nr_pfns && !interrupted; gfn++ )
+    {
+        if ( !full && !(bitmap[gfn / BITS_PER_UL] & (1UL << (gfn % BITS_PER_UL))) )
+            continue;
+
+        gfns[nr++] = gfn;
+        if ( nr == BATCH )
+        {
+            dedup_batch(d, gfns, nr);
+            *pages += nr;
+            nr = 0;
+            throttle(start, *pages);
+        }
+    }
+
+    if ( nr )
+    {
+        dedup_batch(d, gfns, nr);
+        *pages += nr;
+    }
+
+    if ( !interrupted )
+        dom->scanned = true;
+}
+
+static double cpu_seconds(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static void report(uint64_t wall_ns, double cpu)
+{
+    long freed = xc_sharing_freed_pages(xch);
+
+    stats.hashed += pass_stats.hashed;
+    stats.nominated += pass_stats.nominated;
+    stats.shared += pass_stats.shared;
+    stats.mismatched += pass_stats.mismatched;
+
+    printf("pass: hashed %"PRIu64" pages, shared %"PRIu64
+           ", hash collisions %"PRIu64", %.2fs CPU in %.2fs (%.1f%%)\n",
+           pass_stats.hashed, pass_stats.shared, pass_stats.mismatched,
+           cpu, wall_ns / 1e9, wall_ns ? cpu * 1e11 / wall_ns : 0.0);
+    printf("total: hashed %"PRIu64" pages, shared %"PRIu64
+           ", indexed %"PRIu32", saved %ld MiB system-wide\n",
+           stats.hashed, stats.shared, nr_entries,
+           freed < 0 ? -1 : freed >> (20 - XC_PAGE_SHIFT));
+    fflush(stdout);
+
+    memset(&pass_stats, 0, sizeof(pass_stats));
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <domid>...\n"
+            "Share identical pages between domains.\n\n"
+            "Options:\n"
+            "  -r <pages>  Hash at most <pages> pages per second (default %lu)\n"
+            "  -i <secs>   Rescan dirtied pages every <secs> seconds (default %u)\n"
+            "  -o          Stop after the first pass\n"
+            "  -v          Verbose\n",
+            prog, rate, interval);
+}
+
+int main(int argc, char **argv)
+{
+    struct sigaction act = { .sa_handler = close_handler };
+    xen_pfn_t total_pfns = 0;
+    unsigned int i, nr_buckets;
+    int opt, rc = 1;
+
+    while ( (opt = getopt(argc, argv, "r:i:ovh")) != -1 )
+    {
+        switch ( opt )
+        {
+        case 'r':
+            rate = strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            interval = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            oneshot = true;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt != 'h';
+        }
+    }
+
+    if ( optind == argc || !rate )
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    sigemptyset(&act.sa_mask);
+    sigaction(SIGHUP,  &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+    sigaction(SIGINT,  &act, NULL);
+
+    xch = xc_interface_open(NULL, NULL, 0);
+    if ( !xch )
+        err(1, "xc_interface_open()");
+    fh = xenforeignmemory_open(NULL, 0);
+    if ( !fh )
+        err(1, "xenforeignmemory_open()");
+
+    nr_doms = argc - optind;
+    doms = calloc(nr_doms, sizeof(*doms));
+    if ( !doms )
+        err(1, "calloc()");
+
+    for ( i = 0; i < nr_doms; i++ )
+    {
+        doms[i].domid = strtoul(argv[optind + i], NULL, 0);
+        if ( dom_setup(&doms[i]) )
+            goto out;
+        total_pfns += doms[i].nr_pfns;
+    }
+
+    /* Size the index for about one entry per bucket. */
+    for ( nr_buckets = 1024; nr_buckets < total_pfns && nr_buckets < (1U << 31);
+          nr_buckets <<= 1 )
+        ;
+    buckets = malloc(nr_buckets * sizeof(*buckets));
+    if ( !buckets )
+        err(1, "malloc()");
+    memset(buckets, 0xff, nr_buckets * sizeof(*buckets));
+    bucket_mask = nr_buckets - 1;
+
+    while ( !interrupted )
+    {
+        uint64_t start = now_ns(), pages = 0;
+        double cpu = cpu_seconds();
+
+        for ( i = 0; i < nr_doms && !interrupted; i++ )
+            dom_pass(i, start, &pages);
+
+        report(now_ns() - start, cpu_seconds() - cpu);
+
+        if ( oneshot )
+            break;
+
+        sleep(interval);
+    }
+
+    rc = 0;
+
+ out:
+    for ( i = 0; i < nr_doms; i++ )
+        dom_teardown(&doms[i]);
+
+    xenforeignmemory_close(fh);
+    xc_interface_close(xch);
+
+    return rc;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
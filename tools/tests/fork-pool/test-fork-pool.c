@@ -0,0 +1,268 @@
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include <xenctrl.h>
+#include <xenforeignmemory.h>
+#include <xen-tools/common-macros.h>
+
+#define NR_FORKS       16
+#define NR_PAGES       256  /* Parent's memory. */
+#define NR_DIRTY       64   /* Pages written by each fork between resets. */
+
+static unsigned int nr_failures;
+#define fail(fmt, ...)                          \
+({                                              \
+    nr_failures++;                              \
+    (void)printf(fmt, ##__VA_ARGS__);           \
+})
+
+static xc_interface *xch;
+static xenforeignmemory_handle *fh;
+static uint32_t parent = DOMID_INVALID;
+static uint32_t forks[NR_FORKS];
+static xen_pfn_t gfns[NR_PAGES];
+
+static struct xen_domctl_createdomain create = {
+    .flags = XEN_DOMCTL_CDF_hvm | XEN_DOMCTL_CDF_hap,
+    .max_vcpus = 1,
+    .max_grant_frames = 1,
+    .grant_opts = XEN_DOMCTL_GRANT_version(1),
+
+    .arch = {
+#if defined(__x86_64__) || defined(__i386__)
+        .emulation_flags = XEN_X86_EMU_LAPIC,
+#endif
+    },
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Map nr pages of a domain, starting at gfn 0. */
+static uint8_t *map(uint32_t domid, int prot, unsigned int nr)
+{
+    int errs[NR_PAGES];
+    unsigned int i;
+    uint8_t *p = xenforeignmemory_map(fh, domid, prot, nr, gfns, errs);
+
+    if ( !p )
+        return NULL;
+
+    for ( i = 0; i < nr; i++ )
+        if ( errs[i] )
+        {
+            xenforeignmemory_unmap(fh, p, nr);
+            errno = -errs[i];
+            return NULL;
+        }
+
+    return p;
+}
+
+static void setup_parent(void)
+{
+    unsigned int i;
+    uint8_t *p;
+
+    if ( xc_domain_setmaxmem(xch, parent, -1) )
+        return fail("  Fail: setmaxmem: %d - %s\n", errno, strerror(errno));
+
+    if ( xc_domain_populate_physmap_exact(xch, parent, NR_PAGES, 0, 0, gfns) )
+        return fail("  Fail: populate physmap: %d - %s\n",
+                    errno, strerror(errno));
+
+    p = map(parent, PROT_READ | PROT_WRITE, NR_PAGES);
+    if ( !p )
+        return fail("  Fail: map parent: %d - %s\n", errno, strerror(errno));
+
+    for ( i = 0; i < NR_PAGES; i++ )
+        memset(p + i * XC_PAGE_SIZE, i, XC_PAGE_SIZE);
+
+    xenforeignmemory_unmap(fh, p, NR_PAGES);
+}
+
+/* Write to the first NR_DIRTY pages of every fork, forcing private copies. */
+static void dirty_forks(void)
+{
+    unsigned int i;
+
+    for ( i = 0; i < NR_FORKS; i++ )
+    {
+        uint8_t *p = map(forks[i], PROT_READ | PROT_WRITE, NR_DIRTY);
+
+        if ( !p )
+            return fail("  Fail: map d%u: %d - %s\n",
+                        forks[i], errno, strerror(errno));
+
+        memset(p, 0xff, NR_DIRTY * XC_PAGE_SIZE);
+        xenforeignmemory_unmap(fh, p, NR_DIRTY);
+    }
+}
+
+/* Check that all forks see the parent's memory again. */
+static void check_forks(void)
+{
+    unsigned int i, j;
+
+    for ( i = 0; i < NR_FORKS; i++ )
+    {
+        uint8_t *p = map(forks[i], PROT_READ, NR_DIRTY);
+
+        if ( !p )
+            return fail("  Fail: map d%u: %d - %s\n",
+                        forks[i], errno, strerror(errno));
+
+        for ( j = 0; j < NR_DIRTY; j++ )
+            if ( p[j * XC_PAGE_SIZE] != (uint8_t)j )
+            {
+                fail("  Fail: d%u gfn %u not reset: %#x\n",
+                     forks[i], j, p[j * XC_PAGE_SIZE]);
+                break;
+            }
+
+        xenforeignmemory_unmap(fh, p, NR_DIRTY);
+    }
+}
+
+static void run_tests(void)
+{
+    uint64_t start, ns;
+    unsigned int i;
+
+    setup_parent();
+    if ( nr_failures )
+        return;
+
+    printf("Test fork pool creation\n");
+
+    start = now_ns();
+    if ( xc_memshr_fork_pool(xch, parent, &create, false, true,
+                             forks, NR_FORKS) )
+    {
+        for ( i = 0; i < NR_FORKS; i++ )
+            forks[i] = DOMID_INVALID;
+
+        if ( errno == EOPNOTSUPP || errno == ENOSYS )
+            printf("  Skip: %d - %s\n", errno, strerror(errno));
+        else
+            fail("  Fail: fork pool: %d - %s\n", errno, strerror(errno));
+        return;
+    }
+    ns = now_ns() - start;
+
+    printf("  %u forks in %"PRIu64"us, %"PRIu64" forks/s\n",
+           NR_FORKS, ns / 1000, NR_FORKS * UINT64_C(1000000000) / (ns ?: 1));
+
+    printf("Test individual resets\n");
+
+    dirty_forks();
+    if ( nr_failures )
+        return;
+
+    start = now_ns();
+    for ( i = 0; i < NR_FORKS; i++ )
+        if ( xc_memshr_fork_reset(xch, forks[i], false, true) )
+            return fail("  Fail: reset d%u: %d - %s\n",
+                        forks[i], errno, strerror(errno));
+    ns = now_ns() - start;
+
+    printf("  %u pages per fork, %"PRIu64"us per reset\n",
+           NR_DIRTY, ns / 1000 / NR_FORKS);
+
+    check_forks();
+    if ( nr_failures )
+        return;
+
+    printf("Test batched reset\n");
+
+    dirty_forks();
+    if ( nr_failures )
+        return;
+
+    start = now_ns();
+    if ( xc_memshr_fork_reset_multi(xch, parent, forks, NR_FORKS,
+                                    false, true) )
+        return fail("  Fail: batched reset: %d - %s\n",
+                    errno, strerror(errno));
+    ns = now_ns() - start;
+
+    printf("  %u pages per fork, %"PRIu64"us per reset\n",
+           NR_DIRTY, ns / 1000 / NR_FORKS);
+
+    check_forks();
+
+    printf("Test batched reset rejects foreign domains\n");
+
+    if ( !xc_memshr_fork_reset_multi(xch, parent, &parent, 1, false, true) ||
+         errno != EINVAL )
+        fail("  Fail: expected -1/EINVAL, got %d - %s\n",
+             errno, strerror(errno));
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int i;
+    int rc;
+
+    printf("Fork pool tests\n");
+
+    for ( i = 0; i < NR_PAGES; i++ )
+        gfns[i] = i;
+    for ( i = 0; i < NR_FORKS; i++ )
+        forks[i] = DOMID_INVALID;
+
+    xch = xc_interface_open(NULL, NULL, 0);
+    if ( !xch )
+        err(1, "xc_interface_open");
+
+    fh = xenforeignmemory_open(NULL, 0);
+    if ( !fh )
+        err(1, "xenforeignmemory_open");
+
+    rc = xc_domain_create(xch, &parent, &create);
+    if ( rc )
+    {
+        if ( errno == EINVAL || errno == EOPNOTSUPP )
+            printf("  Skip: %d - %s\n", errno, strerror(errno));
+        else
+            fail("  Domain create failure: %d - %s\n",
+                 errno, strerror(errno));
+        goto out;
+    }
+
+    printf("  Created d%u\n", parent);
+
+    run_tests();
+
+    for ( i = 0; i < NR_FORKS; i++ )
+        if ( forks[i] != DOMID_INVALID && xc_domain_destroy(xch, forks[i]) )
+            fail("  Failed to destroy fork: %d - %s\n",
+                 errno, strerror(errno));
+
+    rc = xc_domain_destroy(xch, parent);
+    if ( rc )
+        fail("  Failed to destroy domain: %d - %s\n",
+             errno, strerror(errno));
+ out:
+    return !!nr_failures;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
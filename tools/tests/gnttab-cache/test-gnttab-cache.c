@@ -0,0 +1,228 @@
+/*
+ * Unit tests for libxengnttab's grant cache.
+ *
+ * Grant mappings are emulated with plain allocations, checking that the
+ * cache only ever unmaps whole regions, as the grant devices require.
+ */
+#include <stdio.h>
+
+/* The code under test is static in places, so include it whole. */
+#include "gnttab_cache.c"
+
+#define DOMID          1
+#define MAX_MAPS       16
+
+static unsigned int nr_failures;
+#define fail(fmt, ...)                          \
+({                                              \
+    nr_failures++;                              \
+    (void)printf(fmt, ##__VA_ARGS__);           \
+})
+
+static struct {
+    void *addr;
+    uint32_t count;
+} maps[MAX_MAPS];
+
+void *xengnttab_map_domain_grant_refs(xengnttab_handle *xgt,
+                                      uint32_t count, uint32_t domid,
+                                      uint32_t *refs, int prot)
+{
+    unsigned int i;
+
+    for ( i = 0; i < MAX_MAPS; i++ )
+        if ( !maps[i].addr )
+        {
+            maps[i].addr = calloc(count, XC_PAGE_SIZE);
+            maps[i].count = count;
+            return maps[i].addr;
+        }
+
+    errno = ENOMEM;
+    return NULL;
+}
+
+int xengnttab_unmap(xengnttab_handle *xgt, void *start_address,
+                    uint32_t count)
+{
+    unsigned int i;
+
+    for ( i = 0; i < MAX_MAPS; i++ )
+        if ( maps[i].addr == start_address )
+        {
+            if ( maps[i].count != count )
+                fail("  unmapped %u of a region of %u pages\n",
+                     count, maps[i].count);
+            free(maps[i].addr);
+            maps[i].addr = NULL;
+            return 0;
+        }
+
+    fail("  unmapped %p, not a region\n", start_address);
+    errno = EINVAL;
+    return -1;
+}
+
+static void *get(xengnttab_cache *cache, uint32_t ref)
+{
+    void *addr = NULL;
+
+    if ( xengnttab_cache_get(cache, DOMID, 1, &ref, &addr) )
+        fail("  get of ref %u failed: %d\n", ref, errno);
+
+    return addr;
+}
+
+static void put(xengnttab_cache *cache, void *addr)
+{
+    if ( xengnttab_cache_put(cache, 1, &addr) )
+        fail("  put of %p failed: %d\n", addr, errno);
+}
+
+/* Map refs as a single region, leaving them unpinned. */
+static void add(xengnttab_cache *cache, uint32_t count, uint32_t *refs)
+{
+    void *addrs[8];
+
+    if ( xengnttab_cache_get(cache, DOMID, count, refs, addrs) ||
+         xengnttab_cache_put(cache, count, addrs) )
+        fail("  adding %u refs failed: %d\n", count, errno);
+}
+
+static void expect_stats(xengnttab_cache *cache, uint64_t hits,
+                         uint64_t misses, uint64_t evictions,
+                         uint32_t mapped_pages)
+{
+    xengnttab_cache_stats stats;
+
+    xengnttab_cache_get_stats(cache, &stats);
+    if ( stats.hits != hits || stats.misses != misses ||
+         stats.evictions != evictions || stats.mapped_pages != mapped_pages )
+        fail("  expected %u/%u/%u/%u hits/misses/evictions/pages, "
+             "got %u/%u/%u/%u\n",
+             (unsigned int)hits, (unsigned int)misses,
+             (unsigned int)evictions, mapped_pages,
+             (unsigned int)stats.hits, (unsigned int)stats.misses,
+             (unsigned int)stats.evictions, stats.mapped_pages);
+}
+
+static void test_hit_miss(void)
+{
+    xengnttab_cache *cache = xengnttab_cache_create(NULL, 8, 0);
+    uint32_t refs[] = { 1, 2, 3 };
+    void *addrs[3], *addr;
+
+    printf("Testing hits and misses\n");
+
+    if ( xengnttab_cache_get(cache, DOMID, 3, refs, addrs) )
+        fail("  get failed: %d\n", errno);
+    expect_stats(cache, 0, 3, 0, 3);
+
+    /* A pinned entry hits too. */
+    addr = get(cache, 2);
+    if ( addr != addrs[1] )
+        fail("  ref 2 at %p, expected %p\n", addr, addrs[1]);
+    expect_stats(cache, 1, 3, 0, 3);
+
+    put(cache, addr);
+    if ( xengnttab_cache_put(cache, 3, addrs) )
+        fail("  put failed: %d\n", errno);
+    if ( !xengnttab_cache_put(cache, 1, addrs) || errno != EINVAL )
+        fail("  put of an unpinned entry succeeded\n");
+
+    addr = get(cache, 3);
+    if ( addr != addrs[2] )
+        fail("  ref 3 at %p, expected %p\n", addr, addrs[2]);
+    put(cache, addr);
+    expect_stats(cache, 2, 3, 0, 3);
+
+    xengnttab_cache_destroy(cache);
+}
+
+static void test_evict(void)
+{
+    xengnttab_cache *cache = xengnttab_cache_create(NULL, 4, 0);
+    uint32_t a[] = { 1, 2 }, b[] = { 3, 4 }, c[] = { 6, 7, 8 };
+    void *addr, *addrs[3];
+
+    printf("Testing eviction\n");
+
+    add(cache, 2, a);
+    add(cache, 2, b);
+    expect_stats(cache, 0, 4, 0, 4);
+
+    /* Evicting ref 2 alone would free no page: all of b goes instead. */
+    addr = get(cache, 1);
+    put(cache, get(cache, 5));
+    expect_stats(cache, 1, 5, 2, 3);
+
+    /* Region a can't be unmapped while ref 1 is pinned. */
+    if ( xengnttab_cache_get(cache, DOMID, 3, c, addrs) != -1 ||
+         errno != ENOSPC )
+        fail("  get of 3 refs didn't fail with ENOSPC\n");
+    expect_stats(cache, 1, 8, 2, 3);
+
+    /* It can once ref 1 is unpinned, and goes before the more recent 5. */
+    put(cache, addr);
+    add(cache, 3, c);
+    expect_stats(cache, 1, 11, 4, 4);
+
+    put(cache, get(cache, 5));
+    put(cache, get(cache, 6));
+    expect_stats(cache, 3, 11, 4, 4);
+
+    xengnttab_cache_destroy(cache);
+}
+
+static void test_invalidate(void)
+{
+    xengnttab_cache *cache = xengnttab_cache_create(NULL, 4, 0);
+    uint32_t a[] = { 1, 2 };
+    void *addr;
+
+    printf("Testing invalidation\n");
+
+    add(cache, 2, a);
+    addr = get(cache, 1);
+    xengnttab_cache_invalidate(cache, DOMID);
+
+    /* The region stays mapped until the last pin of ref 1 goes. */
+    expect_stats(cache, 1, 2, 0, 2);
+    put(cache, addr);
+    expect_stats(cache, 1, 2, 0, 0);
+
+    put(cache, get(cache, 1));
+    expect_stats(cache, 1, 3, 0, 1);
+
+    xengnttab_cache_destroy(cache);
+}
+
+int main(void)
+{
+    unsigned int i;
+
+    test_hit_miss();
+    test_evict();
+    test_invalidate();
+
+    for ( i = 0; i < MAX_MAPS; i++ )
+        if ( maps[i].addr )
+            fail("Region of %u pages left mapped\n", maps[i].count);
+
+    if ( nr_failures )
+        printf("Done: %u failures\n", nr_failures);
+    else
+        printf("Done: all ok\n");
+
+    return !!nr_failures;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,89 @@
+/*
+ * Unit tests for the grant table's maptrack free lists.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms and conditions of the GNU General Public
+ * License, version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_MAPTRACK_
+#define _TEST_MAPTRACK_
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <xen-tools/common-macros.h>
+
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#define ASSERT(x) assert(x)
+
+typedef bool spinlock_t;
+#define spin_lock(l) (assert(!*(l)), *(l) = true)
+#define spin_unlock(l) (assert(*(l)), *(l) = false)
+
+#define arch_fetch_and_add(p, x) __atomic_fetch_add(p, x, __ATOMIC_RELAXED)
+
+#define PAGE_SIZE 4096
+
+typedef uint32_t grant_ref_t;
+typedef uint16_t domid_t;
+typedef unsigned int grant_handle_t;
+
+struct grant_mapping {
+    grant_ref_t ref;
+    uint16_t flags;
+    domid_t  domid;
+    uint32_t vcpu;
+    uint32_t pad;
+};
+
+struct grant_table {
+    unsigned int maptrack_limit;
+    struct grant_mapping **maptrack;
+};
+
+#define MAPTRACK_PER_PAGE (PAGE_SIZE / sizeof(struct grant_mapping))
+#define maptrack_entry(t, e) \
+    ((t)->maptrack[(e) / MAPTRACK_PER_PAGE][(e) % MAPTRACK_PER_PAGE])
+#define MAPTRACK_TAIL (~0u)
+
+struct vcpu {
+    unsigned int vcpu_id;
+    struct domain *domain;
+    spinlock_t maptrack_freelist_lock;
+    unsigned int maptrack_head;
+    unsigned int maptrack_tail;
+    unsigned int maptrack_steal;
+};
+
+struct domain {
+    unsigned int max_vcpus;
+    struct vcpu **vcpu;
+};
+
+extern struct vcpu *current;
+
+#define get_random() ((unsigned int)rand())
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,163 @@
+/*
+ * Unit tests for the grant table's maptrack free lists.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms and conditions of the GNU General Public
+ * License, version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "emul.h"
+
+/* The code under test is static, so include it whole. */
+#include "maptrack.c"
+
+#define NR_VCPUS 2
+
+/*
+ * One domain with NR_VCPUS vCPUs, already at its maptrack frame limit of a
+ * single frame.
+ */
+static struct grant_mapping frame[MAPTRACK_PER_PAGE];
+static struct grant_mapping *frames[] = { frame };
+static struct grant_table gt = {
+    .maptrack_limit = MAPTRACK_PER_PAGE,
+    .maptrack = frames,
+};
+
+static struct vcpu vcpus[NR_VCPUS];
+static struct vcpu *vcpu_ptrs[NR_VCPUS];
+static struct domain d = {
+    .max_vcpus = NR_VCPUS,
+    .vcpu = vcpu_ptrs,
+};
+
+struct vcpu *current;
+
+static bool taken[MAPTRACK_PER_PAGE];
+
+#define EXPECT(expr)                                                    \
+do {                                                                    \
+    if ( !(expr) )                                                      \
+    {                                                                   \
+        fprintf(stderr, "%s:%d: check failed: %s\n",                    \
+                __FILE__, __LINE__, #expr);                             \
+        abort();                                                        \
+    }                                                                   \
+} while ( 0 )
+
+/* All of the frame on v's free list, as after its allocation by v. */
+static void setup(struct vcpu *v)
+{
+    unsigned int i;
+
+    for ( i = 0; i < NR_VCPUS; i++ )
+    {
+        vcpus[i].vcpu_id = i;
+        vcpus[i].domain = &d;
+        vcpus[i].maptrack_head = MAPTRACK_TAIL;
+        vcpus[i].maptrack_tail = MAPTRACK_TAIL;
+        vcpus[i].maptrack_steal = 1;
+        vcpu_ptrs[i] = &vcpus[i];
+    }
+
+    for ( i = 0; i < MAPTRACK_PER_PAGE; i++ )
+    {
+        frame[i].ref = i + 1;
+        frame[i].vcpu = v->vcpu_id;
+        taken[i] = false;
+    }
+    frame[MAPTRACK_PER_PAGE - 1].ref = MAPTRACK_TAIL;
+    v->maptrack_head = 0;
+    v->maptrack_tail = MAPTRACK_PER_PAGE - 1;
+}
+
+/* The slow path of get_maptrack_handle(), with no more frames to add. */
+static grant_handle_t get_handle(struct vcpu *v)
+{
+    grant_handle_t handle;
+
+    current = v;
+
+    handle = _get_maptrack_handle(&gt, v);
+    if ( handle == INVALID_MAPTRACK_HANDLE )
+        handle = steal_maptrack_handle(&gt, v);
+
+    if ( handle != INVALID_MAPTRACK_HANDLE )
+    {
+        EXPECT(handle < MAPTRACK_PER_PAGE);
+        EXPECT(!taken[handle]);
+        EXPECT(frame[handle].vcpu == v->vcpu_id);
+        taken[handle] = true;
+    }
+
+    return handle;
+}
+
+static void put_handle(struct vcpu *v, grant_handle_t handle)
+{
+    current = v;
+
+    EXPECT(taken[handle]);
+    taken[handle] = false;
+    put_maptrack_handle(&gt, handle);
+}
+
+/* Get handles on v until there are none left, returning how many. */
+static unsigned int drain(struct vcpu *v)
+{
+    unsigned int n = 0;
+
+    while ( get_handle(v) != INVALID_MAPTRACK_HANDLE )
+        n++;
+
+    return n;
+}
+
+int main(void)
+{
+    unsigned int i, n;
+
+    /*
+     * A vCPU with no free list at all needs to steal an extra entry as the
+     * tail sentinel of its list, but must get a handle on its first steal.
+     */
+    setup(&vcpus[1]);
+    EXPECT(get_handle(&vcpus[0]) != INVALID_MAPTRACK_HANDLE);
+
+    /*
+     * It can keep stealing all the entries but the victim's tail sentinel
+     * and its own.
+     */
+    setup(&vcpus[1]);
+    n = drain(&vcpus[0]);
+    EXPECT(n == MAPTRACK_PER_PAGE - 2);
+    EXPECT(vcpus[0].maptrack_steal > 1);
+
+    /* Entries freed go back to their new owner, and can be stolen back. */
+    for ( i = 0; i < MAPTRACK_PER_PAGE; i++ )
+        if ( taken[i] )
+            put_handle(&vcpus[0], i);
+    EXPECT(drain(&vcpus[1]) == MAPTRACK_PER_PAGE - 2);
+    EXPECT(drain(&vcpus[0]) == 0);
+
+    printf("All tests passed.\n");
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
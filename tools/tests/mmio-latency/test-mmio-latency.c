@@ -0,0 +1,165 @@
+/*
+ * MMIO exit latency microbenchmark.
+ *
+ * Maps the HPET through /dev/mem and times single accesses to it, each of
+ * which is a VM exit handled by Xen's HPET emulation.  Loads and stores by
+ * plain MOVs are eligible for the hypervisor's MMIO fast path, while other
+ * insns accessing memory always take the full instruction emulator, so
+ * comparing the two gives the cost of full emulation.  Reads are of the main
+ * counter, writes are to the read-only capabilities register and hence get
+ * discarded.
+ *
+ * Needs to run as root in an HVM (with hpet=1) or PVH domain, for the HPET
+ * to be emulated.  The fast path can be turned off at runtime by
+ * "xl set-parameters hvm-mmio-fast=0", and its hits are counted by the
+ * "hvm mmio fast path" performance counter.
+ */
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <xen-tools/common-macros.h>
+
+#define HPET_BASE      0xfed00000UL
+#define HPET_ID        0x000
+#define HPET_COUNTER   0x0f0
+#define PAGE_SIZE      4096
+#define NR_ACCESSES    (1U << 16)
+#define NS_PER_SEC     UINT64_C(1000000000)
+
+static unsigned int nr_failures;
+#define fail(fmt, ...)                          \
+({                                              \
+    nr_failures++;                              \
+    (void)printf(fmt, ##__VA_ARGS__);           \
+})
+
+static volatile uint32_t *hpet;
+static uint64_t lat[NR_ACCESSES];
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static void mov_load(void)
+{
+    uint32_t val;
+
+    asm volatile ( "mov %1, %0" : "=r" (val) : "m" (hpet[HPET_COUNTER / 4]) );
+}
+
+static void mov_store(void)
+{
+    asm volatile ( "movl %1, %0" : "=m" (hpet[HPET_ID / 4]) : "r" (0) );
+}
+
+static void cmp_load(void)
+{
+    asm volatile ( "cmp %0, %1" :: "m" (hpet[HPET_COUNTER / 4]), "r" (0)
+                   : "cc" );
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void bench(const char *name, void (*access)(void))
+{
+    unsigned int i;
+    uint64_t t, total = 0;
+
+    for ( i = 0; i < NR_ACCESSES; i++ )
+    {
+        t = now_ns();
+        access();
+        lat[i] = now_ns() - t;
+        total += lat[i];
+    }
+
+    qsort(lat, NR_ACCESSES, sizeof(*lat), cmp_u64);
+
+    printf("  %-10s avg %6"PRIu64" ns, p50 %6"PRIu64" ns, p99 %6"PRIu64
+           " ns per access\n", name, total / NR_ACCESSES,
+           lat[NR_ACCESSES / 2], lat[NR_ACCESSES * 99 / 100]);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        void (*access)(void);
+    } tests[] = {
+        { "mov load",  mov_load },
+        { "mov store", mov_store },
+        { "cmp load",  cmp_load },
+    };
+    unsigned long base = HPET_BASE;
+    uint32_t id;
+    unsigned int i;
+    int fd;
+
+    printf("MMIO exit latency tests\n");
+
+    if ( argc > 1 )
+        base = strtoul(argv[1], NULL, 0);
+
+    fd = open("/dev/mem", O_RDWR | O_SYNC);
+    if ( fd < 0 )
+    {
+        printf("  Skip: no /dev/mem: %d - %s\n", errno, strerror(errno));
+        return 0;
+    }
+
+    hpet = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, base);
+    close(fd);
+    if ( hpet == MAP_FAILED )
+    {
+        printf("  Skip: can't map %#lx: %d - %s\n", base, errno,
+               strerror(errno));
+        return 0;
+    }
+
+    /* Vendor ID in the top half, revision in the low byte. */
+    id = hpet[HPET_ID / 4];
+    if ( !(id >> 16) || id == ~0U || !(id & 0xff) )
+    {
+        printf("  Skip: no HPET at %#lx (id %#x)\n", base, id);
+        goto out;
+    }
+
+    for ( i = 0; i < ARRAY_SIZE(tests); i++ )
+        bench(tests[i].name, tests[i].access);
+
+    if ( hpet[HPET_ID / 4] != id )
+        fail("  Fail: HPET id changed from %#x to %#x\n",
+             id, hpet[HPET_ID / 4]);
+
+ out:
+    munmap((void *)hpet, PAGE_SIZE);
+
+    return !!nr_failures;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <stdio.h>
+#include <time.h>
 #include <sys/mman.h>
 
 asm ( ".pushsection .test, \"ax\", @progbits; .popsection" );
@@ -897,6 +898,65 @@ static const struct {
 };
 #endif
 
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Emulate a loop summing up an array, like a driver polling MMIO registers
+ * would execute the same few instructions over and over.  Returns the
+ * number of instructions emulated, or 0 on failure.
+ */
+static unsigned long decode_cache_loop(char *instr, unsigned int *res,
+                                       struct x86_emulate_ctxt *ctxt,
+                                       struct x86_decode_cache *cache)
+{
+    static const uint8_t loop[] = {
+        0x8b, 0x0c, 0x98,               /* mov (%eax,%ebx,4),%ecx */
+        0x01, 0xca,                     /* add %ecx,%edx */
+        0x83, 0xc3, 0x01,               /* add $1,%ebx */
+        0x81, 0xfb, 0x00, 0x04, 0, 0,   /* cmp $0x400,%ebx */
+        0x72, 0xf0,                     /* jb .-16 */
+    };
+    struct cpu_user_regs *regs = ctxt->regs;
+    unsigned long nr = 0;
+    unsigned int i, sum = 0;
+    int rc = X86EMUL_OKAY;
+
+    memcpy(instr, loop, sizeof(loop));
+    for ( i = 0; i < 0x400; i++ )
+        sum += res[i];
+
+    memset(regs, 0, sizeof(*regs));
+    regs->eflags = 0x200;
+    regs->eip    = (unsigned long)instr;
+    regs->eax    = (unsigned long)res;
+
+    ctxt->decode_cache = cache;
+    ctxt->insn_bytes_len = MAX_INST_LEN;
+
+    while ( regs->eip != (unsigned long)instr + sizeof(loop) )
+    {
+        ctxt->insn_bytes = (const void *)(unsigned long)regs->eip;
+        rc = x86_emulate(ctxt, &emulops);
+        if ( rc != X86EMUL_OKAY )
+            break;
+        nr++;
+    }
+
+    ctxt->decode_cache = NULL;
+    ctxt->insn_bytes_len = 0;
+
+    if ( rc != X86EMUL_OKAY || regs->ebx != 0x400 || regs->edx != sum )
+        return 0;
+
+    return nr;
+}
+
 int main(int argc, char **argv)
 {
     struct x86_emulate_ctxt ctxt;
@@ -917,6 +977,8 @@ int main(int argc, char **argv)
     ctxt.regs = &regs;
     ctxt.force_writeback = 0;
     ctxt.cpu_policy = &cpu_policy;
+    ctxt.decode_cache = NULL;
+    ctxt.insn_bytes_len = 0;
     ctxt.lma       = sizeof(void *) == 8;
     ctxt.addr_size = 8 * sizeof(void *);
     ctxt.sp_size   = 8 * sizeof(void *);
@@ -5410,6 +5472,40 @@ int main(int argc, char **argv)
         printf("%*sokay\n", nr < 40 ? 40 - nr : 0, "");
     }
 
+    ctxt.lma = sizeof(void *) == 8;
+    ctxt.addr_size = ctxt.sp_size = 8 * sizeof(void *);
+
+    printf("%-40s", "Testing decode cache...");
+    {
+        struct x86_decode_cache *cache = x86_decode_cache_alloc();
+        unsigned long nr[2] = {}, ns[2] = {}, expect = 0;
+        uint64_t start;
+
+        if ( !cache )
+            goto fail;
+
+        for ( i = 0; i < 20; i++ )
+            for ( j = 0; j < 2; j++ )
+            {
+                unsigned long n;
+
+                start = now_ns();
+                n = decode_cache_loop(instr, res, &ctxt, j ? cache : NULL);
+                ns[j] += now_ns() - start;
+                if ( !n || (expect && n != expect) )
+                {
+                    x86_decode_cache_free(cache);
+                    goto fail;
+                }
+                expect = n;
+                nr[j] += n;
+            }
+
+        x86_decode_cache_free(cache);
+        printf("okay (%lu vs %lu ns/insn)\n",
+               ns[0] / nr[0], ns[1] / nr[1]);
+    }
+
     return 0;
 
  fail:
@@ -0,0 +1,225 @@
+/*
+ * Unit tests for libxentrace's reading of a trace buffer.
+ *
+ * Lays out records by hand in a buffer the way Xen's insert_record() does,
+ * and checks what xentrace_next() returns, and how it moves cons.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+
+/* The code under test is static in places, so include it whole. */
+#include "core.c"
+
+#define BUF_PAGES      2
+
+static unsigned int nr_failures;
+#define fail(fmt, ...)                          \
+({                                              \
+    nr_failures++;                              \
+    (void)printf(fmt, ##__VA_ARGS__);           \
+})
+
+static uint32_t buf[BUF_PAGES * XC_PAGE_SIZE / sizeof(uint32_t)];
+static struct t_buf *const meta = (struct t_buf *)buf;
+static uint32_t *const data = (uint32_t *)((struct t_buf *)buf + 1);
+
+static struct xentrace_cpu cpu = { .meta = (struct t_buf *)buf };
+static xentrace_handle xth = {
+    .nr_cpus = 1,
+    .cpus = &cpu,
+    .data_size = sizeof(buf) - sizeof(struct t_buf),
+};
+
+/* Put a record at pos, returning the position following it. */
+static uint32_t put(uint32_t pos, uint32_t event, unsigned int extra,
+                    int cycles, uint64_t tsc, uint32_t d0)
+{
+    uint32_t *words = data + (pos % xth.data_size) / sizeof(uint32_t);
+    unsigned int i;
+
+    *words++ = event | (extra << TRACE_EXTRA_SHIFT) |
+               (cycles ? TRC_HD_CYCLE_FLAG : 0);
+    if ( cycles )
+    {
+        *words++ = tsc;
+        *words++ = tsc >> 32;
+    }
+    for ( i = 0; i < extra; i++ )
+        *words++ = d0 + i;
+
+    pos += sizeof(uint32_t) * (1 + extra + (cycles ? 2 : 0));
+    return pos >= 2 * xth.data_size ? pos - 2 * xth.data_size : pos;
+}
+
+static void reset(uint32_t pos)
+{
+    memset(buf, 0, sizeof(buf));
+    meta->cons = meta->prod = cpu.pos = cpu.prod = pos;
+}
+
+static void expect(uint32_t event, int has_tsc, uint64_t tsc,
+                   unsigned int nr_data, uint32_t d0)
+{
+    xentrace_record rec;
+    int rc = xentrace_next(&xth, 0, &rec);
+
+    if ( rc != 1 )
+        fail("  expected event %#x, got rc %d\n", event, rc);
+    else if ( rec.event != event || rec.has_tsc != has_tsc ||
+              rec.tsc != tsc || rec.nr_data != nr_data ||
+              (nr_data && rec.data[0] != d0) )
+        fail("  expected event %#x/%d/%"PRIu64"/%u/%#x, "
+             "got %#x/%d/%"PRIu64"/%u/%#x\n",
+             event, has_tsc, tsc, nr_data, d0, rec.event, rec.has_tsc,
+             rec.tsc, rec.nr_data, rec.data[0]);
+}
+
+static void expect_none(void)
+{
+    xentrace_record rec;
+    int rc = xentrace_next(&xth, 0, &rec);
+
+    if ( rc != 0 )
+        fail("  expected no record, got rc %d event %#x\n", rc, rec.event);
+}
+
+static void expect_eio(void)
+{
+    xentrace_record rec;
+    int rc = xentrace_next(&xth, 0, &rec);
+
+    if ( rc != -1 || errno != EIO )
+        fail("  expected EIO, got rc %d errno %d\n", rc, errno);
+}
+
+static void test_empty(void)
+{
+    printf("Testing an empty buffer\n");
+
+    reset(0x40);
+    expect_none();
+    if ( meta->cons != 0x40 )
+        fail("  cons moved to %#x\n", meta->cons);
+}
+
+static void test_simple(void)
+{
+    uint32_t pos;
+
+    printf("Testing records without a wrap\n");
+
+    reset(0);
+    pos = put(0, 0x21001, 1, 1, 5, 0x100);
+    pos = put(pos, 0x28004, 3, 0, 0, 0x200);
+    meta->prod = pos;
+
+    expect(0x21001, 1, 5, 1, 0x100);
+    /* cons only moves once the records read so far are exhausted. */
+    if ( meta->cons != 0 )
+        fail("  cons moved early, to %#x\n", meta->cons);
+    expect(0x28004, 0, 0, 3, 0x200);
+    expect_none();
+    if ( meta->cons != pos )
+        fail("  cons %#x, expected %#x\n", meta->cons, pos);
+}
+
+static void test_wrap(uint32_t start)
+{
+    uint32_t pos, end = start + xth.data_size;
+
+    printf("Testing a wrap from %#x\n", start);
+
+    /*
+     * A record which doesn't fit in the 8 bytes left at the end of the
+     * buffer: Xen pads them, and puts the record at the start.
+     */
+    reset(end - 24);
+    pos = put(end - 24, 0x21001, 1, 1, 7, 0x300);
+    pos = put(pos, TRC_TRACE_WRAP_BUFFER, 1, 0, 0, 0);
+    if ( pos % xth.data_size )
+        fail("  bad test layout, padding ends at %#x\n", pos);
+    pos = put(pos, 0x28004, 2, 0, 0, 0x400);
+    meta->prod = pos;
+
+    expect(0x21001, 1, 7, 1, 0x300);
+    expect(0x28004, 0, 0, 2, 0x400);
+    expect_none();
+    if ( meta->cons != pos )
+        fail("  cons %#x, expected %#x\n", meta->cons, pos);
+}
+
+static void test_new_records(void)
+{
+    uint32_t pos;
+
+    printf("Testing records inserted while reading\n");
+
+    reset(0);
+    pos = put(0, 0x21001, 1, 0, 0, 0x500);
+    meta->prod = pos;
+
+    expect(0x21001, 0, 0, 1, 0x500);
+    pos = put(pos, 0x21002, 1, 0, 0, 0x600);
+    meta->prod = pos;
+    expect(0x21002, 0, 0, 1, 0x600);
+    expect_none();
+}
+
+static void test_bogus_prod(void)
+{
+    printf("Testing a bogus prod\n");
+
+    reset(0);
+    meta->prod = 2 * xth.data_size;
+    expect_eio();
+
+    reset(0);
+    meta->prod = 6;
+    expect_eio();
+}
+
+static void test_bogus_record(void)
+{
+    printf("Testing a record straddling the end of the buffer\n");
+
+    /* Only the header fits, the data would be past the end. */
+    reset(xth.data_size - 8);
+    data[(xth.data_size - 8) / sizeof(uint32_t)] =
+        0x21001 | (3U << TRACE_EXTRA_SHIFT);
+    meta->prod = xth.data_size + 8;
+    expect_eio();
+}
+
+int main(void)
+{
+    /* Corrupt buffers get logged, quietly expect that instead. */
+    xth.logger = (xentoollog_logger *)
+        xtl_createlogger_stdiostream(stderr, XTL_CRITICAL, 0);
+    if ( !xth.logger )
+        return 1;
+
+    test_empty();
+    test_simple();
+    test_wrap(0);
+    test_wrap(xth.data_size);
+    test_new_records();
+    test_bogus_prod();
+    test_bogus_record();
+
+    if ( nr_failures )
+        printf("Done: %u failures\n", nr_failures);
+    else
+        printf("Done: all ok\n");
+
+    return !!nr_failures;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
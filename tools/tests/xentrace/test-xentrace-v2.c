@@ -0,0 +1,193 @@
+/*
+ * Unit tests for the chunk encoding of xentrace's trace format v2.
+ *
+ * Encodes raw records the way xentrace does, and checks that decoding the
+ * chunk gives them back unchanged.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <xen/xen.h>
+#include <xen/trace.h>
+#include <xen-tools/common-macros.h>
+
+#include "trace-v2.h"
+
+#define CHUNK_SIZE     (64 << 10)
+#define MAX_RECORDS    4096
+
+static unsigned int nr_failures;
+#define fail(fmt, ...)                          \
+({                                              \
+    nr_failures++;                              \
+    (void)printf(fmt, ##__VA_ARGS__);           \
+})
+
+static uint64_t chunk[CHUNK_SIZE / sizeof(uint64_t)];
+static struct xt2_enc enc = { .buf = (uint8_t *)chunk, .size = CHUNK_SIZE };
+static const struct xt2_chunk_header *const hdr = (void *)chunk;
+
+static uint32_t recs[MAX_RECORDS][XT2_REC_MAX_WORDS];
+static unsigned int nr_recs;
+
+/* Encode a record, keeping a copy of it to check decoding against. */
+static bool put(uint32_t event, unsigned int extra, bool cycles,
+                uint64_t tsc, uint32_t d0)
+{
+    uint32_t *rec = recs[nr_recs], *data = rec + 1;
+    unsigned int i;
+
+    rec[0] = event | (extra << TRACE_EXTRA_SHIFT) |
+             (cycles ? TRC_HD_CYCLE_FLAG : 0);
+    if ( cycles )
+    {
+        *data++ = tsc;
+        *data++ = tsc >> 32;
+    }
+    for ( i = 0; i < extra; i++ )
+        data[i] = d0 * (i + 1);
+
+    if ( !xt2_enc_record(&enc, rec) )
+        return false;
+
+    nr_recs++;
+    return true;
+}
+
+static void reset(void)
+{
+    xt2_enc_reset(&enc);
+    nr_recs = 0;
+}
+
+/* Decode the chunk, and check it against the records encoded. */
+static void check(void)
+{
+    struct xt2_dec dec;
+    uint32_t rec[XT2_REC_MAX_WORDS];
+    unsigned int i;
+    int nr;
+
+    if ( hdr->nr_records != nr_recs )
+        fail("  %u records in the header, expected %u\n",
+             hdr->nr_records, nr_recs);
+
+    if ( !xt2_dec_init(&dec, hdr, CHUNK_SIZE) )
+    {
+        fail("  bad chunk header\n");
+        return;
+    }
+
+    for ( i = 0; i < nr_recs; i++ )
+    {
+        nr = xt2_dec_record(&dec, rec);
+        if ( nr != 1 + TRC_HD_EXTRA(recs[i][0]) +
+                    (TRC_HD_INCLUDES_CYCLE_COUNT(recs[i][0]) ? 2 : 0) ||
+             memcmp(rec, recs[i], nr * sizeof(*rec)) )
+        {
+            fail("  record %u: got %d words, header %#x, expected %#x\n",
+                 i, nr, nr > 0 ? rec[0] : 0, recs[i][0]);
+            return;
+        }
+    }
+
+    nr = xt2_dec_record(&dec, rec);
+    if ( nr )
+        fail("  got %d past the last record\n", nr);
+}
+
+static void test_dict_full(void)
+{
+    unsigned int i;
+
+    printf("Testing more events than the dictionary holds\n");
+
+    reset();
+    for ( i = 0; i < XT2_DICT_MAX + 40; i++ )
+        put(0x21000 + i, 1, false, 0, i);
+    /* Events in the dictionary, then ones which didn't make it. */
+    for ( i = 0; i < XT2_DICT_MAX + 40; i += 7 )
+        put(0x21000 + i, 2, false, 0, i);
+    check();
+}
+
+static void test_tsc(void)
+{
+    static const uint64_t tscs[] = {
+        1000, 999, 1ULL << 40, 5, UINT64_MAX, 0x100000000ULL, 0xffffffffULL,
+    };
+    unsigned int i;
+
+    printf("Testing timestamps going backwards\n");
+
+    reset();
+    put(0x28001, 0, false, 0, 0);
+    for ( i = 0; i < ARRAY_SIZE(tscs); i++ )
+    {
+        put(0x28002, 1, true, tscs[i], i);
+        put(0x28003, 0, false, 0, 0);
+    }
+    check();
+
+    if ( hdr->first_tsc != tscs[0] ||
+         hdr->last_tsc != tscs[ARRAY_SIZE(tscs) - 1] )
+        fail("  header TSCs %"PRIu64"-%"PRIu64", expected %"PRIu64"-%"PRIu64
+             "\n", hdr->first_tsc, hdr->last_tsc, tscs[0],
+             tscs[ARRAY_SIZE(tscs) - 1]);
+}
+
+static void test_max_extra(void)
+{
+    printf("Testing records with %u extra words\n", TRACE_EXTRA_MAX);
+
+    reset();
+    put(0x21001, TRACE_EXTRA_MAX, true, UINT64_MAX, UINT32_MAX);
+    put(0x21001, TRACE_EXTRA_MAX, false, 0, 0x80000001U);
+    put(0x21002, TRACE_EXTRA_MAX, true, 0, 0);
+    check();
+}
+
+static void test_full(void)
+{
+    unsigned int n = 0;
+
+    printf("Testing a full chunk\n");
+
+    reset();
+    while ( nr_recs < MAX_RECORDS &&
+            put(0x21001 + n % 3, TRACE_EXTRA_MAX, true, UINT64_MAX - n,
+                UINT32_MAX) )
+        n++;
+
+    if ( nr_recs == MAX_RECORDS )
+        fail("  chunk never filled up\n");
+    else if ( sizeof(*hdr) + hdr->used > CHUNK_SIZE )
+        fail("  %u bytes used, past the chunk\n", hdr->used);
+    check();
+}
+
+int main(void)
+{
+    test_dict_full();
+    test_tsc();
+    test_max_extra();
+    test_full();
+
+    if ( nr_failures )
+        printf("Done: %u failures\n", nr_failures);
+    else
+        printf("Done: all ok\n");
+
+    return !!nr_failures;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
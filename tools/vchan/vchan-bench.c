@@ -0,0 +1,291 @@
+/**
+ * @file
+ * @section LICENSE
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ *  libxenvchan throughput and latency benchmark.
+ *
+ *  Runs both ends of a vchan in the local domain (loopback): the process
+ *  sets up the server and forks a client connecting to it.  The server
+ *  streams messages to the client to measure throughput, then the client
+ *  measures round trips of messages echoed back by the server.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include <libxenvchan.h>
+
+#define RING_SIZE	65536
+#define HDR_SIZE	16
+
+enum mode { MODE_COPY, MODE_SENDV, MODE_ZEROCOPY };
+
+static const char *const mode_names[] = {
+	[MODE_COPY] = "copy",
+	[MODE_SENDV] = "sendv",
+	[MODE_ZEROCOPY] = "zerocopy",
+};
+
+static enum mode mode;
+static size_t msg_size = 256;
+static size_t batch;
+static unsigned long total_mb = 1024;
+static unsigned long round_trips = 100000;
+static char *buf;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-m copy|sendv|zerocopy] [-s msg-size] [-b batch]\n"
+		"          [-t total-MiB] [-r round-trips] [domid]\n"
+		"\n"
+		"Both ends of the vchan run in domain <domid> (default 0),\n"
+		"which has to be the local domain.\n", prog);
+	exit(2);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static void die(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+/* Zero-copy send, waiting for space like libxenvchan_send(). */
+static void zc_send(struct libxenvchan *ctrl, const char *data, size_t size)
+{
+	struct iovec iov[2];
+	int avail;
+
+	while ((avail = libxenvchan_send_peek(ctrl, size, iov)) < (int)size) {
+		if (avail < 0 || libxenvchan_wait(ctrl))
+			die("send_peek");
+	}
+	if (iov[0].iov_len >= size) {
+		memcpy(iov[0].iov_base, data, size);
+	} else {
+		memcpy(iov[0].iov_base, data, iov[0].iov_len);
+		memcpy(iov[1].iov_base, data + iov[0].iov_len,
+		       size - iov[0].iov_len);
+	}
+	if (libxenvchan_send_commit(ctrl, size) < 0)
+		die("send_commit");
+}
+
+/*
+ * A real consumer would parse the message in place, copying only what it
+ * needs to validate.
+ */
+static void zc_recv(struct libxenvchan *ctrl, size_t size)
+{
+	struct iovec iov[2];
+	int avail;
+
+	while ((avail = libxenvchan_recv_peek(ctrl, size, iov)) < (int)size) {
+		if (avail < 0 || libxenvchan_wait(ctrl))
+			die("recv_peek");
+	}
+	if (libxenvchan_recv_commit(ctrl, size) < 0)
+		die("recv_commit");
+}
+
+static void send_msg(struct libxenvchan *ctrl)
+{
+	struct iovec iov[2] = {
+		{ .iov_base = buf, .iov_len = HDR_SIZE },
+		{ .iov_base = buf + HDR_SIZE, .iov_len = msg_size - HDR_SIZE },
+	};
+	int ret;
+
+	switch (mode) {
+	case MODE_COPY:
+		ret = libxenvchan_send(ctrl, buf, msg_size);
+		break;
+	case MODE_SENDV:
+		ret = libxenvchan_sendv(ctrl, iov, 2);
+		break;
+	default:
+		zc_send(ctrl, buf, msg_size);
+		return;
+	}
+	if (ret != msg_size)
+		die("send");
+}
+
+static void recv_msg(struct libxenvchan *ctrl, char *data)
+{
+	struct iovec iov[2] = {
+		{ .iov_base = data, .iov_len = HDR_SIZE },
+		{ .iov_base = data + HDR_SIZE, .iov_len = msg_size - HDR_SIZE },
+	};
+	int ret;
+
+	switch (mode) {
+	case MODE_COPY:
+		ret = libxenvchan_recv(ctrl, data, msg_size);
+		break;
+	case MODE_SENDV:
+		ret = libxenvchan_recvv(ctrl, iov, 2);
+		break;
+	default:
+		zc_recv(ctrl, msg_size);
+		return;
+	}
+	if (ret != msg_size)
+		die("recv");
+}
+
+static void server(struct libxenvchan *ctrl)
+{
+	unsigned long i, nr = (total_mb << 20) / msg_size;
+
+	for (i = 0; i < nr; i++)
+		send_msg(ctrl);
+
+	/* Echo round trips; the client waits for every reply. */
+	for (i = 0; i < round_trips; i++) {
+		recv_msg(ctrl, buf);
+		send_msg(ctrl);
+		if (libxenvchan_flush(ctrl))
+			die("flush");
+	}
+}
+
+static void client(struct libxenvchan *ctrl)
+{
+	unsigned long i, nr = (total_mb << 20) / msg_size;
+	char *data = malloc(msg_size);
+	uint64_t start, ns;
+
+	if (!data)
+		die("malloc");
+
+	recv_msg(ctrl, data);
+	start = now_ns();
+	for (i = 1; i < nr; i++)
+		recv_msg(ctrl, data);
+	ns = now_ns() - start;
+
+	printf("%-8s %5zu bytes: %10.1f MiB/s %10.0f msgs/s\n",
+	       mode_names[mode], msg_size,
+	       (double)(nr - 1) * msg_size * 1e9 / ns / (1 << 20),
+	       (double)(nr - 1) * 1e9 / ns);
+
+	start = now_ns();
+	for (i = 0; i < round_trips; i++) {
+		send_msg(ctrl);
+		if (libxenvchan_flush(ctrl))
+			die("flush");
+		recv_msg(ctrl, data);
+	}
+	ns = now_ns() - start;
+
+	printf("%-8s %5zu bytes: %10.2f us round trip\n",
+	       mode_names[mode], msg_size, ns / 1e3 / round_trips);
+
+	free(data);
+}
+
+int main(int argc, char **argv)
+{
+	struct libxenvchan *ctrl;
+	char path[64];
+	int domid = 0, opt, status;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "m:s:b:t:r:")) != -1) {
+		switch (opt) {
+		case 'm':
+			for (mode = 0; mode < 3; mode++)
+				if (!strcmp(optarg, mode_names[mode]))
+					break;
+			if (mode == 3)
+				usage(argv[0]);
+			break;
+		case 's':
+			msg_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			total_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			round_trips = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind < argc)
+		domid = atoi(argv[optind]);
+	if (msg_size <= HDR_SIZE || msg_size > RING_SIZE || !total_mb)
+		usage(argv[0]);
+
+	buf = malloc(msg_size);
+	if (!buf)
+		die("malloc");
+	memset(buf, 0x5a, msg_size);
+
+	snprintf(path, sizeof(path), "/local/domain/%d/data/vchan-bench/%d",
+		 domid, getpid());
+
+	ctrl = libxenvchan_server_init(NULL, domid, path, RING_SIZE, RING_SIZE);
+	if (!ctrl)
+		die("libxenvchan_server_init");
+
+	pid = fork();
+	if (pid < 0)
+		die("fork");
+	if (!pid) {
+		/* The child must not use the server's handles. */
+		ctrl = libxenvchan_client_init(NULL, domid, path);
+		if (!ctrl)
+			die("libxenvchan_client_init");
+		ctrl->blocking = 1;
+		libxenvchan_set_notify_batch(ctrl, batch);
+		client(ctrl);
+		libxenvchan_close(ctrl);
+		return 0;
+	}
+
+	ctrl->blocking = 1;
+	libxenvchan_set_notify_batch(ctrl, batch);
+	server(ctrl);
+
+	if (waitpid(pid, &status, 0) < 0)
+		die("waitpid");
+	libxenvchan_close(ctrl);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
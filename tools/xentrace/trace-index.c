@@ -0,0 +1,677 @@
+/*
+ * tools/xentrace/trace-index.c
+ *
+ * Per-CPU index of the windows of a trace file, and reading of each CPU's
+ * records by worker threads, see trace-index.h.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <xen/xen.h>
+#include <xen/trace.h>
+
+#include "trace-index.h"
+
+#define CACHE_MAGIC        0x31495a58  /* "XZI1" */
+#define CACHE_SUFFIX       ".xzi"
+
+#define CPU_CHANGE_SIZE    12
+#define CPU_CHANGE_HEADER  (TRC_TRACE_CPU_CHANGE | (2U << TRACE_EXTRA_SHIFT))
+
+#define BATCH_RECS         512
+#define QUEUE_DEPTH        4       /* Batches read ahead per CPU. */
+
+struct cache_header {
+    uint32_t magic;
+    uint32_t pad;
+    uint64_t file_size;
+    int64_t mtime_sec, mtime_nsec;
+    uint64_t nr_windows;
+};
+
+/* A window of records, in the cache in file order. */
+struct window {
+    uint64_t offset;        /* Of its CPU change record. */
+    uint32_t cpu;
+    uint32_t size;          /* Of the records after the CPU change record. */
+};
+
+struct batch {
+    struct batch *next;
+    unsigned int nr;
+    struct tindex_rec recs[BATCH_RECS];
+};
+
+struct tindex_cpu {
+    struct window *windows;
+    unsigned int nr_windows;
+
+    /* Reader state, owned by the worker which set busy. */
+    unsigned int next_window;
+    uint64_t pos, end;
+
+    /* Protected by the lock. */
+    bool busy, eof;
+    struct batch *ready, **ready_tail;
+    unsigned int nr_ready;
+
+    /* Consumer state. */
+    struct batch *cur;
+    unsigned int cur_idx;
+};
+
+struct tindex {
+    const uint8_t *map;
+    uint64_t size;
+
+    unsigned int nr_cpus;
+    struct tindex_cpu *cpus;
+
+    unsigned int nr_threads;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work, ready;
+    struct batch *free;
+    unsigned int nr_eof;
+    bool stop;
+};
+
+static int load_cache(const char *path, const struct stat *st,
+                      struct window **windows, uint64_t *nr_windows)
+{
+    struct cache_header hdr;
+    struct stat cst;
+    struct window *w = NULL;
+    int fd, rc = -1;
+
+    fd = open(path, O_RDONLY);
+    if ( fd < 0 )
+        return -1;
+
+    if ( fstat(fd, &cst) ||
+         read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+         hdr.magic != CACHE_MAGIC ||
+         hdr.file_size != st->st_size ||
+         hdr.mtime_sec != st->st_mtim.tv_sec ||
+         hdr.mtime_nsec != st->st_mtim.tv_nsec ||
+         hdr.nr_windows > (cst.st_size - sizeof(hdr)) / sizeof(*w) ||
+         cst.st_size != sizeof(hdr) + hdr.nr_windows * sizeof(*w) )
+        goto out;
+
+    w = malloc(hdr.nr_windows * sizeof(*w) ?: 1);
+    if ( !w ||
+         read(fd, w, hdr.nr_windows * sizeof(*w)) !=
+         hdr.nr_windows * sizeof(*w) )
+    {
+        free(w);
+        goto out;
+    }
+
+    *windows = w;
+    *nr_windows = hdr.nr_windows;
+    rc = 0;
+
+ out:
+    close(fd);
+    return rc;
+}
+
+static void save_cache(const char *path, const struct stat *st,
+                       const struct window *windows, uint64_t nr_windows)
+{
+    struct cache_header hdr = {
+        .magic = CACHE_MAGIC,
+        .file_size = st->st_size,
+        .mtime_sec = st->st_mtim.tv_sec,
+        .mtime_nsec = st->st_mtim.tv_nsec,
+        .nr_windows = nr_windows,
+    };
+    int fd;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if ( fd < 0 )
+    {
+        fprintf(stderr, "Can't cache the trace index in %s: %s\n",
+                path, strerror(errno));
+        return;
+    }
+
+    if ( write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+         write(fd, windows, nr_windows * sizeof(*windows)) !=
+         nr_windows * sizeof(*windows) )
+    {
+        fprintf(stderr, "Failed to write the trace index to %s\n", path);
+        unlink(path);
+    }
+
+    close(fd);
+}
+
+/*
+ * Scan the trace's CPU change records.  A truncated trace, e.g. because the
+ * disk filled up, gets cut at the start of its last round of windows, so
+ * that no CPU is ahead of the others.
+ */
+static int build(const struct tindex *ti, unsigned int max_cpus,
+                 struct window **windows, uint64_t *nr_windows)
+{
+    uint64_t offset = 0, last_epoch = 0, nr = 0, max = 0, i;
+    struct window *w = NULL;
+    unsigned int last_cpu = 0;
+    bool truncated = false;
+
+    while ( offset < ti->size )
+    {
+        uint32_t rec[3];
+
+        if ( ti->size - offset < CPU_CHANGE_SIZE )
+        {
+            truncated = true;
+            break;
+        }
+
+        memcpy(rec, ti->map + offset, sizeof(rec));
+
+        if ( rec[0] != CPU_CHANGE_HEADER )
+        {
+            fprintf(stderr, "No CPU change record at offset %#"PRIx64
+                    ", ignoring the rest of the trace\n", offset);
+            truncated = true;
+            break;
+        }
+
+        if ( rec[1] >= max_cpus )
+        {
+            fprintf(stderr, "CPU %u at offset %#"PRIx64" exceeds %u\n",
+                    rec[1], offset, max_cpus);
+            free(w);
+            return -1;
+        }
+
+        if ( ti->size - offset - CPU_CHANGE_SIZE < rec[2] )
+        {
+            truncated = true;
+            break;
+        }
+
+        if ( last_cpu > rec[1] )
+            last_epoch = offset;
+        last_cpu = rec[1];
+
+        if ( nr == max )
+        {
+            struct window *n;
+
+            max = max ? max * 2 : 1024;
+            n = realloc(w, max * sizeof(*w));
+            if ( !n )
+            {
+                perror("realloc");
+                free(w);
+                return -1;
+            }
+            w = n;
+        }
+
+        w[nr++] = (struct window){
+            .offset = offset,
+            .cpu = rec[1],
+            .size = rec[2],
+        };
+
+        offset += CPU_CHANGE_SIZE + rec[2];
+    }
+
+    if ( truncated )
+    {
+        for ( i = 0; i < nr && w[i].offset <= last_epoch; i++ )
+            ;
+        fprintf(stderr, "Truncated trace, ignoring %"PRIu64" windows from "
+                "offset %#"PRIx64"\n", nr - i, last_epoch);
+        nr = i;
+    }
+
+    *windows = w;
+    *nr_windows = nr;
+
+    return 0;
+}
+
+static int distribute(struct tindex *ti, const struct window *windows,
+                      uint64_t nr_windows, unsigned int max_cpus)
+{
+    uint64_t i;
+    unsigned int cpu;
+
+    for ( i = 0; i < nr_windows; i++ )
+    {
+        if ( windows[i].cpu >= max_cpus ||
+             windows[i].offset + CPU_CHANGE_SIZE + windows[i].size >
+             ti->size )
+            return -1;
+        if ( windows[i].cpu >= ti->nr_cpus )
+            ti->nr_cpus = windows[i].cpu + 1;
+    }
+
+    ti->cpus = calloc(ti->nr_cpus ?: 1, sizeof(*ti->cpus));
+    if ( !ti->cpus )
+        return -1;
+
+    for ( i = 0; i < nr_windows; i++ )
+        ti->cpus[windows[i].cpu].nr_windows++;
+
+    for ( cpu = 0; cpu < ti->nr_cpus; cpu++ )
+    {
+        struct tindex_cpu *c = &ti->cpus[cpu];
+
+        c->windows = malloc(c->nr_windows * sizeof(*c->windows) ?: 1);
+        if ( !c->windows )
+            return -1;
+        c->nr_windows = 0;
+        c->ready_tail = &c->ready;
+    }
+
+    for ( i = 0; i < nr_windows; i++ )
+    {
+        struct tindex_cpu *c = &ti->cpus[windows[i].cpu];
+
+        c->windows[c->nr_windows++] = windows[i];
+    }
+
+    for ( cpu = 0; cpu < ti->nr_cpus; cpu++ )
+        if ( !ti->cpus[cpu].nr_windows )
+        {
+            ti->cpus[cpu].eof = true;
+            ti->nr_eof++;
+        }
+
+    return 0;
+}
+
+struct tindex *tindex_open(int fd, const char *trace_file,
+                           unsigned int max_cpus)
+{
+    struct tindex *ti;
+    struct window *windows = NULL;
+    uint64_t nr_windows;
+    struct stat st;
+    char *path = NULL;
+    void *map;
+
+    if ( fstat(fd, &st) || !S_ISREG(st.st_mode) || !st.st_size ||
+         st.st_size != (size_t)st.st_size )
+        return NULL;
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if ( map == MAP_FAILED )
+    {
+        perror("mmap");
+        return NULL;
+    }
+
+    ti = calloc(1, sizeof(*ti));
+    if ( !ti )
+        goto fail;
+
+    ti->map = map;
+    ti->size = st.st_size;
+
+    path = malloc(strlen(trace_file) + sizeof(CACHE_SUFFIX));
+    if ( !path )
+        goto fail;
+    strcpy(path, trace_file);
+    strcat(path, CACHE_SUFFIX);
+
+    if ( load_cache(path, &st, &windows, &nr_windows) )
+    {
+        if ( build(ti, max_cpus, &windows, &nr_windows) )
+            goto fail;
+        save_cache(path, &st, windows, nr_windows);
+    }
+
+    if ( distribute(ti, windows, nr_windows, max_cpus) )
+    {
+        fprintf(stderr, "Bad trace index %s\n", path);
+        unlink(path);
+        goto fail;
+    }
+
+    free(windows);
+    free(path);
+
+    return ti;
+
+ fail:
+    free(windows);
+    free(path);
+    tindex_close(ti);
+    if ( !ti )
+        munmap(map, st.st_size);
+    return NULL;
+}
+
+unsigned int tindex_nr_cpus(const struct tindex *ti)
+{
+    return ti->nr_cpus;
+}
+
+unsigned int tindex_nr_windows(const struct tindex *ti, unsigned int cpu)
+{
+    return cpu < ti->nr_cpus ? ti->cpus[cpu].nr_windows : 0;
+}
+
+/*
+ * Read up to a batch of records of a CPU, CPU change records included.
+ * Returns true if the CPU has no more records after them.
+ */
+static bool fill_batch(const struct tindex *ti, struct tindex_cpu *c,
+                       struct batch *b)
+{
+    b->nr = 0;
+
+    while ( b->nr < BATCH_RECS )
+    {
+        struct tindex_rec *r = &b->recs[b->nr];
+        uint32_t hdr, size;
+
+        if ( c->pos == c->end )
+        {
+            const struct window *w;
+
+            if ( c->next_window == c->nr_windows )
+                return true;
+
+            w = &c->windows[c->next_window++];
+            r->offset = w->offset;
+            r->size = CPU_CHANGE_SIZE;
+            memcpy(r->words, ti->map + w->offset, CPU_CHANGE_SIZE);
+            memset((uint8_t *)r->words + CPU_CHANGE_SIZE, 0,
+                   sizeof(r->words) - CPU_CHANGE_SIZE);
+            b->nr++;
+
+            c->pos = w->offset + CPU_CHANGE_SIZE;
+            c->end = c->pos + w->size;
+            continue;
+        }
+
+        size = sizeof(hdr);
+        if ( c->end - c->pos >= sizeof(hdr) )
+        {
+            memcpy(&hdr, ti->map + c->pos, sizeof(hdr));
+            size *= 1 + TRC_HD_EXTRA(hdr) +
+                    (TRC_HD_INCLUDES_CYCLE_COUNT(hdr) ? 2 : 0);
+        }
+
+        if ( c->end - c->pos < size )
+        {
+            fprintf(stderr, "Truncated record at offset %#"PRIx64
+                    ", skipping the rest of its window\n", c->pos);
+            c->pos = c->end;
+            continue;
+        }
+
+        r->offset = c->pos;
+        r->size = size;
+        memcpy(r->words, ti->map + c->pos, size);
+        memset((uint8_t *)r->words + size, 0, sizeof(r->words) - size);
+        b->nr++;
+
+        c->pos += size;
+    }
+
+    return false;
+}
+
+static struct batch *get_batch(struct tindex *ti)
+{
+    struct batch *b = ti->free;
+
+    if ( b )
+    {
+        ti->free = b->next;
+        return b;
+    }
+
+    b = malloc(sizeof(*b));
+    if ( !b )
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    return b;
+}
+
+static void put_batch(struct tindex *ti, struct batch *b)
+{
+    b->next = ti->free;
+    ti->free = b;
+}
+
+/* The CPU with the fewest records read ahead, which can take more. */
+static struct tindex_cpu *pick_cpu(struct tindex *ti)
+{
+    struct tindex_cpu *best = NULL;
+    unsigned int cpu;
+
+    for ( cpu = 0; cpu < ti->nr_cpus; cpu++ )
+    {
+        struct tindex_cpu *c = &ti->cpus[cpu];
+
+        if ( c->busy || c->eof || c->nr_ready >= QUEUE_DEPTH )
+            continue;
+
+        if ( !best || c->nr_ready < best->nr_ready )
+            best = c;
+    }
+
+    return best;
+}
+
+static void *worker(void *arg)
+{
+    struct tindex *ti = arg;
+
+    pthread_mutex_lock(&ti->lock);
+
+    while ( !ti->stop && ti->nr_eof < ti->nr_cpus )
+    {
+        struct tindex_cpu *c = pick_cpu(ti);
+        struct batch *b;
+        bool eof;
+
+        if ( !c )
+        {
+            pthread_cond_wait(&ti->work, &ti->lock);
+            continue;
+        }
+
+        b = get_batch(ti);
+        c->busy = true;
+        pthread_mutex_unlock(&ti->lock);
+
+        eof = fill_batch(ti, c, b);
+
+        pthread_mutex_lock(&ti->lock);
+        c->busy = false;
+
+        if ( b->nr )
+        {
+            b->next = NULL;
+            *c->ready_tail = b;
+            c->ready_tail = &b->next;
+            c->nr_ready++;
+        }
+        else
+            put_batch(ti, b);
+
+        if ( eof )
+        {
+            c->eof = true;
+            if ( ++ti->nr_eof == ti->nr_cpus )
+                pthread_cond_broadcast(&ti->work);
+        }
+
+        pthread_cond_signal(&ti->ready);
+    }
+
+    pthread_mutex_unlock(&ti->lock);
+
+    return NULL;
+}
+
+int tindex_start(struct tindex *ti, unsigned int nr_threads)
+{
+    unsigned int i;
+
+    if ( nr_threads > ti->nr_cpus - ti->nr_eof )
+        nr_threads = ti->nr_cpus - ti->nr_eof;
+    if ( !nr_threads )
+        return 0;
+
+    ti->threads = calloc(nr_threads, sizeof(*ti->threads));
+    if ( !ti->threads )
+        return -ENOMEM;
+
+    pthread_mutex_init(&ti->lock, NULL);
+    pthread_cond_init(&ti->work, NULL);
+    pthread_cond_init(&ti->ready, NULL);
+
+    for ( i = 0; i < nr_threads; i++ )
+    {
+        int rc = pthread_create(&ti->threads[i], NULL, worker, ti);
+
+        if ( rc )
+        {
+            fprintf(stderr, "Failed to start reader thread: %s\n",
+                    strerror(rc));
+            if ( !i )
+                return -rc;
+            break;
+        }
+    }
+
+    ti->nr_threads = i;
+
+    return 0;
+}
+
+const struct tindex_rec *tindex_next(struct tindex *ti, unsigned int cpu)
+{
+    struct tindex_cpu *c;
+
+    if ( cpu >= ti->nr_cpus )
+        return NULL;
+
+    c = &ti->cpus[cpu];
+
+    if ( c->cur && c->cur_idx < c->cur->nr )
+        return &c->cur->recs[c->cur_idx++];
+
+    if ( !ti->nr_threads )
+    {
+        if ( c->eof )
+            return NULL;
+
+        if ( !c->cur )
+            c->cur = get_batch(ti);
+
+        c->eof = fill_batch(ti, c, c->cur);
+        c->cur_idx = 0;
+    }
+    else
+    {
+        pthread_mutex_lock(&ti->lock);
+
+        if ( c->cur )
+            put_batch(ti, c->cur);
+
+        while ( !c->ready && !c->eof )
+            pthread_cond_wait(&ti->ready, &ti->lock);
+
+        c->cur = c->ready;
+        c->cur_idx = 0;
+        if ( c->cur )
+        {
+            c->ready = c->cur->next;
+            if ( !c->ready )
+                c->ready_tail = &c->ready;
+            c->nr_ready--;
+        }
+
+        /* There's room for more now. */
+        pthread_cond_signal(&ti->work);
+        pthread_mutex_unlock(&ti->lock);
+    }
+
+    return c->cur && c->cur->nr ? &c->cur->recs[c->cur_idx++] : NULL;
+}
+
+void tindex_close(struct tindex *ti)
+{
+    unsigned int i;
+
+    if ( !ti )
+        return;
+
+    if ( ti->nr_threads )
+    {
+        pthread_mutex_lock(&ti->lock);
+        ti->stop = true;
+        pthread_cond_broadcast(&ti->work);
+        pthread_mutex_unlock(&ti->lock);
+
+        for ( i = 0; i < ti->nr_threads; i++ )
+            pthread_join(ti->threads[i], NULL);
+    }
+    free(ti->threads);
+
+    for ( i = 0; ti->cpus && i < ti->nr_cpus; i++ )
+    {
+        struct tindex_cpu *c = &ti->cpus[i];
+
+        while ( c->ready )
+        {
+            struct batch *b = c->ready;
+
+            c->ready = b->next;
+            free(b);
+        }
+        free(c->cur);
+        free(c->windows);
+    }
+    free(ti->cpus);
+
+    while ( ti->free )
+    {
+        struct batch *b = ti->free;
+
+        ti->free = b->next;
+        free(b);
+    }
+
+    if ( ti->map )
+        munmap((void *)ti->map, ti->size);
+    free(ti);
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,64 @@
+/*
+ * tools/xentrace/trace-index.h
+ *
+ * Per-CPU index of the windows of a trace file, as written by xentrace, and
+ * reading of each CPU's records by worker threads.
+ *
+ * xentrace writes windows of records of one CPU at a time, each preceded by
+ * a CPU change record giving the CPU and the window's size.  The index lists
+ * each CPU's windows, so that its records can be read without skipping over
+ * those of all other CPUs.  It gets cached next to the trace, in
+ * <trace file>.xzi, and reused as long as the trace's size and mtime match.
+ *
+ * Worker threads read ahead each CPU's records into batches, in parallel,
+ * while the caller merges the per-CPU streams in order of time.
+ */
+#ifndef __XENTRACE_TRACE_INDEX_H__
+#define __XENTRACE_TRACE_INDEX_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+struct tindex;
+
+struct tindex_rec {
+    off_t offset;           /* In the trace file. */
+    uint32_t size;          /* Bytes of words. */
+    uint32_t words[10];     /* Header, TSC, up to 7 data items. */
+};
+
+/*
+ * Load the index of trace_file, open as fd, from its cache or build it.
+ * Returns NULL if the trace can't be indexed, in which case it has to be
+ * read sequentially.
+ */
+struct tindex *tindex_open(int fd, const char *trace_file,
+                           unsigned int max_cpus);
+
+/* One more than the highest CPU with any records. */
+unsigned int tindex_nr_cpus(const struct tindex *ti);
+unsigned int tindex_nr_windows(const struct tindex *ti, unsigned int cpu);
+
+/* Start reading ahead, with nr_threads workers, or none to read on demand. */
+int tindex_start(struct tindex *ti, unsigned int nr_threads);
+
+/*
+ * The next record of cpu, starting with the CPU change record of its first
+ * window, or NULL after the last one.  Valid until the next call for the
+ * same CPU.  Must only be called from a single thread.
+ */
+const struct tindex_rec *tindex_next(struct tindex *ti, unsigned int cpu);
+
+void tindex_close(struct tindex *ti);
+
+#endif /* __XENTRACE_TRACE_INDEX_H__ */
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,230 @@
+/*
+ * tools/xentrace/trace-v2.c
+ *
+ * Encoding and decoding of chunks of the trace stream format v2, see
+ * trace-v2.h.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <xen/xen.h>
+#include <xen/trace.h>
+
+#include "trace-v2.h"
+
+#define HEAD_EXTRA_MASK  0x7
+#define HEAD_CYCLES      0x8
+#define HEAD_DICT_SHIFT  4
+
+static unsigned int hash_event(uint32_t event)
+{
+    return (event * 2654435761U) >> 16;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint64_t val)
+{
+    while ( val >= 0x80 )
+    {
+        *p++ = val | 0x80;
+        val >>= 7;
+    }
+    *p++ = val;
+
+    return p;
+}
+
+static bool get_varint(struct xt2_dec *dec, uint64_t *val)
+{
+    unsigned int shift;
+
+    *val = 0;
+    for ( shift = 0; shift < 64; shift += 7 )
+    {
+        uint8_t b;
+
+        if ( dec->p >= dec->end )
+            return false;
+
+        b = *dec->p++;
+        *val |= (uint64_t)(b & 0x7f) << shift;
+        if ( !(b & 0x80) )
+            return true;
+    }
+
+    return false;
+}
+
+static uint64_t zigzag(int64_t val)
+{
+    return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+}
+
+static int64_t unzigzag(uint64_t val)
+{
+    return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+}
+
+void xt2_enc_reset(struct xt2_enc *enc)
+{
+    struct xt2_chunk_header *hdr = (void *)enc->buf;
+
+    memset(enc->buf, 0, enc->size);
+    hdr->magic = XT2_MAGIC_CHUNK;
+
+    enc->prev_tsc = 0;
+    enc->nr_dict = 0;
+    memset(enc->hash, 0, sizeof(enc->hash));
+}
+
+static unsigned int dict_lookup(struct xt2_enc *enc, uint32_t event)
+{
+    unsigned int h = hash_event(event), i;
+
+    for ( i = 0; i < XT2_DICT_HASH; i++ )
+    {
+        unsigned int slot = (h + i) & (XT2_DICT_HASH - 1);
+        unsigned int idx = enc->hash[slot];
+
+        if ( !idx )
+        {
+            if ( enc->nr_dict == XT2_DICT_MAX )
+                return 0;
+
+            enc->dict[enc->nr_dict++] = event;
+            enc->hash[slot] = enc->nr_dict;
+            /* Still to be sent literally, the decoder learns it from that. */
+            return 0;
+        }
+
+        if ( enc->dict[idx - 1] == event )
+            return idx;
+    }
+
+    return 0;
+}
+
+bool xt2_enc_record(struct xt2_enc *enc, const uint32_t *rec)
+{
+    struct xt2_chunk_header *hdr = (void *)enc->buf;
+    uint8_t tmp[XT2_REC_MAX_ENC], *p = tmp;
+    uint32_t event = TRC_HD_TO_EVENT(rec[0]);
+    unsigned int extra = TRC_HD_EXTRA(rec[0]);
+    bool cycles = TRC_HD_INCLUDES_CYCLE_COUNT(rec[0]);
+    unsigned int i, idx;
+    const uint32_t *data = rec + 1;
+    uint64_t tsc = 0;
+
+    if ( sizeof(*hdr) + hdr->used + XT2_REC_MAX_ENC > enc->size )
+        return false;
+
+    idx = dict_lookup(enc, event);
+
+    p = put_varint(p, (idx << HEAD_DICT_SHIFT) |
+                      (cycles ? HEAD_CYCLES : 0) | extra);
+    if ( !idx )
+        p = put_varint(p, event);
+
+    if ( cycles )
+    {
+        tsc = ((uint64_t)rec[2] << 32) | rec[1];
+        p = put_varint(p, zigzag(tsc - enc->prev_tsc));
+        data += 2;
+    }
+
+    for ( i = 0; i < extra; i++ )
+        p = put_varint(p, data[i]);
+
+    memcpy(enc->buf + sizeof(*hdr) + hdr->used, tmp, p - tmp);
+    hdr->used += p - tmp;
+    hdr->nr_records++;
+
+    if ( cycles )
+    {
+        if ( !hdr->first_tsc )
+            hdr->first_tsc = tsc;
+        hdr->last_tsc = tsc;
+        enc->prev_tsc = tsc;
+    }
+
+    return true;
+}
+
+bool xt2_dec_init(struct xt2_dec *dec, const struct xt2_chunk_header *hdr,
+                  uint32_t chunk_size)
+{
+    if ( hdr->magic != XT2_MAGIC_CHUNK ||
+         hdr->used > chunk_size - sizeof(*hdr) )
+        return false;
+
+    dec->p = (const uint8_t *)(hdr + 1);
+    dec->end = dec->p + hdr->used;
+    dec->prev_tsc = 0;
+    dec->nr_dict = 0;
+
+    return true;
+}
+
+int xt2_dec_record(struct xt2_dec *dec, uint32_t *rec)
+{
+    uint64_t head, val;
+    unsigned int idx, extra, i, nr = 1;
+    uint32_t event;
+
+    if ( dec->p == dec->end )
+        return 0;
+
+    if ( !get_varint(dec, &head) || (head >> HEAD_DICT_SHIFT) > XT2_DICT_MAX )
+        return -1;
+
+    idx = head >> HEAD_DICT_SHIFT;
+    extra = head & HEAD_EXTRA_MASK;
+
+    if ( idx )
+    {
+        if ( idx > dec->nr_dict )
+            return -1;
+        event = dec->dict[idx - 1];
+    }
+    else
+    {
+        if ( !get_varint(dec, &val) || val > TRC_HD_TO_EVENT(~0U) )
+            return -1;
+        event = val;
+        /* Literal events are new to the dictionary, unless it's full. */
+        if ( dec->nr_dict < XT2_DICT_MAX )
+            dec->dict[dec->nr_dict++] = event;
+    }
+
+    rec[0] = event | (extra << TRACE_EXTRA_SHIFT);
+
+    if ( head & HEAD_CYCLES )
+    {
+        if ( !get_varint(dec, &val) )
+            return -1;
+
+        dec->prev_tsc += unzigzag(val);
+        rec[0] |= TRC_HD_CYCLE_FLAG;
+        rec[nr++] = dec->prev_tsc;
+        rec[nr++] = dec->prev_tsc >> 32;
+    }
+
+    for ( i = 0; i < extra; i++ )
+    {
+        if ( !get_varint(dec, &val) || val > UINT32_MAX )
+            return -1;
+        rec[nr++] = val;
+    }
+
+    return nr;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,141 @@
+/*
+ * tools/xentrace/trace-v2.h
+ *
+ * Xen trace stream format v2.
+ *
+ * Instead of one stream of raw records interleaving windows of all CPUs,
+ * "xentrace --v2-dir=DIR" writes a file per physical CPU, DIR/cpuN.xt2, and
+ * an index of the chunks written, DIR/index.xt2.  All values are host
+ * endian.
+ *
+ * A per-CPU file is a XT2_HEADER_SIZE header, followed by chunks of
+ * chunk_size bytes, so that chunk n is at offset
+ * XT2_HEADER_SIZE + n * chunk_size and can be mmap()-ed on its own.  Chunks
+ * are self contained: a chunk header, followed by used bytes of encoded
+ * records, followed by padding.
+ *
+ * A record is encoded as a sequence of LEB128 varints:
+ *
+ *   head   (dict << 4) | (cycles << 3) | extra
+ *   event  only if dict is 0, the event ID, which then becomes the next
+ *          entry of the chunk's dictionary (up to XT2_DICT_MAX entries);
+ *          otherwise dict - 1 indexes the dictionary
+ *   tsc    only if cycles is set, zigzag encoded difference from the
+ *          chunk's previous timestamp, or from 0 for the first one
+ *   data   extra varints, the event data items
+ *
+ * Wrap records of the hypervisor's buffers (TRC_TRACE_WRAP_BUFFER) are just
+ * padding, and are dropped.  CPU change records aren't needed.
+ *
+ * The index is a struct xt2_index_header, followed by an entry for every
+ * chunk, in the order they were completed.
+ */
+#ifndef __XENTRACE_TRACE_V2_H__
+#define __XENTRACE_TRACE_V2_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define XT2_MAGIC_FILE          0x32525458  /* "XTR2" */
+#define XT2_MAGIC_CHUNK         0x4b4e4843  /* "CHNK" */
+#define XT2_MAGIC_INDEX         0x58444e49  /* "INDX" */
+#define XT2_VERSION             2
+
+#define XT2_HEADER_SIZE         4096
+#define XT2_DEFAULT_CHUNK_SIZE  (64 << 10)
+#define XT2_DICT_MAX            255
+#define XT2_DICT_HASH           512     /* Power of 2, > XT2_DICT_MAX. */
+
+/* Words of the largest raw record: header, TSC, TRACE_EXTRA_MAX data. */
+#define XT2_REC_MAX_WORDS       (1 + 2 + 7)
+/* Bytes of the largest encoded record. */
+#define XT2_REC_MAX_ENC         (2 + 5 + 10 + 7 * 5)
+
+struct xt2_file_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t cpu;
+    uint32_t chunk_size;
+    uint32_t pad;
+};
+
+struct xt2_chunk_header {
+    uint32_t magic;
+    uint32_t used;          /* Bytes of records after the header. */
+    uint32_t nr_records;
+    uint32_t pad;
+    uint64_t first_tsc;     /* Of the records with one, 0 if none. */
+    uint64_t last_tsc;
+};
+
+struct xt2_index_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t pad;
+    uint32_t chunk_size;
+    uint32_t pad2;
+};
+
+struct xt2_index_entry {
+    uint16_t cpu;
+    uint16_t pad;
+    uint32_t chunk;         /* Number within the CPU's file. */
+    uint32_t nr_records;
+    uint32_t pad2;
+    uint64_t first_tsc;
+    uint64_t last_tsc;
+};
+
+static inline uint64_t xt2_chunk_offset(uint32_t chunk_size, uint32_t chunk)
+{
+    return XT2_HEADER_SIZE + (uint64_t)chunk * chunk_size;
+}
+
+/* Encoder state for one chunk, whose buffer starts with its header. */
+struct xt2_enc {
+    uint8_t *buf;
+    uint32_t size;
+    uint64_t prev_tsc;
+    unsigned int nr_dict;
+    uint32_t dict[XT2_DICT_MAX];
+    uint8_t hash[XT2_DICT_HASH];        /* Dictionary index + 1, by event. */
+};
+
+void xt2_enc_reset(struct xt2_enc *enc);
+
+/*
+ * Append a raw record, as found in the hypervisor's trace buffers.  Returns
+ * false without doing anything if it doesn't fit in the chunk anymore.
+ */
+bool xt2_enc_record(struct xt2_enc *enc, const uint32_t *rec);
+
+/* Decoder state for one chunk. */
+struct xt2_dec {
+    const uint8_t *p, *end;
+    uint64_t prev_tsc;
+    unsigned int nr_dict;
+    uint32_t dict[XT2_DICT_MAX];
+};
+
+/* Returns false if hdr isn't a valid chunk of chunk_size bytes. */
+bool xt2_dec_init(struct xt2_dec *dec, const struct xt2_chunk_header *hdr,
+                  uint32_t chunk_size);
+
+/*
+ * Decode the next record into its raw form, in rec[XT2_REC_MAX_WORDS].
+ * Returns the number of words, 0 at the end of the chunk, or -1 if the
+ * chunk is corrupt.
+ */
+int xt2_dec_record(struct xt2_dec *dec, uint32_t *rec);
+
+#endif /* __XENTRACE_TRACE_V2_H__ */
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,287 @@
+/*
+ * tools/xentrace/v2cat.c
+ *
+ * Convert a trace format v2 directory, as written by "xentrace --v2-dir",
+ * back into the single stream format which xentrace writes by default.
+ *
+ * Chunks are emitted in order of their first timestamp, each as a window of
+ * records preceded by a CPU change record, like xentrace does for the
+ * windows it reads from the hypervisor's buffers.  A chunk without any
+ * timestamp goes right after the previous chunk of its CPU.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <xen/xen.h>
+#include <xen/trace.h>
+
+#include "trace-v2.h"
+
+struct cpu_change_record {
+    uint32_t header;
+    struct {
+        int cpu;
+        unsigned window_size;
+    } data;
+};
+
+#define CPU_CHANGE_HEADER                                           \
+    (TRC_TRACE_CPU_CHANGE                                           \
+     | (((sizeof(struct cpu_change_record)/sizeof(uint32_t)) - 1)   \
+        << TRACE_EXTRA_SHIFT) )
+
+static const char *dir;
+static uint32_t chunk_size;
+
+static struct cpu_file {
+    const uint8_t *map;
+    size_t size;
+} *cpus;
+static unsigned int nr_cpus;
+
+static void *map_file(const char *name, size_t *size)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    void *map;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+    fd = open(path, O_RDONLY);
+    if ( fd < 0 || fstat(fd, &st) )
+    {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    *size = st.st_size;
+    map = *size ? mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    if ( map == MAP_FAILED )
+    {
+        fprintf(stderr, "Could not map %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    return map;
+}
+
+static const struct xt2_chunk_header *get_chunk(unsigned int cpu,
+                                                uint32_t chunk)
+{
+    struct cpu_file *f;
+    const struct xt2_file_header *hdr;
+    uint64_t offset = xt2_chunk_offset(chunk_size, chunk);
+
+    if ( cpu >= nr_cpus )
+    {
+        struct cpu_file *n = realloc(cpus, (cpu + 1) * sizeof(*cpus));
+
+        if ( !n )
+        {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        memset(n + nr_cpus, 0, (cpu + 1 - nr_cpus) * sizeof(*n));
+        cpus = n;
+        nr_cpus = cpu + 1;
+    }
+
+    f = &cpus[cpu];
+    if ( !f->map )
+    {
+        char name[32];
+
+        snprintf(name, sizeof(name), "cpu%u.xt2", cpu);
+        f->map = map_file(name, &f->size);
+
+        hdr = (const void *)f->map;
+        if ( f->size < XT2_HEADER_SIZE || hdr->magic != XT2_MAGIC_FILE ||
+             hdr->version != XT2_VERSION || hdr->cpu != cpu ||
+             hdr->chunk_size != chunk_size )
+        {
+            fprintf(stderr, "%s/%s: bad file header\n", dir, name);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ( offset + chunk_size > f->size )
+    {
+        fprintf(stderr, "%s/cpu%u.xt2: chunk %u beyond the end of the file\n",
+                dir, cpu, chunk);
+        exit(EXIT_FAILURE);
+    }
+
+    return (const void *)(f->map + offset);
+}
+
+static int cmp_chunk(const void *a, const void *b)
+{
+    const struct xt2_index_entry *x = a, *y = b;
+
+    if ( x->cpu != y->cpu )
+        return x->cpu < y->cpu ? -1 : 1;
+
+    return (x->chunk > y->chunk) - (x->chunk < y->chunk);
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+    const struct xt2_index_entry *x = a, *y = b;
+
+    if ( x->first_tsc != y->first_tsc )
+        return x->first_tsc < y->first_tsc ? -1 : 1;
+    if ( x->cpu != y->cpu )
+        return x->cpu < y->cpu ? -1 : 1;
+
+    return (x->chunk > y->chunk) - (x->chunk < y->chunk);
+}
+
+static void write_out(int fd, const void *buf, size_t size)
+{
+    if ( write(fd, buf, size) != size )
+    {
+        perror("write");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const struct xt2_index_header *ihdr;
+    struct xt2_index_entry *ents;
+    size_t size, nr, i;
+    uint32_t *out = NULL;
+    size_t out_size = 0;
+    int outfd = 1;
+
+    if ( argc < 2 || argc > 3 )
+    {
+        fprintf(stderr, "Usage: %s DIR [output file]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    dir = argv[1];
+
+    if ( argc > 2 )
+    {
+        outfd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if ( outfd < 0 )
+        {
+            perror("Could not open output file");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if ( isatty(outfd) )
+    {
+        fprintf(stderr, "Cannot output to a TTY, specify a file.\n");
+        return EXIT_FAILURE;
+    }
+
+    ihdr = map_file("index.xt2", &size);
+    if ( size < sizeof(*ihdr) || ihdr->magic != XT2_MAGIC_INDEX ||
+         ihdr->version != XT2_VERSION ||
+         ihdr->chunk_size < XT2_HEADER_SIZE ||
+         ihdr->chunk_size % XT2_HEADER_SIZE )
+    {
+        fprintf(stderr, "%s/index.xt2: bad header\n", dir);
+        return EXIT_FAILURE;
+    }
+
+    chunk_size = ihdr->chunk_size;
+
+    /* A copy, for sorting.  A trailing partial entry is ignored. */
+    nr = (size - sizeof(*ihdr)) / sizeof(*ents);
+    ents = malloc(nr * sizeof(*ents) ?: 1);
+    if ( !ents )
+    {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    memcpy(ents, ihdr + 1, nr * sizeof(*ents));
+
+    /* Chunks without a timestamp sort as at the end of the previous one. */
+    qsort(ents, nr, sizeof(*ents), cmp_chunk);
+    for ( i = 1; i < nr; i++ )
+        if ( !ents[i].first_tsc && ents[i].cpu == ents[i - 1].cpu )
+            ents[i].first_tsc = ents[i].last_tsc = ents[i - 1].last_tsc;
+
+    qsort(ents, nr, sizeof(*ents), cmp_entry);
+
+    for ( i = 0; i < nr; i++ )
+    {
+        const struct xt2_chunk_header *chdr = get_chunk(ents[i].cpu,
+                                                       ents[i].chunk);
+        struct cpu_change_record rec = {
+            .header = CPU_CHANGE_HEADER,
+            .data.cpu = ents[i].cpu,
+        };
+        struct xt2_dec dec;
+        size_t used = 0;
+        int rc;
+
+        if ( !xt2_dec_init(&dec, chdr, chunk_size) )
+        {
+            fprintf(stderr, "cpu%u chunk %u: bad chunk header\n",
+                    ents[i].cpu, ents[i].chunk);
+            return EXIT_FAILURE;
+        }
+
+        for ( ; ; )
+        {
+            if ( used + XT2_REC_MAX_WORDS > out_size )
+            {
+                out_size = out_size ? out_size * 2 : chunk_size;
+                out = realloc(out, out_size * sizeof(*out));
+                if ( !out )
+                {
+                    perror("realloc");
+                    return EXIT_FAILURE;
+                }
+            }
+
+            rc = xt2_dec_record(&dec, out + used);
+            if ( rc <= 0 )
+                break;
+            used += rc;
+        }
+
+        if ( rc < 0 )
+            fprintf(stderr, "cpu%u chunk %u: corrupt record, skipping the rest\n",
+                    ents[i].cpu, ents[i].chunk);
+
+        if ( !used )
+            continue;
+
+        rec.data.window_size = used * sizeof(*out);
+        write_out(outfd, &rec, sizeof(rec));
+        write_out(outfd, out, used * sizeof(*out));
+    }
+
+    free(out);
+    free(ents);
+    close(outfd);
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
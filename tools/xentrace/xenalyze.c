@@ -34,6 +34,7 @@
 #include "analyze.h"
 #include "mread.h"
 #include "pv.h"
+#include "trace-index.h"
 #include <errno.h>
 #include <strings.h>
 #include <string.h>
@@ -68,6 +69,7 @@ struct array_struct {
 struct {
     int fd;
     struct mread_ctrl *mh;
+    struct tindex *index;
     struct symbol_struct * symbols;
     char * symbol_file;
     char * trace_file;
@@ -181,6 +183,7 @@ struct {
         summary:1,
         report_pcpu:1,
         tsc_loop_fatal:1,
+        no_index:1,
         summary_info;
     long long cpu_qhz, cpu_hz;
     int scatterplot_interrupt_vector;
@@ -191,6 +194,7 @@ struct {
     int interrupt_eip_enumeration_vector;
     int default_guest_paging_levels;
     int sample_size, sample_max;
+    int threads;                /* Trace reader threads, -1 for default */
     enum error_level tolerance; /* Tolerate up to this level of error */
     struct {
         tsc_t cycles;
@@ -254,6 +258,8 @@ struct {
     .summary = 0,
     .report_pcpu = 0,
     .tsc_loop_fatal = 0,
+    .no_index = 0,
+    .threads = -1,
     .cpu_hz = DEFAULT_CPU_HZ,
     /* Pre-calculate a multiplier that makes the rest of the
      * calculations easier */
@@ -9431,7 +9437,8 @@ void process_cpu_change(struct pcpu_info *p) {
 
         if(p->next_cpu_change_offset > G.file_size)
             activate_early_eof();
-        else if(p->pid == P.max_active_pcpu)
+        else if(!G.index && p->pid == P.max_active_pcpu)
+            /* With an index, all pcpus got activated upfront. */
             scan_for_new_pcpu(p->next_cpu_change_offset);
 
     }
@@ -9744,6 +9751,26 @@ void __fill_in_record_info(struct pcpu_info *p)
     ri->cpu = p->pid;
 }
 
+/*
+ * With an index, each pcpu's records come straight from its own windows,
+ * read ahead by the index's threads, rather than from the file offset
+ * following its last record.
+ */
+static ssize_t read_indexed_record(struct pcpu_info *p)
+{
+    const struct tindex_rec *r = tindex_next(G.index, p->pid);
+
+    if ( !r )
+        return 0;
+
+    memcpy(&p->ri.rec, r->words, sizeof(p->ri.rec));
+    p->file_offset = r->offset;
+    if ( p->ri.rec.event == TRC_TRACE_CPU_CHANGE )
+        p->next_cpu_change_offset = r->offset;
+
+    return r->size;
+}
+
 ssize_t read_record(struct pcpu_info * p) {
     off_t * offset;
     struct record_info *ri;
@@ -9751,7 +9778,10 @@ ssize_t read_record(struct pcpu_info * p) {
     offset = &p->file_offset;
     ri = &p->ri;
 
-    ri->size = __read_record(&ri->rec, *offset);
+    if ( G.index )
+        ri->size = read_indexed_record(p);
+    else
+        ri->size = __read_record(&ri->rec, *offset);
     if(ri->size)
     {
         __fill_in_record_info(p);
@@ -10075,6 +10105,28 @@ void init_pcpus(void) {
 
     sched_default_domain_init();
 
+    if ( G.index )
+    {
+        for ( i = 0; i < tindex_nr_cpus(G.index); i++ )
+        {
+            struct pcpu_info *p = P.pcpu + i;
+
+            if ( !tindex_nr_windows(G.index, i) )
+                continue;
+
+            fprintf(warn, "%s: Activating pcpu %d, %u windows\n",
+                    __func__, i, tindex_nr_windows(G.index, i));
+
+            p->active = 1;
+            P.max_active_pcpu = i;
+            /* The first record is the cpu_change of its first window. */
+            read_record(p);
+            record_order_insert(p);
+            sched_default_vcpu_activate(p);
+        }
+        return;
+    }
+
     /* Scan through the cpu_change recs until we see a duplicate */
     do {
         offset = scan_for_new_pcpu(offset);
@@ -10140,6 +10192,8 @@ enum {
     OPT_PROGRESS,
     OPT_TOLERANCE,
     OPT_TSC_LOOP_FATAL,
+    OPT_NO_INDEX,
+    OPT_THREADS,
     /* Specific letters */
     OPT_DUMP_ALL='a',
     OPT_INTERVAL_LENGTH='i',
@@ -10620,6 +10674,20 @@ error_t cmd_parser(int key, char *arg, struct argp_state *state)
         opt.tsc_loop_fatal = 1;
         break;
 
+    case OPT_NO_INDEX:
+        opt.no_index = 1;
+        break;
+
+    case OPT_THREADS:
+    {
+        char * inval;
+
+        opt.threads = (int)strtol(arg, &inval, 0);
+        if ( inval == arg || opt.threads < 0 )
+            argp_usage(state);
+    }
+    break;
+
     case ARGP_KEY_ARG:
     {
         /* FIXME - strcpy */
@@ -10909,6 +10977,15 @@ const struct argp_option cmd_opts[] =  {
       .arg = "errlevel",
       .doc = "Sets tolerance for errors found in the file.  Default is 3; max is 6.", },
 
+    { .name = "no-index",
+      .key = OPT_NO_INDEX,
+      .doc = "Read the trace sequentially, rather than by a per-cpu index of its windows.  The index gets cached in <trace file>.xzi.", },
+
+    { .name = "threads",
+      .key = OPT_THREADS,
+      .arg = "N",
+      .doc = "Threads reading ahead per-cpu records when using the index; 0 reads them as they get processed.  Default is the number of online cpus, up to 8.", },
+
 
     { 0 },
 };
@@ -10941,6 +11018,29 @@ int main(int argc, char *argv[]) {
     if ( (G.mh = mread_init(G.fd)) == NULL )
         perror("mread");
 
+    if ( !opt.no_index )
+    {
+        G.index = tindex_open(G.fd, G.trace_file, MAX_CPUS);
+        if ( !G.index )
+            fprintf(stderr, "Can't index the trace, reading it sequentially\n");
+        else
+        {
+            if ( opt.threads < 0 )
+            {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+                opt.threads = cpus < 1 ? 1 : cpus > 8 ? 8 : cpus;
+            }
+
+            if ( tindex_start(G.index, opt.threads) )
+            {
+                tindex_close(G.index);
+                G.index = NULL;
+                fprintf(stderr, "Can't read the trace in parallel, reading it sequentially\n");
+            }
+        }
+    }
+
     if (G.symbol_file != NULL)
         parse_symbol_file(G.symbol_file);
 
@@ -10966,6 +11066,8 @@ int main(int argc, char *argv[]) {
     if(opt.progress)
         progress_finish();
 
+    tindex_close(G.index);
+
     return 0;
 }
 /*
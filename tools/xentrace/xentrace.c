@@ -24,6 +24,7 @@
 #include <getopt.h>
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
 #include <poll.h>
 #include <sys/statvfs.h>
 
@@ -34,6 +35,8 @@
 #include <xenevtchn.h>
 #include <xenctrl.h>
 
+#include "trace-v2.h"
+
 #define PERROR(_m, _a...)                                       \
 do {                                                            \
     int __saved_errno = errno;                                  \
@@ -49,6 +52,10 @@ do {                                                            \
 #define POLL_SLEEP_MILLIS 100
 
 #define DEFAULT_TBUF_SIZE 32
+
+/* Number of --sample options */
+#define MAX_SAMPLES 16
+
 /***** The code **************************************************************/
 
 typedef struct settings_st {
@@ -60,9 +67,19 @@ typedef struct settings_st {
     unsigned long disk_rsvd;
     unsigned long timeout;
     unsigned long memory_buffer;
+    char *v2_dir;
+    unsigned long v2_chunk_size;
+    uint32_t filter_domid;
+    uint32_t filter_vcpu;
+    unsigned int nr_samples;
+    struct {
+        uint32_t class_mask;
+        uint32_t rate;
+    } samples[MAX_SAMPLES];
     uint8_t discard:1,
         disable_tracing:1,
-        start_disabled:1;
+        start_disabled:1,
+        set_filter:1;
 } settings_t;
 
 struct t_struct {
@@ -332,6 +349,241 @@ fail:
     return;
 }
 
+/*
+ * Exit if writing size more bytes to fd would leave less than the reserved
+ * space on its filesystem.
+ */
+static void check_disk_space(int fd, unsigned long size)
+{
+    struct statvfs stat;
+    unsigned long long freespace;
+
+    if ( opts.disk_rsvd == 0 )
+        return;
+
+    /* Check that filesystem has enough space. */
+    if ( fstatvfs (fd, &stat) )
+    {
+        PERROR("Statfs failed");
+        exit(EXIT_FAILURE);
+    }
+
+    freespace = stat.f_frsize * (unsigned long long)stat.f_bfree;
+    freespace -= size;
+    freespace >>= 20; /* Convert to MB */
+
+    if ( freespace <= opts.disk_rsvd )
+    {
+        fprintf(stderr, "Disk space limit reached (free space: %lluMB, limit: %luMB).\n", freespace, opts.disk_rsvd);
+        exit (EXIT_FAILURE);
+    }
+}
+
+/*
+ * Trace format v2 output, see trace-v2.h: records get encoded into a chunk
+ * per CPU, which gets written to the CPU's file and listed in the index once
+ * full.
+ */
+static struct {
+    int index_fd;
+    struct v2_cpu {
+        int fd;
+        uint32_t nr_chunks;
+        struct xt2_enc enc;
+    } *cpus;
+    unsigned int nr_cpus;
+    uint64_t nr_records, raw_bytes, enc_bytes, nr_chunks;
+} v2 = { .index_fd = -1 };
+
+static int v2_open(const char *name)
+{
+    char path[PATH_MAX];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", opts.v2_dir, name);
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE, 0644);
+    if ( fd < 0 )
+    {
+        PERROR("Could not open %s", path);
+        exit(EXIT_FAILURE);
+    }
+
+    return fd;
+}
+
+static void v2_pwrite(int fd, const void *buf, size_t size, off_t offset)
+{
+    ssize_t written = pwrite(fd, buf, size, offset);
+
+    if ( written != size )
+    {
+        fprintf(stderr, "Write failed! (size %zu, returned %zd)\n",
+                size, written);
+        PERROR("Failed to write trace data");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void v2_init(unsigned int num)
+{
+    struct xt2_index_header hdr = {
+        .magic = XT2_MAGIC_INDEX,
+        .version = XT2_VERSION,
+        .chunk_size = opts.v2_chunk_size,
+    };
+    unsigned int i;
+
+    if ( mkdir(opts.v2_dir, 0755) && errno != EEXIST )
+    {
+        PERROR("Could not create %s", opts.v2_dir);
+        exit(EXIT_FAILURE);
+    }
+
+    v2.cpus = calloc(num, sizeof(*v2.cpus));
+    if ( !v2.cpus )
+    {
+        PERROR("Failed to allocate v2 state");
+        exit(EXIT_FAILURE);
+    }
+    v2.nr_cpus = num;
+    for ( i = 0; i < num; i++ )
+        v2.cpus[i].fd = -1;
+
+    v2.index_fd = v2_open("index.xt2");
+    v2_pwrite(v2.index_fd, &hdr, sizeof(hdr), 0);
+    lseek(v2.index_fd, sizeof(hdr), SEEK_SET);
+}
+
+/* Files only get created for CPUs which produce records. */
+static struct v2_cpu *v2_get_cpu(unsigned int cpu)
+{
+    struct v2_cpu *c = &v2.cpus[cpu];
+    static const uint8_t zero[XT2_HEADER_SIZE];
+    struct xt2_file_header hdr = {
+        .magic = XT2_MAGIC_FILE,
+        .version = XT2_VERSION,
+        .cpu = cpu,
+        .chunk_size = opts.v2_chunk_size,
+    };
+    char name[32];
+
+    if ( c->fd >= 0 )
+        return c;
+
+    c->enc.size = opts.v2_chunk_size;
+    c->enc.buf = malloc(c->enc.size);
+    if ( !c->enc.buf )
+    {
+        PERROR("Failed to allocate v2 chunk");
+        exit(EXIT_FAILURE);
+    }
+    xt2_enc_reset(&c->enc);
+
+    snprintf(name, sizeof(name), "cpu%u.xt2", cpu);
+    c->fd = v2_open(name);
+    v2_pwrite(c->fd, zero, sizeof(zero), 0);
+    v2_pwrite(c->fd, &hdr, sizeof(hdr), 0);
+
+    return c;
+}
+
+static void v2_seal_chunk(unsigned int cpu)
+{
+    struct v2_cpu *c = &v2.cpus[cpu];
+    const struct xt2_chunk_header *hdr = (const void *)c->enc.buf;
+    struct xt2_index_entry ent = {
+        .cpu = cpu,
+        .chunk = c->nr_chunks,
+        .nr_records = hdr->nr_records,
+        .first_tsc = hdr->first_tsc,
+        .last_tsc = hdr->last_tsc,
+    };
+    ssize_t written;
+
+    if ( !hdr->nr_records )
+        return;
+
+    check_disk_space(c->fd, c->enc.size + sizeof(ent));
+
+    v2_pwrite(c->fd, c->enc.buf, c->enc.size,
+              xt2_chunk_offset(c->enc.size, c->nr_chunks));
+
+    written = write(v2.index_fd, &ent, sizeof(ent));
+    if ( written != sizeof(ent) )
+    {
+        fprintf(stderr, "Cannot write index entry (write returned %zd)\n",
+                written);
+        PERROR("Failed to write trace data");
+        exit(EXIT_FAILURE);
+    }
+
+    v2.enc_bytes += sizeof(*hdr) + hdr->used;
+    v2.nr_chunks++;
+    c->nr_chunks++;
+    xt2_enc_reset(&c->enc);
+}
+
+/* Records never straddle the end of the buffer, so neither the pieces. */
+static void v2_write_buffer(unsigned int cpu, unsigned char *start, int size)
+{
+    struct v2_cpu *c = v2_get_cpu(cpu);
+
+    v2.raw_bytes += size;
+
+    while ( size >= sizeof(uint32_t) )
+    {
+        const uint32_t *rec = (const uint32_t *)start;
+        int len = (1 + TRC_HD_EXTRA(*rec) +
+                   (TRC_HD_INCLUDES_CYCLE_COUNT(*rec) ? 2 : 0)) *
+                  sizeof(uint32_t);
+
+        if ( len > size )
+        {
+            fprintf(stderr, "Truncated trace record on CPU%u, dropping %d bytes\n",
+                    cpu, size);
+            break;
+        }
+
+        /* Wrap records only pad the end of the hypervisor's buffer. */
+        if ( TRC_HD_TO_EVENT(*rec) != TRC_TRACE_WRAP_BUFFER )
+        {
+            if ( !xt2_enc_record(&c->enc, rec) )
+            {
+                v2_seal_chunk(cpu);
+                xt2_enc_record(&c->enc, rec);
+            }
+            v2.nr_records++;
+        }
+
+        start += len;
+        size -= len;
+    }
+}
+
+static void v2_finish(void)
+{
+    unsigned int i;
+
+    for ( i = 0; i < v2.nr_cpus; i++ )
+    {
+        if ( v2.cpus[i].fd < 0 )
+            continue;
+
+        v2_seal_chunk(i);
+        close(v2.cpus[i].fd);
+        free(v2.cpus[i].enc.buf);
+    }
+
+    close(v2.index_fd);
+    free(v2.cpus);
+
+    fprintf(stderr, "%"PRIu64" records, %"PRIu64" bytes encoded from %"PRIu64
+            " (%"PRIu64"%%), in %"PRIu64" chunks\n",
+            v2.nr_records, v2.enc_bytes, v2.raw_bytes,
+            v2.raw_bytes ? v2.enc_bytes * 100 / v2.raw_bytes : 0,
+            v2.nr_chunks);
+}
+
 /**
  * write_buffer - write a section of the trace buffer
  * @cpu      - source buffer CPU ID
@@ -346,36 +598,17 @@ fail:
 static void write_buffer(unsigned int cpu, unsigned char *start, int size,
                          int total_size)
 {
-    struct statvfs stat;
     size_t written = 0;
-    
-    if ( opts.memory_buffer == 0 && opts.disk_rsvd != 0 )
-    {
-        unsigned long long freespace;
 
-        /* Check that filesystem has enough space. */
-        if ( fstatvfs (outfd, &stat) )
-        {
-            fprintf(stderr, "Statfs failed!\n");
-            goto fail;
-        }
-
-        freespace = stat.f_frsize * (unsigned long long)stat.f_bfree;
-
-        if ( total_size )
-            freespace -= total_size;
-        else
-            freespace -= size;
-
-        freespace >>= 20; /* Convert to MB */
-
-        if ( freespace <= opts.disk_rsvd )
-        {
-            fprintf(stderr, "Disk space limit reached (free space: %lluMB, limit: %luMB).\n", freespace, opts.disk_rsvd);
-            exit (EXIT_FAILURE);
-        }
+    if ( opts.v2_dir )
+    {
+        v2_write_buffer(cpu, start, size);
+        return;
     }
 
+    if ( opts.memory_buffer == 0 )
+        check_disk_space(outfd, total_size ?: size);
+
     /* Write a CPU_BUF record on each buffer "window" written.  Wrapped
      * windows may involve two writes, so only write the record on the
      * first write. */
@@ -584,6 +817,40 @@ static void set_evt_mask(uint32_t mask)
     }
 }
 
+/**
+ * set_filter - restrict tracing to a domain, or a vCPU of it
+ */
+static void set_filter(uint32_t domid, uint32_t vcpu)
+{
+    if ( xc_tbuf_set_filter(xc_handle, domid, vcpu) != 0 )
+    {
+        PERROR("Failure to set the trace filter");
+        exit(EXIT_FAILURE);
+    }
+
+    if ( domid == DOMID_INVALID )
+        fprintf(stderr, "tracing all domains\n");
+    else if ( vcpu == XEN_SYSCTL_TBUF_ALL_VCPUS )
+        fprintf(stderr, "tracing d%u only\n", domid);
+    else
+        fprintf(stderr, "tracing d%uv%u only\n", domid, vcpu);
+}
+
+/**
+ * set_sample - trace only 1 in rate events of some classes
+ */
+static void set_sample(uint32_t class_mask, uint32_t rate)
+{
+    if ( xc_tbuf_set_sample(xc_handle, class_mask, rate) != 0 )
+    {
+        PERROR("Failure to set the trace sampling rate");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "sampling 1 in %u events of classes 0x%x\n",
+            rate ?: 1, class_mask);
+}
+
 /**
  * get_num_cpus - get the number of logical CPUs
  */
@@ -706,6 +973,9 @@ static void monitor_tbufs(void)
     meta = tbufs->meta;
     data = tbufs->data;
 
+    if ( opts.v2_dir )
+        v2_init(num);
+
     if ( opts.discard )
         for ( i = 0; i < num; i++ )
             if ( meta[i] )
@@ -790,6 +1060,9 @@ static void monitor_tbufs(void)
     if ( opts.memory_buffer )
         membuf_dump();
 
+    if ( opts.v2_dir )
+        v2_finish();
+
     /* cleanup */
     free(meta);
     free(data);
@@ -842,6 +1115,17 @@ static void usage(int status)
 "  -r  --reserve-disk-space=n Before writing trace records to disk, check to see\n" \
 "                          that after the write there will be at least n space\n" \
 "                          left on the disk.\n" \
+"      --v2-dir=DIR        Write the compact trace format v2 instead: a file\n" \
+"                          per CPU, DIR/cpuN.xt2, and an index of their\n" \
+"                          chunks, DIR/index.xt2.  xentrace_v2cat converts\n" \
+"                          them back to a single stream.\n" \
+"      --v2-chunk-size=b   Size of the chunks of v2 files, a multiple of 4k\n" \
+"                          (default 64k).\n" \
+"      --domid=d           Only trace events occurring while a vCPU of\n" \
+"                          domain d is running, or of any domain with all.\n" \
+"      --vcpu=v            With --domid, only while its vCPU v is running.\n" \
+"      --sample=c:n        Only trace 1 in n events of class(es) c, given\n" \
+"                          like an evt-mask.  May be repeated.\n" \
 "\n" \
 "This tool is used to capture trace buffer data from Xen. The\n" \
 "data is output in a binary format, in the following order:\n" \
@@ -926,26 +1210,56 @@ static long argtol(const char *restrict arg, int base)
     return val;
 }
 
-static int parse_evtmask(char *arg)
+static uint32_t class_by_name(const char *arg)
 {
-    /* search filtering class */
     if (strcmp(arg, "gen") == 0){ 
-        opts.evt_mask |= TRC_GEN;
+        return TRC_GEN;
     } else if(strcmp(arg, "sched") == 0){ 
-        opts.evt_mask |= TRC_SCHED;
+        return TRC_SCHED;
     } else if(strcmp(arg, "dom0op") == 0){ 
-        opts.evt_mask |= TRC_DOM0OP;
+        return TRC_DOM0OP;
     } else if(strcmp(arg, "hvm") == 0){ 
-        opts.evt_mask |= TRC_HVM;
+        return TRC_HVM;
     } else if(strcmp(arg, "all") == 0){ 
-        opts.evt_mask |= TRC_ALL;
-    } else {
-        opts.evt_mask = argtol(arg, 0);
+        return TRC_ALL;
     }
 
     return 0;
 }
 
+static int parse_evtmask(char *arg)
+{
+    /* search filtering class */
+    uint32_t mask = class_by_name(arg);
+
+    if ( mask )
+        opts.evt_mask |= mask;
+    else
+        opts.evt_mask = argtol(arg, 0);
+
+    return 0;
+}
+
+/* parse class:rate */
+static void parse_sample(char *arg)
+{
+    char *sep = strchr(arg, ':');
+    uint32_t mask;
+
+    if ( !sep || opts.nr_samples == MAX_SAMPLES )
+    {
+        fprintf(stderr, "Invalid sample: %s\n\n", arg);
+        usage(EXIT_FAILURE);
+    }
+
+    *sep = '\0';
+    mask = class_by_name(arg) ?: argtol(arg, 0);
+
+    opts.samples[opts.nr_samples].class_mask = mask;
+    opts.samples[opts.nr_samples].rate = argtol(sep + 1, 0);
+    opts.nr_samples++;
+}
+
 #define ZERO_DIGIT '0'
 
 #define is_terminator(c) ((c)=='\0' || (c)==',')
@@ -1074,6 +1388,14 @@ static int parse_cpu_mask(void)
     return ret;
 }
 
+enum {
+    OPT_V2_DIR = 256,
+    OPT_V2_CHUNK_SIZE,
+    OPT_DOMID,
+    OPT_VCPU,
+    OPT_SAMPLE,
+};
+
 /* parse command line arguments */
 static void parse_args(int argc, char **argv)
 {
@@ -1090,6 +1412,11 @@ static void parse_args(int argc, char **argv)
         { "discard-buffers", no_argument,      0, 'D' },
         { "dont-disable-tracing", no_argument, 0, 'x' },
         { "start-disabled", no_argument,       0, 'X' },
+        { "v2-dir",         required_argument, 0, OPT_V2_DIR },
+        { "v2-chunk-size",  required_argument, 0, OPT_V2_CHUNK_SIZE },
+        { "domid",          required_argument, 0, OPT_DOMID },
+        { "vcpu",           required_argument, 0, OPT_VCPU },
+        { "sample",         required_argument, 0, OPT_SAMPLE },
         { "help",           no_argument,       0, 'h' },
         { "version",        no_argument,       0, 'V' },
         { 0, 0, 0, 0 }
@@ -1144,6 +1471,35 @@ static void parse_args(int argc, char **argv)
             opts.memory_buffer = sargtol(optarg, 0);
             break;
 
+        case OPT_V2_DIR:
+            opts.v2_dir = optarg;
+            break;
+
+        case OPT_V2_CHUNK_SIZE:
+            opts.v2_chunk_size = sargtol(optarg, 0);
+            if ( opts.v2_chunk_size < XT2_HEADER_SIZE ||
+                 opts.v2_chunk_size > (64 << 20) ||
+                 opts.v2_chunk_size % XT2_HEADER_SIZE )
+            {
+                fprintf(stderr, "Invalid v2 chunk size: %s\n\n", optarg);
+                usage(EXIT_FAILURE);
+            }
+            break;
+
+        case OPT_DOMID:
+            opts.filter_domid = strcmp(optarg, "all") == 0
+                                ? DOMID_INVALID : argtol(optarg, 0);
+            opts.set_filter = 1;
+            break;
+
+        case OPT_VCPU:
+            opts.filter_vcpu = argtol(optarg, 0);
+            break;
+
+        case OPT_SAMPLE:
+            parse_sample(optarg);
+            break;
+
         case 'h':
             usage(EXIT_SUCCESS);
             break;
@@ -1156,6 +1512,20 @@ static void parse_args(int argc, char **argv)
     /* get outfile (optional last argument) */
     if (argc > optind)
         opts.outfile = argv[optind];
+
+    if ( opts.v2_dir && (opts.outfile || opts.memory_buffer) )
+    {
+        fprintf(stderr, "--v2-dir can't be combined with an output file "
+                "or a memory buffer\n\n");
+        usage(EXIT_FAILURE);
+    }
+
+    if ( opts.filter_vcpu != XEN_SYSCTL_TBUF_ALL_VCPUS &&
+         (!opts.set_filter || opts.filter_domid == DOMID_INVALID) )
+    {
+        fprintf(stderr, "--vcpu requires --domid\n\n");
+        usage(EXIT_FAILURE);
+    }
 }
 
 /* *BSD has no O_LARGEFILE */
@@ -1166,6 +1536,7 @@ static void parse_args(int argc, char **argv)
 int main(int argc, char **argv)
 {
     struct sigaction act;
+    unsigned int i;
 
     opts.outfile = 0;
     opts.poll_sleep = POLL_SLEEP_MILLIS;
@@ -1175,6 +1546,11 @@ int main(int argc, char **argv)
     opts.disable_tracing = 1;
     opts.start_disabled = 0;
     opts.timeout = 0;
+    opts.v2_dir = NULL;
+    opts.v2_chunk_size = XT2_DEFAULT_CHUNK_SIZE;
+    opts.filter_domid = DOMID_INVALID;
+    opts.filter_vcpu = XEN_SYSCTL_TBUF_ALL_VCPUS;
+    opts.nr_samples = 0;
 
     parse_args(argc, argv);
 
@@ -1188,6 +1564,12 @@ int main(int argc, char **argv)
     if ( opts.evt_mask != 0 )
         set_evt_mask(opts.evt_mask);
 
+    if ( opts.set_filter )
+        set_filter(opts.filter_domid, opts.filter_vcpu);
+
+    for ( i = 0; i < opts.nr_samples; i++ )
+        set_sample(opts.samples[i].class_mask, opts.samples[i].rate);
+
     if ( opts.cpu_mask_str )
     {
         if ( parse_cpu_mask() )
@@ -1208,7 +1590,7 @@ int main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }        
 
-    if ( isatty(outfd) )
+    if ( !opts.v2_dir && isatty(outfd) )
     {
         fprintf(stderr, "Cannot output to a TTY, specify a log file.\n");
         exit(EXIT_FAILURE);
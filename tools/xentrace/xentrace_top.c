@@ -0,0 +1,509 @@
+/*
+ * tools/xentrace/xentrace_top.c
+ *
+ * Live, xentop-like view of scheduling and HVM exits per vCPU, aggregated
+ * from Xen's trace buffers as they fill, with libxentrace, instead of from
+ * a trace file.
+ *
+ * Records are attributed to the vCPU running on the physical CPU they were
+ * recorded on, as known from the last runstate change to running there.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <xenctrl.h>
+#include <xentrace.h>
+
+#include <xen/xen.h>
+#include <xen/trace.h>
+#include <xen/vcpu.h>
+
+#define DEFAULT_TBUF_SIZE   32
+#define POLL_MS             100
+#define NR_TOP_EXITS        4
+#define NR_EXIT_REASONS     0x410   /* Beyond SVM's VMEXIT_NPF and friends. */
+#define HASH_SIZE           1024
+
+#define EVT_MASK (TRC_SCHED_MIN | TRC_SCHED_VERBOSE | TRC_HVM_ENTRYEXIT)
+
+struct exit_count {
+    uint32_t reason;
+    unsigned long count;
+};
+
+struct vcpu_stats {
+    struct vcpu_stats *next;
+    unsigned int domid, vcpu;
+
+    /* Over the current interval. */
+    uint64_t run_cycles;
+    unsigned long switches, wakes, exits;
+    unsigned long *exit_counts;     /* [NR_EXIT_REASONS], once it exits. */
+    unsigned long other_exits;      /* With reasons beyond those. */
+};
+
+struct pcpu_state {
+    struct vcpu_stats *curr;
+    uint64_t run_start;         /* TSC curr started running at, or 0. */
+    uint64_t last_tsc;
+};
+
+static struct vcpu_stats *hash[HASH_SIZE];
+static struct pcpu_state *pcpus;
+static unsigned int nr_pcpus;
+static unsigned int nr_vcpus;
+static unsigned long lost_records;
+
+static volatile sig_atomic_t interrupted;
+
+static struct {
+    double delay;
+    unsigned long iterations;
+    unsigned long tbuf_size;
+    unsigned int batch:1,
+        keep_mask:1,
+        disable_tracing:1;
+} opts = {
+    .delay = 1,
+    .tbuf_size = DEFAULT_TBUF_SIZE,
+    .disable_tracing = 1,
+};
+
+static void close_handler(int signal)
+{
+    interrupted = 1;
+}
+
+static struct vcpu_stats *get_vcpu(unsigned int domid, unsigned int vcpu)
+{
+    unsigned int h = (domid * 31 + vcpu) % HASH_SIZE;
+    struct vcpu_stats *v;
+
+    for ( v = hash[h]; v; v = v->next )
+        if ( v->domid == domid && v->vcpu == vcpu )
+            return v;
+
+    v = calloc(1, sizeof(*v));
+    if ( !v )
+    {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    v->domid = domid;
+    v->vcpu = vcpu;
+    v->next = hash[h];
+    hash[h] = v;
+    nr_vcpus++;
+
+    return v;
+}
+
+static void account_run(struct pcpu_state *p, uint64_t tsc)
+{
+    if ( p->curr && p->run_start && tsc > p->run_start )
+        p->curr->run_cycles += tsc - p->run_start;
+    p->run_start = tsc;
+}
+
+static void count_exit(struct vcpu_stats *v, uint32_t reason)
+{
+    v->exits++;
+
+    if ( reason >= NR_EXIT_REASONS )
+    {
+        v->other_exits++;
+        return;
+    }
+
+    if ( !v->exit_counts )
+    {
+        v->exit_counts = calloc(NR_EXIT_REASONS, sizeof(*v->exit_counts));
+        if ( !v->exit_counts )
+        {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    v->exit_counts[reason]++;
+}
+
+static void process_record(unsigned int cpu, const xentrace_record *rec)
+{
+    struct pcpu_state *p = &pcpus[cpu];
+    uint32_t event = rec->event;
+
+    if ( rec->has_tsc )
+        p->last_tsc = rec->tsc;
+
+    if ( event == TRC_LOST_RECORDS )
+    {
+        if ( rec->nr_data )
+            lost_records += rec->data[0];
+        /* Whatever ran in between is unknown. */
+        p->curr = NULL;
+        p->run_start = 0;
+    }
+    else if ( (event & ~0xff0) == TRC_SCHED_RUNSTATE_CHANGE &&
+              rec->nr_data >= 1 )
+    {
+        unsigned int old = (event >> 8) & 0xf, new = (event >> 4) & 0xf;
+        struct vcpu_stats *v = get_vcpu(rec->data[0] >> 16,
+                                        rec->data[0] & 0xffff);
+
+        if ( old == RUNSTATE_running && p->curr == v )
+        {
+            account_run(p, rec->tsc);
+            p->curr = NULL;
+            p->run_start = 0;
+        }
+
+        if ( new == RUNSTATE_running )
+        {
+            v->switches++;
+            p->curr = v;
+            p->run_start = rec->tsc;
+        }
+    }
+    else if ( event == TRC_SCHED_WAKE && rec->nr_data >= 2 )
+        get_vcpu(rec->data[0], rec->data[1])->wakes++;
+    else if ( (event & ~(TRC_64_FLAG | TRC_HVM_NESTEDFLAG)) ==
+              TRC_HVM_VMX_EXIT && rec->nr_data >= 1 && p->curr )
+        /* Basic exit reason. */
+        count_exit(p->curr, rec->data[0] & 0xffff);
+    else if ( (event & ~(TRC_64_FLAG | TRC_HVM_NESTEDFLAG)) ==
+              TRC_HVM_SVM_EXIT && rec->nr_data >= 1 && p->curr )
+        count_exit(p->curr, rec->data[0]);
+}
+
+static int cmp_vcpu(const void *a, const void *b)
+{
+    const struct vcpu_stats *x = *(const struct vcpu_stats **)a;
+    const struct vcpu_stats *y = *(const struct vcpu_stats **)b;
+
+    if ( x->run_cycles != y->run_cycles )
+        return x->run_cycles > y->run_cycles ? -1 : 1;
+    if ( x->exits != y->exits )
+        return x->exits > y->exits ? -1 : 1;
+    if ( x->domid != y->domid )
+        return x->domid < y->domid ? -1 : 1;
+
+    return (x->vcpu > y->vcpu) - (x->vcpu < y->vcpu);
+}
+
+static int cmp_exit(const void *a, const void *b)
+{
+    const struct exit_count *x = a, *y = b;
+
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+static void print_stats(double elapsed, unsigned long cpu_khz)
+{
+    struct vcpu_stats **list, *v;
+    static struct exit_count exits[NR_EXIT_REASONS];
+    unsigned int i, n = 0, j, nr_exits;
+    unsigned long other;
+    double cycles = elapsed * cpu_khz * 1000;
+    time_t now = time(NULL);
+    char buf[32];
+
+    for ( i = 0; i < nr_pcpus; i++ )
+        account_run(&pcpus[i], pcpus[i].last_tsc);
+
+    list = calloc(nr_vcpus ?: 1, sizeof(*list));
+    if ( !list )
+    {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for ( i = 0; i < HASH_SIZE; i++ )
+        for ( v = hash[i]; v; v = v->next )
+            list[n++] = v;
+    qsort(list, n, sizeof(*list), cmp_vcpu);
+
+    strftime(buf, sizeof(buf), "%H:%M:%S", localtime(&now));
+
+    if ( !opts.batch )
+        printf("\033[H\033[2J");
+    printf("xentrace_top - %s  interval %.2fs  lost records %lu\n\n",
+           buf, elapsed, lost_records);
+    printf("%6s %5s %6s %9s %9s %9s  %s\n",
+           "DOMID", "VCPU", "RUN%", "SWITCH/s", "WAKE/s", "EXIT/s",
+           "TOP EXITS (reason:count/s)");
+
+    for ( i = 0; i < n; i++ )
+    {
+        v = list[i];
+
+        if ( v->domid == DOMID_IDLE ||
+             (!v->run_cycles && !v->switches && !v->wakes && !v->exits) )
+            continue;
+
+        printf("%6u %5u %6.1f %9.0f %9.0f %9.0f ",
+               v->domid, v->vcpu,
+               cycles ? v->run_cycles * 100 / cycles : 0,
+               v->switches / elapsed, v->wakes / elapsed,
+               v->exits / elapsed);
+
+        nr_exits = 0;
+        for ( j = 0; v->exit_counts && j < NR_EXIT_REASONS; j++ )
+            if ( v->exit_counts[j] )
+            {
+                exits[nr_exits].reason = j;
+                exits[nr_exits++].count = v->exit_counts[j];
+            }
+        qsort(exits, nr_exits, sizeof(exits[0]), cmp_exit);
+
+        other = v->other_exits;
+        for ( j = 0; j < nr_exits; j++ )
+        {
+            if ( j < NR_TOP_EXITS )
+                printf(" %u:%.0f", exits[j].reason, exits[j].count / elapsed);
+            else
+                other += exits[j].count;
+        }
+        if ( other )
+            printf(" other:%.0f", other / elapsed);
+        printf("\n");
+    }
+
+    fflush(stdout);
+    free(list);
+
+    /* Start the next interval afresh. */
+    for ( i = 0; i < HASH_SIZE; i++ )
+        for ( v = hash[i]; v; v = v->next )
+        {
+            v->run_cycles = 0;
+            v->switches = v->wakes = v->exits = v->other_exits = 0;
+            if ( v->exit_counts )
+                memset(v->exit_counts, 0,
+                       NR_EXIT_REASONS * sizeof(*v->exit_counts));
+        }
+    lost_records = 0;
+}
+
+static void usage(int status)
+{
+    printf("Usage: xentrace_top [OPTION...]\n"
+           "Live view of scheduling and HVM exits per vCPU, from Xen's trace\n"
+           "buffers.\n"
+           "\n"
+           "  -d, --delay=s           Seconds between updates (default 1).\n"
+           "  -i, --iterations=n      Exit after n updates.\n"
+           "  -b, --batch             Don't clear the screen between updates.\n"
+           "  -S, --trace-buf-size=N  Set trace buffer size in pages (default %u),\n"
+           "                          unless already set this boot cycle.\n"
+           "  -k, --keep-evt-mask     Don't set the event mask to the scheduler\n"
+           "                          and VM entry/exit events.\n"
+           "  -x, --dont-disable-tracing\n"
+           "                          Keep tracing on when exiting.\n"
+           "  -h, --help              Show this message\n"
+           "\n"
+           "Only one consumer of the trace buffers may run at a time.\n",
+           DEFAULT_TBUF_SIZE);
+
+    exit(status);
+}
+
+static void parse_args(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        { "delay",                required_argument, NULL, 'd' },
+        { "iterations",           required_argument, NULL, 'i' },
+        { "batch",                no_argument,       NULL, 'b' },
+        { "trace-buf-size",       required_argument, NULL, 'S' },
+        { "keep-evt-mask",        no_argument,       NULL, 'k' },
+        { "dont-disable-tracing", no_argument,       NULL, 'x' },
+        { "help",                 no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    char *end;
+    int c;
+
+    while ( (c = getopt_long(argc, argv, "d:i:bS:kxh", long_options,
+                             NULL)) != -1 )
+    {
+        switch ( c )
+        {
+        case 'd':
+            opts.delay = strtod(optarg, &end);
+            if ( *end || opts.delay <= 0 )
+                usage(EXIT_FAILURE);
+            break;
+
+        case 'i':
+            opts.iterations = strtoul(optarg, &end, 0);
+            if ( *end )
+                usage(EXIT_FAILURE);
+            break;
+
+        case 'b':
+            opts.batch = 1;
+            break;
+
+        case 'S':
+            opts.tbuf_size = strtoul(optarg, &end, 0);
+            if ( *end || !opts.tbuf_size )
+                usage(EXIT_FAILURE);
+            break;
+
+        case 'k':
+            opts.keep_mask = 1;
+            break;
+
+        case 'x':
+            opts.disable_tracing = 0;
+            break;
+
+        case 'h':
+            usage(EXIT_SUCCESS);
+
+        default:
+            usage(EXIT_FAILURE);
+        }
+    }
+
+    if ( optind != argc )
+        usage(EXIT_FAILURE);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns false on error. */
+static bool drain(xentrace_handle *xth)
+{
+    xentrace_record rec;
+    unsigned int cpu;
+    int rc;
+
+    for ( cpu = 0; cpu < nr_pcpus; cpu++ )
+    {
+        while ( (rc = xentrace_next(xth, cpu, &rec)) > 0 )
+            process_record(cpu, &rec);
+        if ( rc < 0 )
+            return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    struct sigaction act = { .sa_handler = close_handler };
+    xc_interface *xch;
+    xentrace_handle *xth;
+    xc_physinfo_t physinfo;
+    unsigned long n = 0;
+    double start;
+    int rc = EXIT_SUCCESS;
+
+    parse_args(argc, argv);
+
+    xch = xc_interface_open(NULL, NULL, 0);
+    if ( !xch )
+    {
+        perror("xenctrl interface open");
+        return EXIT_FAILURE;
+    }
+
+    if ( xc_physinfo(xch, &physinfo) )
+    {
+        perror("Failure to get physical CPU information from Xen");
+        return EXIT_FAILURE;
+    }
+
+    if ( !opts.keep_mask && xc_tbuf_set_evt_mask(xch, EVT_MASK) )
+    {
+        perror("Failure to set the event mask");
+        return EXIT_FAILURE;
+    }
+
+    xth = xentrace_open(NULL, opts.tbuf_size, XENTRACE_OPENFLAG_DISCARD);
+    if ( !xth )
+    {
+        perror("Failure to open the trace buffers");
+        return EXIT_FAILURE;
+    }
+
+    nr_pcpus = xentrace_nr_cpus(xth);
+    pcpus = calloc(nr_pcpus, sizeof(*pcpus));
+    if ( !pcpus )
+    {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+
+    sigaction(SIGHUP,  &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+    sigaction(SIGINT,  &act, NULL);
+
+    start = now();
+    while ( !interrupted && (!opts.iterations || n < opts.iterations) )
+    {
+        double remaining = start + opts.delay - now();
+
+        if ( !drain(xth) )
+        {
+            perror("Failure to read the trace buffers");
+            rc = EXIT_FAILURE;
+            break;
+        }
+
+        if ( remaining <= 0 )
+        {
+            double t = now();
+
+            print_stats(t - start, physinfo.cpu_khz);
+            start = t;
+            n++;
+            continue;
+        }
+
+        if ( xentrace_wait(xth, remaining * 1000 < POLL_MS
+                                ? remaining * 1000 : POLL_MS) < 0 &&
+             errno != EINTR )
+        {
+            perror("Failure to wait for trace buffer notifications");
+            rc = EXIT_FAILURE;
+            break;
+        }
+    }
+
+    if ( opts.disable_tracing && xc_tbuf_disable(xch) )
+        perror("Couldn't disable trace buffers");
+
+    xentrace_close(xth);
+    xc_interface_close(xch);
+
+    return rc;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -219,6 +219,12 @@ const struct cmd_spec cmd_table[] = {
       "Set the current memory usage for a domain",
       "<Domain> <MemMB['b'[bytes]|'k'[KB]|'m'[MB]|'g'[GB]|'t'[TB]]>",
     },
+    { "mem-superpages",
+      &main_mem_superpages, 0, 1,
+      "Show or control superpage recoalescing for a domain",
+      "[-r <Rate>] <Domain>",
+      "-r <Rate>  Examine <Rate> 2MB regions per second, 0 to stop",
+    },
     { "button-press",
       &main_button_press, 0, 1,
       "Indicate an ACPI button press to the domain",
@@ -12,6 +12,7 @@
  * GNU Lesser General Public License for more details.
  */
 
+#include <inttypes.h>
 #include <stdlib.h>
 
 #include <libxl.h>
@@ -90,6 +91,63 @@ int main_memset(int argc, char **argv)
     return set_memory_target(domid, mem);
 }
 
+int main_mem_superpages(int argc, char **argv)
+{
+    uint32_t domid;
+    int opt = 0, rc = EXIT_FAILURE;
+    long rate = -1;
+    char *endptr;
+    uint64_t total;
+    libxl_superpage_info info;
+
+    SWITCH_FOREACH_OPT(opt, "r:", NULL, "mem-superpages", 1) {
+    case 'r':
+        rate = strtol(optarg, &endptr, 10);
+        if (*endptr || rate < 0 || rate > UINT32_MAX) {
+            fprintf(stderr, "invalid rate: %s\n", optarg);
+            return EXIT_FAILURE;
+        }
+        break;
+    }
+
+    domid = find_domain(argv[optind]);
+
+    if (rate >= 0) {
+        if (libxl_domain_set_superpage_scan_rate(ctx, domid, rate)) {
+            fprintf(stderr, "cannot set superpage scan rate of domid %u\n",
+                    domid);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    libxl_superpage_info_init(&info);
+
+    if (libxl_domain_get_superpage_info(ctx, domid, &info)) {
+        fprintf(stderr, "cannot get superpage info of domid %u\n", domid);
+        goto out;
+    }
+
+    total = info.pages_4k + info.pages_2m + info.pages_1g;
+
+    printf("Scan rate (2MB regions/s): %"PRIu32"\n", info.scan_rate);
+    printf("Completed scan passes:     %"PRIu64"\n", info.passes);
+    printf("Superpages recoalesced:    %"PRIu64"\n", info.coalesced);
+    if (info.passes) {
+        printf("Memory mapped as 4kB:      %"PRIu64" MB\n", info.pages_4k >> 8);
+        printf("Memory mapped as 2MB:      %"PRIu64" MB\n", info.pages_2m >> 8);
+        printf("Memory mapped as 1GB:      %"PRIu64" MB\n", info.pages_1g >> 8);
+        printf("Superpage ratio:           %.1f%%\n",
+               total ? (info.pages_2m + info.pages_1g) * 100.0 / total : 0.0);
+    }
+
+    rc = EXIT_SUCCESS;
+
+ out:
+    libxl_superpage_info_dispose(&info);
+    return rc;
+}
+
 static void sharing(const libxl_dominfo *info, int nb_domain)
 {
     int i;
@@ -24,6 +24,7 @@
 #include <asm/gdbsx.h>
 #include <asm/irq.h>
 #include <asm/hvm/emulate.h>
+#include <asm/hvm/exit_stats.h>
 #include <asm/hvm/hvm.h>
 #include <asm/processor.h>
 #include <asm/acpi.h> /* for hvm_acpi_power_button */
@@ -1043,6 +1044,28 @@ long arch_do_domctl(
         break;
 #endif /* P2M_AUDIT */
 
+#ifdef CONFIG_HVM
+    case XEN_DOMCTL_p2m_superpage:
+        if ( d == currd )
+            ret = -EPERM;
+        else
+        {
+            ret = p2m_superpage_domctl(d, &domctl->u.p2m_superpage);
+            copyback = !ret;
+        }
+        break;
+
+    case XEN_DOMCTL_exit_stats:
+        if ( d == currd )
+            ret = -EPERM;
+        else
+        {
+            ret = hvm_exit_stats_domctl(d, &domctl->u.exit_stats);
+            copyback = !ret;
+        }
+        break;
+#endif
+
     case XEN_DOMCTL_set_broken_page_p2m:
     {
         p2m_type_t pt;
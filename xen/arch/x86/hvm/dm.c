@@ -321,6 +321,52 @@ static int inject_event(struct domain *d,
     return 0;
 }
 
+static int inject_msi_batch(struct domain *d, const struct dmop_args *bufs,
+                            struct xen_dm_op_inject_msi_batch *header)
+{
+#define MSIS_BUFFER 1
+
+    /* Process maximum of 64 MSIs before checking for continuation. */
+    const unsigned int cont_check_interval = 0x40;
+    unsigned int batch = 0;
+
+    if ( header->done > header->nr ||
+         (bufs->buf[MSIS_BUFFER].size /
+          sizeof(struct xen_dm_op_inject_msi)) < header->nr )
+        return -EINVAL;
+
+    while ( header->done < header->nr )
+    {
+        struct xen_dm_op_inject_msi msi;
+        int rc;
+
+        if ( batch++ == cont_check_interval )
+        {
+            if ( hypercall_preempt_check() )
+                return -ERESTART;
+            batch = 0;
+        }
+
+        if ( !COPY_FROM_GUEST_BUF_OFFSET(msi, bufs, MSIS_BUFFER,
+                                         header->done * sizeof(msi)) )
+            return -EFAULT;
+
+        if ( msi.pad )
+            return -EINVAL;
+
+        rc = hvm_inject_msi(d, msi.addr, msi.data);
+        if ( rc )
+            return rc;
+
+        header->done++;
+        perfc_incr(dm_msi_batched);
+    }
+
+    return 0;
+
+#undef MSIS_BUFFER
+}
+
 int dm_op(const struct dmop_args *op_args)
 {
     struct domain *d;
@@ -349,6 +395,7 @@ int dm_op(const struct dmop_args *op_args)
         [XEN_DMOP_relocate_memory]                  = sizeof(struct xen_dm_op_relocate_memory),
         [XEN_DMOP_pin_memory_cacheattr]             = sizeof(struct xen_dm_op_pin_memory_cacheattr),
         [XEN_DMOP_nr_vcpus]                         = sizeof(struct xen_dm_op_nr_vcpus),
+        [XEN_DMOP_inject_msi_batch]                 = sizeof(struct xen_dm_op_inject_msi_batch),
     };
 
     rc = rcu_lock_remote_domain_by_id(op_args->domid, &d);
@@ -539,6 +586,23 @@ int dm_op(const struct dmop_args *op_args)
         break;
     }
 
+    case XEN_DMOP_inject_msi_batch:
+    {
+        struct xen_dm_op_inject_msi_batch *data =
+            &op.u.inject_msi_batch;
+
+        const_op = false;
+
+        rc = inject_msi_batch(d, op_args, data);
+
+        /* Tell the caller how many got injected also on error. */
+        if ( rc && rc != -ERESTART &&
+             copy_to_guest_offset(op_args->buf[0].h, offset, (void *)&op.u,
+                                  op_size[op.op]) )
+            rc = -EFAULT;
+        break;
+    }
+
     case XEN_DMOP_remote_shutdown:
     {
         const struct xen_dm_op_remote_shutdown *data =
@@ -642,6 +706,7 @@ CHECK_dm_op_remote_shutdown;
 CHECK_dm_op_relocate_memory;
 CHECK_dm_op_pin_memory_cacheattr;
 CHECK_dm_op_nr_vcpus;
+CHECK_dm_op_inject_msi_batch;
 
 int compat_dm_op(
     domid_t domid, unsigned int nr_bufs, XEN_GUEST_HANDLE_PARAM(void) bufs)
@@ -411,6 +411,70 @@ static void __init pvh_init_p2m(struct domain *d)
     } while ( preempted );
 }
 
+/*
+ * Create the IOMMU mappings for the whole p2m in a single pass, merging
+ * contiguous ranges so that iommu_map() can use the largest page sizes the
+ * IOMMU supports, and flushing only once at the end.
+ */
+static int __init pvh_iommu_map_p2m(struct domain *d)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    unsigned long gfn = 0, start = 0, nr = 0, done = 0;
+    unsigned int start_flags = 0, flush_flags = 0;
+    mfn_t start_mfn = INVALID_MFN;
+    int rc = 0, err;
+
+    while ( gfn <= p2m->max_mapped_pfn )
+    {
+        p2m_type_t t;
+        p2m_access_t a;
+        unsigned int order, flags = 0;
+        unsigned long count;
+        mfn_t mfn = get_gfn_type_access(p2m, gfn, &t, &a, 0, &order);
+
+        put_gfn(d, gfn);
+
+        /* Entries may be superpages, which gfn needn't be the start of. */
+        count = (1UL << order) - (gfn & ((1UL << order) - 1));
+        if ( !mfn_eq(mfn, INVALID_MFN) )
+            flags = p2m_get_iommu_flags(t, a, mfn);
+
+        if ( nr && (flags != start_flags ||
+                    !mfn_eq(mfn, mfn_add(start_mfn, nr))) )
+        {
+            rc = iommu_map(d, _dfn(start), start_mfn, nr, start_flags,
+                           &flush_flags);
+            if ( rc )
+                break;
+            nr = 0;
+        }
+
+        if ( flags )
+        {
+            if ( !nr )
+            {
+                start = gfn;
+                start_mfn = mfn;
+                start_flags = flags;
+            }
+            nr += count;
+        }
+
+        gfn += count;
+
+        if ( !(++done & 0xfff) )
+            process_pending_softirqs();
+    }
+
+    if ( !rc && nr )
+        rc = iommu_map(d, _dfn(start), start_mfn, nr, start_flags,
+                       &flush_flags);
+
+    err = iommu_iotlb_flush_all(d, flush_flags);
+
+    return rc ?: err;
+}
+
 static int __init pvh_populate_p2m(struct domain *d)
 {
     struct vcpu *v = d->vcpu[0];
@@ -1306,6 +1370,8 @@ int __init dom0_construct_pvh(struct domain *d, const module_t *image,
                               const char *cmdline)
 {
     paddr_t entry, start_info;
+    s_time_t start, populated;
+    bool lazy;
     int rc;
 
     printk(XENLOG_INFO "*** Building a PVH Dom%d ***\n", d->domain_id);
@@ -1340,12 +1406,39 @@ int __init dom0_construct_pvh(struct domain *d, const module_t *image,
 
     iommu_hwdom_init(d);
 
+    /*
+     * In lazy mode, populate the p2m without keeping the IOMMU page tables
+     * in sync, one p2m update at a time, and map everything afterwards.
+     */
+    lazy = iommu_hwdom_lazy && need_iommu_pt_sync(d);
+    if ( lazy )
+        dom_iommu(d)->need_sync = false;
+
+    start = NOW();
     rc = pvh_populate_p2m(d);
     if ( rc )
     {
         printk("Failed to setup Dom0 physical memory map\n");
         return rc;
     }
+    populated = NOW();
+    printk(XENLOG_INFO "%pd: memory populated in %"PRI_stime"ms\n",
+           d, (populated - start) / MILLISECS(1));
+
+    if ( lazy )
+    {
+        dom_iommu(d)->need_sync = true;
+
+        rc = pvh_iommu_map_p2m(d);
+        if ( rc )
+        {
+            printk("Failed to setup Dom0 IOMMU mappings: %d\n", rc);
+            return rc;
+        }
+
+        printk(XENLOG_INFO "%pd: IOMMU mappings created in %"PRI_stime"ms\n",
+               d, (NOW() - populated) / MILLISECS(1));
+    }
 
     rc = pvh_load_kernel(d, image, image_headroom, initrd, bootstrap_map(image),
                          cmdline, &entry, &start_info);
@@ -14,7 +14,9 @@
 #include <xen/lib.h>
 #include <xen/sched.h>
 #include <xen/paging.h>
+#include <xen/param.h>
 #include <xen/trace.h>
+#include <xen/unaligned.h>
 #include <xen/vm_event.h>
 #include <asm/event.h>
 #include <asm/i387.h>
@@ -22,6 +24,7 @@
 #include <asm/hvm/emulate.h>
 #include <asm/hvm/hvm.h>
 #include <asm/hvm/monitor.h>
+#include <asm/hvm/nestedhvm.h>
 #include <asm/hvm/support.h>
 #include <asm/iocap.h>
 #include <asm/vm_event.h>
@@ -2777,6 +2780,250 @@ int hvm_emulate_one_mmio(unsigned long mfn, unsigned long gla)
     return rc;
 }
 
+static bool __read_mostly opt_hvm_mmio_fast = true;
+boolean_runtime_param("hvm-mmio-fast", opt_hvm_mmio_fast);
+
+/*
+ * Fast path for the bulk of MMIO accesses by device drivers: plain MOVs
+ * between a register (or an immediate) and memory, to a device emulated
+ * inside Xen.  The access having faulted on its final guest physical
+ * address, the guest's page walk has been done by hardware, so all that is
+ * needed is decoding enough of the insn to know the operand, and checking
+ * that it is the access which faulted.  The access itself goes through the
+ * ordinary intercept / ioreq machinery.
+ *
+ * Returns X86EMUL_UNRECOGNIZED without having done anything if the access
+ * isn't eligible, for the caller to use the full emulator.
+ */
+int hvm_emulate_mmio_fast(unsigned long gla, paddr_t gpa, struct npfec access)
+{
+    struct vcpu *curr = current;
+    struct hvm_vcpu_io *hvio = &curr->arch.hvm.hvm_io;
+    struct cpu_user_regs *regs = guest_cpu_user_regs();
+    struct hvm_emulate_ctxt ctxt;
+    const struct segment_register *sreg;
+    enum x86_segment seg = x86_seg_ds;
+    const uint8_t *p;
+    unsigned int rex = 0, op_bytes = 4, size, modrm, reg, rm, insn_len;
+    unsigned long ea = 0, linear, data = 0, one_rep = 1;
+    void *gpr = NULL;
+    bool mode64, write, has_base = true, rip_rel = false;
+    uint8_t opc;
+    int rc;
+
+    if ( !opt_hvm_mmio_fast ||
+         access.kind != npfec_kind_with_gla || access.insn_fetch ||
+         curr->io.req.state != STATE_IOREQ_NONE ||
+         hvio->cache->num_ents <= hvio->cache->max_ents ||
+         (regs->eflags & (X86_EFLAGS_TF | X86_EFLAGS_VM)) ||
+         !(curr->arch.hvm.guest_cr[0] & X86_CR0_PE) ||
+         nestedhvm_vcpu_in_guestmode(curr) ||
+         !hvm_mmio_internal(gpa) )
+        return X86EMUL_UNRECOGNIZED;
+
+    hvm_emulate_init_once(&ctxt, NULL, regs);
+    if ( ctxt.intr_shadow )
+        return X86EMUL_UNRECOGNIZED;
+
+    hvm_emulate_init_per_insn(&ctxt, NULL, 0);
+    if ( ctxt.ctxt.addr_size == 16 )
+        goto fallback;
+    mode64 = ctxt.ctxt.addr_size == 64;
+
+    /*
+     * At most one operand size prefix and a REX one, for the insn to fit
+     * insn_buf[] whatever its encoding.  Its length gets checked against
+     * what was actually fetched further down.
+     */
+    p = ctxt.insn_buf;
+    if ( *p == 0x66 )
+    {
+        op_bytes = 2;
+        p++;
+    }
+    if ( mode64 && (*p & 0xf0) == 0x40 )
+        rex = *p++;
+    if ( rex & 8 ) /* REX.W */
+        op_bytes = 8;
+
+    switch ( opc = *p++ )
+    {
+    case 0x88: case 0x89: /* mov reg,mem */
+    case 0xc6: case 0xc7: /* mov imm,mem */
+        write = true;
+        break;
+
+    case 0x8a: case 0x8b: /* mov mem,reg */
+        write = false;
+        break;
+
+    default:
+        goto fallback;
+    }
+
+    size = (opc & 1) ? op_bytes : 1;
+
+    modrm = *p++;
+    reg = ((modrm >> 3) & 7) | ((rex & 4) << 1);
+    rm = modrm & 7;
+    if ( (modrm >> 6) == 3 || (opc >= 0xc6 && reg) )
+        goto fallback;
+
+    if ( rm == 4 )
+    {
+        unsigned int sib = *p++;
+        unsigned int index = ((sib >> 3) & 7) | ((rex & 2) << 2);
+
+        if ( index != 4 )
+            ea = *decode_gpr(regs, index) << (sib >> 6);
+        rm = sib & 7;
+        if ( rm == 5 && !(modrm >> 6) )
+        {
+            ea += (int32_t)get_unaligned_le32(p);
+            p += 4;
+            has_base = false;
+        }
+    }
+    else if ( rm == 5 && !(modrm >> 6) )
+    {
+        ea = (int32_t)get_unaligned_le32(p);
+        p += 4;
+        rip_rel = mode64;
+        has_base = false;
+    }
+
+    if ( has_base )
+    {
+        ea += *decode_gpr(regs, rm | ((rex & 1) << 3));
+        if ( rm == 4 || rm == 5 )
+            seg = x86_seg_ss;
+    }
+
+    switch ( modrm >> 6 )
+    {
+    case 1:
+        ea += (int8_t)*p++;
+        break;
+
+    case 2:
+        ea += (int32_t)get_unaligned_le32(p);
+        p += 4;
+        break;
+    }
+
+    if ( write )
+    {
+        if ( opc == 0xc6 )
+            data = *p++;
+        else if ( opc == 0xc7 && op_bytes == 2 )
+        {
+            data = get_unaligned_le16(p);
+            p += 2;
+        }
+        else if ( opc == 0xc7 )
+        {
+            data = (int32_t)get_unaligned_le32(p);
+            p += 4;
+        }
+    }
+
+    insn_len = p - ctxt.insn_buf;
+    if ( insn_len > ctxt.insn_buf_bytes )
+        goto fallback;
+
+    if ( rip_rel )
+        ea += regs->rip + insn_len;
+    else if ( !mode64 )
+        ea = (uint32_t)ea;
+
+    if ( opc < 0xc6 )
+    {
+        /* AH, CH, DH, and BH, absent a REX prefix. */
+        if ( size == 1 && !rex && (reg & 4) )
+            gpr = (uint8_t *)decode_gpr(regs, reg & 3) + 1;
+        else
+            gpr = decode_gpr(regs, reg);
+
+        if ( write )
+            memcpy(&data, gpr, size);
+    }
+
+    /*
+     * The operand must be the access which faulted: with a matching linear
+     * address when hardware reports it, and with a matching page offset in
+     * any event, not crossing into another page.
+     */
+    sreg = hvmemul_get_seg_reg(seg, &ctxt);
+    if ( IS_ERR(sreg) ||
+         !hvm_virtual_to_linear_addr(seg, sreg, ea, size,
+                                     write ? hvm_access_write
+                                           : hvm_access_read,
+                                     &ctxt.seg_reg[x86_seg_cs], &linear) ||
+         write != access.write_access ||
+         (access.gla_valid && linear != gla) ||
+         (linear & ~PAGE_MASK) != (gpa & ~PAGE_MASK) ||
+         (linear & ~PAGE_MASK) + size > PAGE_SIZE )
+        goto fallback;
+
+    /* Enable the cache, like _hvm_emulate_one() would. */
+    hvio->cache->num_ents = 0;
+
+    rc = hvmemul_do_mmio_buffer(gpa, &one_rep, size,
+                                write ? IOREQ_WRITE : IOREQ_READ, false,
+                                &data);
+
+    if ( ioreq_needs_completion(&curr->io.req) )
+    {
+        /*
+         * Passed on to a device model after all: have the full emulator
+         * re-execute the insn for completion, picking up the response.
+         */
+        ASSERT(rc == X86EMUL_RETRY);
+        curr->io.completion = VIO_mmio_completion;
+        hvio->mmio_insn_bytes = ctxt.insn_buf_bytes;
+        memcpy(hvio->mmio_insn, ctxt.insn_buf, hvio->mmio_insn_bytes);
+        perfc_incr(hvm_mmio_fast_dm);
+
+        return rc;
+    }
+
+    hvio->mmio_access = (struct npfec){};
+    hvmemul_cache_disable(curr);
+
+    if ( rc != X86EMUL_OKAY )
+        return rc;
+
+    if ( !write )
+    {
+        switch ( size )
+        {
+        case 1: *(uint8_t *)gpr = data; break;
+        case 2: *(uint16_t *)gpr = data; break;
+        /* 32-bit destinations get zero-extended. */
+        case 4: *(unsigned long *)gpr = (uint32_t)data; break;
+        case 8: *(unsigned long *)gpr = data; break;
+        }
+    }
+
+    regs->rip += insn_len;
+    if ( !mode64 )
+        regs->rip = (uint32_t)regs->rip;
+    /* Retiring the insn clears RF, like x86_emulate() does. */
+    regs->eflags &= ~X86_EFLAGS_RF;
+
+    perfc_incr(hvm_mmio_fast);
+
+    return X86EMUL_OKAY;
+
+ fallback:
+    /* Spare the full emulator fetching the insn again. */
+    BUILD_BUG_ON(sizeof(hvio->mmio_insn) < sizeof(ctxt.insn_buf));
+    hvio->mmio_insn_bytes = ctxt.insn_buf_bytes;
+    memcpy(hvio->mmio_insn, ctxt.insn_buf, hvio->mmio_insn_bytes);
+
+    return X86EMUL_UNRECOGNIZED;
+}
+
 void hvm_emulate_one_vm_event(enum emul_kind kind, unsigned int trapnr,
     unsigned int errcode)
 {
@@ -2910,6 +3157,10 @@ void hvm_emulate_init_per_insn(
             sizeof(hvmemul_ctxt->insn_buf) : 0;
     }
 
+    hvmemul_ctxt->ctxt.decode_cache = curr->arch.hvm.hvm_io.decode_cache;
+    hvmemul_ctxt->ctxt.insn_bytes = hvmemul_ctxt->insn_buf;
+    hvmemul_ctxt->ctxt.insn_bytes_len = hvmemul_ctxt->insn_buf_bytes;
+
     hvmemul_ctxt->is_mem_access = false;
 }
 
@@ -2991,6 +3242,13 @@ int hvmemul_cache_init(struct vcpu *v)
     if ( !cache )
         return -ENOMEM;
 
+    v->arch.hvm.hvm_io.decode_cache = x86_decode_cache_alloc();
+    if ( !v->arch.hvm.hvm_io.decode_cache )
+    {
+        xfree(cache);
+        return -ENOMEM;
+    }
+
     /* Cache is disabled initially. */
     cache->num_ents = nents + 1;
     cache->max_ents = nents;
@@ -0,0 +1,253 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * arch/x86/hvm/exit_stats.c
+ *
+ * VM exit profiling: counts of VM exits and TSC cycles spent handling them,
+ * by exit reason and by detail (MSR, I/O port, CPUID leaf, faulting frame).
+ *
+ * Statistics are per vCPU and only ever updated by the vCPU itself, so need
+ * no locking.  They get allocated and freed with the domain paused, under
+ * the domctl lock, and are summed up by XEN_DOMCTL_exit_stats' GET.
+ */
+
+#include <xen/guest_access.h>
+#include <xen/sched.h>
+#include <xen/time.h>
+#include <xen/xmalloc.h>
+#include <asm/hvm/exit_stats.h>
+#include <asm/hvm/svm/vmcb.h>
+
+#define SLOT_NPF     0xf0           /* First slot of SVM codes >= NPF. */
+#define SLOT_OTHER   (HVM_EXIT_STATS_SLOTS - 1)
+#define REASON_OTHER (~0U)
+
+#define DETAIL_PROBES 8
+
+static unsigned int reason_to_slot(uint32_t reason)
+{
+    if ( reason < SLOT_NPF )
+        return reason;
+    if ( reason >= VMEXIT_NPF && reason - VMEXIT_NPF < SLOT_OTHER - SLOT_NPF )
+        return reason - VMEXIT_NPF + SLOT_NPF;
+
+    return SLOT_OTHER;
+}
+
+static uint32_t slot_to_reason(unsigned int slot)
+{
+    if ( slot < SLOT_NPF )
+        return slot;
+    if ( slot < SLOT_OTHER )
+        return slot - SLOT_NPF + VMEXIT_NPF;
+
+    return REASON_OTHER;
+}
+
+static struct hvm_exit_detail *find_detail(struct hvm_exit_stats *s,
+                                           uint32_t reason, unsigned int kind,
+                                           uint64_t key)
+{
+    unsigned int i, h = (key ^ (key >> 21) ^ (reason << 4) ^ kind) *
+                        2654435761U;
+
+    for ( i = 0; i < DETAIL_PROBES; i++ )
+    {
+        struct hvm_exit_detail *d =
+            &s->details[(h + i) & (HVM_EXIT_STATS_DETAILS - 1)];
+
+        if ( !d->kind )
+        {
+            d->kind = kind;
+            d->reason = reason;
+            d->key = key;
+            return d;
+        }
+
+        if ( d->kind == kind && d->reason == reason && d->key == key )
+            return d;
+    }
+
+    s->details_lost++;
+
+    return NULL;
+}
+
+void hvm_exit_stats_start(struct hvm_exit_stats *s, uint32_t reason,
+                          unsigned int kind, uint64_t key)
+{
+    s->slot = reason_to_slot(reason);
+    s->detail = kind ? find_detail(s, reason, kind, key) : NULL;
+    s->start = rdtsc();
+}
+
+void hvm_exit_stats_finish(struct hvm_exit_stats *s)
+{
+    uint64_t cycles = rdtsc() - s->start;
+
+    s->reasons[s->slot].count++;
+    s->reasons[s->slot].cycles += cycles;
+
+    if ( s->detail )
+    {
+        s->detail->count++;
+        s->detail->cycles += cycles;
+    }
+
+    s->start = 0;
+}
+
+void hvm_exit_stats_free(struct vcpu *v)
+{
+    XFREE(v->arch.hvm.exit_stats);
+}
+
+static int enable(struct domain *d)
+{
+    struct vcpu *v;
+
+    for_each_vcpu ( d, v )
+    {
+        if ( v->arch.hvm.exit_stats )
+        {
+            memset(v->arch.hvm.exit_stats, 0, sizeof(*v->arch.hvm.exit_stats));
+            continue;
+        }
+
+        v->arch.hvm.exit_stats = xzalloc(struct hvm_exit_stats);
+        if ( !v->arch.hvm.exit_stats )
+        {
+            for_each_vcpu ( d, v )
+                hvm_exit_stats_free(v);
+            return -ENOMEM;
+        }
+    }
+
+    return 0;
+}
+
+static int get(struct domain *d, struct xen_domctl_exit_stats *op)
+{
+    const struct vcpu *v;
+    unsigned int slot, i, nr_reasons = 0, nr_details = 0;
+
+    op->details_lost = 0;
+    op->tsc_khz = cpu_khz;
+
+    for ( slot = 0; slot < HVM_EXIT_STATS_SLOTS; slot++ )
+    {
+        struct xen_domctl_exit_stats_reason r = {
+            .reason = slot_to_reason(slot),
+        };
+
+        for_each_vcpu ( d, v )
+        {
+            const struct hvm_exit_stats *s = v->arch.hvm.exit_stats;
+
+            if ( !s )
+                continue;
+
+            r.count += s->reasons[slot].count;
+            r.cycles += s->reasons[slot].cycles;
+        }
+
+        if ( !r.count )
+            continue;
+
+        if ( nr_reasons < op->nr_reasons &&
+             copy_to_guest_offset(op->reasons, nr_reasons, &r, 1) )
+            return -EFAULT;
+        nr_reasons++;
+    }
+
+    for_each_vcpu ( d, v )
+    {
+        const struct hvm_exit_stats *s = v->arch.hvm.exit_stats;
+
+        if ( !s )
+            continue;
+
+        op->details_lost += s->details_lost;
+
+        for ( i = 0; i < HVM_EXIT_STATS_DETAILS; i++ )
+        {
+            const struct hvm_exit_detail *e = &s->details[i];
+            struct xen_domctl_exit_stats_detail det = {
+                .reason = e->reason,
+                .vcpu = v->vcpu_id,
+                .kind = e->kind,
+                .key = e->key,
+                .count = e->count,
+                .cycles = e->cycles,
+            };
+
+            if ( !det.count )
+                continue;
+
+            if ( nr_details < op->nr_details &&
+                 copy_to_guest_offset(op->details, nr_details, &det, 1) )
+                return -EFAULT;
+            nr_details++;
+        }
+    }
+
+    op->nr_reasons = nr_reasons;
+    op->nr_details = nr_details;
+
+    return 0;
+}
+
+int hvm_exit_stats_domctl(struct domain *d, struct xen_domctl_exit_stats *op)
+{
+    struct vcpu *v;
+    int rc = 0;
+
+    if ( !is_hvm_domain(d) )
+        return -EOPNOTSUPP;
+
+    if ( op->pad )
+        return -EINVAL;
+
+    switch ( op->op )
+    {
+    case XEN_DOMCTL_EXIT_STATS_GET:
+        return get(d, op);
+
+    case XEN_DOMCTL_EXIT_STATS_ENABLE:
+        domain_pause(d);
+        rc = enable(d);
+        domain_unpause(d);
+        break;
+
+    case XEN_DOMCTL_EXIT_STATS_DISABLE:
+        domain_pause(d);
+        for_each_vcpu ( d, v )
+            hvm_exit_stats_free(v);
+        domain_unpause(d);
+        break;
+
+    case XEN_DOMCTL_EXIT_STATS_RESET:
+        domain_pause(d);
+        for_each_vcpu ( d, v )
+            if ( v->arch.hvm.exit_stats )
+                memset(v->arch.hvm.exit_stats, 0,
+                       sizeof(*v->arch.hvm.exit_stats));
+        domain_unpause(d);
+        break;
+
+    default:
+        rc = -EOPNOTSUPP;
+        break;
+    }
+
+    return rc;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -47,6 +47,7 @@
 #include <asm/mce.h>
 #include <asm/monitor.h>
 #include <asm/hvm/emulate.h>
+#include <asm/hvm/exit_stats.h>
 #include <asm/hvm/hvm.h>
 #include <asm/hvm/vpt.h>
 #include <asm/hvm/support.h>
@@ -616,14 +617,18 @@ int hvm_domain_initialise(struct domain *d,
     d->arch.hvm.params = xzalloc_array(uint64_t, HVM_NR_PARAMS);
     d->arch.hvm.io_handler = xzalloc_array(struct hvm_io_handler,
                                            NR_IO_HANDLERS);
+    d->arch.hvm.io_index = xzalloc(struct hvm_io_index);
     d->arch.hvm.irq = xzalloc_flex_struct(struct hvm_irq,
                                           gsi_assert_count, nr_gsis);
 
     rc = -ENOMEM;
     if ( !d->arch.hvm.pl_time || !d->arch.hvm.irq ||
-         !d->arch.hvm.params  || !d->arch.hvm.io_handler )
+         !d->arch.hvm.params  || !d->arch.hvm.io_handler ||
+         !d->arch.hvm.io_index )
         goto fail1;
 
+    spin_lock_init(&d->arch.hvm.io_index->lock);
+
     /* Set the number of GSIs */
     hvm_domain_irq(d)->nr_gsis = nr_gsis;
 
@@ -712,6 +717,7 @@ int hvm_domain_initialise(struct domain *d,
  fail:
     hvm_domain_relinquish_resources(d);
     XFREE(d->arch.hvm.io_handler);
+    XFREE(d->arch.hvm.io_index);
     XFREE(d->arch.hvm.pl_time);
     return rc;
 }
@@ -755,6 +761,7 @@ void hvm_domain_destroy(struct domain *d)
     hvm_domain_relinquish_resources(d);
 
     XFREE(d->arch.hvm.io_handler);
+    XFREE(d->arch.hvm.io_index);
     XFREE(d->arch.hvm.params);
 
     hvm_destroy_cacheattr_region_list(d);
@@ -1686,6 +1693,8 @@ void hvm_vcpu_destroy(struct vcpu *v)
     vlapic_destroy(v);
 
     hvm_vcpu_cacheattr_destroy(v);
+
+    hvm_exit_stats_free(v);
 }
 
 void hvm_vcpu_down(struct vcpu *v)
@@ -1848,7 +1857,7 @@ int hvm_hap_nested_page_fault(paddr_t gpa, unsigned long gla,
      */
     if ( !nestedhvm_vcpu_in_guestmode(curr) && hvm_mmio_internal(gpa) )
     {
-        if ( !handle_mmio_with_translation(gla, gpa >> PAGE_SHIFT, npfec) )
+        if ( !handle_mmio_with_translation(gla, gpa, npfec) )
             hvm_inject_hw_exception(X86_EXC_GP, 0);
         rc = 1;
         goto out;
@@ -1975,7 +1984,7 @@ int hvm_hap_nested_page_fault(paddr_t gpa, unsigned long gla,
          (npfec.write_access &&
           (p2m_is_discard_write(p2mt) || (p2mt == p2m_ioreq_server))) )
     {
-        if ( !handle_mmio_with_translation(gla, gpa >> PAGE_SHIFT, npfec) )
+        if ( !handle_mmio_with_translation(gla, gpa, npfec) )
             hvm_inject_hw_exception(X86_EXC_GP, 0);
         rc = 1;
         goto out_put_gfn;
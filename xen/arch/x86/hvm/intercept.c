@@ -20,6 +20,7 @@
 #include <io_ports.h>
 #include <xen/event.h>
 #include <xen/iommu.h>
+#include <xen/perfc.h>
 
 static bool cf_check hvm_mmio_accept(
     const struct hvm_io_handler *handler, const ioreq_t *p)
@@ -213,28 +214,145 @@ int hvm_process_io_intercept(const struct hvm_io_handler *handler,
     return rc;
 }
 
-static const struct hvm_io_handler *hvm_find_io_handler(const ioreq_t *p)
+static void index_portio_handler(struct hvm_io_index *idx,
+                                 const struct hvm_io_handler *handler,
+                                 unsigned int i)
 {
-    struct domain *curr_d = current->domain;
-    unsigned int i;
+    unsigned int b = handler->portio.port >> HVM_IO_PORT_SHIFT;
+    unsigned int end = handler->portio.port + handler->portio.size;
+
+    for ( ; b < ARRAY_SIZE(idx->ports) && (b << HVM_IO_PORT_SHIFT) < end; b++ )
+        idx->ports[b] |= 1U << i;
+}
+
+/* Index the handlers registered since the last update. */
+static void hvm_update_io_index(struct domain *d)
+{
+    struct hvm_io_index *idx = d->arch.hvm.io_index;
+    unsigned int i, nr = min(ACCESS_ONCE(d->arch.hvm.io_handler_count),
+                             NR_IO_HANDLERS + 0U);
 
+    spin_lock(&idx->lock);
+
+    for ( i = idx->nr; i < nr; i++ )
+    {
+        const struct hvm_io_handler *handler = &d->arch.hvm.io_handler[i];
+        const struct hvm_io_ops *ops = ACCESS_ONCE(handler->ops);
+
+        /* Stop at a handler still being set up by its registration. */
+        if ( !ops )
+            break;
+        smp_rmb();
+
+        if ( ops == &portio_ops )
+            index_portio_handler(idx, handler, i);
+        else
+            idx->dynamic |= 1U << i;
+
+        idx->types[handler->type] |= 1U << i;
+    }
+
+    smp_wmb();
+    idx->nr = i;
+
+    spin_unlock(&idx->lock);
+}
+
+/*
+ * Candidates are visited in registration order, so the first handler
+ * accepting an access wins as it always did: port I/O handlers with fixed
+ * ranges are found through the index and checked without calling their
+ * accept() hook, and only the other handlers have it called.
+ *
+ * MMIO handlers all need their accept() hook called, but a vCPU tends to
+ * access the same device repeatedly: try the last one used first.  Internal
+ * MMIO handlers claim distinct ranges, unless the guest e.g. moves its local
+ * APIC on top of another device, in which case which handler gets the
+ * accesses was never meaningful.
+ */
+static const struct hvm_io_handler *hvm_find_io_handler(const ioreq_t *p)
+{
+    struct vcpu *curr = current;
+    struct domain *curr_d = curr->domain;
+    const struct hvm_io_index *idx = curr_d->arch.hvm.io_index;
+    const struct hvm_io_handler *handler = NULL;
+    unsigned int i, nr_indexed, nr_handlers, calls = 0;
+    uint32_t cand;
+
+    BUILD_BUG_ON(NR_IO_HANDLERS > 32);
     BUG_ON((p->type != IOREQ_TYPE_PIO) &&
            (p->type != IOREQ_TYPE_COPY));
 
-    for ( i = 0; i < curr_d->arch.hvm.io_handler_count; i++ )
+    nr_indexed = ACCESS_ONCE(idx->nr);
+    nr_handlers = ACCESS_ONCE(curr_d->arch.hvm.io_handler_count);
+    if ( nr_indexed != min(nr_handlers, NR_IO_HANDLERS + 0U) )
+        hvm_update_io_index(curr_d);
+    smp_rmb();
+
+    perfc_incr(hvm_io_lookups);
+
+    cand = idx->dynamic;
+    if ( p->type == IOREQ_TYPE_PIO )
+        cand |= idx->ports[(p->addr & 0xffff) >> HVM_IO_PORT_SHIFT];
+    else
     {
-        const struct hvm_io_handler *handler =
-            &curr_d->arch.hvm.io_handler[i];
-        const struct hvm_io_ops *ops = handler->ops;
+        i = curr->arch.hvm.hvm_io.mmio_handler_hint;
+        if ( cand & idx->types[IOREQ_TYPE_COPY] & (1U << i) )
+        {
+            const struct hvm_io_handler *hint = &curr_d->arch.hvm.io_handler[i];
+
+            calls++;
+            if ( hint->ops->accept(hint, p) )
+            {
+                perfc_incr(hvm_io_hint_hits);
+                handler = hint;
+                goto out;
+            }
+            cand &= ~(1U << i);
+        }
+    }
 
-        if ( handler->type != p->type )
+    for ( ; cand; cand &= cand - 1 )
+    {
+        const struct hvm_io_handler *h;
+
+        i = ffs(cand) - 1;
+        h = &curr_d->arch.hvm.io_handler[i];
+
+        if ( h->type != p->type )
             continue;
 
-        if ( ops->accept(handler, p) )
-            return handler;
+        if ( h->ops == &portio_ops )
+        {
+            if ( !hvm_portio_accept(h, p) )
+                continue;
+        }
+        else
+        {
+            calls++;
+            if ( !h->ops->accept(h, p) )
+                continue;
+        }
+
+        if ( p->type == IOREQ_TYPE_COPY )
+            curr->arch.hvm.hvm_io.mmio_handler_hint = i;
+
+        handler = h;
+        break;
     }
 
-    return NULL;
+ out:
+#ifdef CONFIG_PERF_COUNTERS
+    /* A linear scan calls accept() on all handlers of the type up to ours. */
+    i = hweight32(idx->types[p->type] &
+                  (handler ? (2U << (handler - curr_d->arch.hvm.io_handler)) - 1
+                           : ~0U));
+    perfc_add(hvm_io_accept_calls, calls);
+    if ( i > calls )
+        perfc_add(hvm_io_accept_avoided, i - calls);
+#endif
+
+    return handler;
 }
 
 int hvm_io_intercept(ioreq_t *p)
@@ -273,8 +391,10 @@ void register_mmio_handler(struct domain *d,
         return;
 
     handler->type = IOREQ_TYPE_COPY;
-    handler->ops = &mmio_ops;
     handler->mmio.ops = ops;
+    /* Setting ->ops publishes the handler to hvm_update_io_index(). */
+    smp_wmb();
+    handler->ops = &mmio_ops;
 }
 
 void register_portio_handler(struct domain *d, unsigned int port,
@@ -286,10 +406,12 @@ void register_portio_handler(struct domain *d, unsigned int port,
         return;
 
     handler->type = IOREQ_TYPE_PIO;
-    handler->ops = &portio_ops;
     handler->portio.port = port;
     handler->portio.size = size;
     handler->portio.action = action;
+    /* Setting ->ops publishes the handler to hvm_update_io_index(). */
+    smp_wmb();
+    handler->ops = &portio_ops;
 }
 
 bool relocate_portio_handler(struct domain *d, unsigned int old_port,
@@ -308,7 +430,16 @@ bool relocate_portio_handler(struct domain *d, unsigned int old_port,
         if ( (handler->portio.port == old_port) &&
              (handler->portio.size = size) )
         {
+            struct hvm_io_index *idx = d->arch.hvm.io_index;
+
             handler->portio.port = new_port;
+
+            /* Buckets of the old range may stay, ranges get checked anyway. */
+            spin_lock(&idx->lock);
+            if ( i < idx->nr )
+                index_portio_handler(idx, handler, i);
+            spin_unlock(&idx->lock);
+
             return true;
         }
     }
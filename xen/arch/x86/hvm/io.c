@@ -79,7 +79,7 @@ bool hvm_emulate_one_insn(hvm_emulate_validate_t *validate, const char *descr)
     return true;
 }
 
-bool handle_mmio_with_translation(unsigned long gla, unsigned long gpfn,
+bool handle_mmio_with_translation(unsigned long gla, paddr_t gpa,
                                   struct npfec access)
 {
     struct hvm_vcpu_io *hvio = &current->arch.hvm.hvm_io;
@@ -88,7 +88,21 @@ bool handle_mmio_with_translation(unsigned long gla, unsigned long gpfn,
                         access.kind == npfec_kind_with_gla
                         ? access : (struct npfec){};
     hvio->mmio_gla = gla & PAGE_MASK;
-    hvio->mmio_gpfn = gpfn;
+    hvio->mmio_gpfn = PFN_DOWN(gpa);
+
+    switch ( hvm_emulate_mmio_fast(gla, gpa, access) )
+    {
+    case X86EMUL_UNRECOGNIZED:
+        break;
+
+    case X86EMUL_OKAY:
+    case X86EMUL_RETRY:
+        return true;
+
+    default:
+        return false;
+    }
+
     return handle_mmio();
 }
 
@@ -20,6 +20,7 @@
 #include <asm/debugreg.h>
 #include <asm/gdbsx.h>
 #include <asm/hvm/emulate.h>
+#include <asm/hvm/exit_stats.h>
 #include <asm/hvm/hvm.h>
 #include <asm/hvm/io.h>
 #include <asm/hvm/monitor.h>
@@ -896,6 +897,8 @@ static void cf_check svm_ctxt_switch_from(struct vcpu *v)
 {
     int cpu = smp_processor_id();
 
+    hvm_exit_stats_end(v);
+
     /*
      * Return early if trying to do a context switch without SVM enabled,
      * this can happen when the hypervisor shuts down with HVM guests
@@ -1018,6 +1021,8 @@ void asmlinkage svm_vmenter_helper(void)
 
     ASSERT(hvmemul_cache_disabled(curr));
 
+    hvm_exit_stats_end(curr);
+
     svm_asid_handle_vmrun();
 
     TRACE_TIME(TRC_HVM_VMENTRY |
@@ -2530,6 +2535,39 @@ const struct hvm_function_table * __init start_svm(void)
     return &svm_function_table;
 }
 
+static void svm_exit_stats(struct vcpu *v, uint32_t exit_reason,
+                           const struct vmcb_struct *vmcb,
+                           const struct cpu_user_regs *regs)
+{
+    unsigned int kind = 0;
+    uint64_t key = 0;
+
+    switch ( exit_reason )
+    {
+    case VMEXIT_MSR:
+        kind = XEN_DOMCTL_EXIT_STATS_MSR;
+        key = regs->ecx | ((uint64_t)(vmcb->exitinfo1 == 1) << 32);
+        break;
+
+    case VMEXIT_IOIO:
+        kind = XEN_DOMCTL_EXIT_STATS_IO;
+        key = vmcb->ei.io.port | ((uint64_t)!vmcb->ei.io.in << 32);
+        break;
+
+    case VMEXIT_CPUID:
+        kind = XEN_DOMCTL_EXIT_STATS_CPUID;
+        key = regs->eax | ((uint64_t)regs->ecx << 32);
+        break;
+
+    case VMEXIT_NPF:
+        kind = XEN_DOMCTL_EXIT_STATS_NPF;
+        key = PFN_DOWN(vmcb->ei.npf.gpa);
+        break;
+    }
+
+    hvm_exit_stats_start(v->arch.hvm.exit_stats, exit_reason, kind, key);
+}
+
 void asmlinkage svm_vmexit_handler(void)
 {
     struct cpu_user_regs *regs = guest_cpu_user_regs();
@@ -2658,6 +2696,9 @@ void asmlinkage svm_vmexit_handler(void)
                 ? exit_reason
                 : exit_reason - VMEXIT_NPF + VMEXIT_NPF_PERFC);
 
+    if ( unlikely(v->arch.hvm.exit_stats) )
+        svm_exit_stats(v, exit_reason, vmcb, regs);
+
     hvm_maybe_deassert_evtchn_irq();
 
     vmcb->cleanbits.raw = ~0u;
@@ -26,6 +26,7 @@
 #include <asm/p2m.h>
 #include <asm/mem_sharing.h>
 #include <asm/hvm/emulate.h>
+#include <asm/hvm/exit_stats.h>
 #include <asm/hvm/hvm.h>
 #include <asm/hvm/support.h>
 #include <asm/hvm/vmx/vmx.h>
@@ -1141,6 +1142,8 @@ static void cf_check vmx_fpu_leave(struct vcpu *v)
 
 static void cf_check vmx_ctxt_switch_from(struct vcpu *v)
 {
+    hvm_exit_stats_end(v);
+
     /*
      * Return early if trying to do a context switch without VMX enabled,
      * this can happen when the hypervisor shuts down with HVM guests
@@ -2292,9 +2295,23 @@ static void cf_check vmx_deliver_posted_intr(struct vcpu *v, u8 vector)
          * Besides that, if 'ON' is already set, no need to
          * send posted-interrupts notification event as well,
          * according to hardware behavior.
+         *
+         * For a running vCPU not even a kick is needed then: both hardware
+         * and vmx_sync_pir_to_irr() clear ON before reading PIR, and whoever
+         * set ON has sent a notification or kicked the vCPU already, so the
+         * vector posted above will be picked up along with theirs.  This
+         * saves an IPI, and the VM exit it would cause, when a burst of
+         * interrupts targets the same vCPU.
          */
+        if ( pi_test_on(&prev) && !pi_test_sn(&prev) && v->is_running )
+        {
+            perfc_incr(vmx_pi_kicks_avoided);
+            return;
+        }
+
         if ( pi_test_sn(&prev) || pi_test_on(&prev) )
         {
+            perfc_incr(vmx_pi_kicks);
             vcpu_kick(v);
             return;
         }
@@ -4046,6 +4063,45 @@ static int vmx_handle_apic_write(void)
     return vlapic_apicv_write(current, exit_qualification & 0xfff);
 }
 
+static void vmx_exit_stats(struct vcpu *v, unsigned int exit_reason,
+                           const struct cpu_user_regs *regs)
+{
+    unsigned long val;
+    unsigned int kind = 0;
+    uint64_t key = 0;
+
+    switch ( exit_reason )
+    {
+    case EXIT_REASON_MSR_READ:
+    case EXIT_REASON_MSR_WRITE:
+        kind = XEN_DOMCTL_EXIT_STATS_MSR;
+        key = regs->ecx |
+              ((uint64_t)(exit_reason == EXIT_REASON_MSR_WRITE) << 32);
+        break;
+
+    case EXIT_REASON_IO_INSTRUCTION:
+        __vmread(EXIT_QUALIFICATION, &val);
+        kind = XEN_DOMCTL_EXIT_STATS_IO;
+        /* Bit 3 is set for IN. */
+        key = ((val >> 16) & 0xffff) | ((uint64_t)!(val & 8) << 32);
+        break;
+
+    case EXIT_REASON_CPUID:
+        kind = XEN_DOMCTL_EXIT_STATS_CPUID;
+        key = regs->eax | ((uint64_t)regs->ecx << 32);
+        break;
+
+    case EXIT_REASON_EPT_VIOLATION:
+    case EXIT_REASON_EPT_MISCONFIG:
+        __vmread(GUEST_PHYSICAL_ADDRESS, &val);
+        kind = XEN_DOMCTL_EXIT_STATS_NPF;
+        key = PFN_DOWN(val);
+        break;
+    }
+
+    hvm_exit_stats_start(v->arch.hvm.exit_stats, exit_reason, kind, key);
+}
+
 static void undo_nmis_unblocked_by_iret(void)
 {
     unsigned long guest_info;
@@ -4097,6 +4153,9 @@ void asmlinkage vmx_vmexit_handler(struct cpu_user_regs *regs)
 
     perfc_incra(vmexits, (uint16_t)exit_reason);
 
+    if ( unlikely(v->arch.hvm.exit_stats) )
+        vmx_exit_stats(v, (uint16_t)exit_reason, regs);
+
     /* Handle the interrupt we missed before allowing any more in. */
     switch ( (uint16_t)exit_reason )
     {
@@ -4811,6 +4870,8 @@ bool asmlinkage vmx_vmenter_helper(const struct cpu_user_regs *regs)
 
     ASSERT(hvmemul_cache_disabled(curr));
 
+    hvm_exit_stats_end(curr);
+
     /* Shadow EPTP can't be updated here because irqs are disabled */
      if ( nestedhvm_vcpu_in_guestmode(curr) && vcpu_nestedhvm(curr).stale_np2m )
          return false;
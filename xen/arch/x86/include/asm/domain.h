@@ -183,6 +183,18 @@ struct log_dirty_domain {
     unsigned long  fault_count;
     unsigned long  dirty_count;
 
+    /* optional dirty ring, see struct xen_dirty_ring */
+    struct {
+        struct page_info      *pg;
+        struct xen_dirty_ring *va;
+        unsigned int           nr_frames;
+        unsigned int           size;
+        /* Private copies of the Xen-written indices. */
+        unsigned int           prod;
+        unsigned int           harvest;
+        bool                   overflow;
+    } ring;
+
     /* functions which are paging mode specific */
     const struct log_dirty_ops {
         int        (*enable  )(struct domain *d);
@@ -27,6 +27,17 @@ struct mem_sharing_domain
      * to resume the search.
      */
     unsigned long next_shared_gfn_to_relinquish;
+
+    /*
+     * Forks only: gfns which got a private page since the last reset, so
+     * that resetting doesn't need to walk all of the fork's memory.  When
+     * the log overflows, or the fork gained pages some other way, the next
+     * reset falls back to walking the fork's page list.
+     */
+    gfn_t *reset_log;
+    unsigned int reset_log_nr;
+    bool reset_log_overflow;
+    unsigned int reset_tot_pages;
 };
 #endif
 
@@ -65,6 +76,7 @@ struct hvm_domain {
 
     struct hvm_io_handler *io_handler;
     unsigned int          io_handler_count;
+    struct hvm_io_index   *io_index;
 
     /* Lock protects access to irq, vpic and vioapic. */
     spinlock_t             irq_lock;
@@ -86,6 +86,7 @@ struct segment_register *hvmemul_get_seg_reg(
     enum x86_segment seg,
     struct hvm_emulate_ctxt *hvmemul_ctxt);
 int hvm_emulate_one_mmio(unsigned long mfn, unsigned long gla);
+int hvm_emulate_mmio_fast(unsigned long gla, paddr_t gpa, struct npfec access);
 
 static inline bool handle_mmio(void)
 {
@@ -120,6 +121,8 @@ int __must_check hvmemul_cache_init(struct vcpu *v);
 static inline void hvmemul_cache_destroy(struct vcpu *v)
 {
     XFREE(v->arch.hvm.hvm_io.cache);
+    x86_decode_cache_free(v->arch.hvm.hvm_io.decode_cache);
+    v->arch.hvm.hvm_io.decode_cache = NULL;
 }
 bool hvmemul_read_cache(const struct vcpu *v, paddr_t gpa,
                         void *buffer, unsigned int size);
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * include/asm-x86/hvm/exit_stats.h
+ *
+ * VM exit profiling, see XEN_DOMCTL_exit_stats.
+ */
+
+#ifndef __ASM_X86_HVM_EXIT_STATS_H__
+#define __ASM_X86_HVM_EXIT_STATS_H__
+
+#include <xen/sched.h>
+#include <public/domctl.h>
+
+/*
+ * Reasons are accounted in slots: VMX basic exit reasons and SVM exit codes
+ * below VMEXIT_NPF map 1:1, SVM exit codes from VMEXIT_NPF onwards get
+ * folded into the top slots, and the last slot collects anything else.
+ */
+#define HVM_EXIT_STATS_SLOTS     256
+#define HVM_EXIT_STATS_DETAILS   256    /* Per vCPU, power of 2. */
+
+struct hvm_exit_stats {
+    struct {
+        uint64_t count, cycles;
+    } reasons[HVM_EXIT_STATS_SLOTS];
+
+    struct hvm_exit_detail {
+        uint64_t key;
+        uint64_t count, cycles;
+        uint32_t reason;
+        uint8_t kind;                   /* 0 if the entry is free. */
+    } details[HVM_EXIT_STATS_DETAILS];
+    uint64_t details_lost;
+
+    /* Exit being handled, if start is non-zero. */
+    uint64_t start;
+    unsigned int slot;
+    struct hvm_exit_detail *detail;
+};
+
+void hvm_exit_stats_start(struct hvm_exit_stats *s, uint32_t reason,
+                          unsigned int kind, uint64_t key);
+void hvm_exit_stats_finish(struct hvm_exit_stats *s);
+int hvm_exit_stats_domctl(struct domain *d, struct xen_domctl_exit_stats *op);
+void hvm_exit_stats_free(struct vcpu *v);
+
+/* To be called when done handling a VM exit, before entering the guest. */
+static inline void hvm_exit_stats_end(struct vcpu *v)
+{
+    struct hvm_exit_stats *s = v->arch.hvm.exit_stats;
+
+    if ( unlikely(s) && s->start )
+        hvm_exit_stats_finish(s);
+}
+
+#endif /* __ASM_X86_HVM_EXIT_STATS_H__ */
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -63,6 +63,22 @@ struct hvm_io_ops {
     hvm_io_write_t    write;
 };
 
+/*
+ * Index of a domain's io_handler[], maintained by hvm_find_io_handler().
+ * Handlers can be registered while the domain runs, but are never removed,
+ * so entries only ever get added and lookups need no locking.
+ */
+#define HVM_IO_PORT_SHIFT 8
+
+struct hvm_io_index {
+    spinlock_t lock;            /* Serialises index updates. */
+    unsigned int nr;            /* io_handler[] entries indexed. */
+    uint32_t dynamic;           /* Handlers with their own accept() logic. */
+    uint32_t types[IOREQ_TYPE_COPY + 1];   /* All handlers, by type. */
+    /* Fixed range port I/O handlers, by port >> HVM_IO_PORT_SHIFT. */
+    uint32_t ports[0x10000 >> HVM_IO_PORT_SHIFT];
+};
+
 int hvm_process_io_intercept(const struct hvm_io_handler *handler,
                              ioreq_t *p);
 
@@ -84,7 +100,7 @@ bool relocate_portio_handler(
     unsigned int size);
 
 void send_timeoffset_req(unsigned long timeoff);
-bool handle_mmio_with_translation(unsigned long gla, unsigned long gpfn,
+bool handle_mmio_with_translation(unsigned long gla, paddr_t gpa,
                                   struct npfec access);
 bool handle_pio(uint16_t port, unsigned int size, int dir);
 void hvm_interrupt_post(struct vcpu *v, int vector, int type);
@@ -56,6 +56,9 @@ struct hvm_vcpu_io {
     unsigned char mmio_insn[16];
     struct hvmemul_cache *cache;
 
+    /* Recently decoded instructions, for re-use by hvm_emulate_one(). */
+    struct x86_decode_cache *decode_cache;
+
     /*
      * For string instruction emulation we need to be able to signal a
      * necessary retry through other than function return codes.
@@ -67,6 +70,9 @@ struct hvm_vcpu_io {
     unsigned long msix_snoop_gpa;
 
     const struct g2m_ioport *g2m_ioport;
+
+    /* io_handler[] index of the last internal MMIO handler used. */
+    unsigned int mmio_handler_hint;
 };
 
 struct nestedvcpu {
@@ -180,6 +186,9 @@ struct hvm_vcpu {
 
     struct hvm_vcpu_io  hvm_io;
 
+    /* VM exit profiling, see XEN_DOMCTL_exit_stats.  NULL when disabled. */
+    struct hvm_exit_stats *exit_stats;
+
     /* Pending hw/sw interrupt (.vector = -1 means nothing pending). */
     struct x86_event     inject_event;
 
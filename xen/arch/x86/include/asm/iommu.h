@@ -52,6 +52,16 @@ struct arch_iommu
         struct {
             unsigned int paging_mode;
             struct page_info *root_table;
+            /*
+             * Last table found by a page table walk, protected by
+             * mapping_lock: consecutive (un)maps mostly hit the same leaf
+             * table.  Invalidated (mfn 0) whenever page tables get freed.
+             */
+            struct {
+                unsigned long tag;      /* dfn >> (9 * level) */
+                unsigned int level;
+                unsigned long mfn;
+            } walk;
         } amd;
     };
 };
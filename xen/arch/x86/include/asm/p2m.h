@@ -16,6 +16,8 @@
 
 #include <xen/paging.h>
 #include <xen/mem_access.h>
+#include <xen/tasklet.h>
+#include <xen/timer.h>
 #include <asm/mem_sharing.h>
 #include <asm/page.h>    /* for pagetable_t */
 
@@ -295,6 +297,21 @@ struct p2m_domain {
     /* Highest guest frame that's ever been mapped in the p2m */
     unsigned long max_mapped_pfn;
 
+    /*
+     * Host p2m: superpage recoalescing scanner.  Protected by the p2m lock.
+     * The page counts are indexed by mapping order (4k, 2M, 1G).
+     */
+    struct {
+        struct timer     timer;
+        struct tasklet   tasklet;
+        unsigned int     rate;         /* 2M regions examined per second */
+        unsigned long    next_gfn;     /* Position of the pass in progress */
+        unsigned long    pages[3];     /* RAM pages seen so far this pass */
+        unsigned long    last[3];      /* ... and during the last pass */
+        unsigned long    coalesced;    /* 2M entries re-created */
+        unsigned long    passes;       /* Completed passes */
+    } recoalesce;
+
     /*
      * Alternate p2m's only: range of gfn's for which underlying
      * mfn may have duplicate mappings
@@ -791,6 +808,36 @@ int __must_check p2m_set_entry(struct p2m_domain *p2m, gfn_t gfn, mfn_t mfn,
                                unsigned int page_order, p2m_type_t p2mt,
                                p2m_access_t p2ma);
 
+/*
+ * Batched p2m updates: only for use by p2m code.
+ *
+ * p2m_batch_begin() takes the p2m write lock, which is held until
+ * p2m_batch_commit().  Updates queued with p2m_batch_set() are accumulated
+ * into runs of contiguous gfns mapping contiguous mfns with identical type
+ * and access, and each run is written with the largest page orders its
+ * alignment permits.  TLB flushes required by the individual writes are
+ * deferred and issued once, when the lock is dropped at commit time.
+ *
+ * Queued updates are not visible to p2m lookups until they are written
+ * back, either by p2m_batch_flush() or p2m_batch_commit().  Callers must
+ * flush before any operation which may itself modify the p2m (e.g. an
+ * allocating lookup of a PoD or paged-out gfn).
+ */
+struct p2m_batch {
+    struct p2m_domain *p2m;
+    gfn_t gfn;              /* First gfn of the pending run. */
+    mfn_t mfn;              /* First mfn of the pending run. */
+    unsigned long nr;       /* Number of entries in the pending run. */
+    p2m_type_t t;
+    p2m_access_t a;
+};
+
+void p2m_batch_begin(struct p2m_batch *b, struct p2m_domain *p2m);
+int __must_check p2m_batch_set(struct p2m_batch *b, gfn_t gfn, mfn_t mfn,
+                               p2m_type_t t, p2m_access_t a);
+int __must_check p2m_batch_flush(struct p2m_batch *b);
+int __must_check p2m_batch_commit(struct p2m_batch *b);
+
 #if defined(CONFIG_HVM)
 /* Set up function pointers for PT implementation: only for use by p2m code */
 extern void p2m_pt_init(struct p2m_domain *p2m);
@@ -801,6 +848,14 @@ static inline void p2m_pt_init(struct p2m_domain *p2m) {}
 void *map_domain_gfn(struct p2m_domain *p2m, gfn_t gfn, mfn_t *mfn,
                      p2m_query_t q, uint32_t *pfec);
 
+struct xen_domctl_p2m_superpage;
+#ifdef CONFIG_HVM
+int p2m_superpage_domctl(struct domain *d, struct xen_domctl_p2m_superpage *op);
+void p2m_recoalesce_stop(struct domain *d);
+#else
+static inline void p2m_recoalesce_stop(struct domain *d) {}
+#endif
+
 #if P2M_AUDIT
 extern void audit_p2m(struct domain *d,
                       uint64_t *orphans,
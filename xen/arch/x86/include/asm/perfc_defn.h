@@ -15,6 +15,13 @@ PERFCOUNTER_ARRAY(vmexits,              "vmexits",
 #define VMX_PERF_VECTOR_SIZE 0x20
 PERFCOUNTER_ARRAY(cause_vector,         "cause vector", VMX_PERF_VECTOR_SIZE)
 
+PERFCOUNTER(hvm_mmio_fast,              "hvm mmio fast path")
+PERFCOUNTER(hvm_mmio_fast_dm,           "hvm mmio fast path to device model")
+
+PERFCOUNTER(vmx_pi_kicks,               "vmx posted intr kicks")
+PERFCOUNTER(vmx_pi_kicks_avoided,       "vmx posted intr kicks avoided")
+PERFCOUNTER(dm_msi_batched,             "MSIs injected by batched dm_op")
+
 #endif /* CONFIG_HVM */
 
 PERFCOUNTER(seg_fixups,             "segmentation fixups")
@@ -35,6 +42,10 @@ PERFCOUNTER(copy_user_faults,       "copy_user faults")
 PERFCOUNTER(map_domain_page_count,  "map_domain_page count")
 PERFCOUNTER(ptwr_emulations,        "writable pt emulations")
 PERFCOUNTER(mmio_ro_emulations,     "mmio ro emulations")
+PERFCOUNTER(hvm_io_lookups,         "HVM I/O handler lookups")
+PERFCOUNTER(hvm_io_accept_calls,    "HVM I/O handler accept() calls")
+PERFCOUNTER(hvm_io_accept_avoided,  "HVM I/O handler accept() calls avoided")
+PERFCOUNTER(hvm_io_hint_hits,       "HVM MMIO handler hint hits")
 
 PERFCOUNTER(exception_fixed,        "pre-exception fixed")
 
@@ -127,6 +138,14 @@ PERFCOUNTER(pauseloop_exits, "vmexits from Pause-Loop Detection")
 
 PERFCOUNTER(iommu_pt_shatters,    "IOMMU page table shatters")
 PERFCOUNTER(iommu_pt_coalesces,   "IOMMU page table coalesces")
+PERFCOUNTER(iommu_pt_walk_hits,   "IOMMU page table walks avoided")
+PERFCOUNTER(iommu_qi_descs,       "IOMMU QI descriptors")
+PERFCOUNTER(iommu_qi_waits,       "IOMMU QI wait descriptors")
+PERFCOUNTER(iommu_qi_iotlb_batched,   "IOMMU QI batched IOTLB range flushes")
+PERFCOUNTER(iommu_qi_iotlb_escalated, "IOMMU QI IOTLB range flushes escalated")
+
+PERFCOUNTER(p2m_batch_flushes,    "p2m batch TLB flushes")
+PERFCOUNTER(p2m_batch_coalesced,  "p2m batch entries coalesced")
 
 PERFCOUNTER(buslock, "Bus Locks Detected")
 PERFCOUNTER(vmnotify_crash, "domain crashes by Notify VM Exit")
@@ -270,10 +270,11 @@ static int p2m_set_altp2m_mem_access(struct domain *d, struct p2m_domain *hp2m,
     return ap2m->set_entry(ap2m, gfn, mfn, PAGE_ORDER_4K, t, a, -1);
 }
 
-static int set_mem_access(struct domain *d, struct p2m_domain *p2m,
+static int set_mem_access(struct domain *d, struct p2m_batch *b,
                           struct p2m_domain *ap2m, p2m_access_t a,
                           gfn_t gfn)
 {
+    struct p2m_domain *p2m = b->p2m;
     int rc = 0;
 
     if ( ap2m )
@@ -287,10 +288,23 @@ static int set_mem_access(struct domain *d, struct p2m_domain *p2m,
     {
         p2m_access_t _a;
         p2m_type_t t;
-        mfn_t mfn = p2m_get_gfn_type_access(p2m, gfn, &t, &_a,
-                                            P2M_ALLOC, NULL, false);
+        mfn_t mfn = p2m_get_gfn_type_access(p2m, gfn, &t, &_a, 0, NULL,
+                                            false);
+
+        /*
+         * Populating the gfn may modify neighbouring entries, so write back
+         * any queued updates before doing an allocating lookup.
+         */
+        if ( !mfn_valid(mfn) )
+        {
+            rc = p2m_batch_flush(b);
+            if ( !rc )
+                mfn = p2m_get_gfn_type_access(p2m, gfn, &t, &_a, P2M_ALLOC,
+                                              NULL, false);
+        }
 
-        rc = p2m->set_entry(p2m, gfn, mfn, PAGE_ORDER_4K, t, a, -1);
+        if ( !rc )
+            rc = p2m_batch_set(b, gfn, mfn, t, a);
     }
 
     return rc;
@@ -340,9 +354,11 @@ long p2m_set_mem_access(struct domain *d, gfn_t gfn, uint32_t nr,
                         unsigned int altp2m_idx)
 {
     struct p2m_domain *p2m = p2m_get_hostp2m(d), *ap2m = NULL;
+    struct p2m_batch b;
     p2m_access_t a;
     unsigned long gfn_l;
     long rc = 0;
+    int ret;
 
     /* altp2m view 0 is treated as the hostp2m */
     if ( altp2m_idx )
@@ -365,13 +381,13 @@ long p2m_set_mem_access(struct domain *d, gfn_t gfn, uint32_t nr,
         return 0;
     }
 
-    p2m_lock(p2m);
+    p2m_batch_begin(&b, p2m);
     if ( ap2m )
         p2m_lock(ap2m);
 
     for ( gfn_l = gfn_x(gfn) + start; nr > start; ++gfn_l )
     {
-        rc = set_mem_access(d, p2m, ap2m, a, _gfn(gfn_l));
+        rc = set_mem_access(d, &b, ap2m, a, _gfn(gfn_l));
 
         if ( rc )
             break;
@@ -386,7 +402,9 @@ long p2m_set_mem_access(struct domain *d, gfn_t gfn, uint32_t nr,
 
     if ( ap2m )
         p2m_unlock(ap2m);
-    p2m_unlock(p2m);
+    ret = p2m_batch_commit(&b);
+    if ( ret && rc >= 0 )
+        rc = ret;
 
     return rc;
 }
@@ -398,7 +416,9 @@ long p2m_set_mem_access_multi(struct domain *d,
                               unsigned int altp2m_idx)
 {
     struct p2m_domain *p2m = p2m_get_hostp2m(d), *ap2m = NULL;
+    struct p2m_batch b;
     long rc = 0;
+    int ret;
 
     /* altp2m view 0 is treated as the hostp2m */
     if ( altp2m_idx )
@@ -411,7 +431,7 @@ long p2m_set_mem_access_multi(struct domain *d,
         ap2m = array_access_nospec(d->arch.altp2m_p2m, altp2m_idx);
     }
 
-    p2m_lock(p2m);
+    p2m_batch_begin(&b, p2m);
     if ( ap2m )
         p2m_lock(ap2m);
 
@@ -434,7 +454,7 @@ long p2m_set_mem_access_multi(struct domain *d,
             break;
         }
 
-        rc = set_mem_access(d, p2m, ap2m, a, _gfn(gfn_l));
+        rc = set_mem_access(d, &b, ap2m, a, _gfn(gfn_l));
 
         if ( rc )
             break;
@@ -449,7 +469,9 @@ long p2m_set_mem_access_multi(struct domain *d,
 
     if ( ap2m )
         p2m_unlock(ap2m);
-    p2m_unlock(p2m);
+    ret = p2m_batch_commit(&b);
+    if ( ret && rc >= 0 )
+        rc = ret;
 
     return rc;
 }
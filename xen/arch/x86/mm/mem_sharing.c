@@ -1235,6 +1235,25 @@ err_out:
 }
 
 
+/* Maximum number of gfns a fork logs for its next reset. */
+#define FORK_RESET_LOG_ENTRIES (PAGE_SIZE / sizeof(gfn_t))
+
+/*
+ * Record that a fork got a private page at gfn, for the next reset to drop.
+ * The fork's p2m must be locked.
+ */
+static void fork_reset_log(struct domain *d, gfn_t gfn)
+{
+    struct mem_sharing_domain *msd = &d->arch.hvm.mem_sharing;
+
+    ASSERT(p2m_locked_by_me(p2m_get_hostp2m(d)));
+
+    if ( msd->reset_log && msd->reset_log_nr < FORK_RESET_LOG_ENTRIES )
+        msd->reset_log[msd->reset_log_nr++] = gfn;
+    else
+        msd->reset_log_overflow = true;
+}
+
 /*
  * A note on the rationale for unshare error handling:
  *  1. Unshare can only fail with ENOMEM. Any other error conditions BUG_ON()'s
@@ -1376,6 +1395,8 @@ int __mem_sharing_unshare_page(struct domain *d,
      * marking dirty is feasible
      */
     paging_mark_dirty(d, page_to_mfn(page));
+    if ( mem_sharing_is_fork(d) )
+        fork_reset_log(d, _gfn(gfn));
     /* We do not need to unlock a private page */
 
  out:
@@ -1445,6 +1466,10 @@ int relinquish_shared_pages(struct domain *d)
     }
 
     p2m_unlock(p2m);
+
+    if ( !rc )
+        XFREE(msd->reset_log);
+
     return rc;
 }
 
@@ -1601,8 +1626,12 @@ int mem_sharing_fork_page(struct domain *d, gfn_t gfn, bool unsharing)
 
     put_gfn(parent, gfn_l);
 
-    return p2m->set_entry(p2m, gfn, new_mfn, PAGE_ORDER_4K, p2m_ram_rw,
-                          p2m->default_access, -1);
+    rc = p2m->set_entry(p2m, gfn, new_mfn, PAGE_ORDER_4K, p2m_ram_rw,
+                        p2m->default_access, -1);
+    if ( !rc )
+        fork_reset_log(d, gfn);
+
+    return rc;
 }
 
 static int bring_up_vcpus(struct domain *cd, struct domain *d)
@@ -1899,6 +1928,18 @@ static int fork(struct domain *cd, struct domain *d)
 
     rc = copy_settings(cd, d);
 
+    if ( !rc )
+    {
+        struct mem_sharing_domain *msd = &cd->arch.hvm.mem_sharing;
+
+        /* Failing to allocate the log only makes resets slower. */
+        if ( !msd->reset_log )
+            msd->reset_log = xmalloc_array(gfn_t, FORK_RESET_LOG_ENTRIES);
+        msd->reset_log_nr = 0;
+        msd->reset_log_overflow = false;
+        msd->reset_tot_pages = domain_tot_pages(cd);
+    }
+
  done:
     if ( rc && rc != -ERESTART )
     {
@@ -1910,6 +1951,68 @@ static int fork(struct domain *cd, struct domain *d)
     return rc;
 }
 
+/*
+ * Drop a private page of a fork, for it to get populated from the parent
+ * again on next access.
+ */
+static void fork_reset_page(struct domain *d, struct p2m_domain *p2m,
+                            gfn_t gfn, struct page_info *page)
+{
+    shr_handle_t sh;
+    int rc;
+
+    /*
+     * We only want to remove pages from the fork here that were copied
+     * from the parent but could be potentially re-populated using memory
+     * sharing after the reset. These pages all must be regular pages with
+     * no extra reference held to them, thus should be possible to make
+     * them sharable. Unfortunately p2m_is_sharable check is not sufficient
+     * to test this as it doesn't check the page's reference count. We thus
+     * check whether the page is convertable to the shared type using
+     * nominate_page. In case the page is already shared (ie. a share
+     * handle is returned) then we don't remove it.
+     */
+    if ( nominate_page(d, gfn, 0, true, &sh) || sh )
+        return;
+
+    /* forked memory is 4k, not splitting large pages so this must work */
+    rc = p2m->set_entry(p2m, gfn, INVALID_MFN, PAGE_ORDER_4K,
+                        p2m_invalid, p2m_access_rwx, -1);
+    ASSERT(!rc);
+
+    put_page_alloc_ref(page);
+    put_page_and_type(page);
+}
+
+/*
+ * Drop only the pages logged since the last reset.  This is possible as
+ * long as the log didn't overflow and all pages the fork gained since are
+ * accounted for by it.
+ */
+static bool fork_reset_logged_pages(struct domain *d, struct p2m_domain *p2m)
+{
+    const struct mem_sharing_domain *msd = &d->arch.hvm.mem_sharing;
+    unsigned int i;
+
+    if ( !msd->reset_log || msd->reset_log_overflow ||
+         domain_tot_pages(d) != msd->reset_tot_pages + msd->reset_log_nr )
+        return false;
+
+    for ( i = 0; i < msd->reset_log_nr; i++ )
+    {
+        gfn_t gfn = msd->reset_log[i];
+        p2m_access_t a;
+        p2m_type_t t;
+        mfn_t mfn = p2m->get_entry(p2m, gfn, &t, &a, 0, NULL, NULL);
+
+        if ( mfn_valid(mfn) && t == p2m_ram_rw &&
+             page_get_owner(mfn_to_page(mfn)) == d )
+            fork_reset_page(d, p2m, gfn, mfn_to_page(mfn));
+    }
+
+    return true;
+}
+
 /*
  * The fork reset operation is intended to be used on short-lived forks only.
  * There is no hypercall continuation operation implemented for this reason.
@@ -1926,7 +2029,7 @@ int mem_sharing_fork_reset(struct domain *d, bool reset_state,
     int rc = 0;
     struct domain *pd = d->parent;
     struct p2m_domain *p2m = p2m_get_hostp2m(d);
-    struct page_info *page, *tmp;
+    struct mem_sharing_domain *msd = &d->arch.hvm.mem_sharing;
 
     ASSERT(reset_state || reset_memory);
 
@@ -1935,37 +2038,25 @@ int mem_sharing_fork_reset(struct domain *d, bool reset_state,
     if ( !reset_memory )
         goto state;
 
-    /* need recursive lock because we will free pages */
-    rspin_lock(&d->page_alloc_lock);
-    page_list_for_each_safe(page, tmp, &d->page_list)
+    /* Hold the p2m lock throughout, for a single TLB flush at the end. */
+    p2m_lock(p2m);
+
+    if ( !fork_reset_logged_pages(d, p2m) )
     {
-        shr_handle_t sh;
-        mfn_t mfn = page_to_mfn(page);
-        gfn_t gfn = mfn_to_gfn(d, mfn);
+        struct page_info *page, *tmp;
 
-        /*
-         * We only want to remove pages from the fork here that were copied
-         * from the parent but could be potentially re-populated using memory
-         * sharing after the reset. These pages all must be regular pages with
-         * no extra reference held to them, thus should be possible to make
-         * them sharable. Unfortunately p2m_is_sharable check is not sufficient
-         * to test this as it doesn't check the page's reference count. We thus
-         * check whether the page is convertable to the shared type using
-         * nominate_page. In case the page is already shared (ie. a share
-         * handle is returned) then we don't remove it.
-         */
-        if ( (rc = nominate_page(d, gfn, 0, true, &sh)) || sh )
-            continue;
+        /* need recursive lock because we will free pages */
+        rspin_lock(&d->page_alloc_lock);
+        page_list_for_each_safe(page, tmp, &d->page_list)
+            fork_reset_page(d, p2m, mfn_to_gfn(d, page_to_mfn(page)), page);
+        rspin_unlock(&d->page_alloc_lock);
+    }
 
-        /* forked memory is 4k, not splitting large pages so this must work */
-        rc = p2m->set_entry(p2m, gfn, INVALID_MFN, PAGE_ORDER_4K,
-                            p2m_invalid, p2m_access_rwx, -1);
-        ASSERT(!rc);
+    msd->reset_log_nr = 0;
+    msd->reset_log_overflow = false;
+    msd->reset_tot_pages = domain_tot_pages(d);
 
-        put_page_alloc_ref(page);
-        put_page_and_type(page);
-    }
-    rspin_unlock(&d->page_alloc_lock);
+    p2m_unlock(p2m);
 
  state:
     if ( reset_state )
@@ -1984,6 +2075,47 @@ int mem_sharing_fork_reset(struct domain *d, bool reset_state,
     return rc;
 }
 
+/*
+ * Reset the forks of pd listed by the caller, checking for preemption
+ * between forks.  Returns 1 when a continuation is needed.
+ */
+static int fork_reset_multi(struct domain *pd,
+                            struct mem_sharing_op_fork_reset_multi *multi)
+{
+    bool reset_state = multi->flags & XENMEM_FORK_RESET_STATE;
+    bool reset_memory = multi->flags & XENMEM_FORK_RESET_MEMORY;
+
+    while ( multi->nr_done < multi->nr_forks )
+    {
+        struct domain *cd;
+        domid_t domid;
+        int rc;
+
+        if ( copy_from_guest_offset(&domid, multi->forks, multi->nr_done, 1) )
+            return -EFAULT;
+
+        rc = rcu_lock_live_remote_domain_by_id(domid, &cd);
+        if ( rc )
+            return rc;
+
+        rc = xsm_mem_sharing(XSM_DM_PRIV, cd);
+        if ( !rc && cd->parent != pd )
+            rc = -EINVAL;
+        if ( !rc )
+            rc = mem_sharing_fork_reset(cd, reset_state, reset_memory);
+
+        rcu_unlock_domain(cd);
+
+        if ( rc )
+            return rc;
+
+        if ( ++multi->nr_done < multi->nr_forks && hypercall_preempt_check() )
+            return 1;
+    }
+
+    return 0;
+}
+
 int mem_sharing_memop(XEN_GUEST_HANDLE_PARAM(xen_mem_sharing_op_t) arg)
 {
     int rc;
@@ -2302,6 +2434,35 @@ int mem_sharing_memop(XEN_GUEST_HANDLE_PARAM(xen_mem_sharing_op_t) arg)
         break;
     }
 
+    case XENMEM_sharing_op_fork_reset_multi:
+    {
+        struct mem_sharing_op_fork_reset_multi *multi =
+            &mso.u.fork_reset_multi;
+
+        rc = -EINVAL;
+        if ( multi->pad || multi->nr_done > multi->nr_forks ||
+             !(multi->flags &
+               (XENMEM_FORK_RESET_STATE | XENMEM_FORK_RESET_MEMORY)) ||
+             (multi->flags &
+              ~(XENMEM_FORK_RESET_STATE | XENMEM_FORK_RESET_MEMORY)) )
+            goto out;
+
+        rc = fork_reset_multi(d, multi);
+
+        if ( rc > 0 )
+        {
+            if ( __copy_to_guest(arg, &mso, 1) )
+                rc = -EFAULT;
+            else
+                rc = hypercall_create_continuation(__HYPERVISOR_memory_op,
+                                                   "lh", XENMEM_sharing_op,
+                                                   arg);
+        }
+        else if ( rc < 0 && __copy_to_guest(arg, &mso, 1) )
+            rc = -EFAULT;
+    }
+    break;
+
     default:
         rc = -ENOSYS;
         break;
@@ -39,6 +39,7 @@ static int p2m_initialise(struct domain *d, struct p2m_domain *p2m)
 
     p2m_pod_init(p2m);
     p2m_nestedp2m_init(p2m);
+    p2m_recoalesce_init(p2m);
 
     if ( hap_enabled(d) && using_vmx() )
         ret = ept_p2m_init(p2m);
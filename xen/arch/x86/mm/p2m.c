@@ -18,6 +18,7 @@
 #include <xen/grant_table.h>
 #include <xen/ioreq.h>
 #include <xen/param.h>
+#include <public/domctl.h>
 #include <public/vm_event.h>
 #include <asm/domain.h>
 #include <asm/page.h>
@@ -25,6 +26,7 @@
 #include <asm/p2m.h>
 #include <asm/mem_sharing.h>
 #include <asm/hvm/nestedhvm.h>
+#include <asm/hvm/vmx/vmx.h>
 #include <asm/altp2m.h>
 #include <asm/vm_event.h>
 #include <xsm/xsm.h>
@@ -393,11 +395,30 @@ struct page_info *p2m_get_page_from_gfn(
     return page;
 }
 
+/*
+ * The largest order of entry p2m_set_entry() uses to map todo pages at frame
+ * numbers with the alignment of fn_mask.
+ */
+static unsigned int p2m_entry_order(const struct p2m_domain *p2m,
+                                    unsigned long fn_mask, unsigned long todo)
+{
+    bool hap = hap_enabled(p2m->domain);
+
+    if ( !(fn_mask & ((1UL << PAGE_ORDER_1G) - 1)) &&
+         todo >= (1UL << PAGE_ORDER_1G) && hap && hap_has_1gb )
+        return PAGE_ORDER_1G;
+
+    if ( !(fn_mask & ((1UL << PAGE_ORDER_2M) - 1)) &&
+         todo >= (1UL << PAGE_ORDER_2M) && (!hap || hap_has_2mb) )
+        return PAGE_ORDER_2M;
+
+    return PAGE_ORDER_4K;
+}
+
 /* Returns: 0 for success, -errno for failure */
 int p2m_set_entry(struct p2m_domain *p2m, gfn_t gfn, mfn_t mfn,
                   unsigned int page_order, p2m_type_t p2mt, p2m_access_t p2ma)
 {
-    bool hap = hap_enabled(p2m->domain);
     unsigned long todo = 1UL << page_order;
     int set_rc, rc = 0;
 
@@ -407,12 +428,7 @@ int p2m_set_entry(struct p2m_domain *p2m, gfn_t gfn, mfn_t mfn,
     {
         unsigned long fn_mask = (!mfn_eq(mfn, INVALID_MFN) ? mfn_x(mfn) : 0) |
                                 gfn_x(gfn) | todo;
-        unsigned int order = (!(fn_mask & ((1UL << PAGE_ORDER_1G) - 1)) &&
-                              hap && hap_has_1gb)
-                             ? PAGE_ORDER_1G
-                             : (!(fn_mask & ((1UL << PAGE_ORDER_2M) - 1)) &&
-                                (!hap || hap_has_2mb))
-                               ? PAGE_ORDER_2M : PAGE_ORDER_4K;
+        unsigned int order = p2m_entry_order(p2m, fn_mask, todo);
 
         set_rc = p2m->set_entry(p2m, gfn, mfn, order, p2mt, p2ma, -1);
         if ( set_rc )
@@ -427,6 +443,94 @@ int p2m_set_entry(struct p2m_domain *p2m, gfn_t gfn, mfn_t mfn,
     return rc;
 }
 
+void p2m_batch_begin(struct p2m_batch *b, struct p2m_domain *p2m)
+{
+    p2m_lock(p2m);
+
+    b->p2m = p2m;
+    b->nr = 0;
+}
+
+/* Write back the pending run.  Returns: 0 for success, -errno for failure */
+int p2m_batch_flush(struct p2m_batch *b)
+{
+    gfn_t gfn = b->gfn;
+    mfn_t mfn = b->mfn;
+    unsigned long todo = b->nr;
+    int rc = 0;
+
+    ASSERT(p2m_locked_by_me(b->p2m));
+
+    b->nr = 0;
+
+    while ( todo && !rc )
+    {
+        unsigned long fn_mask = (!mfn_eq(mfn, INVALID_MFN) ? mfn_x(mfn) : 0) |
+                                gfn_x(gfn);
+        unsigned int order = p2m_entry_order(b->p2m, fn_mask, todo);
+
+        rc = p2m_set_entry(b->p2m, gfn, mfn, order, b->t, b->a);
+        if ( order && !rc )
+            perfc_add(p2m_batch_coalesced, (1UL << order) - 1);
+
+        gfn = gfn_add(gfn, 1UL << order);
+        if ( !mfn_eq(mfn, INVALID_MFN) )
+            mfn = mfn_add(mfn, 1UL << order);
+        todo -= 1UL << order;
+    }
+
+    return rc;
+}
+
+/*
+ * Queue a single 4k update.  Returns: 0 for success, -errno if writing back
+ * the previously pending run failed.
+ */
+int p2m_batch_set(struct p2m_batch *b, gfn_t gfn, mfn_t mfn,
+                  p2m_type_t t, p2m_access_t a)
+{
+    int rc;
+
+    if ( b->nr && t == b->t && a == b->a &&
+         gfn_eq(gfn, gfn_add(b->gfn, b->nr)) &&
+         (mfn_eq(b->mfn, INVALID_MFN)
+          ? mfn_eq(mfn, INVALID_MFN)
+          : mfn_eq(mfn, mfn_add(b->mfn, b->nr))) )
+    {
+        b->nr++;
+        return 0;
+    }
+
+    rc = p2m_batch_flush(b);
+    if ( rc )
+        return rc;
+
+    b->gfn = gfn;
+    b->mfn = mfn;
+    b->t = t;
+    b->a = a;
+    b->nr = 1;
+
+    return 0;
+}
+
+/*
+ * Write back the pending run and drop the p2m lock, issuing any TLB flush
+ * the batch accumulated.  The lock is dropped even on failure.
+ */
+int p2m_batch_commit(struct p2m_batch *b)
+{
+    struct p2m_domain *p2m = b->p2m;
+    int rc = p2m_batch_flush(b);
+
+    if ( p2m->defer_flush == 1 && p2m->need_flush )
+        perfc_incr(p2m_batch_flushes);
+
+    p2m_unlock(p2m);
+
+    return rc;
+}
+
 mfn_t p2m_alloc_ptp(struct p2m_domain *p2m, unsigned int level)
 {
     struct page_info *pg;
@@ -1735,6 +1839,180 @@ int unmap_mmio_regions(struct domain *d,
     return i == nr ? 0 : i ?: ret;
 }
 
+/*
+ * Superpage recoalescing.
+ *
+ * Superpage mappings get shattered over a guest's lifetime (PoD, ballooning,
+ * mem_access, grant mappings, ...) and nothing ever re-creates them.  When
+ * enabled, a rate limited scanner walks the host p2m in 2M steps, replacing
+ * runs of 512 4k entries which map contiguous, suitably aligned RAM with
+ * identical type and access by a single 2M entry.  Runs backed by scattered
+ * frames are left alone; the guest's memory is not migrated.  With EPT, the
+ * run also needs a single effective memory type, or the 2M entry would only
+ * get split again by resolve_misconfig().
+ */
+#define RECOALESCE_HZ         10
+#define RECOALESCE_MAX_RATE   (1U << 20)
+
+static void p2m_recoalesce_region(struct p2m_domain *p2m, unsigned long gfn)
+{
+    p2m_type_t t0, t;
+    p2m_access_t a0, a;
+    unsigned int order, i, present;
+    mfn_t mfn0, mfn;
+    bool merge, ipat;
+
+    ASSERT(p2m_locked_by_me(p2m));
+
+    mfn0 = p2m->get_entry(p2m, _gfn(gfn), &t0, &a0, 0, &order, NULL);
+
+    if ( order >= PAGE_ORDER_2M )
+    {
+        if ( p2m_is_ram(t0) )
+            p2m->recoalesce.pages[order >= PAGE_ORDER_1G ? 2 : 1] +=
+                1UL << PAGE_ORDER_2M;
+        return;
+    }
+
+    present = !!p2m_is_ram(t0);
+    merge = hap_has_2mb && (t0 == p2m_ram_rw || t0 == p2m_ram_ro) &&
+            mfn_valid(mfn0) && !(mfn_x(mfn0) & ((1UL << PAGE_ORDER_2M) - 1));
+
+    for ( i = 1; i < (1U << PAGE_ORDER_2M); i++ )
+    {
+        mfn = p2m->get_entry(p2m, _gfn(gfn + i), &t, &a, 0, NULL, NULL);
+
+        if ( p2m_is_ram(t) )
+            present++;
+        if ( merge &&
+             (t != t0 || a != a0 || !mfn_eq(mfn, mfn_add(mfn0, i))) )
+            merge = false;
+    }
+
+    if ( merge && using_vmx() &&
+         epte_get_entry_emt(p2m->domain, _gfn(gfn), mfn0, PAGE_ORDER_2M,
+                            &ipat, t0) < 0 )
+        merge = false;
+
+    if ( merge &&
+         !p2m_set_entry(p2m, _gfn(gfn), mfn0, PAGE_ORDER_2M, t0, a0) )
+    {
+        p2m->recoalesce.coalesced++;
+        p2m->recoalesce.pages[1] += 1UL << PAGE_ORDER_2M;
+    }
+    else
+        p2m->recoalesce.pages[0] += present;
+}
+
+static void cf_check p2m_recoalesce_tasklet(void *data)
+{
+    struct p2m_domain *p2m = data;
+    unsigned int budget;
+
+    if ( p2m->domain->is_dying )
+        return;
+
+    p2m_lock(p2m);
+    budget = max(p2m->recoalesce.rate / RECOALESCE_HZ, 1U);
+    p2m_unlock(p2m);
+
+    do {
+        p2m_lock(p2m);
+
+        if ( !p2m->recoalesce.rate )
+        {
+            p2m_unlock(p2m);
+            return;
+        }
+
+        if ( p2m->recoalesce.next_gfn > p2m->max_mapped_pfn )
+        {
+            memcpy(p2m->recoalesce.last, p2m->recoalesce.pages,
+                   sizeof(p2m->recoalesce.last));
+            memset(p2m->recoalesce.pages, 0, sizeof(p2m->recoalesce.pages));
+            p2m->recoalesce.next_gfn = 0;
+            p2m->recoalesce.passes++;
+            budget = 1;
+        }
+        else
+        {
+            p2m_recoalesce_region(p2m, p2m->recoalesce.next_gfn);
+            p2m->recoalesce.next_gfn += 1UL << PAGE_ORDER_2M;
+        }
+
+        p2m_unlock(p2m);
+    } while ( --budget && !softirq_pending(smp_processor_id()) );
+
+    set_timer(&p2m->recoalesce.timer, NOW() + SECONDS(1) / RECOALESCE_HZ);
+}
+
+static void cf_check p2m_recoalesce_timer(void *data)
+{
+    struct p2m_domain *p2m = data;
+
+    tasklet_schedule(&p2m->recoalesce.tasklet);
+}
+
+void p2m_recoalesce_init(struct p2m_domain *p2m)
+{
+    init_timer(&p2m->recoalesce.timer, p2m_recoalesce_timer, p2m,
+               smp_processor_id());
+    tasklet_init(&p2m->recoalesce.tasklet, p2m_recoalesce_tasklet, p2m);
+}
+
+void p2m_recoalesce_stop(struct domain *d)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+
+    if ( !is_hvm_domain(d) || !p2m )
+        return;
+
+    /* Kill the timer first, so the tasklet can't be re-scheduled. */
+    kill_timer(&p2m->recoalesce.timer);
+    tasklet_kill(&p2m->recoalesce.tasklet);
+}
+
+int p2m_superpage_domctl(struct domain *d, struct xen_domctl_p2m_superpage *op)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    bool start;
+
+    if ( !hap_enabled(d) )
+        return -EOPNOTSUPP;
+
+    switch ( op->op )
+    {
+    case XEN_DOMCTL_P2M_SUPERPAGE_GET:
+        p2m_lock(p2m);
+        op->rate = p2m->recoalesce.rate;
+        op->pages_4k = p2m->recoalesce.last[0];
+        op->pages_2m = p2m->recoalesce.last[1];
+        op->pages_1g = p2m->recoalesce.last[2];
+        op->coalesced = p2m->recoalesce.coalesced;
+        op->passes = p2m->recoalesce.passes;
+        p2m_unlock(p2m);
+        return 0;
+
+    case XEN_DOMCTL_P2M_SUPERPAGE_SET:
+        if ( op->rate > RECOALESCE_MAX_RATE )
+            return -EINVAL;
+        if ( d->is_dying )
+            return -EINVAL;
+
+        p2m_lock(p2m);
+        start = op->rate && !p2m->recoalesce.rate;
+        p2m->recoalesce.rate = op->rate;
+        p2m_unlock(p2m);
+
+        if ( start )
+            set_timer(&p2m->recoalesce.timer,
+                      NOW() + SECONDS(1) / RECOALESCE_HZ);
+        return 0;
+    }
+
+    return -EOPNOTSUPP;
+}
+
 /*** Audit ***/
 
 #if P2M_AUDIT
@@ -10,6 +10,7 @@ struct p2m_domain *p2m_init_one(struct domain *d);
 void p2m_free_one(struct p2m_domain *p2m);
 
 void p2m_pod_init(struct p2m_domain *p2m);
+void p2m_recoalesce_init(struct p2m_domain *p2m);
 
 #ifdef CONFIG_HVM
 int p2m_init_logdirty(struct p2m_domain *p2m);
@@ -17,6 +17,7 @@
 #include <asm/event.h>
 #include <asm/hvm/nestedhvm.h>
 #include <xen/numa.h>
+#include <xen/vmap.h>
 #include <xsm/xsm.h>
 #include <public/sched.h> /* SHUTDOWN_suspend */
 
@@ -99,6 +100,292 @@ static void paging_free_log_dirty_page(struct domain *d, mfn_t mfn)
     d->arch.paging.free_page(d, mfn_to_page(mfn));
 }
 
+/*
+ * Find the leaf of the log-dirty trie covering a pfn, without allocating
+ * any missing nodes.  Returns INVALID_MFN if there is none.
+ */
+static mfn_t paging_log_dirty_leaf(const struct domain *d, pfn_t pfn)
+{
+    mfn_t mfn = d->arch.paging.log_dirty.top, *l4, *l3, *l2;
+
+    if ( mfn_eq(mfn, INVALID_MFN) )
+        return INVALID_MFN;
+
+    l4 = map_domain_page(mfn);
+    mfn = l4[L4_LOGDIRTY_IDX(pfn)];
+    unmap_domain_page(l4);
+    if ( mfn_eq(mfn, INVALID_MFN) )
+        return INVALID_MFN;
+
+    l3 = map_domain_page(mfn);
+    mfn = l3[L3_LOGDIRTY_IDX(pfn)];
+    unmap_domain_page(l3);
+    if ( mfn_eq(mfn, INVALID_MFN) )
+        return INVALID_MFN;
+
+    l2 = map_domain_page(mfn);
+    mfn = l2[L2_LOGDIRTY_IDX(pfn)];
+    unmap_domain_page(l2);
+
+    return mfn;
+}
+
+/************************************************/
+/*               DIRTY RING SUPPORT             */
+/************************************************/
+
+/* Upper bound on the ring size, keeping harvests of a full ring short. */
+#define DIRTY_RING_MAX_FRAMES 256
+
+static unsigned int dirty_ring_next(const struct domain *d, unsigned int idx)
+{
+    return ++idx < d->arch.paging.log_dirty.ring.size ? idx : 0;
+}
+
+/*
+ * Discard all ring contents.  Used whenever the log-dirty bitmap gets
+ * cleared as a whole, which supersedes anything recorded in the ring.
+ */
+static void paging_dirty_ring_reset(struct domain *d)
+{
+    typeof(d->arch.paging.log_dirty.ring) *r = &d->arch.paging.log_dirty.ring;
+
+    ASSERT(paging_locked_by_me(d));
+
+    if ( !r->va )
+        return;
+
+    r->prod = r->harvest = 0;
+    r->overflow = false;
+
+    r->va->prod = r->va->harvest = r->va->cons = 0;
+    r->va->flags = 0;
+}
+
+/* Record a pfn whose log-dirty bit just became set. */
+static void paging_dirty_ring_push(struct domain *d, pfn_t pfn)
+{
+    typeof(d->arch.paging.log_dirty.ring) *r = &d->arch.paging.log_dirty.ring;
+    struct xen_dirty_ring *ring = r->va;
+    unsigned int next;
+
+    ASSERT(paging_locked_by_me(d));
+
+    if ( !ring || r->overflow )
+        return;
+
+    next = dirty_ring_next(d, r->prod);
+    if ( unlikely(next == ACCESS_ONCE(ring->cons)) )
+    {
+        r->overflow = true;
+        ring->flags |= XEN_DIRTY_RING_OVERFLOW;
+        return;
+    }
+
+    ring->pfn[r->prod] = pfn_x(pfn);
+    smp_wmb();
+    r->prod = ring->prod = next;
+}
+
+static int paging_dirty_ring_enable(struct domain *d, unsigned long nr_frames)
+{
+    typeof(d->arch.paging.log_dirty.ring) *r = &d->arch.paging.log_dirty.ring;
+    struct xen_dirty_ring *ring;
+    struct page_info *pg;
+    unsigned int i;
+
+    if ( !nr_frames || nr_frames > DIRTY_RING_MAX_FRAMES ||
+         (nr_frames & (nr_frames - 1)) )
+        return -EINVAL;
+
+    if ( r->pg )
+        return -EEXIST;
+
+    pg = alloc_domheap_pages(d, get_order_from_pages(nr_frames),
+                             MEMF_no_refcount);
+    if ( !pg )
+        return -ENOMEM;
+
+    for ( i = 0; i < nr_frames; i++ )
+        if ( unlikely(!get_page_and_type(&pg[i], d, PGT_writable_page)) )
+            /* See vmtrace_alloc_buffer() for how this can happen. */
+            goto refcnt_err;
+
+    ring = vmap_contig(page_to_mfn(pg), nr_frames);
+    if ( !ring )
+        goto refcnt_err;
+
+    memset(ring, 0, nr_frames << PAGE_SHIFT);
+    ring->size = ((nr_frames << PAGE_SHIFT) -
+                  offsetof(struct xen_dirty_ring, pfn)) / sizeof(ring->pfn[0]);
+
+    paging_lock(d);
+
+    r->pg = pg;
+    r->va = ring;
+    r->nr_frames = nr_frames;
+    r->size = ring->size;
+    r->prod = r->harvest = 0;
+
+    /* Pages already marked dirty were never recorded in the ring. */
+    r->overflow = paging_mode_log_dirty(d);
+    if ( r->overflow )
+        ring->flags |= XEN_DIRTY_RING_OVERFLOW;
+
+    paging_unlock(d);
+
+    return 0;
+
+ refcnt_err:
+    while ( i-- )
+    {
+        put_page_alloc_ref(&pg[i]);
+        put_page_and_type(&pg[i]);
+    }
+
+    return -ENOMEM;
+}
+
+static void paging_dirty_ring_free(struct domain *d)
+{
+    typeof(d->arch.paging.log_dirty.ring) *r = &d->arch.paging.log_dirty.ring;
+    struct page_info *pg;
+    const void *va;
+    unsigned int i, nr_frames;
+
+    paging_lock(d);
+    pg = r->pg;
+    va = r->va;
+    nr_frames = r->nr_frames;
+    memset(r, 0, sizeof(*r));
+    paging_unlock(d);
+
+    if ( !pg )
+        return;
+
+    vunmap(va);
+
+    for ( i = 0; i < nr_frames; i++ )
+    {
+        put_page_alloc_ref(&pg[i]);
+        put_page_and_type(&pg[i]);
+    }
+}
+
+/*
+ * Clean the log-dirty bits of all entries appended since the last harvest,
+ * then re-arm dirty logging for them and publish the new harvest index.
+ */
+static int paging_dirty_ring_harvest(struct domain *d,
+                                     struct xen_domctl_shadow_op *sc,
+                                     bool resuming)
+{
+    typeof(d->arch.paging.log_dirty.ring) *r = &d->arch.paging.log_dirty.ring;
+    unsigned long done = 0;
+
+    if ( !resuming )
+    {
+        if ( !r->va || !paging_mode_log_dirty(d) )
+            return -EINVAL;
+
+        /* As for paging_log_dirty_op(). */
+        if ( is_hvm_domain(d) &&
+             (sc->mode & XEN_DOMCTL_SHADOW_LOGDIRTY_FINAL) )
+            hvm_mapped_guest_frames_mark_dirty(d);
+
+        domain_pause(d);
+
+        p2m_flush_hardware_cached_dirty(d);
+    }
+
+    paging_lock(d);
+
+    if ( d->arch.paging.preempt.dom )
+        done = d->arch.paging.preempt.log_dirty.done;
+
+    if ( r->overflow )
+    {
+        d->arch.paging.preempt.dom = NULL;
+        paging_unlock(d);
+        domain_unpause(d);
+        return -EOVERFLOW;
+    }
+
+    while ( r->harvest != r->prod )
+    {
+        /* The consumer can write to the ring, so re-read slots only once. */
+        pfn_t pfn = _pfn(ACCESS_ONCE(r->va->pfn[r->harvest]));
+        mfn_t mfn = paging_log_dirty_leaf(d, pfn);
+
+        if ( !mfn_eq(mfn, INVALID_MFN) )
+        {
+            unsigned long *l1 = map_domain_page(mfn);
+
+            __clear_bit(L1_LOGDIRTY_IDX(pfn), l1);
+            unmap_domain_page(l1);
+        }
+
+        r->harvest = dirty_ring_next(d, r->harvest);
+
+        if ( !(++done & 0xff) && r->harvest != r->prod &&
+             hypercall_preempt_check() )
+        {
+            d->arch.paging.preempt.dom = current->domain;
+            d->arch.paging.preempt.op = sc->op;
+            d->arch.paging.preempt.log_dirty.done = done;
+            paging_unlock(d);
+            return -ERESTART;
+        }
+    }
+
+    d->arch.paging.preempt.dom = NULL;
+
+    r->va->harvest = r->harvest;
+
+    sc->pages = done;
+    sc->stats.fault_count = min(d->arch.paging.log_dirty.fault_count,
+                                UINT32_MAX + 0UL);
+    sc->stats.dirty_count = min(d->arch.paging.log_dirty.dirty_count,
+                                UINT32_MAX + 0UL);
+    d->arch.paging.log_dirty.fault_count = 0;
+    d->arch.paging.log_dirty.dirty_count = 0;
+
+    paging_unlock(d);
+
+    /* Safe because the domain is paused. */
+    d->arch.paging.log_dirty.ops->clean(d);
+
+    domain_unpause(d);
+
+    return 0;
+}
+
+unsigned int paging_dirty_ring_frames(const struct domain *d)
+{
+    return d->arch.paging.log_dirty.ring.nr_frames;
+}
+
+int paging_dirty_ring_acquire(struct domain *d, unsigned int frame,
+                              unsigned int nr_frames, xen_pfn_t mfn_list[])
+{
+    const typeof(d->arch.paging.log_dirty.ring) *r =
+        &d->arch.paging.log_dirty.ring;
+    unsigned int i;
+    int rc = nr_frames;
+
+    paging_lock(d);
+
+    if ( !r->pg || (frame + nr_frames) > r->nr_frames )
+        rc = -EINVAL;
+    else
+        for ( i = 0; i < nr_frames; i++ )
+            mfn_list[i] = mfn_x(page_to_mfn(r->pg)) + frame + i;
+
+    paging_unlock(d);
+
+    return rc;
+}
+
 static int paging_free_log_dirty_bitmap(struct domain *d, int rc)
 {
     mfn_t *l4, *l3, *l2;
@@ -108,6 +395,7 @@ static int paging_free_log_dirty_bitmap(struct domain *d, int rc)
 
     if ( mfn_eq(d->arch.paging.log_dirty.top, INVALID_MFN) )
     {
+        paging_dirty_ring_reset(d);
         paging_unlock(d);
         return 0;
     }
@@ -187,6 +475,8 @@ static int paging_free_log_dirty_bitmap(struct domain *d, int rc)
         ASSERT(d->arch.paging.log_dirty.allocs == 0);
         d->arch.paging.log_dirty.failed_allocs = 0;
 
+        paging_dirty_ring_reset(d);
+
         rc = -d->arch.paging.preempt.log_dirty.done;
         d->arch.paging.preempt.dom = NULL;
     }
@@ -319,6 +609,7 @@ void paging_mark_pfn_dirty(struct domain *d, pfn_t pfn)
                      "d%d: marked mfn %" PRI_mfn " (pfn %" PRI_pfn ")\n",
                      d->domain_id, mfn_x(mfn), pfn_x(pfn));
         d->arch.paging.log_dirty.dirty_count++;
+        paging_dirty_ring_push(d, pfn);
     }
 
 out:
@@ -347,7 +638,7 @@ void paging_mark_dirty(struct domain *d, mfn_t gmfn)
 bool paging_mfn_is_dirty(const struct domain *d, mfn_t gmfn)
 {
     pfn_t pfn;
-    mfn_t mfn, *l4, *l3, *l2;
+    mfn_t mfn;
     unsigned long *l1;
     bool dirty;
 
@@ -360,25 +651,7 @@ bool paging_mfn_is_dirty(const struct domain *d, mfn_t gmfn)
     if ( unlikely(!VALID_M2P(pfn_x(pfn))) )
         return false;
 
-    mfn = d->arch.paging.log_dirty.top;
-    if ( mfn_eq(mfn, INVALID_MFN) )
-        return false;
-
-    l4 = map_domain_page(mfn);
-    mfn = l4[L4_LOGDIRTY_IDX(pfn)];
-    unmap_domain_page(l4);
-    if ( mfn_eq(mfn, INVALID_MFN) )
-        return false;
-
-    l3 = map_domain_page(mfn);
-    mfn = l3[L3_LOGDIRTY_IDX(pfn)];
-    unmap_domain_page(l3);
-    if ( mfn_eq(mfn, INVALID_MFN) )
-        return false;
-
-    l2 = map_domain_page(mfn);
-    mfn = l2[L2_LOGDIRTY_IDX(pfn)];
-    unmap_domain_page(l2);
+    mfn = paging_log_dirty_leaf(d, pfn);
     if ( mfn_eq(mfn, INVALID_MFN) )
         return false;
 
@@ -537,6 +810,7 @@ static int paging_log_dirty_op(struct domain *d,
         {
             d->arch.paging.log_dirty.fault_count = 0;
             d->arch.paging.log_dirty.dirty_count = 0;
+            paging_dirty_ring_reset(d);
         }
     }
     else
@@ -740,6 +1014,18 @@ int paging_domctl(struct domain *d, struct xen_domctl_shadow_op *sc,
         if ( sc->mode & ~XEN_DOMCTL_SHADOW_LOGDIRTY_FINAL )
             return -EINVAL;
         return paging_log_dirty_op(d, sc, resuming);
+
+    case XEN_DOMCTL_SHADOW_OP_DIRTY_RING_ENABLE:
+        return paging_dirty_ring_enable(d, sc->pages);
+
+    case XEN_DOMCTL_SHADOW_OP_DIRTY_RING_DISABLE:
+        paging_dirty_ring_free(d);
+        return 0;
+
+    case XEN_DOMCTL_SHADOW_OP_DIRTY_RING_HARVEST:
+        if ( sc->mode & ~XEN_DOMCTL_SHADOW_LOGDIRTY_FINAL )
+            return -EINVAL;
+        return paging_dirty_ring_harvest(d, sc, resuming);
     }
 
     /* Here, dispatch domctl to the appropriate paging code */
@@ -806,6 +1092,8 @@ int paging_teardown(struct domain *d)
     int rc;
     bool preempted = false;
 
+    p2m_recoalesce_stop(d);
+
     if ( hap_enabled(d) )
         hap_teardown(d, &preempted);
     else
@@ -819,6 +1107,8 @@ int paging_teardown(struct domain *d)
     rc = paging_free_log_dirty_bitmap(d, 0);
     if ( rc == -ERESTART )
         return rc;
+
+    paging_dirty_ring_free(d);
 #endif
 
     /* Move populate-on-demand cache back to domain_list for destruction */
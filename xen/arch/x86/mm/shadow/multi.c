@@ -2231,7 +2231,7 @@ static int cf_check sh_page_fault(
             SHADOW_PRINTK("fast path mmio %#"PRIpaddr"\n", gpa);
             sh_reset_early_unshadow(v);
             sh_trace_va(TRC_SHADOW_FAST_MMIO, va);
-            return handle_mmio_with_translation(va, gpa >> PAGE_SHIFT, access)
+            return handle_mmio_with_translation(va, gpa, access)
                    ? EXCRET_fault_fixed : 0;
 #else
             /* When HVM is not enabled, there shouldn't be MMIO marker */
@@ -2551,7 +2551,7 @@ static int cf_check sh_page_fault(
         perfc_incr(shadow_fault_mmio);
         sh_trace_va(TRC_SHADOW_MMIO, va);
 
-        return handle_mmio_with_translation(va, gpa >> PAGE_SHIFT, access)
+        return handle_mmio_with_translation(va, gpa, access)
                ? EXCRET_fault_fixed : 0;
     }
 
@@ -12,6 +12,7 @@
 
 #ifdef __XEN__
 # include <xen/err.h>
+# include <xen/xmalloc.h>
 #else
 # define ERR_PTR(val) NULL
 #endif
@@ -1011,6 +1012,7 @@ int x86emul_decode(struct x86_emulate_state *s,
     s->ea.type = OP_NONE;
     s->ea.mem.seg = x86_seg_ds;
     s->ea.reg = PTR_POISON;
+    s->ea_base = s->ea_index = EA_NO_REG;
     s->ip = ctxt->regs->r(ip);
 
     s->op_bytes = def_op_bytes = ad_bytes = def_ad_bytes =
@@ -1625,32 +1627,44 @@ int x86emul_decode(struct x86_emulate_state *s,
             {
             case 0:
                 s->ea.mem.off = ctxt->regs->bx + ctxt->regs->si;
+                s->ea_base = 3;
+                s->ea_index = 6;
                 break;
             case 1:
                 s->ea.mem.off = ctxt->regs->bx + ctxt->regs->di;
+                s->ea_base = 3;
+                s->ea_index = 7;
                 break;
             case 2:
                 s->ea.mem.seg = x86_seg_ss;
                 s->ea.mem.off = ctxt->regs->bp + ctxt->regs->si;
+                s->ea_base = 5;
+                s->ea_index = 6;
                 break;
             case 3:
                 s->ea.mem.seg = x86_seg_ss;
                 s->ea.mem.off = ctxt->regs->bp + ctxt->regs->di;
+                s->ea_base = 5;
+                s->ea_index = 7;
                 break;
             case 4:
                 s->ea.mem.off = ctxt->regs->si;
+                s->ea_base = 6;
                 break;
             case 5:
                 s->ea.mem.off = ctxt->regs->di;
+                s->ea_base = 7;
                 break;
             case 6:
                 if ( s->modrm_mod == 0 )
                     break;
                 s->ea.mem.seg = x86_seg_ss;
                 s->ea.mem.off = ctxt->regs->bp;
+                s->ea_base = 5;
                 break;
             case 7:
                 s->ea.mem.off = ctxt->regs->bx;
+                s->ea_base = 3;
                 break;
             }
             switch ( s->modrm_mod )
@@ -1685,6 +1699,7 @@ int x86emul_decode(struct x86_emulate_state *s,
                 {
                     s->ea.mem.off = *decode_gpr(ctxt->regs, s->sib_index);
                     s->ea.mem.off <<= s->sib_scale;
+                    s->ea_index = s->sib_index;
                 }
                 if ( (s->modrm_mod == 0) && ((sib_base & 7) == 5) )
                     s->ea.mem.off += insn_fetch_type(int32_t);
@@ -1692,6 +1707,7 @@ int x86emul_decode(struct x86_emulate_state *s,
                 {
                     s->ea.mem.seg  = x86_seg_ss;
                     s->ea.mem.off += ctxt->regs->r(sp);
+                    s->ea_base = sib_base;
                     if ( !s->ext && (b == 0x8f) )
                         /* POP <rm> computes its EA post increment. */
                         s->ea.mem.off += ((mode_64bit() && (s->op_bytes == 4))
@@ -1701,15 +1717,20 @@ int x86emul_decode(struct x86_emulate_state *s,
                 {
                     s->ea.mem.seg  = x86_seg_ss;
                     s->ea.mem.off += ctxt->regs->r(bp);
+                    s->ea_base = sib_base;
                 }
                 else
+                {
                     s->ea.mem.off += *decode_gpr(ctxt->regs, sib_base);
+                    s->ea_base = sib_base;
+                }
             }
             else
             {
                 generate_exception_if(d & vSIB, X86_EXC_UD);
                 s->modrm_rm |= (s->rex_prefix & 1) << 3;
                 s->ea.mem.off = *decode_gpr(ctxt->regs, s->modrm_rm);
+                s->ea_base = s->modrm_rm;
                 if ( (s->modrm_rm == 5) && (s->modrm_mod != 0) )
                     s->ea.mem.seg = x86_seg_ss;
             }
@@ -1719,6 +1740,7 @@ int x86emul_decode(struct x86_emulate_state *s,
                 if ( (s->modrm_rm & 7) != 5 )
                     break;
                 s->ea.mem.off = insn_fetch_type(int32_t);
+                s->ea_base = EA_NO_REG;
                 pc_rel = mode_64bit();
                 break;
             case 1:
@@ -1821,6 +1843,7 @@ int x86emul_decode(struct x86_emulate_state *s,
 
     if ( s->ea.type == OP_MEM )
     {
+        s->ea_pc_rel = pc_rel;
         if ( pc_rel )
             s->ea.mem.off += s->ip;
 
@@ -1919,3 +1942,124 @@ int x86emul_decode(struct x86_emulate_state *s,
  done:
     return rc;
 }
+
+/*
+ * Parts of the execution mode decoding depends on, besides the instruction
+ * bytes.
+ */
+static unsigned int decode_cache_mode(struct x86_emulate_ctxt *ctxt,
+                                      const struct x86_emulate_ops *ops)
+{
+    unsigned int mode = ctxt->addr_size; /* 16, 32 or 64 */
+
+    if ( amd_like(ctxt) )
+        mode |= 1;
+
+    if ( mode_64bit() )
+        return mode;
+
+    if ( ctxt->regs->eflags & X86_EFLAGS_VM )
+        mode |= 2;
+    else if ( in_realmode(ctxt, ops) )
+        mode |= 4;
+
+    return mode;
+}
+
+/* Contribution of GPRs and rIP to the address of a memory operand. */
+static unsigned long ea_regs(const struct x86_emulate_state *s,
+                             struct cpu_user_regs *regs)
+{
+    unsigned long ea = s->ea_pc_rel ? s->ip : 0;
+
+    if ( s->ea_base != EA_NO_REG )
+        ea += *decode_gpr(regs, s->ea_base);
+    if ( s->ea_index != EA_NO_REG )
+        ea += *decode_gpr(regs, s->ea_index) << s->sib_scale;
+
+    return ea;
+}
+
+/*
+ * Decoding an instruction only depends on its bytes and the execution mode,
+ * except for the address of a memory operand, which gets recorded as the
+ * displacement from the contribution of the registers.  Decoding stops at
+ * the end of the instruction, so an entry matching a prefix of the bytes at
+ * rIP matches the instruction there.
+ */
+int x86emul_decode_cached(struct x86_emulate_state *s,
+                          struct x86_emulate_ctxt *ctxt,
+                          const struct x86_emulate_ops *ops)
+{
+    struct x86_decode_cache *cache = ctxt->decode_cache;
+    struct decode_cache_entry *e;
+    unsigned int i, n, len, mode;
+    int rc;
+
+    if ( !ctxt->insn_bytes_len )
+        return x86emul_decode(s, ctxt, ops);
+
+    mode = decode_cache_mode(ctxt, ops);
+
+    for ( i = 0; i < ARRAY_SIZE(cache->ents); i++ )
+    {
+        e = &cache->ents[i];
+
+        if ( !e->len || e->mode != mode || e->len > ctxt->insn_bytes_len )
+            continue;
+
+        /* Open coded, most entries mismatch in their first byte. */
+        for ( n = 0; n < e->len && e->bytes[n] == ctxt->insn_bytes[n]; n++ )
+            continue;
+
+        if ( n == e->len )
+        {
+            *s = e->state;
+            s->ip = ctxt->regs->r(ip) + e->len;
+            if ( s->ea.type == OP_MEM )
+                s->ea.mem.off = truncate_ea(e->ea_disp +
+                                            ea_regs(s, ctxt->regs));
+            ctxt->opcode = e->opcode;
+
+            return X86EMUL_OKAY;
+        }
+    }
+
+    rc = x86emul_decode(s, ctxt, ops);
+    if ( rc != X86EMUL_OKAY )
+        return rc;
+
+    /* Only cache instructions whose bytes the caller supplied in full. */
+    len = s->ip - ctxt->regs->r(ip);
+    if ( len > ctxt->insn_bytes_len )
+        return rc;
+
+    e = &cache->ents[cache->next++ % ARRAY_SIZE(cache->ents)];
+    e->len = len;
+    e->mode = mode;
+    memcpy(e->bytes, ctxt->insn_bytes, len);
+    e->opcode = ctxt->opcode;
+    e->ea_disp = s->ea.type == OP_MEM ? s->ea.mem.off - ea_regs(s, ctxt->regs)
+                                      : 0;
+    e->state = *s;
+
+    return rc;
+}
+
+struct x86_decode_cache *x86_decode_cache_alloc(void)
+{
+#ifdef __XEN__
+    return xzalloc(struct x86_decode_cache);
+#else
+    return calloc(1, sizeof(struct x86_decode_cache));
+#endif
+}
+
+void x86_decode_cache_free(struct x86_decode_cache *cache)
+{
+#ifdef __XEN__
+    xfree(cache);
+#else
+    free(cache);
+#endif
+}
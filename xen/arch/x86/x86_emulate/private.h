@@ -318,6 +318,15 @@ struct x86_emulate_state {
 #define imm1 ea.val
 #define imm2 ea.orig_val
 
+    /*
+     * GPRs (or EA_NO_REG) a memory operand's address gets computed from, for
+     * re-computing it on decode cache hits.  ea_index is scaled by
+     * sib_scale, and ea_pc_rel adds the address of the next instruction.
+     */
+#define EA_NO_REG 0xff
+    uint8_t ea_base, ea_index;
+    bool ea_pc_rel;
+
     unsigned long ip;
 
     struct stub_exn *stub_exn;
@@ -756,6 +765,24 @@ int x86emul_decode(struct x86_emulate_state *s,
                    struct x86_emulate_ctxt *ctxt,
                    const struct x86_emulate_ops *ops);
 
+#define DECODE_CACHE_ENTRIES 8
+
+struct x86_decode_cache {
+    unsigned int next;              /* Entry to replace next. */
+    struct decode_cache_entry {
+        uint8_t len;                /* 0 if the entry is unused. */
+        uint8_t mode;
+        uint8_t bytes[MAX_INST_LEN];
+        unsigned int opcode;
+        unsigned long ea_disp;      /* Memory operand address sans GPRs. */
+        struct x86_emulate_state state;
+    } ents[DECODE_CACHE_ENTRIES];
+};
+
+int x86emul_decode_cached(struct x86_emulate_state *s,
+                          struct x86_emulate_ctxt *ctxt,
+                          const struct x86_emulate_ops *ops);
+
 int x86emul_fpu(struct x86_emulate_state *s,
                 struct cpu_user_regs *regs,
                 struct operand *dst,
@@ -1259,7 +1259,10 @@ x86_emulate(
                            (_regs.eflags & X86_EFLAGS_VIP)),
                           X86_EXC_GP, 0);
 
-    rc = x86emul_decode(&state, ctxt, ops);
+    if ( ctxt->decode_cache )
+        rc = x86emul_decode_cached(&state, ctxt, ops);
+    else
+        rc = x86emul_decode(&state, ctxt, ops);
     if ( rc != X86EMUL_OKAY )
         return rc;
 
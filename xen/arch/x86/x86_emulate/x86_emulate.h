@@ -556,6 +556,15 @@ struct x86_emulate_ctxt
     /* Caller data that can be used by x86_emulate_ops' routines. */
     void *data;
 
+    /*
+     * Optional cache of decoded instructions, see x86_decode_cache_alloc().
+     * Only consulted if the caller prefetched the instruction: insn_bytes
+     * then holds the insn_bytes_len bytes at rIP.
+     */
+    struct x86_decode_cache *decode_cache;
+    const uint8_t *insn_bytes;
+    unsigned int insn_bytes_len;
+
     /*
      * Input/output state:
      */
@@ -736,6 +745,16 @@ x86_decode_insn(
         unsigned long offset, void *p_data, unsigned int bytes,
         struct x86_emulate_ctxt *ctxt));
 
+/*
+ * Cache of decoded instructions, for callers emulating the same few
+ * instructions over and over, like the MMIO accesses of a device driver.
+ * Entries are keyed by the instruction bytes and the parts of the execution
+ * mode affecting decode, so don't need invalidating when code or mode
+ * change.  A cache must not be shared between different CPU policies.
+ */
+struct x86_decode_cache *x86_decode_cache_alloc(void);
+void x86_decode_cache_free(struct x86_decode_cache *cache);
+
 unsigned int
 x86_insn_opsize(const struct x86_emulate_state *s);
 int
@@ -48,6 +48,9 @@ CHECK_argo_ring_data;
 CHECK_argo_ring_message_header;
 CHECK_argo_unregister_ring;
 CHECK_argo_send_addr;
+#undef CHECK_argo_send_addr
+#define CHECK_argo_send_addr struct xen_argo_send_addr
+CHECK_argo_send_msg;
 #endif
 
 #define MAX_RINGS_PER_DOMAIN            128U
@@ -74,6 +77,7 @@ DEFINE_XEN_GUEST_HANDLE(xen_argo_ring_t);
 DEFINE_XEN_GUEST_HANDLE(xen_argo_ring_data_t);
 DEFINE_XEN_GUEST_HANDLE(xen_argo_ring_data_ent_t);
 DEFINE_XEN_GUEST_HANDLE(xen_argo_send_addr_t);
+DEFINE_XEN_GUEST_HANDLE(xen_argo_send_msg_t);
 DEFINE_XEN_GUEST_HANDLE(xen_argo_unregister_ring_t);
 #ifdef CONFIG_COMPAT
 DEFINE_COMPAT_HANDLE(compat_argo_iov_t);
@@ -1056,6 +1060,19 @@ pending_notify(struct list_head *to_notify)
     }
 }
 
+/* Whether the list of ents to notify already holds one for domain_id. */
+static bool
+pending_listed(const struct list_head *to_notify, domid_t domain_id)
+{
+    const struct pending_ent *ent;
+
+    list_for_each_entry(ent, to_notify, node)
+        if ( ent->domain_id == domain_id )
+            return true;
+
+    return false;
+}
+
 static void
 pending_find(const struct domain *d, struct argo_ring_info *ring_info,
              unsigned int payload_space, struct list_head *to_notify)
@@ -1090,7 +1107,15 @@ pending_find(const struct domain *d, struct argo_ring_info *ring_info,
 
             list_del(&ent->node);
             ring_info->npending--;
-            list_add(&ent->node, to_notify);
+
+            /*
+             * A single signal per domain is enough for it to retry all of
+             * its sends, however many of its ents are satisfied.
+             */
+            if ( pending_listed(to_notify, ent->domain_id) )
+                xfree(ent);
+            else
+                list_add(&ent->node, to_notify);
         }
     }
 
@@ -2082,6 +2107,233 @@ sendv(struct domain *src_d, xen_argo_addr_t *src_addr,
     return ( ret < 0 ) ? ret : len;
 }
 
+static int
+copy_iovs_from_guest(xen_argo_iov_t *iovs, XEN_GUEST_HANDLE_PARAM(void) hnd,
+                     unsigned int first, unsigned int niov, bool compat)
+{
+#ifdef CONFIG_COMPAT
+    if ( compat )
+    {
+        compat_argo_iov_t compat_iovs[XEN_ARGO_MAXIOV];
+        unsigned int i;
+
+        if ( copy_from_guest_offset(compat_iovs, hnd, first, niov) )
+            return -EFAULT;
+
+        for ( i = 0; i < niov; i++ )
+        {
+#define XLAT_argo_iov_HNDL_iov_hnd(_d_, _s_) \
+    guest_from_compat_handle((_d_)->iov_hnd, (_s_)->iov_hnd)
+
+            XLAT_argo_iov(&iovs[i], &compat_iovs[i]);
+
+#undef XLAT_argo_iov_HNDL_iov_hnd
+        }
+
+        return 0;
+    }
+#endif
+
+    return copy_from_guest_offset(iovs, hnd, first, niov) ? -EFAULT : 0;
+}
+
+/*
+ * Start a run of batched messages to dst_id: the destination domain is
+ * looked up, checked and locked once for all of them.
+ */
+static int
+batch_get_dst(const struct domain *src_d, domid_t dst_id,
+              struct domain **dst_d)
+{
+    struct domain *d = rcu_lock_domain_by_id(dst_id);
+    int ret;
+
+    ASSERT(LOCKING_Read_L1);
+
+    if ( !d )
+        return -ESRCH;
+
+    ret = xsm_argo_send(src_d, d);
+    if ( ret )
+    {
+        gprintk(XENLOG_ERR, "argo: XSM REJECTED %i -> %i\n",
+                src_d->domain_id, d->domain_id);
+        rcu_unlock_domain(d);
+
+        return ret;
+    }
+
+    if ( !d->argo )
+    {
+        argo_dprintk("!dst_d->argo, ECONNREFUSED\n");
+        rcu_unlock_domain(d);
+
+        return -ECONNREFUSED;
+    }
+
+    read_lock(&d->argo->rings_L2_rwlock);
+    *dst_d = d;
+
+    return 0;
+}
+
+/* End a run of batched messages, signalling the destination once. */
+static void
+batch_put_dst(struct domain *dst_d, struct argo_ring_info *ring_info,
+              bool signal)
+{
+    if ( ring_info )
+        spin_unlock(&ring_info->L3_lock);
+
+    read_unlock(&dst_d->argo->rings_L2_rwlock);
+
+    if ( signal )
+        signal_domain(dst_d);
+
+    rcu_unlock_domain(dst_d);
+}
+
+static long
+sendv_batch(struct domain *src_d,
+            XEN_GUEST_HANDLE_PARAM(xen_argo_send_msg_t) msgs_hnd,
+            XEN_GUEST_HANDLE_PARAM(void) iovs_hnd, unsigned int nmsg,
+            bool compat)
+{
+    struct domain *dst_d = NULL;
+    struct argo_ring_info *ring_info = NULL;
+    xen_argo_port_t ring_aport = 0;
+    unsigned int i, iov_idx = 0;
+    bool signal = false;
+    long ret = 0;
+
+    ASSERT(nmsg <= XEN_ARGO_MAXBATCH);
+
+    read_lock(&L1_global_argo_rwlock);
+
+    if ( !src_d->argo )
+    {
+        ret = -ENODEV;
+        goto out_unlock;
+    }
+
+    for ( i = 0; i < nmsg; i++ )
+    {
+        XEN_GUEST_HANDLE_PARAM(xen_argo_send_msg_t) msg_hnd = msgs_hnd;
+        xen_argo_iov_t iovs[XEN_ARGO_MAXIOV];
+        xen_argo_send_msg_t msg;
+        struct argo_ring_id src_id;
+        unsigned int len = 0;
+        int rc = 0;
+
+        /* Messages may be large: let the caller resubmit the rest. */
+        if ( i && hypercall_preempt_check() )
+            break;
+
+        guest_handle_add_offset(msg_hnd, i);
+        if ( copy_from_guest(&msg, msg_hnd, 1) )
+        {
+            ret = -EFAULT;
+            break;
+        }
+
+        argo_dprintk("sendv_batch: %u (%u:%x)->(%u:%x) niov:%u type:%x\n", i,
+                     msg.addr.src.domain_id, msg.addr.src.aport,
+                     msg.addr.dst.domain_id, msg.addr.dst.aport, msg.niov,
+                     msg.message_type);
+
+        if ( unlikely(msg.pad || msg.addr.src.pad || msg.addr.dst.pad ||
+                      msg.niov > XEN_ARGO_MAXIOV) )
+            rc = -EINVAL;
+        else
+        {
+            rc = copy_iovs_from_guest(iovs, iovs_hnd, iov_idx, msg.niov,
+                                      compat);
+            iov_idx += msg.niov;
+        }
+
+        if ( !rc && msg.addr.src.domain_id == XEN_ARGO_DOMID_ANY )
+            msg.addr.src.domain_id = src_d->domain_id;
+
+        /* No domain is currently authorized to send on behalf of another */
+        if ( !rc && unlikely(msg.addr.src.domain_id != src_d->domain_id) )
+            rc = -EPERM;
+
+        if ( !rc && (!dst_d || dst_d->domain_id != msg.addr.dst.domain_id) )
+        {
+            if ( dst_d )
+                batch_put_dst(dst_d, ring_info, signal);
+            dst_d = NULL;
+            ring_info = NULL;
+            signal = false;
+
+            rc = batch_get_dst(src_d, msg.addr.dst.domain_id, &dst_d);
+        }
+
+        if ( !rc && (!ring_info || ring_aport != msg.addr.dst.aport) )
+        {
+            if ( ring_info )
+                spin_unlock(&ring_info->L3_lock);
+
+            ring_aport = msg.addr.dst.aport;
+            ring_info = find_ring_info_by_match(dst_d, ring_aport,
+                                                src_d->domain_id);
+            if ( ring_info )
+                spin_lock(&ring_info->L3_lock);
+            else
+            {
+                gprintk(XENLOG_ERR,
+                        "argo: vm%u connection refused, src (vm%u:%x) dst (vm%u:%x)\n",
+                        src_d->domain_id, src_d->domain_id,
+                        msg.addr.src.aport, msg.addr.dst.domain_id,
+                        msg.addr.dst.aport);
+                rc = -ECONNREFUSED;
+            }
+        }
+
+        if ( !rc )
+            rc = iov_count(iovs, msg.niov, &len);
+
+        if ( !rc )
+        {
+            src_id.aport = msg.addr.src.aport;
+            src_id.domain_id = src_d->domain_id;
+            src_id.partner_id = msg.addr.dst.domain_id;
+
+            rc = ringbuf_insert(dst_d, ring_info, &src_id, iovs, msg.niov,
+                                msg.message_type, len);
+            if ( rc == -EAGAIN )
+            {
+                int rc2 = pending_requeue(dst_d, ring_info, src_id.domain_id,
+                                          len);
+
+                if ( rc2 )
+                    rc = rc2;
+            }
+        }
+
+        msg.status = rc ?: len;
+        if ( copy_field_to_guest(msg_hnd, &msg, status) )
+        {
+            ret = -EFAULT;
+            break;
+        }
+
+        if ( rc )
+            break;
+
+        signal = true;
+        ret++;
+    }
+
+    if ( dst_d )
+        batch_put_dst(dst_d, ring_info, signal);
+
+ out_unlock:
+    read_unlock(&L1_global_argo_rwlock);
+
+    return ret;
+}
+
 long
 do_argo_op(unsigned int cmd, XEN_GUEST_HANDLE_PARAM(void) arg1,
            XEN_GUEST_HANDLE_PARAM(void) arg2, unsigned long raw_arg3,
@@ -2209,6 +2461,22 @@ do_argo_op(unsigned int cmd, XEN_GUEST_HANDLE_PARAM(void) arg1,
         break;
     }
 
+    case XEN_ARGO_OP_sendv_batch:
+    {
+        XEN_GUEST_HANDLE_PARAM(xen_argo_send_msg_t) msgs_hnd =
+            guest_handle_cast(arg1, xen_argo_send_msg_t);
+        /* arg2: iovs, arg3: nmsg */
+
+        if ( unlikely(arg3 > XEN_ARGO_MAXBATCH || arg4) )
+        {
+            rc = -EINVAL;
+            break;
+        }
+
+        rc = sendv_batch(currd, msgs_hnd, arg2, arg3, false);
+        break;
+    }
+
     default:
         rc = -EOPNOTSUPP;
         break;
@@ -2236,8 +2504,8 @@ compat_argo_op(unsigned int cmd, XEN_GUEST_HANDLE_PARAM(void) arg1,
     /* check XEN_ARGO_MAXIOV as it sizes stack arrays: iovs, compat_iovs */
     BUILD_BUG_ON(XEN_ARGO_MAXIOV > 8);
 
-    /* Forward all ops besides sendv to the native handler. */
-    if ( cmd != XEN_ARGO_OP_sendv )
+    /* Forward all ops besides sendv and sendv_batch to the native handler. */
+    if ( cmd != XEN_ARGO_OP_sendv && cmd != XEN_ARGO_OP_sendv_batch )
         return do_argo_op(cmd, arg1, arg2, arg3, arg4);
 
     if ( unlikely(!opt_argo) )
@@ -2250,6 +2518,19 @@ compat_argo_op(unsigned int cmd, XEN_GUEST_HANDLE_PARAM(void) arg1,
     argo_dprintk("->compat_argo_op(%u,%p,%p,%lu,0x%lx)\n", cmd,
                  (void *)arg1.p, (void *)arg2.p, arg3, arg4);
 
+    if ( cmd == XEN_ARGO_OP_sendv_batch )
+    {
+        XEN_GUEST_HANDLE_PARAM(xen_argo_send_msg_t) msgs_hnd =
+            guest_handle_cast(arg1, xen_argo_send_msg_t);
+        /* arg2: iovs, arg3: nmsg */
+
+        if ( unlikely(arg3 > XEN_ARGO_MAXBATCH || arg4) )
+            rc = -EINVAL;
+        else
+            rc = sendv_batch(currd, msgs_hnd, arg2, arg3, true);
+        goto out;
+    }
+
     send_addr_hnd = guest_handle_cast(arg1, xen_argo_send_addr_t);
     /* arg2: iovs, arg3: niov, arg4: message_type */
 
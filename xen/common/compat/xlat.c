@@ -54,6 +54,10 @@ CHECK_evtchn_op;
 #undef xen_evtchn_status
 #undef xen_evtchn_unmask
 
+#define xen_evtchn_coalesce_stats evtchn_coalesce_stats
+CHECK_evtchn_coalesce_stats;
+#undef xen_evtchn_coalesce_stats
+
 #define xen_evtchn_expand_array evtchn_expand_array
 CHECK_evtchn_expand_array;
 #undef xen_evtchn_expand_array
@@ -66,6 +70,10 @@ CHECK_evtchn_init_control;
 CHECK_evtchn_reset;
 #undef xen_evtchn_reset
 
+#define xen_evtchn_set_coalesce evtchn_set_coalesce
+CHECK_evtchn_set_coalesce;
+#undef xen_evtchn_set_coalesce
+
 #define xen_evtchn_set_priority evtchn_set_priority
 CHECK_evtchn_set_priority;
 #undef xen_evtchn_set_priority
@@ -27,6 +27,7 @@
 #include <xen/hypercall.h>
 #include <xen/keyhandler.h>
 #include <xen/sections.h>
+#include <xen/timer.h>
 
 #include <asm/current.h>
 
@@ -269,11 +270,113 @@ static void check_free_port(struct domain *d, evtchn_port_t port)
         write_atomic(&d->active_evtchns, d->active_evtchns - 1);
 }
 
+/*
+ * Notification coalescing (EVTCHNOP_set_coalesce).  Allocated on first use
+ * and freed with the port, so that it can be looked up by senders holding
+ * just the lock of their own end of the channel.
+ */
+#define EVTCHN_COALESCE_MAX_US 100000
+
+struct evtchn_coalesce {
+    spinlock_t lock;
+    struct timer timer;
+    struct domain *d;
+    struct evtchn *chn;
+    unsigned int count;         /* Deliver after this many, if non-zero. */
+    s_time_t timeout;           /* Deliver this long after the first held. */
+    unsigned int held;          /* Notifications held back. */
+    uint64_t sent;
+    uint64_t delivered;
+};
+
+static void cf_check evtchn_coalesce_timer_fn(void *data)
+{
+    struct evtchn_coalesce *c = data;
+    struct evtchn *chn = c->chn;
+    bool deliver;
+
+    /*
+     * Don't wait for the channel to be (un)bound: closing it kills this
+     * timer with the lock held.  Retry later instead.
+     */
+    if ( !evtchn_read_trylock(chn) )
+    {
+        set_timer(&c->timer, NOW() + c->timeout);
+        return;
+    }
+
+    spin_lock(&c->lock);
+    deliver = c->held;
+    if ( deliver )
+    {
+        c->held = 0;
+        c->delivered++;
+    }
+    spin_unlock(&c->lock);
+
+    if ( deliver && (chn->state == ECS_INTERDOMAIN || chn->state == ECS_IPI) )
+        evtchn_port_set_pending(c->d, chn->notify_vcpu_id, chn);
+
+    evtchn_read_unlock(chn);
+}
+
+/*
+ * Account for a notification sent to chn.  Returns true if it is to be held
+ * back, false if it is to be delivered now.
+ */
+static bool evtchn_coalesce(struct evtchn *chn)
+{
+    struct evtchn_coalesce *c = read_atomic(&chn->coalesce);
+    bool hold = false;
+
+    if ( likely(!c) )
+        return false;
+
+    spin_lock(&c->lock);
+
+    c->sent++;
+    if ( !c->timeout || (c->count && ++c->held >= c->count) )
+    {
+        if ( c->held )
+        {
+            c->held = 0;
+            stop_timer(&c->timer);
+        }
+        c->delivered++;
+    }
+    else
+    {
+        if ( !c->count )
+            c->held++;
+        if ( c->held == 1 )
+            set_timer(&c->timer, NOW() + c->timeout);
+        hold = true;
+    }
+
+    spin_unlock(&c->lock);
+
+    return hold;
+}
+
+static void evtchn_coalesce_free(struct evtchn *chn)
+{
+    struct evtchn_coalesce *c = chn->coalesce;
+
+    if ( !c )
+        return;
+
+    kill_timer(&c->timer);
+    chn->coalesce = NULL;
+    xfree(c);
+}
+
 void evtchn_free(struct domain *d, struct evtchn *chn)
 {
     /* Clear pending event to avoid unexpected behavior on re-bind. */
     evtchn_port_clear_pending(d, chn);
 
+    evtchn_coalesce_free(chn);
+
     if ( consumer_is_xen(chn) )
     {
         write_atomic(&d->xen_evtchns, d->xen_evtchns - 1);
@@ -850,10 +953,12 @@ int evtchn_send(struct domain *ld, unsigned int lport)
             rcu_unlock_domain(rd);
             return 0;
         }
-        evtchn_port_set_pending(rd, rchn->notify_vcpu_id, rchn);
+        if ( !evtchn_coalesce(rchn) )
+            evtchn_port_set_pending(rd, rchn->notify_vcpu_id, rchn);
         break;
     case ECS_IPI:
-        evtchn_port_set_pending(ld, lchn->notify_vcpu_id, lchn);
+        if ( !evtchn_coalesce(lchn) )
+            evtchn_port_set_pending(ld, lchn->notify_vcpu_id, lchn);
         break;
     case ECS_UNBOUND:
         /* silently drop the notification */
@@ -1258,6 +1363,123 @@ static int evtchn_set_priority(const struct evtchn_set_priority *set_priority)
     return ret;
 }
 
+static int evtchn_set_coalesce(const struct evtchn_set_coalesce *set)
+{
+    struct domain *d = current->domain;
+    struct evtchn *chn = _evtchn_from_port(d, set->port);
+    struct evtchn_coalesce *c;
+    bool deliver = false;
+    int rc = 0;
+
+    if ( !chn )
+        return -EINVAL;
+
+    if ( set->timeout_us > EVTCHN_COALESCE_MAX_US ||
+         (!set->timeout_us && set->count > 1) )
+        return -EINVAL;
+
+    write_lock(&d->event_lock);
+
+    if ( consumer_is_xen(chn) ||
+         (chn->state != ECS_UNBOUND && chn->state != ECS_INTERDOMAIN &&
+          chn->state != ECS_IPI) )
+    {
+        rc = -EINVAL;
+        goto out;
+    }
+
+    c = chn->coalesce;
+    if ( !c )
+    {
+        c = xzalloc(struct evtchn_coalesce);
+        if ( !c )
+        {
+            rc = -ENOMEM;
+            goto out;
+        }
+
+        spin_lock_init(&c->lock);
+        init_timer(&c->timer, evtchn_coalesce_timer_fn, c, smp_processor_id());
+        c->d = d;
+        c->chn = chn;
+
+        /* Senders look the structure up without holding event_lock. */
+        smp_wmb();
+        write_atomic(&chn->coalesce, c);
+    }
+
+    spin_lock(&c->lock);
+
+    c->count = set->count;
+    c->timeout = MICROSECS(set->timeout_us);
+
+    /* Deliver what was held back under the old settings. */
+    if ( c->held && (!c->timeout || (c->count && c->held >= c->count)) )
+    {
+        c->held = 0;
+        c->delivered++;
+        stop_timer(&c->timer);
+        deliver = true;
+    }
+
+    spin_unlock(&c->lock);
+
+    if ( deliver )
+    {
+        evtchn_read_lock(chn);
+        if ( chn->state == ECS_INTERDOMAIN || chn->state == ECS_IPI )
+            evtchn_port_set_pending(d, chn->notify_vcpu_id, chn);
+        evtchn_read_unlock(chn);
+    }
+
+ out:
+    write_unlock(&d->event_lock);
+
+    return rc;
+}
+
+static int evtchn_coalesce_stats(struct evtchn_coalesce_stats *stats)
+{
+    struct domain *d = rcu_lock_domain_by_any_id(stats->dom);
+    const struct evtchn_coalesce *c;
+    struct evtchn *chn;
+    int rc;
+
+    if ( !d )
+        return -ESRCH;
+
+    chn = _evtchn_from_port(d, stats->port);
+    if ( !chn )
+    {
+        rcu_unlock_domain(d);
+        return -EINVAL;
+    }
+
+    read_lock(&d->event_lock);
+
+    rc = xsm_evtchn_status(XSM_TARGET, d, chn);
+    if ( rc )
+        goto out;
+
+    c = chn->coalesce;
+    if ( !c )
+    {
+        rc = -ENOENT;
+        goto out;
+    }
+
+    stats->count = c->count;
+    stats->timeout_us = c->timeout / MICROSECS(1);
+    stats->sent = read_atomic(&c->sent);
+    stats->delivered = read_atomic(&c->delivered);
+
+ out:
+    read_unlock(&d->event_lock);
+    rcu_unlock_domain(d);
+
+    return rc;
+}
+
 long do_event_channel_op(int cmd, XEN_GUEST_HANDLE_PARAM(void) arg)
 {
     int rc;
@@ -1411,6 +1633,24 @@ long do_event_channel_op(int cmd, XEN_GUEST_HANDLE_PARAM(void) arg)
         break;
     }
 
+    case EVTCHNOP_set_coalesce: {
+        struct evtchn_set_coalesce set_coalesce;
+        if ( copy_from_guest(&set_coalesce, arg, 1) != 0 )
+            return -EFAULT;
+        rc = evtchn_set_coalesce(&set_coalesce);
+        break;
+    }
+
+    case EVTCHNOP_coalesce_stats: {
+        struct evtchn_coalesce_stats coalesce_stats;
+        if ( copy_from_guest(&coalesce_stats, arg, 1) != 0 )
+            return -EFAULT;
+        rc = evtchn_coalesce_stats(&coalesce_stats);
+        if ( !rc && __copy_to_guest(arg, &coalesce_stats, 1) )
+            rc = -EFAULT;
+        break;
+    }
+
     default:
         rc = -ENOSYS;
         break;
@@ -41,6 +41,7 @@
 #include <xen/radix-tree.h>
 #include <xen/xvmalloc.h>
 #include <xen/nospec.h>
+#include <xen/perfc.h>
 #include <xsm/xsm.h>
 #include <asm/flushtlb.h>
 #include <asm/guest_atomics.h>
@@ -269,6 +270,23 @@ struct gnttab_unmap_common {
 /* Number of unmap operations that are done between each tlb flush */
 #define GNTTAB_UNMAP_BATCH_SIZE 32
 
+/*
+ * IOTLB flush owed by a batch of (un)map operations.  IOMMU updates for
+ * adjacent DFNs by consecutive ops are merged into one run, so that a batch
+ * mapping or unmapping contiguous frames needs a single ranged flush.
+ *
+ * A failed flush is reported through the status of the ops of the run, as
+ * when each op flushed on its own: the caller sets op to the index of the op
+ * being processed, and reports the failed ops with iotlb_run_report().
+ */
+struct gnttab_iotlb_run {
+    dfn_t dfn;
+    unsigned long count;
+    unsigned int flush_flags;
+    unsigned int op, first_op, last_op;
+    unsigned int failed_op, nr_failed;
+};
+
 
 /*
  * Tracks a mapping of another domain's grant reference. Each domain has a
@@ -429,6 +447,76 @@ static inline void gnttab_flush_tlb(const struct domain *d)
         arch_flush_tlb_mask(d->dirty_cpumask);
 }
 
+static void iotlb_run_flush(struct domain *d, struct gnttab_iotlb_run *run)
+{
+    if ( run->count && run->flush_flags )
+    {
+        perfc_incr(gnttab_iotlb_flush);
+        if ( iommu_iotlb_flush(d, run->dfn, run->count, run->flush_flags) )
+        {
+            /*
+             * Reported after each op, which flushes at most once.  Only a
+             * hypercall failing with -EFAULT leaves one unreported.
+             */
+            run->failed_op = run->first_op;
+            run->nr_failed = run->last_op + 1 - run->first_op;
+        }
+    }
+
+    run->count = 0;
+    run->flush_flags = 0;
+}
+
+static void iotlb_run_add(struct domain *d, struct gnttab_iotlb_run *run,
+                          dfn_t dfn, unsigned int flush_flags)
+{
+    unsigned long start = dfn_x(run->dfn), end = start + run->count;
+
+    if ( !flush_flags )
+        return;
+
+    if ( run->count && run->op <= run->last_op + 1 &&
+         dfn_x(dfn) + 1 >= start && dfn_x(dfn) <= end )
+    {
+        perfc_incr(gnttab_iotlb_flush_merged);
+        if ( dfn_x(dfn) < start )
+            run->dfn = dfn;
+        run->count += dfn_x(dfn) < start || dfn_x(dfn) == end;
+        run->flush_flags |= flush_flags;
+        run->last_op = run->op;
+        return;
+    }
+
+    iotlb_run_flush(d, run);
+
+    run->dfn = dfn;
+    run->count = 1;
+    run->flush_flags = flush_flags;
+    run->first_op = run->last_op = run->op;
+}
+
+/*
+ * Set the status of the ops whose IOTLB flush failed to GNTST_general_error,
+ * uop being the handle of the op numbered 0, and op scratch space of the type
+ * of the ops.  Returns -EFAULT if a status can't be written.
+ */
+#define iotlb_run_report(run, uop, op) ({                                 \
+    struct gnttab_iotlb_run *run_ = (run);                               \
+    int rc_ = 0;                                                         \
+                                                                         \
+    for ( ; run_->nr_failed; run_->nr_failed--, run_->failed_op++ )      \
+    {                                                                    \
+        typeof(uop) hnd_ = (uop);                                        \
+                                                                         \
+        guest_handle_add_offset(hnd_, run_->failed_op);                  \
+        (op).status = GNTST_general_error;                               \
+        if ( unlikely(__copy_field_to_guest(hnd_, &(op), status)) )      \
+            rc_ = -EFAULT;                                               \
+    }                                                                    \
+                                                                         \
+    rc_;                                                                 \
+})
+
 static inline unsigned int
 num_act_frames_from_sha_frames(const unsigned int num)
 {
@@ -561,17 +649,107 @@ _get_maptrack_handle(struct grant_table *t, struct vcpu *v)
 }
 
 /*
- * Try to "steal" a free maptrack entry from another VCPU.
+ * Take up to nr entries off v's free list on behalf of the VCPU with ID
+ * thief, again keeping one entry in the list.  The entries taken remain
+ * chained, from the returned one to *last.
+ */
+static grant_handle_t take_maptrack_handles(
+    struct grant_table *t, struct vcpu *v, unsigned int thief,
+    unsigned int nr, grant_handle_t *last, unsigned int *taken)
+{
+    unsigned int head, next, i;
+
+    spin_lock(&v->maptrack_freelist_lock);
+
+    head = v->maptrack_head;
+    if ( unlikely(head == MAPTRACK_TAIL) )
+    {
+        spin_unlock(&v->maptrack_freelist_lock);
+        return INVALID_MAPTRACK_HANDLE;
+    }
+
+    for ( i = 0; i < nr; i++ )
+    {
+        next = maptrack_entry(t, head).ref;
+        if ( next == MAPTRACK_TAIL )
+            break;
+
+        maptrack_entry(t, head).vcpu = thief;
+        *last = head;
+        head = next;
+    }
+
+    next = v->maptrack_head;
+    v->maptrack_head = head;
+
+    spin_unlock(&v->maptrack_freelist_lock);
+
+    *taken = i;
+
+    return i ? next : INVALID_MAPTRACK_HANDLE;
+}
+
+/* Append the chain of entries first ... last to v's free list. */
+static void add_maptrack_handles(struct grant_table *t, struct vcpu *v,
+                                 grant_handle_t first, grant_handle_t last)
+{
+    maptrack_entry(t, last).ref = MAPTRACK_TAIL;
+
+    spin_lock(&v->maptrack_freelist_lock);
+
+    if ( v->maptrack_tail == MAPTRACK_TAIL )
+        v->maptrack_head = first;
+    else
+        maptrack_entry(t, v->maptrack_tail).ref = first;
+    v->maptrack_tail = last;
+
+    spin_unlock(&v->maptrack_freelist_lock);
+}
+
+/* Statistics, exported via hypfs. */
+static unsigned long maptrack_grows;
+static unsigned long maptrack_steals;
+static unsigned long maptrack_stolen;
+
+#ifdef CONFIG_HYPFS
+static HYPFS_DIR_INIT(grant_dir, "grant");
+static HYPFS_UINT_INIT(maptrack_grows_leaf, "maptrack-grows", maptrack_grows);
+static HYPFS_UINT_INIT(maptrack_steals_leaf, "maptrack-steals",
+                       maptrack_steals);
+static HYPFS_UINT_INIT(maptrack_stolen_leaf, "maptrack-stolen",
+                       maptrack_stolen);
+
+static int __init cf_check maptrack_hypfs_init(void)
+{
+    hypfs_add_dir(&hypfs_root, &grant_dir, true);
+    hypfs_add_leaf(&grant_dir, &maptrack_grows_leaf, true);
+    hypfs_add_leaf(&grant_dir, &maptrack_steals_leaf, true);
+    hypfs_add_leaf(&grant_dir, &maptrack_stolen_leaf, true);
+
+    return 0;
+}
+__initcall(maptrack_hypfs_init);
+#endif
+
+/* Upper bound for struct vcpu's maptrack_steal. */
+#define MAPTRACK_STEAL_MAX (MAPTRACK_PER_PAGE / 4)
+
+/*
+ * Try to "steal" free maptrack entries from another VCPU.
  *
- * A stolen entry is transferred to the thief, so the number of
+ * Stolen entries are transferred to the thief, so the number of
  * entries for each VCPU should tend to the usage pattern.
  *
  * To avoid having to atomically count the number of free entries on
  * each VCPU and to avoid two VCPU repeatedly stealing entries from
  * each other, the initial victim VCPU is selected randomly.
+ *
+ * Entries are stolen in batches, refilling the thief's own list.  The batch
+ * size doubles while victims have enough entries to spare, so that VCPUs
+ * mapping a lot rarely need to come here, and halves once they don't.
  */
 static grant_handle_t steal_maptrack_handle(struct grant_table *t,
-                                            const struct vcpu *curr)
+                                            struct vcpu *curr)
 {
     const struct domain *currd = curr->domain;
     unsigned int first, i;
@@ -580,15 +758,39 @@ static grant_handle_t steal_maptrack_handle(struct grant_table *t,
     first = i = get_random() % currd->max_vcpus;
 
     do {
-        if ( currd->vcpu[i] )
+        if ( currd->vcpu[i] && currd->vcpu[i] != curr )
         {
-            grant_handle_t handle;
+            unsigned int nr = curr->maptrack_steal, taken;
+            grant_handle_t handle, last;
 
-            handle = _get_maptrack_handle(t, currd->vcpu[i]);
+            /*
+             * An uninitialized free list needs an extra entry for the tail
+             * sentinel.  Only curr itself sets up its tail, so no need for
+             * its lock to check.
+             */
+            handle = take_maptrack_handles(
+                t, currd->vcpu[i], curr->vcpu_id,
+                nr + (curr->maptrack_tail == MAPTRACK_TAIL), &last, &taken);
             if ( handle != INVALID_MAPTRACK_HANDLE )
             {
-                maptrack_entry(t, handle).vcpu = curr->vcpu_id;
-                return handle;
+                arch_fetch_and_add(&maptrack_steals, 1);
+                arch_fetch_and_add(&maptrack_stolen, taken);
+
+                if ( taken < nr )
+                    curr->maptrack_steal = max(nr / 2, 1U);
+                else
+                    curr->maptrack_steal = min_t(unsigned int, nr * 2,
+                                                 MAPTRACK_STEAL_MAX);
+
+                /*
+                 * Go through the local free list.  Should the victim have
+                 * given up only the entry now used as the tail sentinel,
+                 * move on to the next one.
+                 */
+                add_maptrack_handles(t, curr, handle, last);
+                handle = _get_maptrack_handle(t, curr);
+                if ( handle != INVALID_MAPTRACK_HANDLE )
+                    return handle;
             }
         }
 
@@ -653,27 +855,11 @@ get_maptrack_handle(
     if ( !new_mt )
     {
         spin_unlock(&lgt->maptrack_lock);
-
-        /*
-         * Uninitialized free list? Steal an extra entry for the tail
-         * sentinel.
-         */
-        if ( curr->maptrack_tail == MAPTRACK_TAIL )
-        {
-            handle = steal_maptrack_handle(lgt, curr);
-            if ( handle == INVALID_MAPTRACK_HANDLE )
-                return handle;
-            spin_lock(&curr->maptrack_freelist_lock);
-            maptrack_entry(lgt, handle).ref = MAPTRACK_TAIL;
-            curr->maptrack_tail = handle;
-            if ( curr->maptrack_head == MAPTRACK_TAIL )
-                curr->maptrack_head = handle;
-            spin_unlock(&curr->maptrack_freelist_lock);
-        }
         return steal_maptrack_handle(lgt, curr);
     }
 
     clear_page(new_mt);
+    arch_fetch_and_add(&maptrack_grows, 1);
 
     /*
      * Use the first new entry and add the remaining entries to the
@@ -993,7 +1179,7 @@ union maptrack_node {
 
 static void
 map_grant_ref(
-    struct gnttab_map_grant_ref *op)
+    struct gnttab_map_grant_ref *op, struct gnttab_iotlb_run *iotlb)
 {
     struct domain *ld, *rd, *owner = NULL;
     struct grant_table *lgt, *rgt;
@@ -1244,7 +1430,7 @@ map_grant_ref(
         };
         int err;
         void **slot = NULL;
-        unsigned int kind;
+        unsigned int kind, flush_flags = 0;
 
         grant_write_lock(lgt);
 
@@ -1283,7 +1469,8 @@ map_grant_ref(
         else
             kind = 0;
         if ( err ||
-             (kind && iommu_legacy_map(ld, _dfn(mfn_x(mfn)), mfn, 1, kind)) )
+             (kind && iommu_map(ld, _dfn(mfn_x(mfn)), mfn, 1, kind,
+                                &flush_flags)) )
         {
             if ( !err )
             {
@@ -1304,7 +1491,19 @@ map_grant_ref(
         grant_write_unlock(lgt);
 
         if ( rc != GNTST_okay )
+        {
+            /* undo_out drops the references, so don't defer this flush. */
+            if ( flush_flags )
+            {
+                perfc_incr(gnttab_iotlb_flush);
+                if ( iommu_iotlb_flush(ld, _dfn(mfn_x(mfn)), 1, flush_flags) )
+                    rc = GNTST_general_error;
+            }
             goto undo_out;
+        }
+
+        /* Flushed by the caller once the whole batch has been processed. */
+        iotlb_run_add(ld, iotlb, _dfn(mfn_x(mfn)), flush_flags);
     }
 
     TRACE_TIME(TRC_MEM_PAGE_GRANT_MAP, op->dom);
@@ -1362,28 +1561,45 @@ gnttab_map_grant_ref(
     XEN_GUEST_HANDLE_PARAM(gnttab_map_grant_ref_t) uop, unsigned int count)
 {
     int i;
+    long rc = 0;
     struct gnttab_map_grant_ref op;
+    struct gnttab_iotlb_run iotlb = { .count = 0 };
 
     for ( i = 0; i < count; i++ )
     {
         if ( i && hypercall_preempt_check() )
-            return i;
+        {
+            rc = i;
+            break;
+        }
 
         if ( unlikely(__copy_from_guest_offset(&op, uop, i, 1)) )
-            return -EFAULT;
+        {
+            rc = -EFAULT;
+            break;
+        }
 
-        map_grant_ref(&op);
+        iotlb.op = i;
+        map_grant_ref(&op, &iotlb);
 
-        if ( unlikely(__copy_to_guest_offset(uop, i, &op, 1)) )
-            return -EFAULT;
+        if ( unlikely(__copy_to_guest_offset(uop, i, &op, 1)) ||
+             unlikely(iotlb_run_report(&iotlb, uop, op)) )
+        {
+            rc = -EFAULT;
+            break;
+        }
     }
 
-    return 0;
+    iotlb_run_flush(current->domain, &iotlb);
+    if ( unlikely(iotlb_run_report(&iotlb, uop, op)) )
+        rc = -EFAULT;
+
+    return rc;
 }
 
 static void
 unmap_common(
-    struct gnttab_unmap_common *op)
+    struct gnttab_unmap_common *op, struct gnttab_iotlb_run *iotlb)
 {
     domid_t          dom;
     struct domain   *ld, *rd;
@@ -1539,6 +1755,7 @@ unmap_common(
     {
         void **slot;
         union maptrack_node node;
+        unsigned int flush_flags = 0;
         int err = 0;
 
         grant_write_lock(lgt);
@@ -1551,10 +1768,10 @@ unmap_common(
             BUG();
 
         if ( !node.raw )
-            err = iommu_legacy_unmap(ld, _dfn(mfn_x(op->mfn)), 1);
+            err = iommu_unmap(ld, _dfn(mfn_x(op->mfn)), 1, 0, &flush_flags);
         else if ( !(flags & GNTMAP_readonly) && !node.cnt.wr )
-            err = iommu_legacy_map(ld, _dfn(mfn_x(op->mfn)), op->mfn, 1,
-                                   IOMMUF_readable);
+            err = iommu_map(ld, _dfn(mfn_x(op->mfn)), op->mfn, 1,
+                            IOMMUF_readable, &flush_flags);
 
         if ( err )
             ;
@@ -1566,6 +1783,12 @@ unmap_common(
 
         grant_write_unlock(lgt);
 
+        /*
+         * Flushed by the caller before unmap_common_complete() drops the
+         * page references.
+         */
+        iotlb_run_add(ld, iotlb, _dfn(mfn_x(op->mfn)), flush_flags);
+
         if ( err )
             rc = GNTST_general_error;
     }
@@ -1653,10 +1876,42 @@ unmap_common_complete(struct gnttab_unmap_common *op)
     rcu_unlock_domain(rd);
 }
 
+/*
+ * Flush the TLBs and IOTLB for a batch of unmaps, and only then drop the
+ * references on the pages.  The TLB flush is skipped if no op in the batch
+ * removed a host mapping.
+ */
+static void
+unmap_common_batch_complete(struct gnttab_unmap_common *common,
+                            unsigned int nr, struct gnttab_iotlb_run *iotlb)
+{
+    struct domain *ld = current->domain;
+    bool host_map = false;
+    unsigned int i;
+
+    for ( i = 0; i < nr; i++ )
+        if ( common[i].done & GNTMAP_host_map )
+            host_map = true;
+
+    if ( host_map )
+    {
+        perfc_incr(gnttab_tlb_flush);
+        gnttab_flush_tlb(ld);
+    }
+    else
+        perfc_incr(gnttab_tlb_flush_avoided);
+
+    iotlb_run_flush(ld, iotlb);
+
+    for ( i = 0; i < nr; i++ )
+        unmap_common_complete(&common[i]);
+}
+
 static void
 unmap_grant_ref(
     struct gnttab_unmap_grant_ref *op,
-    struct gnttab_unmap_common *common)
+    struct gnttab_unmap_common *common,
+    struct gnttab_iotlb_run *iotlb)
 {
     common->host_addr = op->host_addr;
     common->dev_bus_addr = op->dev_bus_addr;
@@ -1668,7 +1923,7 @@ unmap_grant_ref(
     common->rd = NULL;
     common->mfn = INVALID_MFN;
 
-    unmap_common(common);
+    unmap_common(common, iotlb);
     op->status = common->status;
 }
 
@@ -1680,27 +1935,31 @@ gnttab_unmap_grant_ref(
     int i, c, partial_done, done = 0;
     struct gnttab_unmap_grant_ref op;
     struct gnttab_unmap_common common[GNTTAB_UNMAP_BATCH_SIZE];
+    struct gnttab_iotlb_run iotlb = { .count = 0 };
+    XEN_GUEST_HANDLE_PARAM(gnttab_unmap_grant_ref_t) batch;
 
     while ( count != 0 )
     {
         c = min(count, (unsigned int)GNTTAB_UNMAP_BATCH_SIZE);
         partial_done = 0;
+        batch = uop;
 
         for ( i = 0; i < c; i++ )
         {
             if ( unlikely(__copy_from_guest(&op, uop, 1)) )
                 goto fault;
-            unmap_grant_ref(&op, &common[i]);
+            iotlb.op = i;
+            unmap_grant_ref(&op, &common[i], &iotlb);
             ++partial_done;
-            if ( unlikely(__copy_field_to_guest(uop, &op, status)) )
+            if ( unlikely(__copy_field_to_guest(uop, &op, status)) ||
+                 unlikely(iotlb_run_report(&iotlb, batch, op)) )
                 goto fault;
             guest_handle_add_offset(uop, 1);
         }
 
-        gnttab_flush_tlb(current->domain);
-
-        for ( i = 0; i < partial_done; i++ )
-            unmap_common_complete(&common[i]);
+        unmap_common_batch_complete(common, partial_done, &iotlb);
+        if ( unlikely(iotlb_run_report(&iotlb, batch, op)) )
+            return -EFAULT;
 
         count -= c;
         done += c;
@@ -1712,17 +1971,15 @@ gnttab_unmap_grant_ref(
     return 0;
 
 fault:
-    gnttab_flush_tlb(current->domain);
-
-    for ( i = 0; i < partial_done; i++ )
-        unmap_common_complete(&common[i]);
+    unmap_common_batch_complete(common, partial_done, &iotlb);
     return -EFAULT;
 }
 
 static void
 unmap_and_replace(
     struct gnttab_unmap_and_replace *op,
-    struct gnttab_unmap_common *common)
+    struct gnttab_unmap_common *common,
+    struct gnttab_iotlb_run *iotlb)
 {
     common->host_addr = op->host_addr;
     common->new_addr = op->new_addr;
@@ -1734,7 +1991,7 @@ unmap_and_replace(
     common->rd = NULL;
     common->mfn = INVALID_MFN;
 
-    unmap_common(common);
+    unmap_common(common, iotlb);
     op->status = common->status;
 }
 
@@ -1745,27 +2002,31 @@ gnttab_unmap_and_replace(
     int i, c, partial_done, done = 0;
     struct gnttab_unmap_and_replace op;
     struct gnttab_unmap_common common[GNTTAB_UNMAP_BATCH_SIZE];
+    struct gnttab_iotlb_run iotlb = { .count = 0 };
+    XEN_GUEST_HANDLE_PARAM(gnttab_unmap_and_replace_t) batch;
 
     while ( count != 0 )
     {
         c = min(count, (unsigned int)GNTTAB_UNMAP_BATCH_SIZE);
         partial_done = 0;
+        batch = uop;
 
         for ( i = 0; i < c; i++ )
         {
             if ( unlikely(__copy_from_guest(&op, uop, 1)) )
                 goto fault;
-            unmap_and_replace(&op, &common[i]);
+            iotlb.op = i;
+            unmap_and_replace(&op, &common[i], &iotlb);
             ++partial_done;
-            if ( unlikely(__copy_field_to_guest(uop, &op, status)) )
+            if ( unlikely(__copy_field_to_guest(uop, &op, status)) ||
+                 unlikely(iotlb_run_report(&iotlb, batch, op)) )
                 goto fault;
             guest_handle_add_offset(uop, 1);
         }
 
-        gnttab_flush_tlb(current->domain);
-
-        for ( i = 0; i < partial_done; i++ )
-            unmap_common_complete(&common[i]);
+        unmap_common_batch_complete(common, partial_done, &iotlb);
+        if ( unlikely(iotlb_run_report(&iotlb, batch, op)) )
+            return -EFAULT;
 
         count -= c;
         done += c;
@@ -1777,10 +2038,7 @@ gnttab_unmap_and_replace(
     return 0;
 
 fault:
-    gnttab_flush_tlb(current->domain);
-
-    for ( i = 0; i < partial_done; i++ )
-        unmap_common_complete(&common[i]);
+    unmap_common_batch_complete(common, partial_done, &iotlb);
     return -EFAULT;
 }
 
@@ -2862,6 +3120,7 @@ struct gnttab_copy_buf {
     bool read_only;
     bool have_grant;
     bool have_type;
+    bool dirty;
 };
 
 static int gnttab_copy_lock_domain(domid_t domid, bool is_gref,
@@ -2926,6 +3185,15 @@ static int gnttab_copy_lock_domains(const struct gnttab_copy *op,
 
 static void gnttab_copy_release_buf(struct gnttab_copy_buf *buf)
 {
+    /*
+     * Consecutive copies into the same buffer only need to mark it dirty
+     * once, when it gets released.
+     */
+    if ( buf->dirty )
+    {
+        gnttab_mark_dirty(buf->domain, buf->mfn);
+        buf->dirty = false;
+    }
     if ( buf->virt )
     {
         unmap_domain_page(buf->virt);
@@ -3049,9 +3317,16 @@ static int gnttab_copy_buf(const struct gnttab_copy *op,
     /* Make sure the above checks are not bypassed speculatively */
     block_speculation();
 
-    memcpy(dest->virt + op->dest.offset, src->virt + op->source.offset,
-           op->len);
-    gnttab_mark_dirty(dest->domain, dest->mfn);
+    /*
+     * Whole pages (the offsets can only be zero then) are what block and
+     * network backends copy most, use the non-temporal page copy for them.
+     */
+    if ( op->len == PAGE_SIZE )
+        copy_page(dest->virt, src->virt);
+    else
+        memcpy(dest->virt + op->dest.offset, src->virt + op->source.offset,
+               op->len);
+    dest->dirty = true;
 
     return GNTST_okay;
 }
@@ -3110,30 +3385,41 @@ static int gnttab_copy_one(const struct gnttab_copy *op,
  * positive value) a non-zero value is being handed back (zero needs
  * to be avoided, as that means "success, all done").
  */
+#define GNTTAB_COPY_BATCH 8
+
 static long gnttab_copy(
     XEN_GUEST_HANDLE_PARAM(gnttab_copy_t) uop, unsigned int count)
 {
-    unsigned int i;
-    struct gnttab_copy op;
+    unsigned int i, nr = 0, idx = 0;
+    struct gnttab_copy ops[GNTTAB_COPY_BATCH];
     struct gnttab_copy_buf src = {};
     struct gnttab_copy_buf dest = {};
     long rc = 0;
 
     for ( i = 0; i < count; i++ )
     {
+        struct gnttab_copy *op;
+
         if ( i && hypercall_preempt_check() )
         {
             rc = count - i;
             break;
         }
 
-        if ( unlikely(__copy_from_guest(&op, uop, 1)) )
+        /* Fetch ops in batches, rather than accessing guest memory for each. */
+        if ( idx == nr )
         {
-            rc = -EFAULT;
-            break;
+            nr = min_t(unsigned int, count - i, GNTTAB_COPY_BATCH);
+            idx = 0;
+            if ( unlikely(__copy_from_guest(ops, uop, nr)) )
+            {
+                rc = -EFAULT;
+                break;
+            }
         }
+        op = &ops[idx++];
 
-        rc = gnttab_copy_one(&op, &dest, &src);
+        rc = gnttab_copy_one(op, &dest, &src);
         if ( rc > 0 )
         {
             rc = count - i;
@@ -3145,9 +3431,9 @@ static long gnttab_copy(
             gnttab_copy_release_buf(&dest);
         }
 
-        op.status = rc;
+        op->status = rc;
         rc = 0;
-        if ( unlikely(__copy_field_to_guest(uop, &op, status)) )
+        if ( unlikely(__copy_field_to_guest(uop, op, status)) )
         {
             rc = -EFAULT;
             break;
@@ -4036,6 +4322,7 @@ void grant_table_init_vcpu(struct vcpu *v)
     spin_lock_init(&v->maptrack_freelist_lock);
     v->maptrack_head = MAPTRACK_TAIL;
     v->maptrack_tail = MAPTRACK_TAIL;
+    v->maptrack_steal = 1;
 }
 
 #ifdef CONFIG_MEM_SHARING
@@ -1156,6 +1156,11 @@ static unsigned int resource_max_frames(const struct domain *d,
     case XENMEM_resource_vmtrace_buf:
         return d->vmtrace_size >> PAGE_SHIFT;
 
+#ifdef CONFIG_X86
+    case XENMEM_resource_dirty_ring:
+        return id ? 0 : paging_dirty_ring_frames(d);
+#endif
+
     default:
         return -EOPNOTSUPP;
     }
@@ -1219,6 +1224,20 @@ static int acquire_vmtrace_buf(
     return nr_frames;
 }
 
+static int acquire_dirty_ring(
+    struct domain *d, unsigned int id, unsigned int frame,
+    unsigned int nr_frames, xen_pfn_t mfn_list[])
+{
+#ifdef CONFIG_X86
+    if ( id )
+        return -EINVAL;
+
+    return paging_dirty_ring_acquire(d, frame, nr_frames, mfn_list);
+#else
+    return -EOPNOTSUPP;
+#endif
+}
+
 /*
  * Returns -errno on error, or positive in the range [1, nr_frames] on
  * success.  Returning less than nr_frames contitutes a request for a
@@ -1239,6 +1258,9 @@ static int _acquire_resource(
     case XENMEM_resource_vmtrace_buf:
         return acquire_vmtrace_buf(d, id, frame, nr_frames, mfn_list);
 
+    case XENMEM_resource_dirty_ring:
+        return acquire_dirty_ring(d, id, frame, nr_frames, mfn_list);
+
     default:
         return -EOPNOTSUPP;
     }
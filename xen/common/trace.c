@@ -54,7 +54,6 @@ static struct t_info *t_info;
 static unsigned int t_info_pages;
 
 static DEFINE_PER_CPU_READ_MOSTLY(struct t_buf *, t_bufs);
-static DEFINE_PER_CPU_READ_MOSTLY(spinlock_t, t_lock);
 static u32 data_size __read_mostly;
 
 /* High water mark for trace buffers; */
@@ -65,6 +64,16 @@ static u32 t_buf_highwater;
 static DEFINE_PER_CPU(unsigned long, lost_records);
 static DEFINE_PER_CPU(unsigned long, lost_records_first_tsc);
 
+/*
+ * Records are inserted without locking.  Space in a CPU's buffer is reserved
+ * by advancing t_head, in the same units as the buffer's prod, and gets
+ * published to the consumer as prod once the outermost writer on the CPU is
+ * done.  t_nesting counts the writers on the CPU, which may nest from
+ * interrupt and NMI context.
+ */
+static DEFINE_PER_CPU(uint32_t, t_head);
+static DEFINE_PER_CPU(unsigned int, t_nesting);
+
 /* a flag recording whether initialization has been done */
 /* or more properly, if the tbuf subsystem is enabled right now */
 bool __read_mostly tb_init_done;
@@ -75,20 +84,15 @@ static cpumask_t tb_cpu_mask;
 /* which tracing events are enabled */
 static u32 tb_event_mask = TRC_ALL;
 
-static int cf_check cpu_callback(
-    struct notifier_block *nfb, unsigned long action, void *hcpu)
-{
-    unsigned int cpu = (unsigned long)hcpu;
-
-    if ( action == CPU_UP_PREPARE )
-        spin_lock_init(&per_cpu(t_lock, cpu));
-
-    return NOTIFY_DONE;
-}
+/* which domain, and vCPU of it, tracing is restricted to, if any */
+static domid_t tb_filter_domid = DOMID_INVALID;
+static unsigned int tb_filter_vcpu = XEN_SYSCTL_TBUF_ALL_VCPUS;
 
-static struct notifier_block cpu_nfb = {
-    .notifier_call = cpu_callback
-};
+/* 1 in how many events of each class get traced, 0 or 1 for all */
+#define TRC_NR_CLASSES 12
+static unsigned int tb_sample_rate[TRC_NR_CLASSES];
+static bool tb_sampling;
+static DEFINE_PER_CPU(unsigned int[TRC_NR_CLASSES], tb_sample_count);
 
 static uint32_t calc_tinfo_first_offset(void)
 {
@@ -225,13 +229,12 @@ static int alloc_trace_bufs(unsigned int pages)
     {
         struct t_buf *buf;
 
-        spin_lock_init(&per_cpu(t_lock, cpu));
-
         offset = t_info->mfn_offset[cpu];
 
         /* Initialize the buffer metadata */
         per_cpu(t_bufs, cpu) = buf = mfn_to_virt(t_info_mfn_list[offset]);
         buf->cons = buf->prod = 0;
+        per_cpu(t_head, cpu) = 0;
 
         printk(XENLOG_INFO "xentrace: p%d mfn %x offset %u\n",
                    cpu, t_info_mfn_list[offset], offset);
@@ -303,6 +306,39 @@ static int tb_set_size(unsigned int pages)
     return alloc_trace_bufs(pages);
 }
 
+static inline bool filter_vcpu(void)
+{
+    const struct vcpu *v = current;
+
+    if ( likely(tb_filter_domid == DOMID_INVALID) )
+        return true;
+
+    return v->domain->domain_id == tb_filter_domid &&
+           (tb_filter_vcpu == XEN_SYSCTL_TBUF_ALL_VCPUS ||
+            v->vcpu_id == tb_filter_vcpu);
+}
+
+static bool sample_event(uint32_t event)
+{
+    unsigned int cls = (event >> TRC_CLS_SHIFT) & ((1U << TRC_NR_CLASSES) - 1);
+    unsigned int i, rate, *count;
+
+    if ( !cls )
+        return true;
+
+    i = ffs(cls) - 1;
+    rate = tb_sample_rate[i];
+    if ( rate <= 1 )
+        return true;
+
+    count = &this_cpu(tb_sample_count)[i];
+    if ( ++*count < rate )
+        return false;
+    *count = 0;
+
+    return true;
+}
+
 int trace_will_trace_event(u32 event)
 {
     if ( !tb_init_done )
@@ -326,9 +362,14 @@ int trace_will_trace_event(u32 event)
     if ( !cpumask_test_cpu(smp_processor_id(), &tb_cpu_mask) )
         return 0;
 
+    if ( !filter_vcpu() )
+        return 0;
+
     return 1;
 }
 
+static void trace_self_bench(void);
+
 /**
  * init_trace_bufs - performs initialization of the per-cpu trace buffers.
  *
@@ -339,7 +380,6 @@ int trace_will_trace_event(u32 event)
 void __init init_trace_bufs(void)
 {
     cpumask_setall(&tb_cpu_mask);
-    register_cpu_notifier(&cpu_nfb);
 
     if ( opt_tbuf_size )
     {
@@ -348,8 +388,12 @@ void __init init_trace_bufs(void)
             printk("xentrace: allocation size %d failed, disabling\n",
                    opt_tbuf_size);
             opt_tbuf_size = 0;
+            return;
         }
-        else if ( opt_tevt_mask )
+
+        trace_self_bench();
+
+        if ( opt_tevt_mask )
         {
             printk("xentrace: Starting tracing, enabling mask %x\n",
                    opt_tevt_mask);
@@ -359,6 +403,10 @@ void __init init_trace_bufs(void)
     }
 }
 
+static void cf_check trace_sync(void *unused)
+{
+}
+
 /**
  * tb_control - sysctl operations on trace buffers.
  * @tbc: a pointer to a struct xen_sysctl_tbuf_op to be filled out
@@ -395,6 +443,40 @@ int tb_control(struct xen_sysctl_tbuf_op *tbc)
     case XEN_SYSCTL_TBUFOP_set_size:
         rc = tb_set_size(tbc->size);
         break;
+    case XEN_SYSCTL_TBUFOP_set_filter:
+        if ( tbc->pad ||
+             (tbc->domid >= DOMID_FIRST_RESERVED &&
+              tbc->domid != DOMID_IDLE && tbc->domid != DOMID_INVALID) )
+        {
+            rc = -EINVAL;
+            break;
+        }
+        tb_filter_vcpu = tbc->vcpu;
+        smp_wmb();
+        tb_filter_domid = tbc->domid;
+        break;
+    case XEN_SYSCTL_TBUFOP_set_sample:
+    {
+        unsigned int cls = (tbc->evt_mask >> TRC_CLS_SHIFT) &
+                           ((1U << TRC_NR_CLASSES) - 1);
+        unsigned int i;
+        bool sampling = false;
+
+        if ( !cls )
+        {
+            rc = -EINVAL;
+            break;
+        }
+
+        for ( i = 0; i < TRC_NR_CLASSES; i++ )
+        {
+            if ( cls & (1U << i) )
+                tb_sample_rate[i] = tbc->sample_rate;
+            sampling |= tb_sample_rate[i] > 1;
+        }
+        tb_sampling = sampling;
+    }
+        break;
     case XEN_SYSCTL_TBUFOP_enable:
         /* Enable trace buffers. Check buffers are already allocated. */
         if ( opt_tbuf_size == 0 )
@@ -412,15 +494,19 @@ int tb_control(struct xen_sysctl_tbuf_op *tbc)
 
         tb_init_done = 0;
         smp_wmb();
-        /* Clear any lost-record info so we don't get phantom lost records next time we
-         * start tracing.  Grab the lock to make sure we're not racing anyone.  After this
-         * hypercall returns, no more records should be placed into the buffers. */
+        /*
+         * Once every CPU took an interrupt after the above, writers starting
+         * anew see tracing disabled, so waiting for the ones in progress to
+         * finish makes sure no more records get placed into the buffers.
+         * Then clear any lost-record info, so we don't get phantom lost
+         * records next time we start tracing.
+         */
+        on_each_cpu(trace_sync, NULL, 1);
         for_each_online_cpu(i)
         {
-            unsigned long flags;
-            spin_lock_irqsave(&per_cpu(t_lock, i), flags);
-            per_cpu(lost_records, i)=0;
-            spin_unlock_irqrestore(&per_cpu(t_lock, i), flags);
+            while ( ACCESS_ONCE(per_cpu(t_nesting, i)) )
+                cpu_relax();
+            per_cpu(lost_records, i) = 0;
         }
     }
         break;
@@ -457,12 +543,10 @@ static inline bool bogus(u32 prod, u32 cons)
     return 0;
 }
 
-static inline u32 calc_unconsumed_bytes(const struct t_buf *buf)
+static inline u32 calc_unconsumed_bytes(uint32_t prod, uint32_t cons)
 {
-    uint32_t prod = buf->prod, cons = buf->cons;
     int32_t x;
 
-    barrier(); /* must read buf->prod and buf->cons only once */
     if ( bogus(prod, cons) )
         return data_size;
 
@@ -476,16 +560,11 @@ static inline u32 calc_unconsumed_bytes(const struct t_buf *buf)
     return x;
 }
 
-static inline u32 calc_bytes_to_wrap(const struct t_buf *buf)
+static inline u32 calc_bytes_to_wrap(uint32_t pos)
 {
-    uint32_t prod = buf->prod, cons = buf->cons;
     int32_t x;
 
-    barrier(); /* must read buf->prod and buf->cons only once */
-    if ( bogus(prod, cons) )
-        return 0;
-
-    x = data_size - prod;
+    x = data_size - pos;
     if ( x <= 0 )
         x += data_size;
 
@@ -495,27 +574,26 @@ static inline u32 calc_bytes_to_wrap(const struct t_buf *buf)
     return x;
 }
 
-static inline u32 calc_bytes_avail(const struct t_buf *buf)
+static inline uint32_t advance(uint32_t pos, unsigned int size)
 {
-    return data_size - calc_unconsumed_bytes(buf);
+    pos += size;
+    if ( pos >= 2*data_size )
+        pos -= 2*data_size;
+    ASSERT(pos < 2*data_size);
+
+    return pos;
 }
 
-static unsigned char *next_record(const struct t_buf *buf, uint32_t *next,
-                                 unsigned char **next_page,
-                                 uint32_t *offset_in_page)
+static unsigned char *next_record(uint32_t pos, unsigned char **next_page,
+                                  uint32_t *offset_in_page)
 {
-    u32 x = buf->prod, cons = buf->cons;
+    u32 x = pos;
     uint16_t per_cpu_mfn_offset;
     uint32_t per_cpu_mfn_nr;
     uint32_t *mfn_list;
     uint32_t mfn;
     unsigned char *this_page;
 
-    barrier(); /* must read buf->prod and buf->cons only once */
-    *next = x;
-    if ( !tb_init_done || bogus(x, cons) )
-        return NULL;
-
     if ( x >= data_size )
         x -= data_size;
 
@@ -544,28 +622,30 @@ static unsigned char *next_record(const struct t_buf *buf, uint32_t *next,
     return this_page;
 }
 
-static inline void __insert_record(struct t_buf *buf,
-                                   unsigned long event,
-                                   unsigned int extra,
-                                   bool cycles,
-                                   unsigned int rec_size,
-                                   const void *extra_data)
+/*
+ * Write a record at pos, which must have been reserved, and return the
+ * position following it.
+ */
+static inline uint32_t __insert_record(uint32_t pos,
+                                       unsigned long event,
+                                       unsigned int extra,
+                                       bool cycles,
+                                       unsigned int rec_size,
+                                       const void *extra_data,
+                                       uint64_t tsc)
 {
     struct t_rec split_rec, *rec;
     uint32_t *dst;
     unsigned char *this_page, *next_page;
     unsigned int extra_word = extra / sizeof(u32);
     unsigned int local_rec_size = calc_rec_size(cycles, extra);
-    uint32_t next;
     uint32_t offset;
     uint32_t remaining;
 
     BUG_ON(local_rec_size != rec_size);
     BUG_ON(extra & 3);
 
-    this_page = next_record(buf, &next, &next_page, &offset);
-    if ( !this_page )
-        return;
+    this_page = next_record(pos, &next_page, &offset);
 
     remaining = PAGE_SIZE - offset;
 
@@ -575,9 +655,9 @@ static inline void __insert_record(struct t_buf *buf,
         {
             /* access beyond end of buffer */
             printk(XENLOG_WARNING
-                   "%s: size=%08x prod=%08x cons=%08x rec=%u remaining=%u\n",
-                   __func__, data_size, next, buf->cons, rec_size, remaining);
-            return;
+                   "%s: size=%08x pos=%08x rec=%u remaining=%u\n",
+                   __func__, data_size, pos, rec_size, remaining);
+            return advance(pos, rec_size);
         }
         rec = &split_rec;
     } else {
@@ -589,7 +669,6 @@ static inline void __insert_record(struct t_buf *buf,
     dst = rec->u.nocycles.extra_u32;
     if ( (rec->cycles_included = cycles) != 0 )
     {
-        u64 tsc = (u64)get_cycles();
         rec->u.cycles.cycles_lo = (uint32_t)tsc;
         rec->u.cycles.cycles_hi = (uint32_t)(tsc >> 32);
         dst = rec->u.cycles.extra_u32;
@@ -604,19 +683,13 @@ static inline void __insert_record(struct t_buf *buf,
         memcpy(next_page, (char *)rec + remaining, rec_size - remaining);
     }
 
-    smp_wmb();
-
-    next += rec_size;
-    if ( next >= 2*data_size )
-        next -= 2*data_size;
-    ASSERT(next < 2*data_size);
-    buf->prod = next;
+    return advance(pos, rec_size);
 }
 
-static inline void insert_wrap_record(struct t_buf *buf,
-                                      unsigned int size)
+static inline uint32_t insert_wrap_record(uint32_t pos, unsigned int size,
+                                          uint64_t tsc)
 {
-    u32 space_left = calc_bytes_to_wrap(buf);
+    u32 space_left = calc_bytes_to_wrap(pos);
     unsigned int extra_space = space_left - sizeof(u32);
     bool cycles = false;
 
@@ -630,13 +703,14 @@ static inline void insert_wrap_record(struct t_buf *buf,
         ASSERT((extra_space/sizeof(u32)) <= TRACE_EXTRA_MAX);
     }
 
-    __insert_record(buf, TRC_TRACE_WRAP_BUFFER, extra_space, cycles,
-                    space_left, NULL);
+    return __insert_record(pos, TRC_TRACE_WRAP_BUFFER, extra_space, cycles,
+                           space_left, NULL, tsc);
 }
 
 #define LOST_REC_SIZE (4 + 8 + 16) /* header + tsc + sizeof(struct ed) */
 
-static inline void insert_lost_records(struct t_buf *buf)
+static inline uint32_t insert_lost_records(uint32_t pos, unsigned long lost,
+                                           uint64_t tsc)
 {
     struct __packed {
         u32 lost_records;
@@ -646,13 +720,62 @@ static inline void insert_lost_records(struct t_buf *buf)
 
     ed.vid = current->vcpu_id;
     ed.did = current->domain->domain_id;
-    ed.lost_records = this_cpu(lost_records);
+    ed.lost_records = lost;
     ed.first_tsc = this_cpu(lost_records_first_tsc);
 
-    this_cpu(lost_records) = 0;
+    return __insert_record(pos, TRC_LOST_RECORDS, sizeof(ed), 1 /* cycles */,
+                           LOST_REC_SIZE, &ed, tsc);
+}
+
+/*
+ * Calculate the total size to commit a record at pos, by doing a dry-run:
+ * first a lost records record if needed, then the record itself, each
+ * preceded by a wrap record if it wouldn't fit before the wrap-around.
+ */
+static inline unsigned int calc_total_size(uint32_t pos, bool lost,
+                                           unsigned int rec_size)
+{
+    u32 bytes_to_wrap = calc_bytes_to_wrap(pos);
+    unsigned int total_size = 0;
+
+    if ( lost )
+    {
+        if ( LOST_REC_SIZE > bytes_to_wrap )
+        {
+            total_size += bytes_to_wrap;
+            bytes_to_wrap = data_size;
+        }
+        total_size += LOST_REC_SIZE;
+        bytes_to_wrap -= LOST_REC_SIZE;
+
+        /* LOST_REC might line up perfectly with the buffer wrap */
+        if ( bytes_to_wrap == 0 )
+            bytes_to_wrap = data_size;
+    }
+
+    if ( rec_size > bytes_to_wrap )
+        total_size += bytes_to_wrap;
+    total_size += rec_size;
 
-    __insert_record(buf, TRC_LOST_RECORDS, sizeof(ed), 1 /* cycles */,
-                    LOST_REC_SIZE, &ed);
+    return total_size;
+}
+
+/*
+ * Account for records which didn't fit.  Nested writers may do the same, so
+ * the count is updated atomically with respect to them.
+ */
+static void add_lost_records(unsigned long nr, bool first, uint64_t tsc)
+{
+    unsigned long *lost = &this_cpu(lost_records);
+    unsigned long old, cur = *lost;
+
+    do {
+        old = cur;
+        cur = cmpxchg(lost, old, old + nr);
+    } while ( cur != old );
+
+    if ( !old && first )
+        this_cpu(lost_records_first_tsc) = tsc;
 }
 
 /*
@@ -666,6 +789,128 @@ static void cf_check trace_notify_dom0(void *unused)
 static DECLARE_SOFTIRQ_TASKLET(trace_notify_dom0_tasklet,
                                trace_notify_dom0, NULL);
 
+#ifndef in_nmi_handler
+#define in_nmi_handler() false
+#endif
+
+/*
+ * Insert a record into the current CPU's buffer, without locking.
+ *
+ * The space for it, and for any lost records and wrap records, is reserved
+ * by advancing t_head with cmpxchg, so that writers nesting from interrupt or
+ * NMI context get space after it, and timestamps remain in order.  Only the
+ * outermost writer publishes the records written, up to the latest t_head,
+ * as prod.
+ */
+static void insert_record(uint32_t event, unsigned int extra,
+                          const void *extra_data)
+{
+    struct t_buf *buf = this_cpu(t_bufs);
+    uint32_t *headp = &this_cpu(t_head);
+    unsigned int *nesting = &this_cpu(t_nesting);
+    uint32_t head, prev, pos;
+    unsigned int rec_size, total_size, unconsumed;
+    unsigned long lost;
+    bool crossed_highwater = false;
+    bool cycles = event & TRC_HD_CYCLE_FLAG;
+    uint64_t tsc;
+
+    if ( unlikely(!buf) )
+        return;
+
+    ++*nesting;
+    barrier(); /* must count as writer before checking tb_init_done */
+
+    if ( !tb_init_done )
+        goto commit;
+
+    /* Calculate the record size */
+    rec_size = calc_rec_size(cycles, extra);
+
+    /* Claim the lost records to report, if any, before reserving. */
+    lost = ACCESS_ONCE(this_cpu(lost_records));
+    if ( unlikely(lost) )
+        lost = xchg(&this_cpu(lost_records), 0);
+
+    head = ACCESS_ONCE(*headp);
+    for ( ; ; )
+    {
+        unconsumed = calc_unconsumed_bytes(head, ACCESS_ONCE(buf->cons));
+        total_size = calc_total_size(head, lost, rec_size);
+        tsc = get_cycles();
+
+        /* Do we have enough space for everything? */
+        if ( !tb_init_done || total_size > data_size - unconsumed )
+        {
+            add_lost_records(lost + 1, !lost, tsc);
+            goto commit;
+        }
+
+        prev = cmpxchg(headp, head, advance(head, total_size));
+        if ( likely(prev == head) )
+            break;
+        head = prev;
+    }
+
+    crossed_highwater = unconsumed < t_buf_highwater &&
+                        unconsumed + total_size >= t_buf_highwater;
+
+    /*
+     * Now, actually write information
+     */
+    pos = head;
+
+    if ( lost )
+    {
+        if ( LOST_REC_SIZE > calc_bytes_to_wrap(pos) )
+            pos = insert_wrap_record(pos, LOST_REC_SIZE, tsc);
+        pos = insert_lost_records(pos, lost, tsc);
+    }
+
+    if ( rec_size > calc_bytes_to_wrap(pos) )
+        pos = insert_wrap_record(pos, rec_size, tsc);
+
+    /* Write the original record */
+    pos = __insert_record(pos, event, extra, cycles, rec_size, extra_data, tsc);
+    ASSERT(pos == advance(head, total_size));
+
+ commit:
+    if ( *nesting > 1 )
+    {
+        /* The outermost writer publishes our records. */
+        barrier();
+        --*nesting;
+        return;
+    }
+
+    /*
+     * Publish everything reserved, including by writers which nested while
+     * we were at it.  Recheck after dropping out, for any which got in
+     * between reading t_head and decrementing the nesting count.
+     */
+    for ( ; ; )
+    {
+        head = ACCESS_ONCE(*headp);
+        smp_wmb(); /* records must be visible before prod */
+        buf->prod = head;
+        barrier();
+        --*nesting;
+        barrier();
+        if ( likely(ACCESS_ONCE(*headp) == head) )
+            break;
+        ++*nesting;
+        barrier();
+    }
+
+    /*
+     * Notify trace buffer consumer that we've crossed the high water mark.
+     * Not from NMI context, where the tasklet can't be scheduled safely; the
+     * consumer polls in that case.
+     */
+    if ( crossed_highwater && !in_nmi_handler() )
+        tasklet_schedule(&trace_notify_dom0_tasklet);
+}
+
 /**
  * trace - Enters a trace tuple into the trace buffer for the current CPU.
  * @event: the event type being logged
@@ -676,13 +921,6 @@ static DECLARE_SOFTIRQ_TASKLET(trace_notify_dom0_tasklet,
  */
 void trace(uint32_t event, unsigned int extra, const void *extra_data)
 {
-    struct t_buf *buf;
-    unsigned long flags;
-    u32 bytes_to_tail, bytes_to_wrap;
-    unsigned int rec_size, total_size;
-    bool started_below_highwater;
-    bool cycles = event & TRC_HD_CYCLE_FLAG;
-
     if( !tb_init_done )
         return;
 
@@ -712,100 +950,62 @@ void trace(uint32_t event, unsigned int extra, const void *extra_data)
     if ( !cpumask_test_cpu(smp_processor_id(), &tb_cpu_mask) )
         return;
 
-    spin_lock_irqsave(&this_cpu(t_lock), flags);
-
-    buf = this_cpu(t_bufs);
-
-    if ( unlikely(!buf) )
-    {
-        /* Make gcc happy */
-        started_below_highwater = 0;
-        goto unlock;
-    }
-
-    started_below_highwater = (calc_unconsumed_bytes(buf) < t_buf_highwater);
-
-    /* Calculate the record size */
-    rec_size = calc_rec_size(cycles, extra);
-
-    /* How many bytes are available in the buffer? */
-    bytes_to_tail = calc_bytes_avail(buf);
-
-    /* How many bytes until the next wrap-around? */
-    bytes_to_wrap = calc_bytes_to_wrap(buf);
-
-    /*
-     * Calculate expected total size to commit this record by
-     * doing a dry-run.
-     */
-    total_size = 0;
-
-    /* First, check to see if we need to include a lost_record.
-     */
-    if ( this_cpu(lost_records) )
-    {
-        if ( LOST_REC_SIZE > bytes_to_wrap )
-        {
-            total_size += bytes_to_wrap;
-            bytes_to_wrap = data_size;
-        }
-        total_size += LOST_REC_SIZE;
-        bytes_to_wrap -= LOST_REC_SIZE;
-
-        /* LOST_REC might line up perfectly with the buffer wrap */
-        if ( bytes_to_wrap == 0 )
-            bytes_to_wrap = data_size;
-    }
-
-    if ( rec_size > bytes_to_wrap )
-    {
-        total_size += bytes_to_wrap;
-    }
-    total_size += rec_size;
-
-    /* Do we have enough space for everything? */
-    if ( total_size > bytes_to_tail )
-    {
-        if ( ++this_cpu(lost_records) == 1 )
-            this_cpu(lost_records_first_tsc)=(u64)get_cycles();
-        started_below_highwater = 0;
-        goto unlock;
-    }
-
-    /*
-     * Now, actually write information
-     */
-    bytes_to_wrap = calc_bytes_to_wrap(buf);
-
-    if ( this_cpu(lost_records) )
-    {
-        if ( LOST_REC_SIZE > bytes_to_wrap )
-        {
-            insert_wrap_record(buf, LOST_REC_SIZE);
-            bytes_to_wrap = data_size;
-        }
-        insert_lost_records(buf);
-        bytes_to_wrap -= LOST_REC_SIZE;
-
-        /* LOST_REC might line up perfectly with the buffer wrap */
-        if ( bytes_to_wrap == 0 )
-            bytes_to_wrap = data_size;
-    }
+    if ( !filter_vcpu() )
+        return;
 
-    if ( rec_size > bytes_to_wrap )
-        insert_wrap_record(buf, rec_size);
+    if ( unlikely(tb_sampling) && !sample_event(event) )
+        return;
 
-    /* Write the original record */
-    __insert_record(buf, event, extra, cycles, rec_size, extra_data);
+    insert_record(event, extra, extra_data);
+}
 
-unlock:
-    spin_unlock_irqrestore(&this_cpu(t_lock), flags);
+#define BENCH_RECORDS 1000
+#define BENCH_EVENT   (TRC_GEN + 0xff)
 
-    /* Notify trace buffer consumer that we've crossed the high water mark. */
-    if ( likely(buf!=NULL)
-         && started_below_highwater
-         && (calc_unconsumed_bytes(buf) >= t_buf_highwater) )
-        tasklet_schedule(&trace_notify_dom0_tasklet);
+/*
+ * Measure the cost of tracing, by inserting records into the boot CPU's
+ * buffer, which get discarded afterwards, and of an event which is masked
+ * out.
+ */
+static void __init trace_self_bench(void)
+{
+    struct t_buf *buf = this_cpu(t_bufs);
+    uint32_t data[3] = {};
+    uint32_t head, prod;
+    unsigned long flags, lost;
+    unsigned int i, nr;
+    uint64_t start, rec_cycles, masked_cycles;
+
+    local_irq_save(flags);
+
+    head = this_cpu(t_head);
+    prod = buf->prod;
+    lost = this_cpu(lost_records);
+
+    nr = min_t(unsigned int, BENCH_RECORDS,
+               (data_size - calc_unconsumed_bytes(head, buf->cons)) /
+               calc_rec_size(true, sizeof(data)) / 2);
+
+    start = get_cycles();
+    for ( i = 0; i < nr; i++ )
+        insert_record(BENCH_EVENT | TRC_HD_CYCLE_FLAG, sizeof(data), data);
+    rec_cycles = get_cycles() - start;
+
+    start = get_cycles();
+    for ( i = 0; i < BENCH_RECORDS; i++ )
+        trace(0, 0, NULL); /* An event matching no mask. */
+    masked_cycles = get_cycles() - start;
+
+    this_cpu(t_head) = head;
+    buf->prod = prod;
+    this_cpu(lost_records) = lost;
+
+    local_irq_restore(flags);
+
+    if ( nr )
+        printk(XENLOG_INFO "xentrace: %"PRIu64" cycles per record, "
+               "%"PRIu64" per masked out event\n",
+               rec_cycles / nr, masked_cycles / BENCH_RECORDS);
 }
 
 void __trace_hypercall(uint32_t event, unsigned long op,
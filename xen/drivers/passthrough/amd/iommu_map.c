@@ -304,6 +304,14 @@ static int iommu_pde_from_dfn(struct domain *d, unsigned long dfn,
     if ( dfn >> (PTE_PER_TABLE_SHIFT * level) )
         return 0;
 
+    if ( hd->arch.amd.walk.mfn && hd->arch.amd.walk.level == target &&
+         hd->arch.amd.walk.tag == dfn >> (PTE_PER_TABLE_SHIFT * target) )
+    {
+        perfc_incr(iommu_pt_walk_hits);
+        *pt_mfn = hd->arch.amd.walk.mfn;
+        return 0;
+    }
+
     next_table_mfn = mfn_x(page_to_mfn(table));
 
     while ( level > target )
@@ -385,11 +393,27 @@ static int iommu_pde_from_dfn(struct domain *d, unsigned long dfn,
         level--;
     }
 
+    hd->arch.amd.walk.tag = dfn >> (PTE_PER_TABLE_SHIFT * target);
+    hd->arch.amd.walk.level = target;
+    hd->arch.amd.walk.mfn = next_table_mfn;
+
     /* mfn of target level page table */
     *pt_mfn = next_table_mfn;
     return 0;
 }
 
+void amd_iommu_walk_invalidate(struct domain_iommu *hd)
+{
+    hd->arch.amd.walk.mfn = 0;
+}
+
+/* Free a page table, which the cached walk may end in. */
+static void queue_free_pgtable(struct domain_iommu *hd, struct page_info *pg)
+{
+    amd_iommu_walk_invalidate(hd);
+    iommu_queue_free_pgtable(hd, pg);
+}
+
 static void queue_free_pt(struct domain_iommu *hd, mfn_t mfn, unsigned int level)
 {
     if ( level > 1 )
@@ -407,7 +431,7 @@ static void queue_free_pt(struct domain_iommu *hd, mfn_t mfn, unsigned int level
         unmap_domain_page(pt);
     }
 
-    iommu_queue_free_pgtable(hd, mfn_to_page(mfn));
+    queue_free_pgtable(hd, mfn_to_page(mfn));
 }
 
 int cf_check amd_iommu_map_page(
@@ -478,7 +502,7 @@ int cf_check amd_iommu_map_page(
                               flags & IOMMUF_writable,
                               flags & IOMMUF_readable, &contig);
         *flush_flags |= IOMMU_FLUSHF_modified | IOMMU_FLUSHF_all;
-        iommu_queue_free_pgtable(hd, pg);
+        queue_free_pgtable(hd, pg);
         perfc_incr(iommu_pt_coalesces);
     }
 
@@ -545,7 +569,7 @@ int cf_check amd_iommu_unmap_page(
 
             clear_iommu_pte_present(pt_mfn, dfn_x(dfn), level, &free);
             *flush_flags |= IOMMU_FLUSHF_all;
-            iommu_queue_free_pgtable(hd, pg);
+            queue_free_pgtable(hd, pg);
             perfc_incr(iommu_pt_coalesces);
         }
     }
@@ -870,6 +894,7 @@ int cf_check amd_iommu_quarantine_init(struct pci_dev *pdev, bool scratch_page)
 
     iommu_identity_map_teardown(dom_io);
     hd->arch.amd.root_table = NULL;
+    amd_iommu_walk_invalidate(hd);
 
     if ( rc )
         AMD_IOMMU_WARN("%pp: quarantine unity mapping failed\n", &pdev->sbdf);
@@ -551,6 +551,7 @@ static void cf_check amd_iommu_clear_root_pgtable(struct domain *d)
 
     spin_lock(&hd->arch.mapping_lock);
     hd->arch.amd.root_table = NULL;
+    amd_iommu_walk_invalidate(hd);
     spin_unlock(&hd->arch.mapping_lock);
 }
 
@@ -55,6 +55,7 @@ static bool __hwdom_initdata iommu_hwdom_none;
 bool __hwdom_initdata iommu_hwdom_strict;
 bool __read_mostly iommu_hwdom_passthrough;
 bool __hwdom_initdata iommu_hwdom_inclusive;
+bool __hwdom_initdata iommu_hwdom_lazy;
 int8_t __hwdom_initdata iommu_hwdom_reserved = -1;
 
 #ifndef iommu_hap_pt_share
@@ -170,6 +171,8 @@ static int __init cf_check parse_dom0_iommu_param(const char *s)
             iommu_hwdom_inclusive = val;
         else if ( (val = parse_boolean("map-reserved", s, ss)) >= 0 )
             iommu_hwdom_reserved = val;
+        else if ( (val = parse_boolean("lazy", s, ss)) >= 0 )
+            iommu_hwdom_lazy = val;
         else if ( !cmdline_strcmp(s, "none") )
             iommu_hwdom_none = true;
         else
@@ -249,7 +252,18 @@ static void cf_check iommu_dump_page_tables(unsigned char key)
 
     for_each_domain(d)
     {
-        if ( is_hardware_domain(d) || !is_iommu_enabled(d) )
+        const struct domain_iommu *hd = dom_iommu(d);
+
+        if ( !is_iommu_enabled(d) )
+            continue;
+
+        printk("%pd: %lu page table pages, %lu maps of %lu pages (%"PRI_stime
+               "ns), %lu unmaps of %lu pages (%"PRI_stime"ns)\n",
+               d, hd->stats.pt_pages, hd->stats.maps, hd->stats.map_pages,
+               hd->stats.map_time, hd->stats.unmaps, hd->stats.unmap_pages,
+               hd->stats.unmap_time);
+
+        if ( is_hardware_domain(d) )
             continue;
 
         if ( iommu_use_hap_pt(d) )
@@ -323,20 +337,15 @@ static unsigned int mapping_order(const struct domain_iommu *hd,
     return order;
 }
 
-long iommu_map(struct domain *d, dfn_t dfn0, mfn_t mfn0,
-               unsigned long page_count, unsigned int flags,
-               unsigned int *flush_flags)
+static long map_pages(struct domain *d, dfn_t dfn0, mfn_t mfn0,
+                      unsigned long page_count, unsigned int flags,
+                      unsigned int *flush_flags)
 {
     const struct domain_iommu *hd = dom_iommu(d);
     unsigned long i;
     unsigned int order, j = 0;
     int rc = 0;
 
-    if ( !is_iommu_enabled(d) )
-        return 0;
-
-    ASSERT(!IOMMUF_order(flags));
-
     for ( i = 0; i < page_count; i += 1UL << order )
     {
         dfn_t dfn = dfn_add(dfn0, i);
@@ -381,6 +390,29 @@ long iommu_map(struct domain *d, dfn_t dfn0, mfn_t mfn0,
     return rc;
 }
 
+long iommu_map(struct domain *d, dfn_t dfn0, mfn_t mfn0,
+               unsigned long page_count, unsigned int flags,
+               unsigned int *flush_flags)
+{
+    struct domain_iommu *hd = dom_iommu(d);
+    s_time_t start;
+    long rc;
+
+    if ( !is_iommu_enabled(d) )
+        return 0;
+
+    ASSERT(!IOMMUF_order(flags));
+
+    start = NOW();
+    rc = map_pages(d, dfn0, mfn0, page_count, flags, flush_flags);
+
+    hd->stats.maps++;
+    hd->stats.map_pages += rc > 0 ? rc : page_count;
+    hd->stats.map_time += NOW() - start;
+
+    return rc;
+}
+
 int iommu_legacy_map(struct domain *d, dfn_t dfn, mfn_t mfn,
                      unsigned long page_count, unsigned int flags)
 {
@@ -396,19 +428,14 @@ int iommu_legacy_map(struct domain *d, dfn_t dfn, mfn_t mfn,
     return rc;
 }
 
-long iommu_unmap(struct domain *d, dfn_t dfn0, unsigned long page_count,
-                 unsigned int flags, unsigned int *flush_flags)
+static long unmap_pages(struct domain *d, dfn_t dfn0, unsigned long page_count,
+                        unsigned int flags, unsigned int *flush_flags)
 {
     const struct domain_iommu *hd = dom_iommu(d);
     unsigned long i;
     unsigned int order, j = 0;
     int rc = 0;
 
-    if ( !is_iommu_enabled(d) )
-        return 0;
-
-    ASSERT(!(flags & ~IOMMUF_preempt));
-
     for ( i = 0; i < page_count; i += 1UL << order )
     {
         dfn_t dfn = dfn_add(dfn0, i);
@@ -453,6 +480,28 @@ long iommu_unmap(struct domain *d, dfn_t dfn0, unsigned long page_count,
     return rc;
 }
 
+long iommu_unmap(struct domain *d, dfn_t dfn0, unsigned long page_count,
+                 unsigned int flags, unsigned int *flush_flags)
+{
+    struct domain_iommu *hd = dom_iommu(d);
+    s_time_t start;
+    long rc;
+
+    if ( !is_iommu_enabled(d) )
+        return 0;
+
+    ASSERT(!(flags & ~IOMMUF_preempt));
+
+    start = NOW();
+    rc = unmap_pages(d, dfn0, page_count, flags, flush_flags);
+
+    hd->stats.unmaps++;
+    hd->stats.unmap_pages += rc > 0 ? rc : page_count;
+    hd->stats.unmap_time += NOW() - start;
+
+    return rc;
+}
+
 int iommu_legacy_unmap(struct domain *d, dfn_t dfn, unsigned long page_count)
 {
     unsigned int flush_flags = 0;
@@ -688,6 +688,30 @@ static int __must_check iommu_flush_iotlb_psi(struct vtd_iommu *iommu, u16 did,
     return status;
 }
 
+/* Flush a range which iommu_flush_iotlb_psi() can't cover in one go. */
+static int __must_check iommu_flush_iotlb_range(struct vtd_iommu *iommu,
+                                                u16 did, u64 addr,
+                                                unsigned long nr_pages,
+                                                bool flush_non_present_entry,
+                                                bool flush_dev_iotlb)
+{
+    int status;
+
+    if ( !iommu->flush.iotlb_range || flush_dev_iotlb )
+        return iommu_flush_iotlb_dsi(iommu, did, 0, flush_dev_iotlb);
+
+    /* apply platform specific errata workarounds */
+    vtd_ops_preamble_quirk(iommu);
+
+    status = iommu->flush.iotlb_range(iommu, did, addr, nr_pages,
+                                      flush_non_present_entry);
+
+    /* undo platform specific errata workarounds */
+    vtd_ops_postamble_quirk(iommu);
+
+    return status;
+}
+
 static int __must_check iommu_flush_all(void)
 {
     struct acpi_drhd_unit *drhd;
@@ -767,10 +791,15 @@ static int __must_check cf_check iommu_flush_iotlb(struct domain *d, dfn_t dfn,
         if ( iommu_domid == -1 )
             continue;
 
-        if ( !page_count || (page_count & (page_count - 1)) ||
-             dfn_eq(dfn, INVALID_DFN) || !IS_ALIGNED(dfn_x(dfn), page_count) )
+        if ( !page_count || dfn_eq(dfn, INVALID_DFN) )
             rc = iommu_flush_iotlb_dsi(iommu, iommu_domid,
                                        0, flush_dev_iotlb);
+        else if ( (page_count & (page_count - 1)) ||
+                  !IS_ALIGNED(dfn_x(dfn), page_count) )
+            rc = iommu_flush_iotlb_range(iommu, iommu_domid,
+                                         dfn_to_daddr(dfn), page_count,
+                                         !(flush_flags & IOMMU_FLUSHF_modified),
+                                         flush_dev_iotlb);
         else
             rc = iommu_flush_iotlb_psi(iommu, iommu_domid,
                                        dfn_to_daddr(dfn),
@@ -503,6 +503,10 @@ struct vtd_iommu {
                                   unsigned int size_order, u64 type,
                                   bool flush_non_present_entry,
                                   bool flush_dev_iotlb);
+        /* Optional: flush any range of pages without device IOTLBs. */
+        int __must_check (*iotlb_range)(struct vtd_iommu *iommu, u16 did,
+                                        u64 addr, unsigned long nr_pages,
+                                        bool flush_non_present_entry);
     } flush;
 
     struct list_head ats_devices;
@@ -20,6 +20,7 @@
 
 #include <xen/sched.h>
 #include <xen/iommu.h>
+#include <xen/perfc.h>
 #include <xen/time.h>
 #include <xen/pci.h>
 #include <xen/pci_regs.h>
@@ -32,6 +33,13 @@
 /* Each entry is 16 bytes, and there can be up to 2^7 pages. */
 #define QINVAL_MAX_ENTRY_NR (1u << (7 + PAGE_SHIFT_4K - 4))
 
+/*
+ * Page selective IOTLB invalidations queued for a single range flush,
+ * completed by a single wait descriptor.  Past this many, a domain selective
+ * invalidation is cheaper to queue and for the hardware to process.
+ */
+#define QINVAL_BATCH_MAX 16
+
 /* Status data flag */
 #define QINVAL_STAT_INIT  0
 #define QINVAL_STAT_DONE  1
@@ -48,21 +56,27 @@ static void print_qi_regs(const struct vtd_iommu *iommu)
     printk(" IQT = %"PRIx64"\n", dmar_readq(iommu->reg, DMAR_IQT_REG));
 }
 
-static unsigned int qinval_next_index(struct vtd_iommu *iommu)
+/* Reserve nr consecutive slots, returning the index of the first. */
+static unsigned int qinval_next_index(struct vtd_iommu *iommu, unsigned int nr)
 {
     unsigned int tail = dmar_readl(iommu->reg, DMAR_IQT_REG);
 
+    ASSERT(nr && nr < qi_entry_nr);
+
     tail /= sizeof(struct qinval_entry);
 
     /* (tail+1 == head) indicates a full queue, wait for HW */
-    while ( ((tail + 1) & (qi_entry_nr - 1)) ==
-            (dmar_readl(iommu->reg, DMAR_IQH_REG) / sizeof(struct qinval_entry)) )
+    while ( ((dmar_readl(iommu->reg, DMAR_IQH_REG) /
+              sizeof(struct qinval_entry) - tail - 1) &
+             (qi_entry_nr - 1)) < nr )
     {
         printk_once(XENLOG_ERR VTDPREFIX " IOMMU#%u: no QI slot available\n",
                     iommu->index);
         cpu_relax();
     }
 
+    perfc_add(iommu_qi_descs, nr);
+
     return tail;
 }
 
@@ -96,7 +110,7 @@ static int __must_check queue_invalidate_context_sync(struct vtd_iommu *iommu,
     struct qinval_entry *qinval_entry;
 
     spin_lock_irqsave(&iommu->register_lock, flags);
-    index = qinval_next_index(iommu);
+    index = qinval_next_index(iommu, 1);
     qinval_entry = qi_map_entry(iommu, index);
 
     qinval_entry->q.cc_inv_dsc.lo.type = TYPE_INVAL_CONTEXT;
@@ -116,19 +130,10 @@ static int __must_check queue_invalidate_context_sync(struct vtd_iommu *iommu,
     return invalidate_sync(iommu);
 }
 
-static int __must_check queue_invalidate_iotlb_sync(struct vtd_iommu *iommu,
-                                                    u8 granu, u8 dr, u8 dw,
-                                                    u16 did, u8 am, u8 ih,
-                                                    u64 addr)
+static void qinval_fill_iotlb(struct qinval_entry *qinval_entry,
+                              u8 granu, u8 dr, u8 dw, u16 did, u8 am, u8 ih,
+                              u64 addr)
 {
-    unsigned long flags;
-    unsigned int index;
-    struct qinval_entry *qinval_entry;
-
-    spin_lock_irqsave(&iommu->register_lock, flags);
-    index = qinval_next_index(iommu);
-    qinval_entry = qi_map_entry(iommu, index);
-
     qinval_entry->q.iotlb_inv_dsc.lo.type = TYPE_INVAL_IOTLB;
     qinval_entry->q.iotlb_inv_dsc.lo.granu = granu;
     qinval_entry->q.iotlb_inv_dsc.lo.dr = dr;
@@ -141,6 +146,22 @@ static int __must_check queue_invalidate_iotlb_sync(struct vtd_iommu *iommu,
     qinval_entry->q.iotlb_inv_dsc.hi.ih = ih;
     qinval_entry->q.iotlb_inv_dsc.hi.res_1 = 0;
     qinval_entry->q.iotlb_inv_dsc.hi.addr = addr >> PAGE_SHIFT_4K;
+}
+
+static int __must_check queue_invalidate_iotlb_sync(struct vtd_iommu *iommu,
+                                                    u8 granu, u8 dr, u8 dw,
+                                                    u16 did, u8 am, u8 ih,
+                                                    u64 addr)
+{
+    unsigned long flags;
+    unsigned int index;
+    struct qinval_entry *qinval_entry;
+
+    spin_lock_irqsave(&iommu->register_lock, flags);
+    index = qinval_next_index(iommu, 1);
+    qinval_entry = qi_map_entry(iommu, index);
+
+    qinval_fill_iotlb(qinval_entry, granu, dr, dw, did, am, ih, addr);
 
     qinval_update_qtail(iommu, index);
     spin_unlock_irqrestore(&iommu->register_lock, flags);
@@ -160,9 +181,11 @@ static int __must_check queue_invalidate_wait(struct vtd_iommu *iommu,
     struct qinval_entry *qinval_entry;
     uint32_t *this_poll_slot = &this_cpu(poll_slot);
 
+    perfc_incr(iommu_qi_waits);
+
     spin_lock_irqsave(&iommu->register_lock, flags);
     ACCESS_ONCE(*this_poll_slot) = QINVAL_STAT_INIT;
-    index = qinval_next_index(iommu);
+    index = qinval_next_index(iommu, 1);
     qinval_entry = qi_map_entry(iommu, index);
 
     qinval_entry->q.inv_wait_dsc.lo.type = TYPE_INVAL_WAIT;
@@ -260,7 +283,7 @@ int qinval_device_iotlb_sync(struct vtd_iommu *iommu, struct pci_dev *pdev,
 
     ASSERT(pdev);
     spin_lock_irqsave(&iommu->register_lock, flags);
-    index = qinval_next_index(iommu);
+    index = qinval_next_index(iommu, 1);
     qinval_entry = qi_map_entry(iommu, index);
 
     qinval_entry->q.dev_iotlb_inv_dsc.lo.type = TYPE_INVAL_DEVICE_IOTLB;
@@ -291,7 +314,7 @@ static int __must_check queue_invalidate_iec_sync(struct vtd_iommu *iommu,
     int ret;
 
     spin_lock_irqsave(&iommu->register_lock, flags);
-    index = qinval_next_index(iommu);
+    index = qinval_next_index(iommu, 1);
     qinval_entry = qi_map_entry(iommu, index);
 
     qinval_entry->q.iec_inv_dsc.lo.type = TYPE_INVAL_IEC;
@@ -389,6 +412,84 @@ static int __must_check cf_check flush_iotlb_qi(
     return ret;
 }
 
+/*
+ * Flush the IOTLB for a range which isn't a single naturally aligned power
+ * of two pages: split it into such blocks, and queue their page selective
+ * invalidations together, followed by a single wait descriptor.  Too many
+ * blocks, and the domain's whole IOTLB gets invalidated instead.
+ */
+static int __must_check cf_check flush_iotlb_range_qi(
+    struct vtd_iommu *iommu, uint16_t did, uint64_t addr,
+    unsigned long nr_pages, bool flush_non_present_entry)
+{
+    struct {
+        uint64_t addr;
+        unsigned int order;
+    } psi[QINVAL_BATCH_MAX];
+    unsigned long dfn = addr >> PAGE_SHIFT_4K, end = dfn + nr_pages;
+    unsigned int i, nr = 0, index, max_order = cap_max_amask_val(iommu->cap);
+    u8 dr = cap_read_drain(iommu->cap), dw = cap_write_drain(iommu->cap);
+    unsigned long flags;
+
+    ASSERT(iommu->qinval_maddr);
+    ASSERT(nr_pages);
+
+    if ( flush_non_present_entry && !cap_caching_mode(iommu->cap) )
+        return 1;
+
+    while ( cap_pgsel_inv(iommu->cap) && dfn < end && nr < ARRAY_SIZE(psi) )
+    {
+        unsigned int order = min_t(unsigned int, flsl(end - dfn) - 1,
+                                   max_order);
+
+        if ( dfn )
+            order = min_t(unsigned int, order, ffsl(dfn) - 1);
+
+        psi[nr].addr = (uint64_t)dfn << PAGE_SHIFT_4K;
+        psi[nr++].order = order;
+        dfn += 1UL << order;
+    }
+
+    spin_lock_irqsave(&iommu->register_lock, flags);
+
+    if ( dfn < end )
+    {
+        /* Escalate to a domain selective invalidation. */
+        struct qinval_entry *qinval_entry;
+
+        perfc_incr(iommu_qi_iotlb_escalated);
+
+        index = qinval_next_index(iommu, 1);
+        qinval_entry = qi_map_entry(iommu, index);
+        qinval_fill_iotlb(qinval_entry,
+                          DMA_TLB_DSI_FLUSH >> DMA_TLB_FLUSH_GRANU_OFFSET,
+                          dr, dw, did, 0, 0, 0);
+        unmap_vtd_domain_page(qinval_entry);
+    }
+    else
+    {
+        perfc_incr(iommu_qi_iotlb_batched);
+
+        index = qinval_next_index(iommu, nr);
+        for ( i = 0; i < nr; i++ )
+        {
+            struct qinval_entry *qinval_entry =
+                qi_map_entry(iommu, (index + i) & (qi_entry_nr - 1));
+
+            qinval_fill_iotlb(qinval_entry,
+                              DMA_TLB_PSI_FLUSH >> DMA_TLB_FLUSH_GRANU_OFFSET,
+                              dr, dw, did, psi[i].order, 0, psi[i].addr);
+            unmap_vtd_domain_page(qinval_entry);
+        }
+        index = (index + nr - 1) & (qi_entry_nr - 1);
+    }
+
+    qinval_update_qtail(iommu, index);
+    spin_unlock_irqrestore(&iommu->register_lock, flags);
+
+    return invalidate_sync(iommu);
+}
+
 int enable_qinval(struct vtd_iommu *iommu)
 {
     u32 sts;
@@ -408,14 +509,18 @@ int enable_qinval(struct vtd_iommu *iommu)
         {
             /*
              * With the present synchronous model, we need two slots for every
-             * operation (the operation itself and a wait descriptor).  There
-             * can be one such pair of requests pending per CPU.  One extra
-             * entry is needed as the ring is considered full when there's
-             * only one entry left.
+             * operation (the operation itself and a wait descriptor), or up
+             * to QINVAL_BATCH_MAX + 1 for a range flush.  There can be one
+             * such set of requests pending per CPU.  One extra entry is
+             * needed as the ring is considered full when there's only one
+             * entry left.  Beyond the maximum ring size, range flushes wait
+             * for the hardware to free slots.
              */
             BUILD_BUG_ON(CONFIG_NR_CPUS * 2 >= QINVAL_MAX_ENTRY_NR);
-            qi_pg_order = get_order_from_bytes((num_present_cpus() * 2 + 1) *
-                                               sizeof(struct qinval_entry));
+            qi_pg_order = get_order_from_bytes(
+                min_t(unsigned int,
+                      num_present_cpus() * (QINVAL_BATCH_MAX + 1) + 1,
+                      QINVAL_MAX_ENTRY_NR) * sizeof(struct qinval_entry));
             qi_entry_nr = (PAGE_SIZE << qi_pg_order) /
                           sizeof(struct qinval_entry);
 
@@ -437,6 +542,7 @@ int enable_qinval(struct vtd_iommu *iommu)
 
     iommu->flush.context = flush_context_qi;
     iommu->flush.iotlb   = flush_iotlb_qi;
+    iommu->flush.iotlb_range = flush_iotlb_range_qi;
 
     spin_lock_irqsave(&iommu->register_lock, flags);
 
@@ -503,6 +609,8 @@ void disable_qinval(struct vtd_iommu *iommu)
 out:
     spin_unlock_irqrestore(&iommu->register_lock, flags);
 
+    iommu->flush.iotlb_range = NULL;
+
     /*
      * Assign callbacks to noop to catch errors if register-based invalidation
      * isn't supported.
@@ -400,6 +400,7 @@ void __hwdom_init arch_iommu_hwdom_init(struct domain *d)
     unsigned int i;
     struct rangeset *map;
     struct map_data map_data = { .d = d };
+    s_time_t start = NOW(), ranges, mapped;
     int rc;
 
     BUG_ON(!is_hardware_domain(d));
@@ -526,6 +527,7 @@ void __hwdom_init arch_iommu_hwdom_init(struct domain *d)
     if ( iommu_verbose )
         printk(XENLOG_INFO "%pd: identity mappings for IOMMU:\n", d);
 
+    ranges = NOW();
     rc = rangeset_report_ranges(map, 0, ~0UL, identity_map, &map_data);
     rangeset_destroy(map);
     if ( !rc && is_pv_domain(d) )
@@ -538,9 +540,15 @@ void __hwdom_init arch_iommu_hwdom_init(struct domain *d)
         printk(XENLOG_WARNING "IOMMU unable to create %smappings: %d\n",
                map_data.mmio_ro ? "read-only " : "", rc);
 
-    /* Use if to avoid compiler warning */
-    if ( iommu_iotlb_flush_all(d, map_data.flush_flags) )
-        return;
+    mapped = NOW();
+    rc = iommu_iotlb_flush_all(d, map_data.flush_flags);
+    if ( rc )
+        printk(XENLOG_WARNING "IOMMU unable to flush mappings: %d\n", rc);
+
+    printk(XENLOG_INFO
+           "%pd: IOMMU setup: ranges %"PRI_stime"us, mappings %"PRI_stime
+           "us, flush %"PRI_stime"us\n", d, (ranges - start) / MICROSECS(1),
+           (mapped - ranges) / MICROSECS(1), (NOW() - mapped) / MICROSECS(1));
 }
 
 void arch_pci_init_pdev(struct pci_dev *pdev)
@@ -624,6 +632,7 @@ int iommu_free_pgtables(struct domain *d)
     while ( (pg = page_list_remove_head(&hd->arch.pgtables.list)) )
     {
         free_domheap_page(pg);
+        hd->stats.pt_pages--;
 
         if ( !(++done & 0xff) && general_preempt_check() )
             return -ERESTART;
@@ -679,6 +688,7 @@ struct page_info *iommu_alloc_pgtable(struct domain_iommu *hd,
 
     spin_lock(&hd->arch.pgtables.lock);
     page_list_add(pg, &hd->arch.pgtables.list);
+    hd->stats.pt_pages++;
     spin_unlock(&hd->arch.pgtables.lock);
 
     return pg;
@@ -724,6 +734,7 @@ void iommu_queue_free_pgtable(struct domain_iommu *hd, struct page_info *pg)
 
     spin_lock(&hd->arch.pgtables.lock);
     page_list_del(pg, &hd->arch.pgtables.list);
+    hd->stats.pt_pages--;
     spin_unlock(&hd->arch.pgtables.lock);
 
     page_list_add_tail(pg, &per_cpu(free_pgt_list, cpu));
@@ -54,6 +54,23 @@ typedef struct xen_argo_send_addr
     xen_argo_addr_t dst;
 } xen_argo_send_addr_t;
 
+/*
+ * XEN_ARGO_MAXBATCH : maximum number of messages accepted in a single
+ * sendv_batch.
+ */
+#define XEN_ARGO_MAXBATCH       64U
+
+typedef struct xen_argo_send_msg
+{
+    xen_argo_send_addr_t addr;
+    uint32_t message_type;
+    /* Number of iovs of this message, taken in turn from the iov array. */
+    uint32_t niov;
+    /* OUT: number of bytes sent, or -errno */
+    int32_t status;
+    uint32_t pad;
+} xen_argo_send_msg_t;
+
 typedef struct xen_argo_ring
 {
     /* Guests should use atomic operations to access rx_ptr */
@@ -235,4 +252,35 @@ struct xen_argo_ring_message_header
  */
 #define XEN_ARGO_OP_notify              4
 
+/*
+ * XEN_ARGO_OP_sendv_batch
+ *
+ * Send a batch of messages, each one as XEN_ARGO_OP_sendv would.
+ *
+ * Each message struct holds the addresses, message type and number of iovs
+ * of a message.  The iovs of all messages are in one array, in order: the
+ * first message uses the first niov entries, the next message the entries
+ * following them, and so on.
+ *
+ * Messages are sent in order, stopping at the first one that fails.  The
+ * status field of each message processed is set to the number of bytes sent,
+ * or to the error of the failed message, as XEN_ARGO_OP_sendv would have
+ * returned them; for -EAGAIN, Xen notifies the caller when space is
+ * available as for XEN_ARGO_OP_sendv.  Returns the number of messages sent.
+ * Xen may also stop early, without any failure, when it needs to preempt
+ * the caller: the status of the messages not sent is then left untouched, and
+ * the caller should submit them again.
+ *
+ * Consecutive messages to the same ring are sent under a single lookup of
+ * the ring, and each destination domain is signalled once per run of
+ * consecutive messages to it, so callers should group messages by
+ * destination.
+ *
+ * arg1: XEN_GUEST_HANDLE(xen_argo_send_msg_t) msgs
+ * arg2: XEN_GUEST_HANDLE(xen_argo_iov_t) iovs
+ * arg3: unsigned long nmsg (at most XEN_ARGO_MAXBATCH)
+ * arg4: 0 (ZERO)
+ */
+#define XEN_ARGO_OP_sendv_batch         5
+
 #endif
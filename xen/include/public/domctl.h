@@ -232,6 +232,21 @@ struct xen_domctl_getpageframeinfo3 {
 #define XEN_DOMCTL_SHADOW_OP_GET_ALLOCATION   30
 #define XEN_DOMCTL_SHADOW_OP_SET_ALLOCATION   31
 
+/*
+ * Dirty ring operations.  See struct xen_dirty_ring below.
+ */
+ /* Allocate a ring of 'pages' frames (a power of two). */
+#define XEN_DOMCTL_SHADOW_OP_DIRTY_RING_ENABLE   40
+ /* Free the ring. */
+#define XEN_DOMCTL_SHADOW_OP_DIRTY_RING_DISABLE  41
+ /*
+  * Clean the log-dirty state of all entries appended since the previous
+  * harvest and make them available to the consumer.  'pages' is updated with
+  * the number of newly harvested entries.  Fails with -EOVERFLOW if the ring
+  * has overflowed, in which case a CLEAN of the full bitmap is required.
+  */
+#define XEN_DOMCTL_SHADOW_OP_DIRTY_RING_HARVEST  42
+
 /* Legacy enable operations. */
  /* Equiv. to ENABLE with no mode flags. */
 #define XEN_DOMCTL_SHADOW_OP_ENABLE_TEST       1
@@ -264,13 +279,44 @@ struct xen_domctl_getpageframeinfo3 {
   */
 #define XEN_DOMCTL_SHADOW_ENABLE_EXTERNAL  (1 << 4)
 
-/* Mode flags for XEN_DOMCTL_SHADOW_OP_{CLEAN,PEEK}. */
+/* Mode flags for XEN_DOMCTL_SHADOW_OP_{CLEAN,PEEK,DIRTY_RING_HARVEST}. */
  /*
   * This is the final iteration: Requesting to include pages mapped
   * writably by the hypervisor in the dirty bitmap.
   */
 #define XEN_DOMCTL_SHADOW_LOGDIRTY_FINAL   (1 << 0)
 
+/*
+ * Dirty ring, mapped via XENMEM_resource_dirty_ring (id 0).
+ *
+ * While log-dirty mode is active, Xen appends the PFN of every page whose
+ * log-dirty bit goes from clear to set, i.e. each page appears at most once
+ * between two harvests.  Entries become safe to consume once covered by a
+ * XEN_DOMCTL_SHADOW_OP_DIRTY_RING_HARVEST, which re-arms dirty logging for
+ * them: the consumer processes slots [cons, harvest) and then advances cons.
+ * Entries beyond harvest must not be consumed, as further writes to those
+ * pages would not be logged again.
+ *
+ * If the ring fills up, Xen sets XEN_DIRTY_RING_OVERFLOW and stops appending.
+ * The consumer then has to fall back to XEN_DOMCTL_SHADOW_OP_CLEAN, which
+ * resets the ring (including cons) as the full bitmap supersedes it.  Turning
+ * log-dirty mode off resets the ring as well.  A ring enabled while log-dirty
+ * mode is already active starts out overflowed.
+ *
+ * All indices are in units of entries, in the range [0, size).
+ */
+struct xen_dirty_ring {
+    uint32_t prod;      /* Next slot to be written.  Written by Xen. */
+    uint32_t harvest;   /* End of the consumable slots.  Written by Xen. */
+    uint32_t cons;      /* Next slot to be consumed.  Written by consumer. */
+    uint32_t size;      /* Number of slots.  Written by Xen. */
+    uint32_t flags;     /* Written by Xen. */
+#define _XEN_DIRTY_RING_OVERFLOW 0
+#define XEN_DIRTY_RING_OVERFLOW  (1U << _XEN_DIRTY_RING_OVERFLOW)
+    uint32_t pad[3];
+    uint64_aligned_t pfn[XEN_FLEX_ARRAY_DIM];
+};
+
 struct xen_domctl_shadow_op_stats {
     uint32_t fault_count;
     uint32_t dirty_count;
@@ -289,7 +335,12 @@ struct xen_domctl_shadow_op {
 
     /* OP_PEEK / OP_CLEAN */
     XEN_GUEST_HANDLE_64(uint8) dirty_bitmap;
-    uint64_aligned_t pages; /* Size of buffer. Updated with actual size. */
+    /*
+     * OP_PEEK / OP_CLEAN: Size of buffer. Updated with actual size.
+     * OP_DIRTY_RING_ENABLE: Number of ring frames.
+     * OP_DIRTY_RING_HARVEST: Updated with number of harvested entries.
+     */
+    uint64_aligned_t pages;
     struct xen_domctl_shadow_op_stats stats;
 };
 
@@ -1226,6 +1277,88 @@ struct xen_domctl_vmtrace_op {
 typedef struct xen_domctl_vmtrace_op xen_domctl_vmtrace_op_t;
 DEFINE_XEN_GUEST_HANDLE(xen_domctl_vmtrace_op_t);
 
+/*
+ * XEN_DOMCTL_p2m_superpage: Control superpage recoalescing of a domain's p2m
+ * and report how its RAM is mapped.  x86 HAP guests only.
+ *
+ * When @rate is non-zero, a background scanner walks the p2m examining @rate
+ * 2M regions per second, and replaces runs of 512 4k entries mapping
+ * contiguous, suitably aligned frames with identical type and access by a
+ * single 2M entry.  The page counts describe the p2m as observed during the
+ * last complete scan pass, and are zero before the first pass completes.
+ */
+struct xen_domctl_p2m_superpage {
+#define XEN_DOMCTL_P2M_SUPERPAGE_GET   0
+#define XEN_DOMCTL_P2M_SUPERPAGE_SET   1
+    uint32_t op;                    /* IN */
+    uint32_t rate;                  /* IN (SET) / OUT (GET) */
+    uint64_aligned_t pages_4k;      /* OUT: RAM pages mapped with 4k entries */
+    uint64_aligned_t pages_2m;      /* OUT: ... with 2M entries */
+    uint64_aligned_t pages_1g;      /* OUT: ... with 1G entries */
+    uint64_aligned_t coalesced;     /* OUT: 2M entries created by the scanner */
+    uint64_aligned_t passes;        /* OUT: completed scan passes */
+};
+
+/*
+ * XEN_DOMCTL_exit_stats: VM exit profiling.  x86 HVM guests only.
+ *
+ * While enabled, every VM exit of the domain is accounted by reason, along
+ * with the TSC cycles from the exit to the next VM entry of the vCPU, not
+ * counting time the vCPU spends descheduled.  Reasons are VMX basic exit
+ * reasons on Intel hardware, and SVM exit codes on AMD hardware.
+ *
+ * Some exits are additionally accounted per vCPU by detail, keyed by the
+ * MSR index of MSR accesses and the port of I/O instructions (with bit 32
+ * set for WRMSR and OUT), the leaf (low 32 bits) and subleaf (high 32 bits)
+ * of CPUID, and the frame number of EPT violations / nested page faults.
+ * Each vCPU tracks a limited number of distinct details, exits with further
+ * details are counted in @details_lost.
+ *
+ * GET fills in up to @nr_reasons / @nr_details entries, and sets both to the
+ * number of entries available, which may be larger.  Entries with a zero
+ * count are omitted.  ENABLE on an enabled domain and RESET clear the
+ * statistics.
+ */
+struct xen_domctl_exit_stats_reason {
+    uint32_t reason;
+    uint32_t pad;
+    uint64_aligned_t count;
+    uint64_aligned_t cycles;
+};
+typedef struct xen_domctl_exit_stats_reason xen_domctl_exit_stats_reason_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_exit_stats_reason_t);
+
+struct xen_domctl_exit_stats_detail {
+    uint32_t reason;
+    uint16_t vcpu;
+    uint8_t kind;
+#define XEN_DOMCTL_EXIT_STATS_MSR      1
+#define XEN_DOMCTL_EXIT_STATS_IO       2
+#define XEN_DOMCTL_EXIT_STATS_CPUID    3
+#define XEN_DOMCTL_EXIT_STATS_NPF      4
+    uint8_t pad;
+    uint64_aligned_t key;
+    uint64_aligned_t count;
+    uint64_aligned_t cycles;
+};
+typedef struct xen_domctl_exit_stats_detail xen_domctl_exit_stats_detail_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_exit_stats_detail_t);
+
+struct xen_domctl_exit_stats {
+#define XEN_DOMCTL_EXIT_STATS_DISABLE  0
+#define XEN_DOMCTL_EXIT_STATS_ENABLE   1
+#define XEN_DOMCTL_EXIT_STATS_RESET    2
+#define XEN_DOMCTL_EXIT_STATS_GET      3
+    uint32_t op;                    /* IN */
+    uint32_t nr_reasons;            /* IN/OUT (GET) */
+    uint32_t nr_details;            /* IN/OUT (GET) */
+    uint32_t pad;
+    uint64_aligned_t details_lost;  /* OUT (GET) */
+    uint64_aligned_t tsc_khz;       /* OUT (GET): TSC frequency */
+    XEN_GUEST_HANDLE_64(xen_domctl_exit_stats_reason_t) reasons;
+    XEN_GUEST_HANDLE_64(xen_domctl_exit_stats_detail_t) details;
+};
+
 #if defined(__arm__) || defined(__aarch64__)
 struct xen_domctl_dt_overlay {
     XEN_GUEST_HANDLE_64(const_void) overlay_fdt;  /* IN: overlay fdt. */
@@ -1325,6 +1458,8 @@ struct xen_domctl {
 #define XEN_DOMCTL_set_paging_mempool_size       86
 #define XEN_DOMCTL_dt_overlay                    87
 #define XEN_DOMCTL_gsi_permission                88
+#define XEN_DOMCTL_p2m_superpage                 89
+#define XEN_DOMCTL_exit_stats                    90
 #define XEN_DOMCTL_gdbsx_guestmemio            1000
 #define XEN_DOMCTL_gdbsx_pausevcpu             1001
 #define XEN_DOMCTL_gdbsx_unpausevcpu           1002
@@ -1388,6 +1523,8 @@ struct xen_domctl {
         struct xen_domctl_vuart_op          vuart_op;
         struct xen_domctl_vmtrace_op        vmtrace_op;
         struct xen_domctl_paging_mempool    paging_mempool;
+        struct xen_domctl_p2m_superpage     p2m_superpage;
+        struct xen_domctl_exit_stats        exit_stats;
 #if defined(__arm__) || defined(__aarch64__)
         struct xen_domctl_dt_overlay        dt_overlay;
 #endif
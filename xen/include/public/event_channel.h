@@ -60,6 +60,8 @@
 #ifdef __XEN__
 #define EVTCHNOP_reset_cont      14
 #endif
+#define EVTCHNOP_set_coalesce    15
+#define EVTCHNOP_coalesce_stats  16
 /* ` } */
 
 typedef uint32_t evtchn_port_t;
@@ -298,6 +300,49 @@ struct evtchn_set_priority {
 };
 typedef struct evtchn_set_priority evtchn_set_priority_t;
 
+/*
+ * EVTCHNOP_set_coalesce: coalesce notifications sent to a local
+ * interdomain or IPI port.  Notifications are held back until <count> of
+ * them have been sent, or until <timeout_us> microseconds have passed since
+ * the first one held back, whichever comes first.
+ * NOTES:
+ *  1. <count> == 0 coalesces on the timeout only.  <timeout_us> == 0
+ *     disables coalescing, delivering anything held back, and requires
+ *     <count> <= 1: coalescing on <count> alone could hold notifications
+ *     back forever once the sender stops.  <timeout_us> is at most 100000.
+ *  2. Sent and delivered notifications are counted from the first use of
+ *     this operation on a port until it is closed, see
+ *     EVTCHNOP_coalesce_stats.  <count> == 1 counts without holding back.
+ */
+struct evtchn_set_coalesce {
+    /* IN parameters. */
+    evtchn_port_t port;
+    uint32_t count;
+    uint32_t timeout_us;
+};
+typedef struct evtchn_set_coalesce evtchn_set_coalesce_t;
+
+/*
+ * EVTCHNOP_coalesce_stats: return the coalescing settings of <dom, port>,
+ * and how many notifications were sent to and delivered on it.
+ * NOTES:
+ *  1. <dom> may be specified as DOMID_SELF.
+ *  2. Only a sufficiently-privileged domain may obtain the statistics of an
+ *     event channel for which <dom> is not DOMID_SELF.
+ *  3. Returns -ENOENT if EVTCHNOP_set_coalesce was never used on the port.
+ */
+struct evtchn_coalesce_stats {
+    /* IN parameters. */
+    domid_t dom;
+    evtchn_port_t port;
+    /* OUT parameters. */
+    uint32_t count;
+    uint32_t timeout_us;
+    uint64_t sent;
+    uint64_t delivered;
+};
+typedef struct evtchn_coalesce_stats evtchn_coalesce_stats_t;
+
 /*
  * ` enum neg_errnoval
  * ` HYPERVISOR_event_channel_op_compat(struct evtchn_op *op)
@@ -444,6 +444,26 @@ struct xen_dm_op_nr_vcpus {
 };
 typedef struct xen_dm_op_nr_vcpus xen_dm_op_nr_vcpus_t;
 
+/*
+ * XEN_DMOP_inject_msi_batch: Inject a batch of MSIs for emulated devices.
+ *
+ * DMOP buf 1 contains an array of xen_dm_op_inject_msi with @nr entries,
+ * which get injected in order, as if by XEN_DMOP_inject_msi.  With posted
+ * interrupts, vectors for a vCPU already having a notification outstanding
+ * just get posted, without kicking the vCPU again.
+ *
+ * On error, @done is the number of MSIs which got injected.
+ */
+#define XEN_DMOP_inject_msi_batch 21
+
+struct xen_dm_op_inject_msi_batch {
+    /* IN - Number of MSIs in buf 1 */
+    uint32_t nr;
+    /* IN/OUT - Must be set to 0, number of MSIs injected */
+    uint32_t done;
+};
+typedef struct xen_dm_op_inject_msi_batch xen_dm_op_inject_msi_batch_t;
+
 struct xen_dm_op {
     uint32_t op;
     uint32_t pad;
@@ -468,6 +488,7 @@ struct xen_dm_op {
         xen_dm_op_relocate_memory_t relocate_memory;
         xen_dm_op_pin_memory_cacheattr_t pin_memory_cacheattr;
         xen_dm_op_nr_vcpus_t nr_vcpus;
+        xen_dm_op_inject_msi_batch_t inject_msi_batch;
     } u;
 };
 
@@ -474,6 +474,7 @@ DEFINE_XEN_GUEST_HANDLE(xen_mem_access_op_t);
 #define XENMEM_sharing_op_range_share       8
 #define XENMEM_sharing_op_fork              9
 #define XENMEM_sharing_op_fork_reset        10
+#define XENMEM_sharing_op_fork_reset_multi  11
 
 #define XENMEM_SHARING_OP_S_HANDLE_INVALID  (-10)
 #define XENMEM_SHARING_OP_C_HANDLE_INVALID  (-9)
@@ -535,6 +536,19 @@ struct xen_mem_sharing_op {
             uint16_t flags;               /* IN: optional settings */
             uint32_t pad;                 /* Must be set to 0 */
         } fork;
+        /*
+         * Reset several forks of the domain with a single hypercall.  On
+         * error, nr_done is still copied back and indexes the fork which
+         * failed to reset.
+         */
+        struct mem_sharing_op_fork_reset_multi { /* OP_FORK_RESET_MULTI */
+            XEN_GUEST_HANDLE_64(uint16) forks; /* IN: domain ids of forks */
+            uint32_t nr_forks;             /* IN: number of forks */
+            uint16_t flags;                /* IN: XENMEM_FORK_RESET_* */
+            uint16_t pad;                  /* Must be set to 0 */
+            uint32_t nr_done;              /* IN: must be set to 0 */
+                                           /* OUT: number of forks reset */
+        } fork_reset_multi;
     } u;
 };
 typedef struct xen_mem_sharing_op xen_mem_sharing_op_t;
@@ -618,6 +632,7 @@ struct xen_mem_acquire_resource {
 #define XENMEM_resource_ioreq_server 0
 #define XENMEM_resource_grant_table 1
 #define XENMEM_resource_vmtrace_buf 2
+#define XENMEM_resource_dirty_ring 3
 
     /*
      * IN - a type-specific resource identifier, which must be zero
@@ -61,6 +61,17 @@ struct xen_sysctl_tbuf_op {
 #define XEN_SYSCTL_TBUFOP_set_size     3
 #define XEN_SYSCTL_TBUFOP_enable       4
 #define XEN_SYSCTL_TBUFOP_disable      5
+/*
+ * Only trace events occurring while a vCPU of domid is running, or only
+ * vcpu of it unless that is XEN_SYSCTL_TBUF_ALL_VCPUS.  DOMID_INVALID
+ * removes the filter.
+ */
+#define XEN_SYSCTL_TBUFOP_set_filter   6
+/*
+ * Only trace 1 in sample_rate events of the classes set in evt_mask, all of
+ * them if sample_rate is 0 or 1.
+ */
+#define XEN_SYSCTL_TBUFOP_set_sample   7
     uint32_t cmd;
     /* IN/OUT variables */
     struct xenctl_bitmap cpu_mask;
@@ -68,6 +79,13 @@ struct xen_sysctl_tbuf_op {
     /* OUT variables */
     uint64_aligned_t buffer_mfn;
     uint32_t size;  /* Also an IN variable! */
+    /* IN variables, for set_filter */
+    domid_t domid;
+    uint16_t pad;
+#define XEN_SYSCTL_TBUF_ALL_VCPUS      (~0U)
+    uint32_t vcpu;
+    /* IN variable, for set_sample */
+    uint32_t sample_rate;
 };
 
 /*
@@ -25,6 +25,7 @@
 #include <xen/pci.h>
 #include <xen/spinlock.h>
 #include <xen/errno.h>
+#include <xen/time.h>
 #include <public/domctl.h>
 #include <public/hvm/ioreq.h>
 #include <asm/device.h>
@@ -106,6 +107,7 @@ extern bool iommu_debug;
 extern bool amd_iommu_perdev_intremap;
 
 extern bool iommu_hwdom_strict, iommu_hwdom_passthrough, iommu_hwdom_inclusive;
+extern bool iommu_hwdom_lazy;
 extern int8_t iommu_hwdom_reserved;
 
 extern unsigned int iommu_dev_iotlb_timeout;
@@ -375,6 +377,17 @@ struct domain_iommu {
      * necessarily imply this is true.
      */
     bool need_sync;
+
+    /*
+     * Mapping statistics, reported by the 'o' debug key.  Updated without
+     * locking, so merely indicative with concurrent (un)maps.
+     */
+    struct {
+        unsigned long pt_pages;     /* Page table pages allocated. */
+        unsigned long maps, map_pages;
+        unsigned long unmaps, unmap_pages;
+        s_time_t map_time, unmap_time;
+    } stats;
 };
 
 #define dom_iommu(d)              (&(d)->iommu)
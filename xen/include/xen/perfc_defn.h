@@ -83,4 +83,9 @@ PERFCOUNTER(tickled_cpu_overridden, "csched2: tickled_cpu_overridden")
 
 PERFCOUNTER(need_flush_tlb_flush,   "PG_need_flush tlb flushes")
 
+PERFCOUNTER(gnttab_tlb_flush,          "gnttab: unmap tlb flushes")
+PERFCOUNTER(gnttab_tlb_flush_avoided,  "gnttab: unmap tlb flushes avoided")
+PERFCOUNTER(gnttab_iotlb_flush,        "gnttab: iotlb flushes")
+PERFCOUNTER(gnttab_iotlb_flush_merged, "gnttab: iotlb flushes merged")
+
 /*#endif*/ /* __XEN_PERFC_DEFN_H__ */
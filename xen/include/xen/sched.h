@@ -120,6 +120,7 @@ struct evtchn
     unsigned char priority;        /* FIFO event channels only. */
     unsigned short notify_vcpu_id; /* VCPU for local delivery notification */
     uint32_t fifo_lastq;           /* Data for identifying last queue. */
+    struct evtchn_coalesce *coalesce; /* Notification coalescing, if used. */
 
 #ifdef CONFIG_XSM
     union {
@@ -276,6 +277,8 @@ struct vcpu
     spinlock_t       maptrack_freelist_lock;
     unsigned int     maptrack_head;
     unsigned int     maptrack_tail;
+    /* Number of entries to steal from another VCPU when running out. */
+    unsigned int     maptrack_steal;
 
     /* IRQ-safe virq_lock protects against delivering VIRQ to stale evtchn. */
     evtchn_port_t    virq_to_evtchn[NR_VIRQS];
@@ -75,7 +75,9 @@
 #ifndef __XENXXHASH_H__
 #define __XENXXHASH_H__
 
+#ifdef __XEN__
 #include <xen/types.h>
+#endif
 
 /*-****************************
  * Simple Hash Functions
@@ -792,6 +792,7 @@ static int cf_check flask_domctl(struct domain *d, unsigned int cmd,
 
     case XEN_DOMCTL_debug_op:
     case XEN_DOMCTL_vmtrace_op:
+    case XEN_DOMCTL_exit_stats:
     case XEN_DOMCTL_gdbsx_guestmemio:
     case XEN_DOMCTL_gdbsx_pausevcpu:
     case XEN_DOMCTL_gdbsx_unpausevcpu:
@@ -837,6 +838,7 @@ static int cf_check flask_domctl(struct domain *d, unsigned int cmd,
         return current_has_perm(d, SECCLASS_DOMAIN, DOMAIN__GETPAGINGMEMPOOL);
 
     case XEN_DOMCTL_set_paging_mempool_size:
+    case XEN_DOMCTL_p2m_superpage:
         return current_has_perm(d, SECCLASS_DOMAIN, DOMAIN__SETPAGINGMEMPOOL);
 
     default:
@@ -1602,6 +1604,9 @@ static int cf_check flask_shadow_control(struct domain *d, uint32_t op)
     case XEN_DOMCTL_SHADOW_OP_ENABLE_LOGDIRTY:
     case XEN_DOMCTL_SHADOW_OP_PEEK:
     case XEN_DOMCTL_SHADOW_OP_CLEAN:
+    case XEN_DOMCTL_SHADOW_OP_DIRTY_RING_ENABLE:
+    case XEN_DOMCTL_SHADOW_OP_DIRTY_RING_DISABLE:
+    case XEN_DOMCTL_SHADOW_OP_DIRTY_RING_HARVEST:
         perm = SHADOW__LOGDIRTY;
         break;
     default: